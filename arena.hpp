@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+#include "btree_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Monotonic arena for trees that are built, queried and dropped as a whole. Allocation bumps a
+// pointer through chunks that double in size; nothing is given back until release(), which
+// frees every chunk at once.
+class MonotonicArena {
+    static constexpr size_t INITIAL_CHUNK = 64 * 1024;
+    static constexpr size_t MAX_CHUNK = 64 * 1024 * 1024;
+
+    struct alignas(CACHE_LINE_SIZE) Chunk {
+        Chunk* next_;
+        size_t size_;  // bytes including this header
+    };
+
+    Chunk* chunks_ = nullptr;
+    unsigned char* cursor_ = nullptr;
+    unsigned char* end_ = nullptr;
+    size_t next_chunk_;
+    size_t reserved_ = 0;
+
+public:
+    explicit MonotonicArena(size_t initial_chunk = INITIAL_CHUNK) noexcept
+        : next_chunk_(initial_chunk < sizeof(Chunk) * 2 ? sizeof(Chunk) * 2 : initial_chunk) {}
+
+    ~MonotonicArena() { release(); }
+
+    MonotonicArena(const MonotonicArena& other) = delete;
+    MonotonicArena& operator=(const MonotonicArena& other) = delete;
+
+public:
+    void* allocate(size_t bytes, size_t alignment) {
+        uintptr_t start = alignUp(reinterpret_cast<uintptr_t>(cursor_), alignment);
+        if (cursor_ == nullptr || start + bytes > reinterpret_cast<uintptr_t>(end_)) {
+            grow(bytes, alignment);
+            start = alignUp(reinterpret_cast<uintptr_t>(cursor_), alignment);
+        }
+        cursor_ = reinterpret_cast<unsigned char*>(start + bytes);
+        return reinterpret_cast<void*>(start);
+    }
+
+    // Frees every chunk. Whatever was allocated from the arena is gone afterwards.
+    void release() noexcept {
+        while (chunks_ != nullptr) {
+            Chunk* next = chunks_->next_;
+            ::operator delete(static_cast<void*>(chunks_), std::align_val_t(alignof(Chunk)));
+            chunks_ = next;
+        }
+        cursor_ = nullptr;
+        end_ = nullptr;
+        reserved_ = 0;
+    }
+
+    // Bytes obtained from the system, chunk headers included.
+    size_t reserved() const noexcept { return reserved_; }
+
+private:
+    static uintptr_t alignUp(uintptr_t p, size_t alignment) noexcept {
+        return (p + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    }
+
+    void grow(size_t bytes, size_t alignment) {
+        const size_t needed = sizeof(Chunk) + bytes + (alignment > alignof(Chunk) ? alignment : 0);
+        size_t size = next_chunk_;
+        while (size < needed) {
+            if (size > std::numeric_limits<size_t>::max() / 2) throw std::bad_alloc();
+            size *= 2;
+        }
+        if (next_chunk_ < MAX_CHUNK) next_chunk_ *= 2;
+
+        Chunk* chunk = static_cast<Chunk*>(::operator new(size, std::align_val_t(alignof(Chunk))));
+        chunk->next_ = chunks_;
+        chunk->size_ = size;
+        chunks_ = chunk;
+        reserved_ += size;
+
+        cursor_ = reinterpret_cast<unsigned char*>(chunk) + sizeof(Chunk);
+        end_ = reinterpret_cast<unsigned char*>(chunk) + size;
+    }
+};
+
+// Allocator handle over a MonotonicArena. deallocate is a no-op, and is_monotonic tells the
+// trees that dropping a subtree needs no walk when its entries are trivially destructible.
+template <typename T>
+class ArenaAllocator {
+    template <typename U>
+    friend class ArenaAllocator;
+
+    MonotonicArena* arena_;
+
+public:
+    using value_type = T;
+    using is_monotonic = std::true_type;
+
+public:
+    explicit ArenaAllocator(MonotonicArena& arena) noexcept : arena_(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena_) {}
+
+public:
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) throw std::bad_alloc();
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        (void) p;
+        (void) n;
+    }
+
+    MonotonicArena& arena() const noexcept { return *arena_; }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept {
+    return &lhs.arena() == &rhs.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept {
+    return !(lhs == rhs);
+}
+
+}  // namespace btree
@@ -0,0 +1,96 @@
+/* BTree on the custom list allocator: first-fit and best-fit against size classes.
+ *
+ * Each run inserts random keys, erases half of them in random order, inserts as many again and
+ * destroys the tree, all through smpl_alloc on a fresh heap.
+ *
+ * g++ alloc_policy_bench.cpp -o alloc_policy_bench -std=c++17 -O2
+ *
+ */
+
+#define USE_CUSTOM_LIST_ALLOCATOR
+
+#include "../btree.hpp"
+#include "../example/smpl_alloc.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static double elapsed_ns(std::chrono::high_resolution_clock::time_point start_time) {
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+template <size_t ORDER>
+static void run(const char* name, alloc_policy_t policy, const std::vector<uint32_t>& keys,
+                const std::vector<uint32_t>& erase_order) {
+    custom_list_allocator_t* list = custom_list_alloc_create(CUSTOM_LIST_HEAP_SIZE, policy);
+    if (!list) {
+        std::printf("%-12s failed to create the heap\n", name);
+        return;
+    }
+
+    const size_t half = keys.size() / 2;
+    double insert_ns = 0;
+    double erase_ns = 0;
+    double reinsert_ns = 0;
+    double destroy_ns = 0;
+    {
+        smpl_alloc<uint32_t> alloc(list);
+        auto* tree = new btree::BTree<uint32_t, ORDER, smpl_alloc<uint32_t>>(alloc);
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < half; ++i)
+            tree->insert(keys[i]);
+        insert_ns = elapsed_ns(start_time);
+
+        start_time = std::chrono::high_resolution_clock::now();
+        for (uint32_t key : erase_order)
+            tree->erase(key);
+        erase_ns = elapsed_ns(start_time);
+
+        start_time = std::chrono::high_resolution_clock::now();
+        for (size_t i = half; i < keys.size(); ++i)
+            tree->insert(keys[i]);
+        reinsert_ns = elapsed_ns(start_time);
+
+        start_time = std::chrono::high_resolution_clock::now();
+        delete tree;
+        destroy_ns = elapsed_ns(start_time);
+    }
+
+    std::printf("%-12s %12.1f %12.1f %12.1f %12.1f\n", name, insert_ns / half, erase_ns / erase_order.size(),
+                reinsert_ns / (keys.size() - half), destroy_ns / half);
+    custom_list_alloc_destroy(list);
+}
+
+template <size_t ORDER>
+static void compare(const std::vector<uint32_t>& keys, const std::vector<uint32_t>& erase_order) {
+    std::printf("\nORDER = %zu\n", ORDER);
+    std::printf("%-12s %12s %12s %12s %12s\n", "policy", "insert ns", "erase ns", "reinsert ns", "destroy ns");
+    run<ORDER>("first-fit", ALLOC_POLICY_FIRST_FIT, keys, erase_order);
+    run<ORDER>("best-fit", ALLOC_POLICY_BEST_FIT, keys, erase_order);
+    run<ORDER>("size-class", ALLOC_POLICY_SIZE_CLASS, keys, erase_order);
+}
+
+int main() {
+    const size_t num_keys = 200000;
+
+    std::mt19937 rng(42);
+    std::vector<uint32_t> keys(num_keys);
+    for (uint32_t& key : keys)
+        key = rng();
+
+    // Half of the first batch, in an order unrelated to insertion.
+    std::vector<uint32_t> erase_order(keys.begin(), keys.begin() + num_keys / 2);
+    std::shuffle(erase_order.begin(), erase_order.end(), rng);
+    erase_order.resize(num_keys / 4);
+
+    std::printf("%zu random uint32_t keys per run, per-operation times\n", num_keys);
+
+    compare<8>(keys, erase_order);
+    compare<64>(keys, erase_order);
+    return 0;
+}
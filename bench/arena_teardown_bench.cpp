@@ -0,0 +1,66 @@
+/* Build-once, drop-all trees: std::allocator against a MonotonicArena.
+ *
+ * Inserts random keys (10M unless given as the first argument), then times the destructor.
+ * With the arena the destructor does not visit the nodes, and the arena hands its chunks back
+ * in one release() call.
+ *
+ * g++ arena_teardown_bench.cpp -o arena_teardown_bench -std=c++17 -O2
+ *
+ */
+
+#include "../arena.hpp"
+#include "../btree.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static const size_t ORDER = 64;
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start_time) {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+template <typename Tree, typename Alloc>
+static void run(const char* name, const std::vector<uint64_t>& keys, const Alloc& alloc) {
+    auto* tree = new Tree(alloc);
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (uint64_t key : keys)
+        tree->insert(key);
+    const double build_ms = elapsed_ms(start_time);
+
+    start_time = std::chrono::high_resolution_clock::now();
+    delete tree;
+    const double teardown_ms = elapsed_ms(start_time);
+
+    std::printf("%-22s %12.1f %14.3f", name, build_ms, teardown_ms);
+}
+
+int main(int argc, char** argv) {
+    size_t num_keys = 10000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(num_keys);
+    for (uint64_t& key : keys)
+        key = rng();
+
+    std::printf("%zu random uint64_t keys, ORDER %zu\n\n", num_keys, ORDER);
+    std::printf("%-22s %12s %14s %14s\n", "allocator", "build ms", "destructor ms", "release ms");
+
+    run<btree::BTree<uint64_t, ORDER>>("std::allocator", keys, std::allocator<uint64_t>());
+    std::printf("\n");
+
+    btree::MonotonicArena arena;
+    run<btree::BTree<uint64_t, ORDER, btree::ArenaAllocator<uint64_t>>>("MonotonicArena", keys,
+                                                                         btree::ArenaAllocator<uint64_t>(arena));
+    const size_t reserved = arena.reserved();
+    auto start_time = std::chrono::high_resolution_clock::now();
+    arena.release();
+    std::printf(" %14.3f   (%zu MiB reserved)\n", elapsed_ms(start_time), reserved >> 20);
+    return 0;
+}
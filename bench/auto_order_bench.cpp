@@ -0,0 +1,74 @@
+/* Lookup latency: AutoBTree (ORDER from the key size and a byte target) against hand-picked
+ * ORDERs, for uint32_t, uint64_t and std::string keys.
+ *
+ * Each tree holds random keys (1M unless given as the first argument) and is probed with the
+ * same keys in another random order.
+ *
+ * g++ auto_order_bench.cpp -o auto_order_bench -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+template <typename Tree, typename T>
+static void measure(const char* label, const std::vector<T>& keys, const std::vector<T>& probes) {
+    Tree tree;
+    for (const T& key : keys)
+        tree.insert(key);
+
+    size_t hits = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (const T& key : probes)
+        hits += tree.contains(key);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+
+    std::printf("  %-24s %12.1f ns/lookup%s\n", label, elapsed.count() / probes.size(),
+                hits == probes.size() ? "" : "  (lookup mismatch)");
+}
+
+template <typename T, size_t TARGET_BYTES>
+static void measureAuto(const std::vector<T>& keys, const std::vector<T>& probes) {
+    char label[64];
+    std::snprintf(label, sizeof(label), "auto %zu B (ORDER %zu)", TARGET_BYTES, btree::auto_order<T, TARGET_BYTES>);
+    measure<btree::AutoBTree<T, TARGET_BYTES>>(label, keys, probes);
+}
+
+template <typename T, typename Make>
+static void run(const char* name, size_t num_keys, Make make) {
+    std::mt19937_64 rng(42);
+    std::vector<T> keys;
+    keys.reserve(num_keys);
+    for (size_t i = 0; i < num_keys; ++i)
+        keys.push_back(make(rng()));
+    std::vector<T> probes = keys;
+    std::shuffle(probes.begin(), probes.end(), rng);
+
+    std::printf("\n%s (%zu bytes)\n", name, sizeof(T));
+    measure<btree::BTree<T, 4>>("ORDER 4", keys, probes);
+    measure<btree::BTree<T, 16>>("ORDER 16", keys, probes);
+    measure<btree::BTree<T, 64>>("ORDER 64", keys, probes);
+    measure<btree::BTree<T, 128>>("ORDER 128", keys, probes);
+    measureAuto<T, 256>(keys, probes);
+    measureAuto<T, 512>(keys, probes);
+    measureAuto<T, 1024>(keys, probes);
+    measureAuto<T, 4096>(keys, probes);
+}
+
+int main(int argc, char** argv) {
+    size_t num_keys = 1000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::printf("%zu random keys, lookups of every key in random order\n", num_keys);
+    run<uint32_t>("uint32_t", num_keys, [](uint64_t v) { return static_cast<uint32_t>(v); });
+    run<uint64_t>("uint64_t", num_keys, [](uint64_t v) { return v; });
+    run<std::string>("std::string", num_keys, [](uint64_t v) { return "key-" + std::to_string(v); });
+    return 0;
+}
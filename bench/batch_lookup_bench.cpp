@@ -0,0 +1,91 @@
+/* Batched operations: BTree::search_batch / insert_batch against the same keys one at a time.
+ *
+ * Lookups run against a tree of random keys (10M unless given as the first argument), half of
+ * the probes present, in batches of 256. Inserts add 1M keys to a copy of the same tree, first
+ * scattered at random, then as runs of neighbouring keys where a batch shares few leaves.
+ *
+ * g++ batch_lookup_bench.cpp -o batch_lookup_bench -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+static double elapsed_ns(std::chrono::high_resolution_clock::time_point start_time) {
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    size_t num_keys = 10000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+    const size_t num_probes = std::min<size_t>(num_keys, 2000000);
+    const size_t num_inserts = std::min<size_t>(num_keys / 10, 1000000);
+    const size_t batch = 256;
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(num_keys);
+    for (uint64_t& key : keys)
+        key = rng();
+
+    std::vector<uint64_t> probes(num_probes);
+    for (size_t i = 0; i < num_probes; ++i)
+        probes[i] = (i % 2 == 0) ? keys[rng() % num_keys] : rng();
+
+    std::vector<uint64_t> scattered(num_inserts);
+    for (uint64_t& key : scattered)
+        key = rng();
+
+    std::vector<uint64_t> clustered(num_inserts);
+    for (size_t i = 0; i < num_inserts; i += batch) {
+        const uint64_t base = rng();
+        for (size_t j = i; j < std::min(i + batch, num_inserts); ++j)
+            clustered[j] = base + (rng() & 0xffffff);
+    }
+
+    std::printf("%zu random uint64_t keys, ORDER 32, batches of %zu\n\n", num_keys, batch);
+
+    btree::BTree<uint64_t, 32> tree;
+    tree.bulk_load_unsorted(keys.begin(), keys.end(), 0.7);
+
+    size_t hits_one = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (uint64_t key : probes)
+        hits_one += tree.contains(key);
+    std::printf("%-28s %10.1f ns/key\n", "contains, one by one", elapsed_ns(start_time) / num_probes);
+
+    size_t hits_batch = 0;
+    std::unique_ptr<bool[]> found(new bool[batch]);
+    start_time = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_probes; i += batch)
+        hits_batch += tree.search_batch(probes.data() + i, std::min(batch, num_probes - i), found.get());
+    std::printf("%-28s %10.1f ns/key\n", "search_batch", elapsed_ns(start_time) / num_probes);
+    if (hits_one != hits_batch) std::printf("lookup mismatch\n");
+
+    for (const std::vector<uint64_t>* extra : {&scattered, &clustered}) {
+        const char* kind = extra == &scattered ? "scattered" : "clustered";
+        {
+            btree::BTree<uint64_t, 32> copy;
+            copy.bulk_load_unsorted(keys.begin(), keys.end(), 0.7);
+            start_time = std::chrono::high_resolution_clock::now();
+            for (uint64_t key : *extra)
+                copy.insert(key);
+            std::printf("insert %-21s %10.1f ns/key\n", kind, elapsed_ns(start_time) / num_inserts);
+        }
+        {
+            btree::BTree<uint64_t, 32> copy;
+            copy.bulk_load_unsorted(keys.begin(), keys.end(), 0.7);
+            start_time = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < num_inserts; i += batch)
+                copy.insert_batch(extra->data() + i, std::min(batch, num_inserts - i));
+            std::printf("insert_batch %-15s %10.1f ns/key\n", kind, elapsed_ns(start_time) / num_inserts);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+/* Full scans, short range scans and point lookups: BTree against BPlusTree.
+ *
+ * g++ bplus_scan_bench.cpp -o bplus_scan_bench -std=c++17 -O2
+ *
+ */
+
+#include "../bplus_tree.hpp"
+#include "../btree.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static volatile uint64_t g_sink = 0;
+
+template <typename F>
+static void report(const char* name, size_t ops, F&& body) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    body();
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> elapsed = end_time - start_time;
+    std::printf("%-32s %10.2f ns/op\n", name, elapsed.count() / static_cast<double>(ops));
+}
+
+template <typename Tree>
+static void run(const char* label, const std::vector<uint64_t>& keys, const std::vector<uint64_t>& probes) {
+    std::printf("\n%s\n", label);
+
+    Tree tree;
+    for (uint64_t key : keys)
+        tree.insert(key);
+
+    report("full scan (per key)", keys.size() * 10, [&] {
+        uint64_t sum = 0;
+        for (int round = 0; round < 10; ++round) {
+            for (uint64_t key : tree)
+                sum += key;
+        }
+        g_sink = sum;
+    });
+
+    report("range scan of 100 keys", probes.size(), [&] {
+        uint64_t sum = 0;
+        for (uint64_t lo : probes) {
+            size_t n = 0;
+            for (auto it = tree.lower_bound(lo); it != tree.end() && n < 100; ++it, ++n)
+                sum += *it;
+        }
+        g_sink = sum;
+    });
+
+    report("point lookup", probes.size(), [&] {
+        uint64_t hits = 0;
+        for (uint64_t key : probes)
+            hits += tree.contains(key);
+        g_sink = hits;
+    });
+}
+
+template <size_t ORDER>
+static void compare(const std::vector<uint64_t>& keys, const std::vector<uint64_t>& probes) {
+    std::printf("\n=== ORDER = %zu ===", ORDER);
+    run<btree::BTree<uint64_t, ORDER>>("BTree", keys, probes);
+    run<btree::BPlusTree<uint64_t, ORDER>>("BPlusTree", keys, probes);
+}
+
+int main() {
+    const size_t num_keys = 1000000;
+    const size_t num_probes = 200000;
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(num_keys);
+    for (uint64_t& key : keys)
+        key = rng() % (num_keys * 4);
+
+    std::vector<uint64_t> probes(num_probes);
+    for (uint64_t& probe : probes)
+        probe = rng() % (num_keys * 4);
+
+    std::printf("%zu random uint64_t keys, %zu probes\n", num_keys, num_probes);
+
+    compare<16>(keys, probes);
+    compare<64>(keys, probes);
+    return 0;
+}
@@ -0,0 +1,440 @@
+/* Benchmark suite on Google Benchmark: BTree and BTreeMap against std::multiset and std::map.
+ *
+ * Cases are named  op/container/key/distribution/allocator/n  and cover
+ *   op            insert (into an empty container), find (every key, shuffled), erase (same)
+ *   container     btree<ORDER> for ORDER 4..512, btree_map<64>, std::multiset, std::map
+ *   key           u32, u64, str (15 characters, so std::string keeps them inline)
+ *   distribution  sequential, uniform, zipfian (s = 0.99), duplicates (about 64 copies per key)
+ *   allocator     system (std::allocator), list (custom list allocator with size classes), arena
+ * Each case reports time per iteration (n operations), items_per_second, per_op (time per
+ * operation) and, for insert, bytes_per_key: the container's live allocator bytes per stored key.
+ *
+ * The full sweep takes a while; pick cases with --benchmark_filter, e.g.
+ *   ./btree_benchmarks --benchmark_filter='^find/btree<[0-9]+>/u64/uniform/system'
+ * and set the number of keys with --keys=N (1M by default).
+ *
+ * Built by CMake when Google Benchmark is installed, or by hand:
+ * g++ btree_benchmarks.cpp -o btree_benchmarks -std=c++17 -O2 -lbenchmark -pthread
+ *
+ */
+
+#define USE_CUSTOM_LIST_ALLOCATOR
+
+#include "../arena.hpp"
+#include "../btree.hpp"
+#include "../btree_map.hpp"
+#include "../example/smpl_alloc.hpp"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Live bytes handed out through Counted, across all allocators.
+static size_t g_live_bytes = 0;
+
+// Forwards to A and keeps g_live_bytes up to date. Inherits A's traits, is_monotonic included.
+template <typename A>
+struct Counted : A {
+    using value_type = typename A::value_type;
+
+    template <typename U>
+    struct rebind {
+        using other = Counted<typename std::allocator_traits<A>::template rebind_alloc<U>>;
+    };
+
+    explicit Counted(const A& a) : A(a) {}
+
+    template <typename B>
+    Counted(const Counted<B>& other) : A(static_cast<const B&>(other)) {}
+
+    value_type* allocate(size_t n) {
+        value_type* p = std::allocator_traits<A>::allocate(*this, n);
+        g_live_bytes += n * sizeof(value_type);
+        return p;
+    }
+
+    void deallocate(value_type* p, size_t n) noexcept {
+        g_live_bytes -= n * sizeof(value_type);
+        std::allocator_traits<A>::deallocate(*this, p, n);
+    }
+};
+
+template <typename A, typename B>
+bool operator==(const Counted<A>& lhs, const Counted<B>& rhs) {
+    return static_cast<const A&>(lhs) == static_cast<const B&>(rhs);
+}
+
+template <typename A, typename B>
+bool operator!=(const Counted<A>& lhs, const Counted<B>& rhs) {
+    return !(lhs == rhs);
+}
+
+// Allocators under test. A heap lives for one build and hands out allocators bound to it.
+struct SystemHeap {
+    static constexpr const char* NAME = "system";
+
+    template <typename T>
+    using allocator = std::allocator<T>;
+
+    explicit SystemHeap(size_t) {}
+
+    template <typename T>
+    allocator<T> get() {
+        return allocator<T>();
+    }
+};
+
+struct ListHeap {
+    static constexpr const char* NAME = "list";
+
+    template <typename T>
+    using allocator = smpl_alloc<T>;
+
+    custom_list_allocator_t* heap_;
+
+    explicit ListHeap(size_t bytes) : heap_(custom_list_alloc_create(bytes, ALLOC_POLICY_SIZE_CLASS)) {
+        if (heap_ == nullptr) throw std::bad_alloc();
+    }
+
+    ~ListHeap() { custom_list_alloc_destroy(heap_); }
+
+    ListHeap(const ListHeap& other) = delete;
+    ListHeap& operator=(const ListHeap& other) = delete;
+
+    template <typename T>
+    allocator<T> get() {
+        return allocator<T>(heap_);
+    }
+};
+
+struct ArenaHeap {
+    static constexpr const char* NAME = "arena";
+
+    template <typename T>
+    using allocator = btree::ArenaAllocator<T>;
+
+    btree::MonotonicArena arena_;
+
+    explicit ArenaHeap(size_t) {}
+
+    template <typename T>
+    allocator<T> get() {
+        return allocator<T>(arena_);
+    }
+};
+
+// Containers under test, behind one insert/contains/erase interface.
+template <size_t ORDER>
+struct BTreeSet {
+    template <typename K>
+    using value_type = K;
+
+    template <typename K, typename A>
+    using type = btree::BTree<K, ORDER, A>;
+
+    static std::string name() { return "btree<" + std::to_string(ORDER) + ">"; }
+
+    template <typename C, typename K>
+    static void insert(C& c, const K& key) {
+        c.insert(key);
+    }
+};
+
+template <size_t ORDER>
+struct BTreeMapOf {
+    template <typename K>
+    using value_type = std::pair<const K, uint64_t>;
+
+    template <typename K, typename A>
+    using type = btree::BTreeMap<K, uint64_t, ORDER, std::less<K>, A>;
+
+    static std::string name() { return "btree_map<" + std::to_string(ORDER) + ">"; }
+
+    template <typename C, typename K>
+    static void insert(C& c, const K& key) {
+        c.try_emplace(key, 0);
+    }
+};
+
+struct StdMultiset {
+    template <typename K>
+    using value_type = K;
+
+    template <typename K, typename A>
+    using type = std::multiset<K, std::less<K>, A>;
+
+    static std::string name() { return "std::multiset"; }
+
+    template <typename C, typename K>
+    static void insert(C& c, const K& key) {
+        c.insert(key);
+    }
+};
+
+struct StdMap {
+    template <typename K>
+    using value_type = std::pair<const K, uint64_t>;
+
+    template <typename K, typename A>
+    using type = std::map<K, uint64_t, std::less<K>, A>;
+
+    static std::string name() { return "std::map"; }
+
+    template <typename C, typename K>
+    static void insert(C& c, const K& key) {
+        c.try_emplace(key, 0);
+    }
+};
+
+template <typename Family, typename K, typename Heap>
+using Allocator = Counted<typename Heap::template allocator<typename Family::template value_type<K>>>;
+
+template <typename Family, typename K, typename Heap>
+using Container = typename Family::template type<K, Allocator<Family, K, Heap>>;
+
+// Key types and distributions.
+template <typename K>
+struct KeyOf;
+
+template <>
+struct KeyOf<uint32_t> {
+    static constexpr const char* NAME = "u32";
+    static uint32_t make(uint64_t v) { return static_cast<uint32_t>(v); }
+};
+
+template <>
+struct KeyOf<uint64_t> {
+    static constexpr const char* NAME = "u64";
+    static uint64_t make(uint64_t v) { return v; }
+};
+
+template <>
+struct KeyOf<std::string> {
+    static constexpr const char* NAME = "str";
+    static std::string make(uint64_t v) {
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "%015llu", static_cast<unsigned long long>(v % 1000000000000000ull));
+        return buffer;
+    }
+};
+
+enum class Distribution { SEQUENTIAL, UNIFORM, ZIPFIAN, DUPLICATES };
+
+static const char* distributionName(Distribution distribution) {
+    switch (distribution) {
+        case Distribution::SEQUENTIAL: return "sequential";
+        case Distribution::UNIFORM: return "uniform";
+        case Distribution::ZIPFIAN: return "zipfian";
+        case Distribution::DUPLICATES: return "duplicates";
+    }
+    return "?";
+}
+
+static uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// n values drawn from the distribution. Zipfian ranks are scattered over the key space, so the
+// hot keys are not simply the smallest ones.
+static std::vector<uint64_t> makeValues(Distribution distribution, size_t n) {
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> values(n);
+    switch (distribution) {
+        case Distribution::SEQUENTIAL:
+            for (size_t i = 0; i < n; ++i)
+                values[i] = i;
+            break;
+        case Distribution::UNIFORM:
+            for (uint64_t& v : values)
+                v = rng();
+            break;
+        case Distribution::ZIPFIAN: {
+            std::vector<double> cdf(n);
+            double sum = 0;
+            for (size_t r = 0; r < n; ++r)
+                cdf[r] = sum += 1.0 / std::pow(static_cast<double>(r + 1), 0.99);
+            std::uniform_real_distribution<double> uniform(0, sum);
+            for (uint64_t& v : values)
+                v = mix(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+            break;
+        }
+        case Distribution::DUPLICATES:
+            for (uint64_t& v : values)
+                v = mix(rng() % (n / 64 + 1));
+            break;
+    }
+    return values;
+}
+
+template <typename K>
+static std::vector<K> makeKeys(Distribution distribution, size_t n) {
+    const std::vector<uint64_t> values = makeValues(distribution, n);
+    std::vector<K> keys;
+    keys.reserve(n);
+    for (uint64_t v : values)
+        keys.push_back(KeyOf<K>::make(v));
+    return keys;
+}
+
+template <typename K>
+static std::vector<K> shuffled(std::vector<K> keys) {
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(7));
+    return keys;
+}
+
+// Generous room for the list allocator's fixed heap; malloc only backs what gets touched.
+static size_t heapBytes(size_t n) { return (64u << 20) + n * 512; }
+
+static void report(benchmark::State& state, size_t ops) {
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * ops));
+    state.counters["per_op"] = benchmark::Counter(static_cast<double>(ops), benchmark::Counter::kIsIterationInvariantRate |
+                                                                             benchmark::Counter::kInvert);
+}
+
+template <typename Family, typename K, typename Heap>
+static void insertCase(benchmark::State& state, Distribution distribution) {
+    using C = Container<Family, K, Heap>;
+    const size_t n = static_cast<size_t>(state.range(0));
+    const std::vector<K> keys = makeKeys<K>(distribution, n);
+
+    double bytes_per_key = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        {
+            Heap heap(heapBytes(n));
+            const size_t live = g_live_bytes;
+            C c(Allocator<Family, K, Heap>(heap.template get<typename Family::template value_type<K>>()));
+            state.ResumeTiming();
+
+            for (const K& key : keys)
+                Family::insert(c, key);
+
+            state.PauseTiming();
+            const size_t stored = static_cast<size_t>(std::distance(c.begin(), c.end()));
+            bytes_per_key = static_cast<double>(g_live_bytes - live) / static_cast<double>(std::max<size_t>(stored, 1));
+        }
+        state.ResumeTiming();
+    }
+    report(state, n);
+    state.counters["bytes_per_key"] = bytes_per_key;
+}
+
+template <typename Family, typename K, typename Heap>
+static void findCase(benchmark::State& state, Distribution distribution) {
+    using C = Container<Family, K, Heap>;
+    const size_t n = static_cast<size_t>(state.range(0));
+    const std::vector<K> keys = makeKeys<K>(distribution, n);
+    const std::vector<K> probes = shuffled(keys);
+
+    Heap heap(heapBytes(n));
+    C c(Allocator<Family, K, Heap>(heap.template get<typename Family::template value_type<K>>()));
+    for (const K& key : keys)
+        Family::insert(c, key);
+
+    for (auto _ : state) {
+        size_t hits = 0;
+        for (const K& key : probes)
+            hits += c.find(key) != c.end();
+        benchmark::DoNotOptimize(hits);
+    }
+    report(state, n);
+}
+
+template <typename Family, typename K, typename Heap>
+static void eraseCase(benchmark::State& state, Distribution distribution) {
+    using C = Container<Family, K, Heap>;
+    const size_t n = static_cast<size_t>(state.range(0));
+    const std::vector<K> keys = makeKeys<K>(distribution, n);
+    const std::vector<K> probes = shuffled(keys);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        {
+            Heap heap(heapBytes(n));
+            C c(Allocator<Family, K, Heap>(heap.template get<typename Family::template value_type<K>>()));
+            for (const K& key : keys)
+                Family::insert(c, key);
+            state.ResumeTiming();
+
+            size_t erased = 0;
+            for (const K& key : probes)
+                erased += c.erase(key);
+            benchmark::DoNotOptimize(erased);
+
+            state.PauseTiming();
+        }
+        state.ResumeTiming();
+    }
+    report(state, n);
+}
+
+template <typename Family, typename K, typename Heap>
+static void registerCases(size_t n) {
+    const Distribution distributions[] = {Distribution::SEQUENTIAL, Distribution::UNIFORM, Distribution::ZIPFIAN,
+                                          Distribution::DUPLICATES};
+    for (Distribution distribution : distributions) {
+        const std::string suffix = "/" + Family::name() + "/" + KeyOf<K>::NAME + "/" + distributionName(distribution) +
+                                   "/" + Heap::NAME;
+        benchmark::RegisterBenchmark(("insert" + suffix).c_str(), insertCase<Family, K, Heap>, distribution)
+            ->Arg(static_cast<int64_t>(n))
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("find" + suffix).c_str(), findCase<Family, K, Heap>, distribution)
+            ->Arg(static_cast<int64_t>(n))
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("erase" + suffix).c_str(), eraseCase<Family, K, Heap>, distribution)
+            ->Arg(static_cast<int64_t>(n))
+            ->Unit(benchmark::kMillisecond);
+    }
+}
+
+template <typename Family, typename Heap>
+static void registerKeys(size_t n) {
+    registerCases<Family, uint32_t, Heap>(n);
+    registerCases<Family, uint64_t, Heap>(n);
+    registerCases<Family, std::string, Heap>(n);
+}
+
+template <typename Family>
+static void registerFamily(size_t n) {
+    registerKeys<Family, SystemHeap>(n);
+    registerKeys<Family, ListHeap>(n);
+    registerKeys<Family, ArenaHeap>(n);
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    size_t n = 1 << 20;
+    int rest = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--keys=", 7) == 0)
+            n = static_cast<size_t>(std::strtoull(argv[i] + 7, nullptr, 10));
+        else
+            argv[rest++] = argv[i];
+    }
+    if (benchmark::ReportUnrecognizedArguments(rest, argv)) return 1;
+
+    registerFamily<BTreeSet<4>>(n);
+    registerFamily<BTreeSet<16>>(n);
+    registerFamily<BTreeSet<64>>(n);
+    registerFamily<BTreeSet<128>>(n);
+    registerFamily<BTreeSet<512>>(n);
+    registerFamily<BTreeMapOf<64>>(n);
+    registerFamily<StdMultiset>(n);
+    registerFamily<StdMap>(n);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,104 @@
+/* Multi-threaded throughput: BTree behind one global mutex against ConcurrentBTree.
+ *
+ * Each thread runs a fixed number of operations on a shared tree preloaded with random keys.
+ * Writes alternate between inserting and erasing random keys, so the tree size stays put.
+ * Thread counts go from 1 up to the hardware concurrency (or the first argument).
+ *
+ * g++ concurrent_bench.cpp -o concurrent_bench -std=c++17 -O2 -pthread
+ *
+ */
+
+#include "../btree.hpp"
+#include "../concurrent_btree.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const uint64_t KEY_SPACE = 4000000;
+static const size_t PRELOAD = 1000000;
+static const size_t OPS_PER_THREAD = 1000000;
+
+// The baseline most callers use today.
+class LockedBTree {
+    btree::BTree<uint64_t, 64> tree_;
+    std::mutex mutex_;
+
+public:
+    void insert(uint64_t key) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        tree_.insert(key);
+    }
+
+    bool contains(uint64_t key) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return tree_.contains(key);
+    }
+
+    void erase(uint64_t key) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        tree_.erase(key);
+    }
+};
+
+template <typename Tree>
+static double run(unsigned threads, unsigned write_percent) {
+    Tree tree;
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < PRELOAD; ++i)
+        tree.insert(rng() % KEY_SPACE);
+
+    std::vector<std::thread> workers;
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&tree, t, write_percent] {
+            std::mt19937_64 local(1000 + t);
+            size_t hits = 0;
+            for (size_t i = 0; i < OPS_PER_THREAD; ++i) {
+                const uint64_t key = local() % KEY_SPACE;
+                if (local() % 100 < write_percent) {
+                    if (i & 1)
+                        tree.erase(key);
+                    else
+                        tree.insert(key);
+                } else {
+                    hits += tree.contains(key);
+                }
+            }
+            if (hits == SIZE_MAX) std::printf("unreachable\n");
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end_time - start_time;
+    return static_cast<double>(threads) * OPS_PER_THREAD / elapsed.count() / 1e6;
+}
+
+int main(int argc, char** argv) {
+    unsigned max_threads = std::thread::hardware_concurrency();
+    if (argc > 1) max_threads = static_cast<unsigned>(std::atoi(argv[1]));
+    if (max_threads == 0) max_threads = 1;
+
+    std::printf("%zu preloaded uint64_t keys, %zu operations per thread, ORDER 64\n", PRELOAD, OPS_PER_THREAD);
+
+    const unsigned mixes[] = {0, 5, 50};
+    for (unsigned write_percent : mixes) {
+        std::printf("\n%u%% reads / %u%% writes\n", 100 - write_percent, write_percent);
+        std::printf("%8s %22s %22s\n", "threads", "mutex + BTree Mops/s", "ConcurrentBTree Mops/s");
+
+        for (unsigned threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+            const double locked = run<LockedBTree>(threads, write_percent);
+            const double concurrent = run<btree::ConcurrentBTree<uint64_t, 64>>(threads, write_percent);
+            std::printf("%8u %22.2f %22.2f\n", threads, locked, concurrent);
+            if (threads == max_threads) break;
+        }
+    }
+    return 0;
+}
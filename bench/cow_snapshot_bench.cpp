@@ -0,0 +1,179 @@
+/* Copy-on-write snapshots: CowBTree::snapshot against a deep copy of a BTree.
+ *
+ * Builds both trees from 1M random uint64_t keys (or the first argument) and reports what a
+ * consistent read view costs: the O(1) snapshot against copying every key into a new BTree, the
+ * insert overhead of reference counting without snapshots, and the nodes copied while updates
+ * run with one snapshot pinned or with a new one published every 1000 updates. Last, a reader
+ * thread scans the latest published snapshot over and over while the writer keeps inserting.
+ *
+ * Live heap bytes are measured through the global operator new with malloc_usable_size (glibc).
+ *
+ * g++ cow_snapshot_bench.cpp -o cow_snapshot_bench -std=c++17 -O2 -pthread
+ *
+ */
+
+#include "../btree.hpp"
+#include "../cow_btree.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <mutex>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+static std::atomic<size_t> g_live_bytes{0};
+
+void* operator new(std::size_t size) {
+    if (void* p = std::malloc(size)) {
+        g_live_bytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    const std::size_t a = static_cast<std::size_t>(alignment);
+    if (void* p = std::aligned_alloc(a, (size + a - 1) & ~(a - 1))) {
+        g_live_bytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+static void release(void* p) noexcept {
+    if (p == nullptr) return;
+    g_live_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+    std::free(p);
+}
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete(void* p, std::size_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { release(p); }
+
+static double elapsed_ns(std::chrono::high_resolution_clock::time_point start_time) {
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+static double mib(size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); }
+
+using Cow = btree::CowBTree<uint64_t, 32>;
+
+int main(int argc, char** argv) {
+    size_t num_keys = 1000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+    const size_t num_updates = std::max<size_t>(num_keys / 10, 1);
+    const size_t publish_every = 1000;
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(num_keys);
+    for (uint64_t& key : keys)
+        key = rng();
+    std::vector<uint64_t> updates(num_updates);
+    for (uint64_t& key : updates)
+        key = rng();
+
+    std::printf("%zu random uint64_t keys, ORDER 32, %zu updates\n\n", num_keys, num_updates);
+
+    size_t base = g_live_bytes.load();
+    btree::BTree<uint64_t, 32> plain;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (uint64_t key : keys)
+        plain.insert(key);
+    const double plain_insert_ns = elapsed_ns(start_time) / num_keys;
+    const size_t plain_bytes = g_live_bytes.load() - base;
+
+    base = g_live_bytes.load();
+    Cow tree;
+    start_time = std::chrono::high_resolution_clock::now();
+    for (uint64_t key : keys)
+        tree.insert(key);
+    const double cow_insert_ns = elapsed_ns(start_time) / num_keys;
+    const size_t tree_bytes = g_live_bytes.load() - base;
+
+    std::printf("%-40s %12.1f ns  (%.1f MiB)\n", "BTree insert", plain_insert_ns, mib(plain_bytes));
+    std::printf("%-40s %12.1f ns  (%.1f MiB)\n", "CowBTree insert, no snapshot", cow_insert_ns, mib(tree_bytes));
+
+    // A consistent view without snapshots: copy everything.
+    base = g_live_bytes.load();
+    start_time = std::chrono::high_resolution_clock::now();
+    {
+        std::vector<uint64_t> sorted;
+        sorted.reserve(num_keys);
+        for (uint64_t key : plain)
+            sorted.push_back(key);
+        btree::BTree<uint64_t, 32> copy;
+        copy.bulk_load(sorted.begin(), sorted.end());
+        std::printf("%-40s %12.1f ms  (%.1f MiB)\n", "BTree deep copy", elapsed_ns(start_time) / 1e6,
+                    mib(g_live_bytes.load() - base));
+    }
+
+    const size_t rounds = 100000;
+    start_time = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        Cow::snapshot_type view = tree.snapshot();
+        if (view.size() != num_keys) std::abort();
+    }
+    std::printf("%-40s %12.1f ns\n", "CowBTree snapshot + release", elapsed_ns(start_time) / rounds);
+
+    Cow::snapshot_type pinned = tree.snapshot();
+
+    base = g_live_bytes.load();
+    start_time = std::chrono::high_resolution_clock::now();
+    for (uint64_t key : updates)
+        tree.insert(key);
+    std::printf("%-40s %12.1f ns  (+%.1f MiB copied)\n", "insert, one snapshot pinned", elapsed_ns(start_time) / num_updates,
+                mib(g_live_bytes.load() - base));
+    pinned = Cow::snapshot_type();
+
+    base = g_live_bytes.load();
+    Cow::snapshot_type latest;
+    start_time = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_updates; ++i) {
+        if (i % publish_every == 0) latest = tree.snapshot();
+        tree.erase(updates[i]);
+    }
+    std::printf("%-40s %12.1f ns  (+%.1f MiB held)\n", "erase, snapshot every 1000", elapsed_ns(start_time) / num_updates,
+                mib(g_live_bytes.load() - base));
+
+    // Reader scans whatever is published last, the writer never waits for it.
+    std::mutex slot_mutex;
+    std::atomic<bool> done{false};
+    size_t scans = 0;
+    size_t scanned_keys = 0;
+    std::thread reader([&] {
+        while (!done.load(std::memory_order_acquire)) {
+            Cow::snapshot_type view;
+            {
+                std::lock_guard<std::mutex> lock(slot_mutex);
+                view = latest;
+            }
+            uint64_t sum = 0;
+            for (uint64_t key : view)
+                sum += key;
+            scanned_keys += view.size() + (sum == 1);
+            ++scans;
+        }
+    });
+    start_time = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_updates; ++i) {
+        if (i % publish_every == 0) {
+            Cow::snapshot_type fresh = tree.snapshot();
+            std::lock_guard<std::mutex> lock(slot_mutex);
+            latest = std::move(fresh);
+        }
+        tree.insert(updates[i]);
+    }
+    const double concurrent_ns = elapsed_ns(start_time) / num_updates;
+    done.store(true, std::memory_order_release);
+    reader.join();
+    std::printf("%-40s %12.1f ns  (%zu full scans, %zu keys read)\n", "insert, reader scanning snapshots", concurrent_ns,
+                scans, scanned_keys);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/* Duplicate-heavy inserts under the three Duplicates policies of BTree: multi_keys (a slot per
+ * copy), unique_keys and counted_keys (a slot per distinct key, with a counter).
+ *
+ * As in the example, key i % 1000 is inserted for i < N (1M unless given as the first
+ * argument), then count() is asked for every distinct key. Memory is what stats() reports for
+ * the nodes.
+ *
+ * g++ duplicate_keys_bench.cpp -o duplicate_keys_bench -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+static const uint32_t DISTINCT = 1000;
+
+template <typename Duplicates>
+static void measure(const char* label, size_t n) {
+    btree::BTree<uint32_t, 64, std::allocator<uint32_t>, btree::default_search, btree::no_stats, Duplicates> tree;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < n; ++i)
+        tree.insert(static_cast<uint32_t>(i % DISTINCT));
+    std::chrono::duration<double, std::nano> insert = std::chrono::high_resolution_clock::now() - start_time;
+
+    size_t copies = 0;
+    start_time = std::chrono::high_resolution_clock::now();
+    for (uint32_t key = 0; key < DISTINCT; ++key)
+        copies += tree.count(key);
+    std::chrono::duration<double, std::nano> count = std::chrono::high_resolution_clock::now() - start_time;
+
+    const btree::TreeStats stats = tree.stats();
+    std::printf("%-14s %8zu slots %6zu nodes %10zu bytes %8.1f ns/insert %10.1f ns/count  (%zu copies)\n", label,
+                stats.keys_, stats.nodes_, stats.bytes_, insert.count() / n, count.count() / DISTINCT, copies);
+}
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    std::printf("%zu inserts of %u distinct keys\n\n", n, DISTINCT);
+    measure<btree::multi_keys>("multi_keys", n);
+    measure<btree::unique_keys>("unique_keys", n);
+    measure<btree::counted_keys<>>("counted_keys", n);
+    return 0;
+}
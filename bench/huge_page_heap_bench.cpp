@@ -0,0 +1,169 @@
+/* BTree lookups on custom list heaps backed by malloc, mmap, transparent huge pages and hugetlb.
+ *
+ * Each heap starts at CUSTOM_LIST_HEAP_SIZE and grows in 256 MiB chunks. A tree of random
+ * uint64_t keys (10M unless given as the first argument, run it with 100000000 for the big
+ * picture) is built on it, then probed at random, half of the probes present. Data TLB read
+ * misses are counted with perf_event_open where the kernel lets us; the last run also binds the
+ * heap to NUMA node 0.
+ *
+ * g++ huge_page_heap_bench.cpp -o huge_page_heap_bench -std=c++17 -O2
+ *
+ */
+
+#define USE_CUSTOM_LIST_ALLOCATOR
+
+#include "../btree.hpp"
+#include "../example/smpl_alloc.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#endif
+
+static double elapsed_ns(std::chrono::high_resolution_clock::time_point start_time) {
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+// dTLB read misses of this thread, or -1 when the counter is not available.
+struct TlbMissCounter {
+    int fd_ = -1;
+
+    TlbMissCounter() {
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~TlbMissCounter() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    void start() {
+#ifdef __linux__
+        if (fd_ < 0) return;
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    long long stop() {
+#ifdef __linux__
+        if (fd_ < 0) return -1;
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if (read(fd_, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count))) return -1;
+        return count;
+#else
+        return -1;
+#endif
+    }
+};
+
+static const char* pages_name(heap_pages_t pages) {
+    switch (pages) {
+        case HEAP_PAGES_MALLOC:
+            return "malloc";
+        case HEAP_PAGES_MMAP:
+            return "mmap";
+        case HEAP_PAGES_TRANSPARENT:
+            return "thp";
+        case HEAP_PAGES_HUGETLB:
+            return "hugetlb";
+    }
+    return "?";
+}
+
+static void run(const char* name, heap_pages_t pages, int numa_node, const std::vector<uint64_t>& keys,
+                const std::vector<uint64_t>& probes) {
+    custom_list_heap_options_t options = custom_list_default_heap_options();
+    options.pages = pages;
+    options.populate = pages != HEAP_PAGES_MALLOC;
+    options.numa_node = numa_node;
+    options.grow_size = 256 * 1024 * 1024;
+
+    custom_list_allocator_t* list = custom_list_alloc_create_ex(CUSTOM_LIST_HEAP_SIZE, ALLOC_POLICY_SIZE_CLASS, &options);
+    if (!list) {
+        std::printf("%-16s failed to create the heap\n", name);
+        return;
+    }
+
+    TlbMissCounter tlb;
+    double build_ns = 0;
+    double lookup_ns = 0;
+    long long tlb_misses = -1;
+    size_t hits = 0;
+    {
+        smpl_alloc<uint64_t> alloc(list);
+        btree::BTree<uint64_t, 64, smpl_alloc<uint64_t>> tree(alloc);
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for (uint64_t key : keys)
+            tree.insert(key);
+        build_ns = elapsed_ns(start_time);
+
+        tlb.start();
+        start_time = std::chrono::high_resolution_clock::now();
+        for (uint64_t key : probes)
+            hits += tree.contains(key);
+        lookup_ns = elapsed_ns(start_time);
+        tlb_misses = tlb.stop();
+    }
+
+    size_t chunks = 0;
+    for (const heap_chunk_t* chunk = list->chunks; chunk; chunk = chunk->next)
+        ++chunks;
+    const heap_chunk_t* first = list->chunks;
+
+    char misses[32];
+    if (tlb_misses >= 0)
+        std::snprintf(misses, sizeof(misses), "%.3f", static_cast<double>(tlb_misses) / probes.size());
+    else
+        std::snprintf(misses, sizeof(misses), "n/a");
+    char node[16];
+    std::snprintf(node, sizeof(node), "%d", first->numa_node);
+
+    std::printf("%-16s %-8s %5s %7zu %10.1f %10.1f %12s   (%zu hits)\n", name, pages_name(first->pages),
+                first->numa_node >= 0 ? node : "-", chunks, build_ns / keys.size(), lookup_ns / probes.size(), misses,
+                hits);
+    custom_list_alloc_destroy(list);
+}
+
+int main(int argc, char** argv) {
+    size_t num_keys = 10000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+    const size_t num_probes = std::min<size_t>(num_keys, 2000000);
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(num_keys);
+    for (uint64_t& key : keys)
+        key = rng();
+
+    std::vector<uint64_t> probes(num_probes);
+    for (size_t i = 0; i < num_probes; ++i)
+        probes[i] = (i % 2 == 0) ? keys[rng() % num_keys] : rng();
+
+    std::printf("%zu random uint64_t keys, ORDER 64, %zu probes\n\n", num_keys, num_probes);
+    std::printf("%-16s %-8s %5s %7s %10s %10s %12s\n", "heap", "got", "node", "chunks", "insert ns", "lookup ns",
+                "dTLB miss/op");
+    run("malloc", HEAP_PAGES_MALLOC, -1, keys, probes);
+    run("mmap", HEAP_PAGES_MMAP, -1, keys, probes);
+    run("transparent", HEAP_PAGES_TRANSPARENT, -1, keys, probes);
+    run("hugetlb", HEAP_PAGES_HUGETLB, -1, keys, probes);
+    run("transparent+numa", HEAP_PAGES_TRANSPARENT, 0, keys, probes);
+    return 0;
+}
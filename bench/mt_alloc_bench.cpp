@@ -0,0 +1,179 @@
+/* Allocator contention: per-thread BTrees on one shared heap, 1 to N threads (32 unless given as
+ * the first argument; the second is the number of keys per thread, 20000 by default).
+ *
+ * churn:   every thread inserts its keys into its own tree and erases them again, a few rounds.
+ * handoff: every thread builds a tree, then destroys its neighbour's, so all frees are remote.
+ *
+ * Compared: the thread-cached custom_mt_allocator, the custom list (size classes) behind one
+ * mutex, and the system allocator. Figures are million tree operations per second over all
+ * threads.
+ *
+ * g++ mt_alloc_bench.cpp -o mt_alloc_bench -std=c++17 -O2 -pthread
+ *
+ */
+
+#define USE_CUSTOM_MT_ALLOCATOR
+
+#include "../btree.hpp"
+#include "../example/smpl_alloc.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// The shared list heap with a single lock around it, what sharing custom_list_allocator_t
+// across threads takes without caches.
+struct LockedList {
+    custom_list_allocator_t* heap_;
+    std::mutex lock_;
+};
+
+template <typename T>
+struct LockedListAlloc {
+    using value_type = T;
+
+    LockedList* list_;
+
+    explicit LockedListAlloc(LockedList* list) noexcept : list_(list) {}
+
+    template <typename U>
+    LockedListAlloc(const LockedListAlloc<U>& other) noexcept : list_(other.list_) {}
+
+    T* allocate(size_t n) {
+        std::lock_guard<std::mutex> guard(list_->lock_);
+        void* mem = custom_list_malloc_aligned(list_->heap_, n * sizeof(T), alignof(T));
+        if (!mem) throw std::bad_alloc();
+        return static_cast<T*>(mem);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        std::lock_guard<std::mutex> guard(list_->lock_);
+        custom_list_free_aligned(list_->heap_, p, n * sizeof(T), alignof(T));
+    }
+
+    friend bool operator==(const LockedListAlloc& lhs, const LockedListAlloc& rhs) { return lhs.list_ == rhs.list_; }
+    friend bool operator!=(const LockedListAlloc& lhs, const LockedListAlloc& rhs) { return lhs.list_ != rhs.list_; }
+};
+
+static const size_t ROUNDS = 3;
+static const size_t HEAP_SIZE = size_t(1) << 30;
+
+template <typename Alloc>
+using Tree = btree::BTree<uint64_t, 16, Alloc>;
+
+template <typename Alloc>
+static void churn(const Alloc& alloc, const std::vector<uint64_t>& keys) {
+    Tree<Alloc> tree(alloc);
+    for (size_t round = 0; round < ROUNDS; ++round) {
+        for (uint64_t key : keys)
+            tree.insert(key);
+        for (uint64_t key : keys)
+            tree.erase(key);
+    }
+}
+
+// Phases are timed from the moment one barrier completes to the moment the next one does, which
+// holds even when there are more threads than cores.
+class Barrier {
+    std::mutex lock_;
+    std::condition_variable changed_;
+    unsigned parties_;
+    unsigned waiting_ = 0;
+    unsigned generation_ = 0;
+
+public:
+    std::vector<std::chrono::steady_clock::time_point> completed_;
+
+    explicit Barrier(unsigned parties) : parties_(parties) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock_);
+        const unsigned generation = generation_;
+        if (++waiting_ == parties_) {
+            completed_.push_back(std::chrono::steady_clock::now());
+            waiting_ = 0;
+            ++generation_;
+            changed_.notify_all();
+        } else {
+            changed_.wait(guard, [&] { return generation != generation_; });
+        }
+    }
+};
+
+template <typename Alloc>
+static void run(const char* name, const Alloc& alloc, unsigned threads, const std::vector<std::vector<uint64_t>>& keys) {
+    const double n = static_cast<double>(keys[0].size());
+
+    // The workers live through all phases, as long-running worker threads would, so every block
+    // is freed while the thread that allocated it still holds its cache.
+    std::vector<std::unique_ptr<Tree<Alloc>>> trees(threads);
+    Barrier barrier(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            barrier.wait();
+            churn(alloc, keys[t]);
+            barrier.wait();
+            trees[t].reset(new Tree<Alloc>(alloc));
+            for (uint64_t key : keys[t])
+                trees[t]->insert(key);
+            barrier.wait();
+            trees[(t + 1) % threads].reset();
+            barrier.wait();
+        });
+    }
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    // Million operations per second of phase p, between barriers p and p + 1.
+    auto mops = [&](size_t p, double ops_per_thread) {
+        std::chrono::duration<double, std::micro> elapsed = barrier.completed_[p + 1] - barrier.completed_[p];
+        return threads * ops_per_thread / elapsed.count();
+    };
+    const double churn_mops = mops(0, 2 * ROUNDS * n);
+    const double build_mops = mops(1, n);
+    const double handoff_mops = mops(2, n);
+
+    std::printf("%-14s %3u threads %10.2f churn %10.2f build %10.2f remote destroy\n", name, threads, churn_mops,
+                build_mops, handoff_mops);
+}
+
+int main(int argc, char** argv) {
+    const unsigned max_threads = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 32;
+    const size_t keys_per_thread = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20000;
+
+    std::vector<std::vector<uint64_t>> keys(max_threads);
+    std::mt19937_64 rng(42);
+    for (std::vector<uint64_t>& k : keys) {
+        k.resize(keys_per_thread);
+        for (uint64_t& key : k)
+            key = rng();
+    }
+
+    std::printf("%zu keys per thread, million ops/s over all threads\n\n", keys_per_thread);
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        custom_mt_allocator_t* mt = custom_mt_alloc_create(HEAP_SIZE);
+        LockedList locked{custom_list_alloc_create(HEAP_SIZE, ALLOC_POLICY_SIZE_CLASS), {}};
+        if (!mt || !locked.heap_) {
+            std::printf("failed to create the heaps\n");
+            return 1;
+        }
+
+        run("mt-cached", smpl_alloc<uint64_t>(mt), threads, keys);
+        run("list+mutex", LockedListAlloc<uint64_t>(&locked), threads, keys);
+        run("system", std::allocator<uint64_t>(), threads, keys);
+        std::printf("\n");
+
+        if (threads == max_threads) custom_mt_print_info(mt);
+        custom_mt_alloc_destroy(mt);
+        custom_list_alloc_destroy(locked.heap_);
+    }
+    return 0;
+}
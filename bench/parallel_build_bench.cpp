@@ -0,0 +1,109 @@
+/* Parallel bulk build and aggregation on a work-stealing pool, from 1 thread up to one per
+ * hardware thread (or the second argument).
+ *
+ * N random uint64_t keys (10M unless given as the first argument) are loaded with insert() one by
+ * one, with bulk_load_unsorted and with parallel_build, then summed with traverse and
+ * parallel_reduce and scanned for a missing key with parallel_for_each. Speedups are against the
+ * single-threaded bulk_load_unsorted and traverse.
+ *
+ * g++ parallel_build_bench.cpp -o parallel_build_bench -std=c++17 -O2 -pthread
+ *
+ */
+
+#include "../btree.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+using Tree = btree::BTree<uint64_t, 64>;
+
+struct SumCounter {
+    size_t count = 0;
+    uint64_t sum = 0;
+    void operator()(uint64_t key) {
+        count++;
+        sum += key;
+    }
+};
+
+static void combine(SumCounter& total, SumCounter&& part) {
+    total.count += part.count;
+    total.sum += part.sum;
+}
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start_time) {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    size_t num_keys = 10000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 2) max_threads = static_cast<size_t>(std::strtoull(argv[2], nullptr, 10));
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(num_keys);
+    for (uint64_t& key : keys)
+        key = rng() >> 1;
+    const uint64_t missing = ~uint64_t(0);
+
+    std::printf("%zu random uint64_t keys, ORDER 64\n\n", num_keys);
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    {
+        Tree tree;
+        for (uint64_t key : keys)
+            tree.insert(key);
+    }
+    std::printf("%-28s %10.1f ms\n", "insert loop", elapsed_ms(start_time));
+
+    Tree tree;
+    start_time = std::chrono::high_resolution_clock::now();
+    tree.bulk_load_unsorted(keys.begin(), keys.end());
+    const double bulk_ms = elapsed_ms(start_time);
+    std::printf("%-28s %10.1f ms\n", "bulk_load_unsorted", bulk_ms);
+
+    SumCounter expected;
+    start_time = std::chrono::high_resolution_clock::now();
+    tree.traverse(expected);
+    const double traverse_ms = elapsed_ms(start_time);
+    std::printf("%-28s %10.1f ms\n\n", "traverse", traverse_ms);
+
+    std::printf("%7s %12s %8s %12s %8s %14s\n", "threads", "build ms", "speedup", "reduce ms", "speedup", "for_each ms");
+    for (size_t threads = 1;; threads = std::min(threads * 2, max_threads)) {
+        btree::WorkStealingPool pool(threads);
+
+        start_time = std::chrono::high_resolution_clock::now();
+        tree.parallel_build(keys.begin(), keys.end(), pool);
+        const double build_ms = elapsed_ms(start_time);
+
+        start_time = std::chrono::high_resolution_clock::now();
+        const SumCounter total = tree.parallel_reduce(SumCounter(), combine, pool);
+        const double reduce_ms = elapsed_ms(start_time);
+        if (total.count != expected.count || total.sum != expected.sum) {
+            std::printf("parallel_reduce mismatch: %zu keys, expected %zu\n", total.count, expected.count);
+            return 1;
+        }
+
+        std::atomic<bool> found{false};
+        start_time = std::chrono::high_resolution_clock::now();
+        tree.parallel_for_each(
+            [&found, missing](uint64_t key) {
+                if (key == missing) found.store(true, std::memory_order_relaxed);
+            },
+            pool);
+        const double for_each_ms = elapsed_ms(start_time);
+        if (found.load()) return 1;
+
+        std::printf("%7zu %12.1f %7.2fx %12.2f %7.2fx %14.2f\n", threads, build_ms, bulk_ms / build_ms, reduce_ms,
+                    traverse_ms / reduce_ms, for_each_ms);
+        if (threads >= max_threads) break;
+    }
+    return 0;
+}
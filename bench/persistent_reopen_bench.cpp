@@ -0,0 +1,73 @@
+/* Restart cost: reopening a PersistentBTree file against replaying the inserts into a BTree.
+ *
+ * Builds a file with random keys (5M unless given as the first argument; the file path is the
+ * second argument), closes it, then times opening it again plus a batch of lookups.
+ *
+ * g++ persistent_reopen_bench.cpp -o persistent_reopen_bench -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include "../persistent_btree.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start_time) {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    size_t num_keys = 5000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+    const std::string path = argc > 2 ? argv[2] : "/tmp/persistent_reopen_bench.db";
+    const size_t num_probes = 1000;
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(num_keys);
+    for (uint64_t& key : keys)
+        key = rng();
+
+    using Tree = btree::PersistentBTree<uint64_t, 4096>;
+    std::printf("%zu random uint64_t keys, 4 KiB pages (ORDER %zu), %s\n\n", num_keys, Tree::ORDER, path.c_str());
+
+    ::unlink(path.c_str());
+    auto start_time = std::chrono::high_resolution_clock::now();
+    size_t pages = 0;
+    {
+        Tree tree(path);
+        for (uint64_t key : keys)
+            tree.insert(key);
+        tree.sync();
+        pages = tree.pages();
+    }
+    std::printf("%-40s %12.1f ms (%zu MiB)\n", "build + sync", elapsed_ms(start_time), pages * 4096 >> 20);
+
+    size_t hits = 0;
+    start_time = std::chrono::high_resolution_clock::now();
+    {
+        Tree tree(path);
+        for (size_t i = 0; i < num_probes; ++i)
+            hits += tree.contains(keys[i * (num_keys / num_probes)]);
+    }
+    std::printf("%-40s %12.3f ms\n", "reopen file + 1000 lookups", elapsed_ms(start_time));
+
+    start_time = std::chrono::high_resolution_clock::now();
+    {
+        btree::BTree<uint64_t, 64> tree;
+        for (uint64_t key : keys)
+            tree.insert(key);
+        for (size_t i = 0; i < num_probes; ++i)
+            hits += tree.contains(keys[i * (num_keys / num_probes)]);
+    }
+    std::printf("%-40s %12.1f ms\n", "replay inserts into BTree + 1000 lookups", elapsed_ms(start_time));
+
+    if (hits != 2 * num_probes) std::printf("lookup mismatch\n");
+    ::unlink(path.c_str());
+    return 0;
+}
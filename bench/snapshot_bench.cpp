@@ -0,0 +1,69 @@
+/* Snapshot round trip: BTree::save / BTree::load against rebuilding with insert.
+ *
+ * Runs with 10M uint64_t keys (or the first argument) and a tenth as many string keys.
+ *
+ * g++ snapshot_bench.cpp -o snapshot_bench -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+template <typename F>
+static double time_ms(F&& body) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    body();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+template <typename T>
+static void run(const char* label, const std::vector<T>& keys) {
+    std::printf("\n%s, %zu keys\n", label, keys.size());
+
+    btree::BTree<T, 64> tree;
+    for (const T& key : keys)
+        tree.insert(key);
+
+    std::vector<unsigned char> buffer;
+    const double save_ms = time_ms([&] { tree.save(buffer); });
+    std::printf("%-32s %10.1f ms (%zu MiB)\n", "save to buffer", save_ms, buffer.size() >> 20);
+
+    std::stringstream stream;
+    std::printf("%-32s %10.1f ms\n", "save to stringstream", time_ms([&] { tree.save(stream); }));
+
+    btree::BTree<T, 64> loaded;
+    std::printf("%-32s %10.1f ms\n", "load from buffer", time_ms([&] { loaded.load(buffer.data(), buffer.size()); }));
+    std::printf("%-32s %10.1f ms\n", "load from stringstream", time_ms([&] { loaded.load(stream); }));
+
+    std::printf("%-32s %10.1f ms\n", "rebuild with insert", time_ms([&] {
+                    btree::BTree<T, 64> rebuilt;
+                    for (const T& key : keys)
+                        rebuilt.insert(key);
+                }));
+}
+
+int main(int argc, char** argv) {
+    size_t num_keys = 10000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937_64 rng(42);
+
+    std::vector<uint64_t> numbers(num_keys);
+    for (uint64_t& key : numbers)
+        key = rng();
+    run("uint64_t", numbers);
+
+    std::vector<std::string> strings(num_keys / 10);
+    for (std::string& key : strings)
+        key = "https://example.com/item/" + std::to_string(rng() % 1000000000000ull);
+    run("std::string", strings);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/* Allocation count per insert for heap-allocated std::string keys.
+ *
+ * Every global operator new is counted, so the figures include both the node blocks and the
+ * std::string buffers created while inserting.
+ *
+ * g++ string_insert_alloc_bench.cpp -o string_insert_alloc_bench -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+static size_t g_allocations = 0;
+
+void* operator new(std::size_t size) {
+    ++g_allocations;
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    ++g_allocations;
+    if (void* p = std::aligned_alloc(static_cast<std::size_t>(alignment),
+                                     (size + static_cast<std::size_t>(alignment) - 1) &
+                                         ~(static_cast<std::size_t>(alignment) - 1)))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+// 40 characters, well past the small-string buffer, so every copy of a key costs an allocation.
+static std::vector<std::string> make_keys(size_t n) {
+    std::mt19937_64 rng(42);
+    std::vector<std::string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        keys.push_back("https://example.com/item/" + std::to_string(rng() % 1000000000000ull) + "/x");
+    return keys;
+}
+
+template <typename F>
+static void report(const char* name, size_t n, F&& body) {
+    const size_t before = g_allocations;
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    body();
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> elapsed = end_time - start_time;
+    std::printf("%-40s %8.3f allocs/insert %10.1f ns/insert\n", name,
+                static_cast<double>(g_allocations - before) / static_cast<double>(n), elapsed.count() / n);
+}
+
+template <size_t ORDER>
+static void run(const std::vector<std::string>& keys) {
+    std::printf("\nORDER = %zu\n", ORDER);
+
+    {
+        btree::BTree<std::string, ORDER> tree;
+        report("BTree::insert(const std::string&)", keys.size(), [&] {
+            for (const std::string& key : keys)
+                tree.insert(key);
+        });
+    }
+    {
+        std::vector<std::string> owned(keys);
+        btree::BTree<std::string, ORDER> tree;
+        report("BTree::insert(std::string&&)", keys.size(), [&] {
+            for (std::string& key : owned)
+                tree.insert(std::move(key));
+        });
+    }
+    {
+        btree::BTree<std::string, ORDER> tree;
+        report("BTree::emplace(const char*, size_t)", keys.size(), [&] {
+            for (const std::string& key : keys)
+                tree.emplace(key.data(), key.size());
+        });
+    }
+}
+
+int main() {
+    const size_t num_keys = 200000;
+    const std::vector<std::string> keys = make_keys(num_keys);
+
+    std::printf("Inserting %zu string keys of %zu bytes\n", num_keys, keys.front().size());
+
+    {
+        std::multiset<std::string> reference;
+        report("std::multiset::insert(const std::string&)", keys.size(), [&] {
+            for (const std::string& key : keys)
+                reference.insert(key);
+        });
+    }
+
+    run<8>(keys);
+    run<32>(keys);
+    run<64>(keys);
+    return 0;
+}
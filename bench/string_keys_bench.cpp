@@ -0,0 +1,120 @@
+/* Memory per key and insert / lookup latency for URL-like string keys: StringBTree, which keeps
+ * key bytes inside its nodes with per-node prefix compression, against BTree<std::string> and
+ * std::set<std::string>.
+ *
+ * Live heap bytes are measured through the global operator new with malloc_usable_size (glibc),
+ * so they include the std::string buffers and the allocator's rounding. Keys share long prefixes
+ * ("https://www.example.com/catalog/<category>/item-<n>"); 500k of them unless given as the
+ * first argument.
+ *
+ * g++ string_keys_bench.cpp -o string_keys_bench -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include "../string_btree.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+static size_t g_live_bytes = 0;
+
+void* operator new(std::size_t size) {
+    if (void* p = std::malloc(size)) {
+        g_live_bytes += malloc_usable_size(p);
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    const std::size_t a = static_cast<std::size_t>(alignment);
+    if (void* p = std::aligned_alloc(a, (size + a - 1) & ~(a - 1))) {
+        g_live_bytes += malloc_usable_size(p);
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+static void release(void* p) noexcept {
+    if (p == nullptr) return;
+    g_live_bytes -= malloc_usable_size(p);
+    std::free(p);
+}
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete(void* p, std::size_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { release(p); }
+
+static std::vector<std::string> make_keys(size_t n) {
+    static const char* const categories[] = {"books", "electronics", "garden", "home-and-kitchen", "toys"};
+    std::mt19937_64 rng(42);
+    std::vector<std::string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        keys.push_back(std::string("https://www.example.com/catalog/") + categories[rng() % 5] + "/item-" +
+                       std::to_string(rng() % 100000000000ull));
+    return keys;
+}
+
+template <typename Tree>
+static bool has(const Tree& tree, const std::string& key) {
+    return tree.contains(key);
+}
+
+static bool has(const std::set<std::string>& set, const std::string& key) { return set.count(key) != 0; }
+
+template <typename Tree>
+static void measure(const char* label, const std::vector<std::string>& keys, const std::vector<std::string>& probes) {
+    const size_t before = g_live_bytes;
+    Tree tree;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (const std::string& key : keys)
+        tree.insert(key);
+    std::chrono::duration<double, std::nano> insert = std::chrono::high_resolution_clock::now() - start_time;
+    const size_t bytes = g_live_bytes - before;
+
+    size_t hits = 0;
+    start_time = std::chrono::high_resolution_clock::now();
+    for (const std::string& key : probes)
+        hits += has(tree, key);
+    std::chrono::duration<double, std::nano> lookup = std::chrono::high_resolution_clock::now() - start_time;
+
+    std::printf("%-28s %8.1f bytes/key %10.1f ns/insert %10.1f ns/lookup%s\n", label,
+                static_cast<double>(bytes) / static_cast<double>(keys.size()), insert.count() / keys.size(),
+                lookup.count() / probes.size(), hits == probes.size() ? "" : "  (lookup mismatch)");
+}
+
+int main(int argc, char** argv) {
+    const size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 500000;
+
+    std::vector<std::string> keys = make_keys(num_keys);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(7));
+
+    std::vector<std::string> probes(keys);
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64(9));
+
+    size_t key_bytes = 0;
+    for (const std::string& key : keys)
+        key_bytes += key.size();
+    std::printf("%zu distinct keys, %.1f bytes on average\n\n", keys.size(),
+                static_cast<double>(key_bytes) / static_cast<double>(keys.size()));
+
+    measure<std::set<std::string>>("std::set<std::string>", keys, probes);
+    measure<btree::BTree<std::string, 64>>("BTree<std::string, 64>", keys, probes);
+    measure<btree::StringBTree<1024>>("StringBTree<1024>", keys, probes);
+    measure<btree::StringBTree<2048>>("StringBTree<2048>", keys, probes);
+    measure<btree::StringBTree<4096>>("StringBTree<4096>", keys, probes);
+    return 0;
+}
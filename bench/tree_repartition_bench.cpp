@@ -0,0 +1,107 @@
+/* Repartitioning BTrees: merge, split_at and join against reinserting the keys one by one.
+ *
+ * Two trees of N random uint64_t keys each (1M unless given as the first argument) are merged,
+ * the result is split at its median and the halves are joined again. Each step is timed next to
+ * what it replaces without these operations: inserting every key of one tree into the other, or
+ * into a new tree. Moving a tree is timed last.
+ *
+ * g++ tree_repartition_bench.cpp -o tree_repartition_bench -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+
+using Tree = btree::BTree<uint64_t, 32>;
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start_time) {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start_time;
+    return elapsed.count();
+}
+
+static size_t count_keys(Tree& tree) {
+    size_t n = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it)
+        ++n;
+    return n;
+}
+
+static Tree build(const std::vector<uint64_t>& keys) {
+    Tree tree;
+    for (uint64_t key : keys)
+        tree.insert(key);
+    return tree;
+}
+
+int main(int argc, char** argv) {
+    size_t num_keys = 1000000;
+    if (argc > 1) num_keys = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> left_keys(num_keys);
+    std::vector<uint64_t> right_keys(num_keys);
+    for (size_t i = 0; i < num_keys; ++i) {
+        left_keys[i] = rng();
+        right_keys[i] = rng();
+    }
+    std::vector<uint64_t> all_keys(left_keys);
+    all_keys.insert(all_keys.end(), right_keys.begin(), right_keys.end());
+    std::sort(all_keys.begin(), all_keys.end());
+    const uint64_t median = all_keys[all_keys.size() / 2];
+
+    std::printf("2 x %zu random uint64_t keys, ORDER 32\n\n", num_keys);
+    std::printf("%-10s %14s %14s\n", "", "operation ms", "reinsert ms");
+
+    // merge: one linear pass over both trees and a bottom-up rebuild.
+    Tree merged = build(left_keys);
+    Tree other = build(right_keys);
+    auto start_time = std::chrono::high_resolution_clock::now();
+    merged.merge(other);
+    const double merge_ms = elapsed_ms(start_time);
+
+    Tree reinserted = build(left_keys);
+    start_time = std::chrono::high_resolution_clock::now();
+    for (uint64_t key : right_keys)
+        reinserted.insert(key);
+    std::printf("%-10s %14.2f %14.2f\n", "merge", merge_ms, elapsed_ms(start_time));
+
+    // split_at: cut along one root-to-leaf path.
+    start_time = std::chrono::high_resolution_clock::now();
+    Tree upper = merged.split_at(median);
+    const double split_ms = elapsed_ms(start_time);
+
+    start_time = std::chrono::high_resolution_clock::now();
+    Tree lower_copy;
+    Tree upper_copy;
+    for (auto it = reinserted.begin(); it != reinserted.end(); ++it)
+        (it.key() < median ? lower_copy : upper_copy).insert(it.key());
+    std::printf("%-10s %14.4f %14.2f\n", "split_at", split_ms, elapsed_ms(start_time));
+
+    // join: hang the shorter tree off the spine of the taller one.
+    start_time = std::chrono::high_resolution_clock::now();
+    Tree joined = Tree::join(std::move(merged), std::move(upper));
+    const double join_ms = elapsed_ms(start_time);
+
+    start_time = std::chrono::high_resolution_clock::now();
+    for (auto it = upper_copy.begin(); it != upper_copy.end(); ++it)
+        lower_copy.insert(it.key());
+    std::printf("%-10s %14.4f %14.2f\n", "join", join_ms, elapsed_ms(start_time));
+
+    start_time = std::chrono::high_resolution_clock::now();
+    Tree moved(std::move(joined));
+    std::printf("%-10s %14.4f\n", "move", elapsed_ms(start_time));
+
+    const size_t total = count_keys(moved);
+    if (total != all_keys.size() || count_keys(lower_copy) != all_keys.size()) {
+        std::printf("key count mismatch: %zu, expected %zu\n", total, all_keys.size());
+        return 1;
+    }
+    return 0;
+}
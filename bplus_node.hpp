@@ -0,0 +1,98 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+
+#include "btree_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Node of BPlusTree, again a single cache-line aligned block:
+//
+//   leaf:      [ header | keys[2 * ORDER - 1] ]
+//   internal:  [ header | separators[2 * ORDER - 1] | childs[2 * ORDER] ]
+//
+// Every key lives in a leaf and the leaves form a doubly linked list in key order. Internal nodes
+// only route: their separators are copies of leaf keys, and child i holds keys between
+// separators i - 1 and i (inclusive on both ends, so runs of equal keys may straddle a split).
+template <typename T, size_t ORDER>
+struct BPlusNode {
+    static_assert(ORDER >= 2, "BPlusTree ORDER must be at least 2");
+    static_assert(alignof(T) <= CACHE_LINE_SIZE, "over-aligned keys are not supported");
+
+    using key_type = T;
+
+    static constexpr size_t MAX_KEYS = 2 * ORDER - 1;
+    static constexpr size_t MAX_CHILDS = 2 * ORDER;
+    static constexpr size_t MIN_KEYS = ORDER - 1;
+
+    static constexpr size_t MAX_HEIGHT = 2 + 64 / floorLog2(ORDER);
+
+    size_t keys_count_;
+    bool leaf_;
+    BPlusNode* prev_;  // neighbouring leaves, unused in internal nodes
+    BPlusNode* next_;
+
+public:
+    explicit BPlusNode(bool leaf) : keys_count_(0), leaf_(leaf), prev_(nullptr), next_(nullptr) {
+        static_assert(alignof(BPlusNode) <= CACHE_LINE_SIZE, "node header must not need more than cache line alignment");
+        static_assert(keysOffset() % alignof(T) == 0 && childsOffset() % alignof(BPlusNode*) == 0, "misaligned node arrays");
+        static_assert(internalBytes() <= blockCount(false) * CACHE_LINE_SIZE, "node does not fit its blocks");
+    }
+    ~BPlusNode() {}
+
+    BPlusNode(const BPlusNode& other) = delete;
+    BPlusNode& operator=(const BPlusNode& other) = delete;
+
+    template <typename Search, typename K, typename Compare>
+    __attribute__((always_inline)) size_t lowerBound(const K& key, const Compare& comp) const {
+        return Search::lower_bound(keys(), keys_count_, key, comp);
+    }
+
+    template <typename Search, typename K, typename Compare>
+    __attribute__((always_inline)) size_t upperBound(const K& key, const Compare& comp) const {
+        return Search::upper_bound(keys(), keys_count_, key, comp);
+    }
+
+public:
+    __attribute__((always_inline)) bool isLeaf() const noexcept { return leaf_; }
+
+    __attribute__((always_inline)) size_t size() const noexcept { return keys_count_; }
+
+    __attribute__((always_inline)) T* keys() noexcept {
+        return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) const T* keys() const noexcept {
+        return reinterpret_cast<const T*>(reinterpret_cast<const unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) BPlusNode** childs() noexcept {
+        return reinterpret_cast<BPlusNode**>(reinterpret_cast<unsigned char*>(this) + childsOffset());
+    }
+
+    __attribute__((always_inline)) BPlusNode* const* childs() const noexcept {
+        return reinterpret_cast<BPlusNode* const*>(reinterpret_cast<const unsigned char*>(this) + childsOffset());
+    }
+
+public:
+    static constexpr size_t alignUp(size_t n, size_t alignment) noexcept {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr size_t keysOffset() noexcept { return alignUp(sizeof(BPlusNode), alignof(T)); }
+
+    static constexpr size_t leafBytes() noexcept { return keysOffset() + MAX_KEYS * sizeof(T); }
+
+    static constexpr size_t childsOffset() noexcept { return alignUp(leafBytes(), alignof(BPlusNode*)); }
+
+    static constexpr size_t internalBytes() noexcept { return childsOffset() + MAX_CHILDS * sizeof(BPlusNode*); }
+
+    static constexpr size_t blockCount(bool leaf) noexcept {
+        return alignUp(leaf ? leafBytes() : internalBytes(), CACHE_LINE_SIZE) / CACHE_LINE_SIZE;
+    }
+};
+
+}  // namespace btree
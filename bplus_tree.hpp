@@ -0,0 +1,531 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "bplus_node.hpp"
+#include "btree_iterator.hpp"
+#include "btree_search.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+template <typename T, size_t ORDER, typename Alloc, typename Search>
+class BPlusTree;
+
+// Cursor over the leaf chain: a leaf and a slot in it. Stepping never touches internal nodes.
+// The end iterator keeps the last leaf so that --end() is O(1) as well.
+template <typename Node>
+class BPlusIterator {
+public:
+    using key_type = typename Node::key_type;
+
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = key_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const key_type*;
+    using reference = const key_type&;
+
+private:
+    Node* node_;
+    size_t index_;
+    Node* tail_;
+
+    template <typename, size_t, typename, typename>
+    friend class BPlusTree;
+
+    BPlusIterator(Node* node, size_t index, Node* tail) noexcept : node_(node), index_(index), tail_(tail) {}
+
+public:
+    BPlusIterator() noexcept : node_(nullptr), index_(0), tail_(nullptr) {}
+
+public:
+    reference operator*() const noexcept { return node_->keys()[index_]; }
+
+    pointer operator->() const noexcept { return &node_->keys()[index_]; }
+
+    const key_type& key() const noexcept { return node_->keys()[index_]; }
+
+    BPlusIterator& operator++() noexcept {
+        if (++index_ == node_->keys_count_) {
+            node_ = node_->next_;
+            index_ = 0;
+        }
+        return *this;
+    }
+
+    BPlusIterator operator++(int) noexcept {
+        BPlusIterator tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    BPlusIterator& operator--() noexcept {
+        if (node_ == nullptr) {
+            node_ = tail_;
+            index_ = tail_->keys_count_;
+        } else if (index_ == 0) {
+            node_ = node_->prev_;
+            index_ = node_->keys_count_;
+        }
+        --index_;
+        return *this;
+    }
+
+    BPlusIterator operator--(int) noexcept {
+        BPlusIterator tmp(*this);
+        --*this;
+        return tmp;
+    }
+
+    friend bool operator==(const BPlusIterator& lhs, const BPlusIterator& rhs) noexcept {
+        return lhs.node_ == rhs.node_ && lhs.index_ == rhs.index_;
+    }
+
+    friend bool operator!=(const BPlusIterator& lhs, const BPlusIterator& rhs) noexcept { return !(lhs == rhs); }
+
+public:
+    Node* node() const noexcept { return node_; }
+
+    size_t index() const noexcept { return index_; }
+};
+
+// B+-tree flavour of BTree for scan-heavy workloads. Same interface for the operations both
+// offer (multiset semantics, insert/emplace, erase, find, bounds, ranges, traverse), but all keys
+// sit in chained leaves, so in-order scans and range queries walk leaf memory only.
+template <typename T, size_t ORDER, typename Alloc = std::allocator<T>, typename Search = default_search>
+class BPlusTree {
+    using BNode = BPlusNode<T, ORDER>;
+
+    typedef std::allocator_traits<Alloc> alloc_traits;
+    using BlockAllocator = typename alloc_traits::template rebind_alloc<CacheLine>;
+    using KeysAllocator = typename alloc_traits::template rebind_alloc<T>;
+
+    static constexpr bool DROP_WITHOUT_WALK =
+        IsMonotonicAllocator<Alloc>::value && std::is_trivially_destructible<T>::value;
+
+public:
+    using key_type = T;
+    using key_compare = std::less<T>;
+    using allocator_type = Alloc;
+    using size_type = size_t;
+
+    using iterator = BPlusIterator<BNode>;
+    using const_iterator = iterator;
+
+private:
+    // One step of a root-to-leaf path: the node and the child that was descended into.
+    struct Frame {
+        BNode* node_;
+        size_t index_;
+    };
+
+private:
+    BlockAllocator block_alloc_;
+    KeysAllocator keys_alloc_;
+    std::less<T> comp_;
+    BNode* root_;
+    BNode* head_;  // first and last leaf of the chain
+    BNode* tail_;
+
+public:
+    explicit BPlusTree(const Alloc& alloc = Alloc())
+        : block_alloc_(BlockAllocator(alloc)), keys_alloc_(KeysAllocator(alloc)), root_(createNode(true)) {
+        head_ = tail_ = root_;
+    }
+
+    ~BPlusTree() { clear(root_); }
+
+    BPlusTree(const BPlusTree& other) = delete;
+    BPlusTree(BPlusTree&& other) = delete;
+
+    BPlusTree& operator=(const BPlusTree& other) = delete;
+    BPlusTree& operator=(BPlusTree&& other) = delete;
+
+public:
+    iterator begin() const noexcept { return head_->keys_count_ == 0 ? end() : iterator(head_, 0, tail_); }
+
+    iterator end() const noexcept { return iterator(nullptr, 0, tail_); }
+
+    bool empty() const noexcept { return root_->keys_count_ == 0; }
+
+    key_compare key_comp() const { return comp_; }
+
+    // In-order walk over the leaf chain.
+    template <typename U>
+    void traverse(U& u = U()) const {
+        for (BNode* leaf = head_; leaf != nullptr; leaf = leaf->next_) {
+            const T* keys = leaf->keys();
+            for (size_t i = 0; i < leaf->keys_count_; ++i)
+                u(keys[i]);
+        }
+    }
+
+    iterator lower_bound(const T& key) const { return bound<false>(key); }
+
+    iterator upper_bound(const T& key) const { return bound<true>(key); }
+
+    std::pair<iterator, iterator> equal_range(const T& key) const { return {lower_bound(key), upper_bound(key)}; }
+
+    iterator find(const T& key) const {
+        iterator it = lower_bound(key);
+        return (it != end() && !comp_(key, *it)) ? it : end();
+    }
+
+    bool contains(const T& key) const { return find(key) != end(); }
+
+    // Keys in [lo, hi).
+    BTreeRange<iterator> range(const T& lo, const T& hi) const {
+        if (!comp_(lo, hi)) return {end(), end()};
+        return {lower_bound(lo), lower_bound(hi)};
+    }
+
+public:
+    // The key is compared in place and only copied (or moved) once, into its leaf slot.
+    void insert(const T& key) {
+        insertSlot(key, [&](BNode& leaf, size_t i) { constructKey(leaf, i, key); });
+    }
+
+    void insert(T&& key) {
+        insertSlot(key, [&](BNode& leaf, size_t i) { constructKey(leaf, i, std::move(key)); });
+    }
+
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        insert(T(std::forward<Args>(args)...));
+    }
+
+    // Removes every copy of key and returns how many were removed.
+    size_t erase(const T& key) {
+        size_t removed = 0;
+        while (eraseOne(key))
+            ++removed;
+        return removed;
+    }
+
+    // Removes the key at pos, returns an iterator to the key that followed it.
+    iterator erase(const_iterator pos) {
+        Frame path[BNode::MAX_HEIGHT];
+        size_t depth = 0;
+
+        // Copies of pos's key may straddle leaves: walk the path along the chain to pos's leaf.
+        BNode* node = descend(pos.key(), path, depth);
+        while (node != pos.node_)
+            node = nextLeaf(path, depth);
+        return eraseSlot(path, depth, node, pos.index_);
+    }
+
+    void clear() {
+        BNode* empty = createNode(true);
+        clear(root_);
+        root_ = head_ = tail_ = empty;
+    }
+
+private:
+    // Separators only route: lower_bound descends left of separators equal to key, upper_bound
+    // right of them. Either way the answer is in the reached leaf or starts the next one.
+    template <bool UPPER>
+    iterator bound(const T& key) const {
+        const BNode* node = root_;
+        while (!node->leaf_) {
+            const size_t i = UPPER ? node->template upperBound<Search>(key, comp_)
+                                   : node->template lowerBound<Search>(key, comp_);
+            node = node->childs()[i];
+        }
+
+        BNode* leaf = const_cast<BNode*>(node);
+        const size_t i = UPPER ? leaf->template upperBound<Search>(key, comp_)
+                               : leaf->template lowerBound<Search>(key, comp_);
+        if (i < leaf->keys_count_) return iterator(leaf, i, tail_);
+        return iterator(leaf->next_, 0, tail_);
+    }
+
+    // Top-down insertion with preemptive splits, as in BTree: every full node met on the way
+    // down is split before it is entered, so the leaf always has room.
+    template <typename Make>
+    void insertSlot(const T& key, Make&& make) {
+        if (root_->keys_count_ == BNode::MAX_KEYS) {
+            BNode* s = createNode(false);
+            s->childs()[0] = root_;
+            root_ = s;
+            splitChild(*s, 0);
+        }
+
+        BNode* node = root_;
+        while (!node->leaf_) {
+            size_t i = node->template upperBound<Search>(key, comp_);
+            if (node->childs()[i]->keys_count_ == BNode::MAX_KEYS) {
+                splitChild(*node, i);
+                if (!comp_(key, node->keys()[i])) ++i;
+            }
+            node = node->childs()[i];
+        }
+
+        const size_t i = node->template upperBound<Search>(key, comp_);
+        relocateArray(keys_alloc_, node->keys() + i, node->keys() + i + 1, node->keys_count_ - i);
+        try {
+            make(*node, i);
+        } catch (...) {
+            relocateArray(keys_alloc_, node->keys() + i + 1, node->keys() + i, node->keys_count_ - i);
+            throw;
+        }
+        node->keys_count_ += 1;
+    }
+
+    // Splits the full child i of parent. A leaf keeps its first ORDER keys and a copy of the
+    // first key of the new right leaf becomes the separator; an internal node hands its median
+    // up, exactly as in BTree.
+    void splitChild(BNode& parent, size_t i) {
+        BNode& y = *parent.childs()[i];
+
+        if (y.leaf_) {
+            T separator(y.keys()[ORDER]);
+            BNode* z = createNode(true);
+            relocateArray(keys_alloc_, y.keys() + ORDER, z->keys(), BNode::MAX_KEYS - ORDER);
+            z->keys_count_ = BNode::MAX_KEYS - ORDER;
+            y.keys_count_ = ORDER;
+            linkAfter(y, *z);
+            insertSeparator(parent, i, std::move(separator), z);
+        } else {
+            BNode* z = createNode(false);
+            relocateArray(keys_alloc_, y.keys() + ORDER, z->keys(), BNode::MAX_KEYS - ORDER);
+            std::copy(y.childs() + ORDER, y.childs() + BNode::MAX_CHILDS, z->childs());
+            z->keys_count_ = BNode::MAX_KEYS - ORDER;
+
+            relocateArray(keys_alloc_, parent.keys() + i, parent.keys() + i + 1, parent.keys_count_ - i);
+            relocateArray(keys_alloc_, y.keys() + ORDER - 1, parent.keys() + i, 1);
+            y.keys_count_ = ORDER - 1;
+            std::copy_backward(parent.childs() + i + 1, parent.childs() + parent.keys_count_ + 1,
+                               parent.childs() + parent.keys_count_ + 2);
+            parent.childs()[i + 1] = z;
+            parent.keys_count_ += 1;
+        }
+    }
+
+    void insertSeparator(BNode& parent, size_t i, T&& separator, BNode* right) {
+        relocateArray(keys_alloc_, parent.keys() + i, parent.keys() + i + 1, parent.keys_count_ - i);
+        constructKey(parent, i, std::move(separator));
+        std::copy_backward(parent.childs() + i + 1, parent.childs() + parent.keys_count_ + 1,
+                           parent.childs() + parent.keys_count_ + 2);
+        parent.childs()[i + 1] = right;
+        parent.keys_count_ += 1;
+    }
+
+    void linkAfter(BNode& left, BNode& right) {
+        right.prev_ = &left;
+        right.next_ = left.next_;
+        if (left.next_ != nullptr)
+            left.next_->prev_ = &right;
+        else
+            tail_ = &right;
+        left.next_ = &right;
+    }
+
+private:
+    // Descends towards the first copy of key, recording the path, and returns the leaf reached.
+    BNode* descend(const T& key, Frame* path, size_t& depth) const {
+        BNode* node = root_;
+        while (!node->leaf_) {
+            const size_t i = node->template lowerBound<Search>(key, comp_);
+            path[depth++] = Frame{node, i};
+            node = node->childs()[i];
+        }
+        return node;
+    }
+
+    // Advances the path to the leaf after the one it ends in, nullptr past the last leaf.
+    BNode* nextLeaf(Frame* path, size_t& depth) const {
+        while (depth != 0 && path[depth - 1].index_ == path[depth - 1].node_->keys_count_)
+            --depth;
+        if (depth == 0) return nullptr;
+
+        Frame& f = path[depth - 1];
+        f.index_ += 1;
+        BNode* node = f.node_->childs()[f.index_];
+        while (!node->leaf_) {
+            path[depth++] = Frame{node, 0};
+            node = node->childs()[0];
+        }
+        return node;
+    }
+
+    // Removes one copy of key. Deletion works bottom-up along the recorded path: the key is taken
+    // out of its leaf and underfull nodes then borrow from or merge with a sibling, level by level.
+    bool eraseOne(const T& key) {
+        Frame path[BNode::MAX_HEIGHT];
+        size_t depth = 0;
+
+        BNode* node = descend(key, path, depth);
+        size_t i = node->template lowerBound<Search>(key, comp_);
+        if (i == node->keys_count_) {
+            // The separator followed was equal to key but the copies left of it are gone; the
+            // first candidate is the head of the next leaf.
+            node = nextLeaf(path, depth);
+            if (node == nullptr) return false;
+            i = 0;
+        }
+        if (comp_(key, node->keys()[i])) return false;
+
+        eraseSlot(path, depth, node, i);
+        return true;
+    }
+
+    // Removes slot i of leaf, reached through path[0, depth), and returns where the key that
+    // followed it ended up. Only the leaf level moves keys between leaves, so that is the one
+    // rebalance whose effect on the position is tracked.
+    iterator eraseSlot(Frame* path, size_t depth, BNode* leaf, size_t i) {
+        std::allocator_traits<KeysAllocator>::destroy(keys_alloc_, leaf->keys() + i);
+        relocateArray(keys_alloc_, leaf->keys() + i + 1, leaf->keys() + i, leaf->keys_count_ - i - 1);
+        leaf->keys_count_ -= 1;
+
+        BNode* node = leaf;
+        while (depth != 0 && node->keys_count_ < BNode::MIN_KEYS) {
+            const Frame& f = path[--depth];
+            if (node == leaf && f.index_ > 0) {
+                BNode** childs = f.node_->childs();
+                BNode* left = childs[f.index_ - 1];
+                if (left->keys_count_ > BNode::MIN_KEYS) {
+                    i += 1;
+                } else if (f.index_ == f.node_->keys_count_ || childs[f.index_ + 1]->keys_count_ <= BNode::MIN_KEYS) {
+                    i += left->keys_count_;
+                    leaf = left;
+                }
+            }
+            rebalance(*f.node_, f.index_);
+            node = f.node_;
+        }
+
+        if (!root_->leaf_ && root_->keys_count_ == 0) {
+            BNode* old = root_;
+            root_ = old->childs()[0];
+            deleteNode(old);
+        }
+        if (i == leaf->keys_count_) return iterator(leaf->next_, 0, tail_);
+        return iterator(leaf, i, tail_);
+    }
+
+    // Child c of parent is one key short.
+    void rebalance(BNode& parent, size_t c) {
+        BNode** childs = parent.childs();
+        if (c > 0 && childs[c - 1]->keys_count_ > BNode::MIN_KEYS)
+            borrowFromLeft(parent, c);
+        else if (c < parent.keys_count_ && childs[c + 1]->keys_count_ > BNode::MIN_KEYS)
+            borrowFromRight(parent, c);
+        else
+            merge(parent, c > 0 ? c - 1 : c);
+    }
+
+    void borrowFromLeft(BNode& parent, size_t c) {
+        BNode& left = *parent.childs()[c - 1];
+        BNode& node = *parent.childs()[c];
+        const size_t ln = left.keys_count_;
+        const size_t n = node.keys_count_;
+
+        relocateArray(keys_alloc_, node.keys(), node.keys() + 1, n);
+        if (node.leaf_) {
+            T separator(left.keys()[ln - 1]);
+            relocateArray(keys_alloc_, left.keys() + ln - 1, node.keys(), 1);
+            parent.keys()[c - 1] = std::move(separator);
+        } else {
+            std::copy_backward(node.childs(), node.childs() + n + 1, node.childs() + n + 2);
+            relocateArray(keys_alloc_, parent.keys() + c - 1, node.keys(), 1);
+            node.childs()[0] = left.childs()[ln];
+            relocateArray(keys_alloc_, left.keys() + ln - 1, parent.keys() + c - 1, 1);
+        }
+        left.keys_count_ = ln - 1;
+        node.keys_count_ = n + 1;
+    }
+
+    void borrowFromRight(BNode& parent, size_t c) {
+        BNode& node = *parent.childs()[c];
+        BNode& right = *parent.childs()[c + 1];
+        const size_t n = node.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        if (node.leaf_) {
+            T separator(right.keys()[1]);
+            relocateArray(keys_alloc_, right.keys(), node.keys() + n, 1);
+            parent.keys()[c] = std::move(separator);
+        } else {
+            relocateArray(keys_alloc_, parent.keys() + c, node.keys() + n, 1);
+            node.childs()[n + 1] = right.childs()[0];
+            relocateArray(keys_alloc_, right.keys(), parent.keys() + c, 1);
+            std::copy(right.childs() + 1, right.childs() + rn + 1, right.childs());
+        }
+        relocateArray(keys_alloc_, right.keys() + 1, right.keys(), rn - 1);
+        node.keys_count_ = n + 1;
+        right.keys_count_ = rn - 1;
+    }
+
+    // Folds child s + 1 of parent into child s and drops separator s. Leaves simply concatenate
+    // (the separator is only a copy); internal nodes pull the separator down between the halves.
+    void merge(BNode& parent, size_t s) {
+        BNode& left = *parent.childs()[s];
+        BNode* right = parent.childs()[s + 1];
+        const size_t ln = left.keys_count_;
+        const size_t rn = right->keys_count_;
+
+        if (left.leaf_) {
+            relocateArray(keys_alloc_, right->keys(), left.keys() + ln, rn);
+            std::allocator_traits<KeysAllocator>::destroy(keys_alloc_, parent.keys() + s);
+            left.keys_count_ = ln + rn;
+
+            left.next_ = right->next_;
+            if (right->next_ != nullptr)
+                right->next_->prev_ = &left;
+            else
+                tail_ = &left;
+        } else {
+            relocateArray(keys_alloc_, parent.keys() + s, left.keys() + ln, 1);
+            relocateArray(keys_alloc_, right->keys(), left.keys() + ln + 1, rn);
+            std::copy(right->childs(), right->childs() + rn + 1, left.childs() + ln + 1);
+            left.keys_count_ = ln + 1 + rn;
+        }
+
+        relocateArray(keys_alloc_, parent.keys() + s + 1, parent.keys() + s, parent.keys_count_ - s - 1);
+        std::copy(parent.childs() + s + 2, parent.childs() + parent.keys_count_ + 1, parent.childs() + s + 1);
+        parent.keys_count_ -= 1;
+
+        right->keys_count_ = 0;
+        deleteNode(right);
+    }
+
+private:
+    template <typename... Args>
+    void constructKey(BNode& node, size_t i, Args&&... args) {
+        std::allocator_traits<KeysAllocator>::construct(keys_alloc_, node.keys() + i, std::forward<Args>(args)...);
+    }
+
+    BNode* createNode(bool isLeaf) {
+        const size_t blocks = BNode::blockCount(isLeaf);
+        CacheLine* block = std::allocator_traits<BlockAllocator>::allocate(block_alloc_, blocks);
+        return ::new (static_cast<void*>(block)) BNode(isLeaf);
+    }
+
+    void deleteNode(BNode* node) {
+        for (size_t i = 0; i < node->keys_count_; ++i)
+            std::allocator_traits<KeysAllocator>::destroy(keys_alloc_, node->keys() + i);
+
+        const size_t blocks = BNode::blockCount(node->isLeaf());
+        node->~BNode();
+        std::allocator_traits<BlockAllocator>::deallocate(block_alloc_, reinterpret_cast<CacheLine*>(node), blocks);
+    }
+
+    void clear(BNode* node) {
+        if constexpr (DROP_WITHOUT_WALK) return;
+        if (!node) return;
+        if (!node->isLeaf()) {
+            for (size_t i = 0; i <= node->size(); ++i)
+                clear(node->childs()[i]);
+        }
+        deleteNode(node);
+    }
+};
+
+}  // namespace btree
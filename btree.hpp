@@ -1,161 +1,544 @@
-#pragma once
-
-#include <iostream>
-#include <memory>
-
-#include "btree_node.hpp"
-
-namespace btree {
-
-using std::size_t;
-
-template <typename T, size_t ORDER, typename Alloc = std::allocator<T>>
-class BTree {
-    using BNode = BTreeNode<T, ORDER, Alloc>;
-
-    typedef std::allocator_traits<Alloc> alloc_traits;
-    using NodeAllocator = typename alloc_traits::template rebind_alloc<BNode>;
-    using KeysAllocator = typename alloc_traits::template rebind_alloc<T>;
-    using ChildsAllocator = typename alloc_traits::template rebind_alloc<BNode*>;
-
-private:
-    NodeAllocator node_alloc_;
-    KeysAllocator keys_alloc_;
-    ChildsAllocator childs_alloc_;
-    BNode* root_;
-
-public:
-    explicit BTree(const Alloc& alloc = Alloc())
-        : node_alloc_(NodeAllocator(alloc))
-        , keys_alloc_(KeysAllocator(alloc))
-        , childs_alloc_(ChildsAllocator(alloc))
-        , root_(createNode(true)) {}
-
-public:
-    BTree(const BTree& other) = delete;
-    BTree(BTree&& other) = delete;
-
-public:
-    BTree& operator=(const BTree& other) = delete;
-    BTree& operator=(BTree&& other) = delete;
-
-public:
-    ~BTree() { clear(root_); }
-
-public:
-    template <typename U>
-    void traverse(U& u = U()) {
-        if (root_ != nullptr) root_->traverse(u);
-    }
-
-    BNode* search(T key) { return (root_ == nullptr) ? nullptr : root_->search(key); }
-
-    void insert(T key) {
-        if (root_ == nullptr) {
-            root_ = createNode(true);
-            root_->keys_[0] = key;
-            root_->keys_count_ = 1;
-        } else {
-            if (root_->keys_count_ == 2 * ORDER - 1) {
-                BNode* s = createNode(false);
-                s->childs_[0] = root_;
-                splitChild(*s, 0, *root_);
-                size_t i = 0;
-
-                if (s->keys_[0] < key) i++;
-
-                insertNonFull(*s->childs_[i], key);
-                root_ = s;
-            } else
-                insertNonFull(*root_, key);
-        }
-    }
-
-private:
-    void insertNonFull(BNode& node, T key) {
-        int i = static_cast<int>(node.keys_count_) - 1;
-
-        if (node.leaf_) {
-            while (i >= 0 && node.keys_[i] > key) {
-                node.keys_[i + 1] = node.keys_[i];
-                --i;
-            }
-
-            node.keys_[i + 1] = key;
-            node.keys_count_ += 1;
-        } else {
-            while (i >= 0 && node.keys_[i] > key)
-                --i;
-
-            if (node.childs_[i + 1]->keys_count_ == 2 * ORDER - 1) {
-                splitChild(node, i + 1, *node.childs_[i + 1]);
-
-                if (node.keys_[i + 1] < key) i++;
-            }
-            insertNonFull(*node.childs_[i + 1], key);
-        }
-    }
-
-    void splitChild(BNode& node, size_t i, BNode& y) {
-        BNode* z = createNode(y.leaf_);
-        z->keys_count_ = ORDER - 1;
-
-        // fill node
-        for (size_t j = 0; j < ORDER - 1; j++)
-            z->keys_[j] = y.keys_[j + ORDER];
-
-        if (!y.leaf_) {
-            for (size_t j = 0; j < ORDER; j++)
-                z->childs_[j] = y.childs_[j + ORDER];
-        }
-
-        y.keys_count_ = ORDER - 1;
-
-        for (int j = node.keys_count_; j >= static_cast<int>(i + 1); j--)
-            node.childs_[j + 1] = node.childs_[j];
-
-        node.childs_[i + 1] = z;
-
-        for (int j = static_cast<int>(node.keys_count_); j > static_cast<int>(i); j--)
-            node.keys_[j] = node.keys_[j - 1];
-
-        node.keys_[i] = y.keys_[ORDER - 1];
-        node.keys_count_ += 1;
-    }
-
-private:
-    BNode* createNode(bool isLeaf) {
-        BNode* node = std::allocator_traits<NodeAllocator>::allocate(node_alloc_, 1);
-
-        T* keys = std::allocator_traits<KeysAllocator>::allocate(keys_alloc_, 2 * ORDER - 1);
-        for (size_t i = 0; i < 2 * ORDER - 1; ++i)
-            std::allocator_traits<KeysAllocator>::construct(keys_alloc_, &keys[i]);
-
-        BNode** childs = std::allocator_traits<ChildsAllocator>::allocate(childs_alloc_, 2 * ORDER);
-
-        std::allocator_traits<NodeAllocator>::construct(node_alloc_, node, isLeaf, keys, childs);
-        return node;
-    }
-
-    void deleteNode(BNode* node) {
-        for (size_t i = 0; i < node->keys_count_; ++i)
-            std::allocator_traits<KeysAllocator>::destroy(keys_alloc_, node->keys_ + i);
-        std::allocator_traits<KeysAllocator>::deallocate(keys_alloc_, node->keys_, 2 * ORDER - 1);
-
-        std::allocator_traits<ChildsAllocator>::deallocate(childs_alloc_, node->childs_, 2 * ORDER);
-
-        std::allocator_traits<NodeAllocator>::destroy(node_alloc_, node);
-        std::allocator_traits<NodeAllocator>::deallocate(node_alloc_, node, 1);
-    }
-
-    void clear(BNode* node) {
-        if (!node) return;
-        if (!node->isLeaf()) {
-            for (size_t i = 0; i <= node->size(); ++i)
-                clear(node->childs_[i]);
-        }
-        deleteNode(node);
-    }
-};
-
-}  // namespace btree
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "btree_base.hpp"
+#include "btree_duplicates.hpp"
+#include "btree_serialize.hpp"
+#include "btree_stats.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Stats picks what the tree records besides its shape (see btree_stats.hpp): nothing by default,
+// collect_stats<> for split/merge counts and sampled search/insert latencies. Duplicates picks
+// what happens to repeated keys (see btree_duplicates.hpp): multi_keys keeps every copy in its
+// own slot, unique_keys drops repeats and counted_keys<> keeps one slot per key with a counter.
+// A counted tree's iterators visit each distinct key once, as a (key, count) pair; they are all
+// const, so a count only changes through insert and erase.
+template <typename T, size_t ORDER, typename Alloc = std::allocator<T>, typename Search = default_search,
+          typename Stats = no_stats, typename Duplicates = multi_keys>
+class BTree : public BTreeBase<T, typename Duplicates::count_type, ORDER, std::less<T>, Alloc, Search, Stats> {
+    using Base = BTreeBase<T, typename Duplicates::count_type, ORDER, std::less<T>, Alloc, Search, Stats>;
+    using BNode = typename Base::BNode;
+    using Count = typename Duplicates::count_type;
+    using Entry = typename Base::Entry;
+
+    static_assert(!Duplicates::COUNTED || std::is_unsigned<Count>::value, "counted_keys needs an unsigned count type");
+
+public:
+    using typename Base::const_iterator;
+    using iterator = std::conditional_t<Duplicates::COUNTED, const_iterator, typename Base::iterator>;
+
+public:
+    explicit BTree(const Alloc& alloc = Alloc()) : Base(std::less<T>(), alloc) {}
+
+    // Builds the tree from the sorted range [first, last), see bulk_load.
+    template <typename InputIt>
+    BTree(InputIt first, InputIt last, double fill = 1.0, const Alloc& alloc = Alloc())
+        : Base(std::less<T>(), alloc) {
+        bulk_load(first, last, fill);
+    }
+
+    // Trees move in O(1) (see BTreeBase's move operations) and so can be returned and kept in
+    // containers; copying is not offered.
+    BTree(BTree&& other) noexcept = default;
+    BTree& operator=(BTree&& other) = default;
+
+public:
+    void swap(BTree& other) noexcept { this->swapWith(other); }
+
+    friend void swap(BTree& lhs, BTree& rhs) noexcept { lhs.swap(rhs); }
+
+    // Moves every key of other into this tree and leaves other empty. The two in-order sequences
+    // are merged in one pass and packed bottom-up (fill as for bulk_load): O(n + m), where
+    // inserting other's keys one at a time costs O(m log(n + m)). Repeats follow the Duplicates
+    // policy: multi trees keep all copies, unique trees keep this tree's and counted trees add
+    // the counts up.
+    void merge(BTree& other, double fill = 1.0) {
+        this->template mergeWith<Duplicates::UNIQUE>(other, fill, [](auto& kept, auto& dropped) {
+            if constexpr (Duplicates::COUNTED) {
+                if (kept.value_ > std::numeric_limits<Count>::max() - dropped.value_)
+                    throw std::overflow_error("BTree counted_keys: count overflow");
+                kept.value_ += dropped.value_;
+            }
+        });
+    }
+
+    // Cuts the tree at key and returns the keys not less than it as a new tree. Only the nodes
+    // on the path to key are split and rejoined, O(log n); all others change trees as they are.
+    BTree split_at(const T& key) {
+        BTree upper(this->get_allocator());
+        this->splitOff(key, upper);
+        return upper;
+    }
+
+    // Concatenates two trees whose key ranges do not overlap: every key of left is below every
+    // key of right, or not above it in multi trees. The shorter tree is hung off the facing spine
+    // of the taller one, O(log n). Throws std::invalid_argument when the ranges overlap. Trees
+    // with unequal allocators cannot hand nodes over and are merged instead.
+    static BTree join(BTree left, BTree right) {
+        if (!left.empty() && !right.empty()) {
+            const T& last = std::prev(left.end()).key();
+            const T& first = right.begin().key();
+            if (Duplicates::UNIQUE ? !left.comp_(last, first) : left.comp_(first, last))
+                throw std::invalid_argument("BTree::join: key ranges overlap");
+        }
+        if (left.get_allocator() == right.get_allocator())
+            left.joinWith(right);
+        else
+            left.merge(right);
+        return left;
+    }
+
+public:
+    using Base::begin;
+    using Base::end;
+    using Base::equal_range;
+    using Base::find;
+    using Base::lower_bound;
+    using Base::range;
+    using Base::upper_bound;
+
+    iterator begin() noexcept { return Base::begin(); }
+
+    iterator end() noexcept { return Base::end(); }
+
+    iterator find(const T& key) { return Base::find(key); }
+
+    iterator lower_bound(const T& key) { return Base::lower_bound(key); }
+
+    iterator upper_bound(const T& key) { return Base::upper_bound(key); }
+
+    std::pair<iterator, iterator> equal_range(const T& key) { return {lower_bound(key), upper_bound(key)}; }
+
+    BTreeRange<iterator> range(const T& lo, const T& hi) {
+        if (!this->comp_(lo, hi)) return {end(), end()};
+        return {lower_bound(lo), lower_bound(hi)};
+    }
+
+public:
+    // In-order walk; a counted key is passed once per copy.
+    template <typename U>
+    void traverse(U& u = U()) {
+        this->forEachSlot([&u](BNode* node, size_t i) { visitSlot(u, node, i); });
+    }
+
+    // traverse spread over a pool: the top levels are cut into a few subtrees per thread (see
+    // BTreeBase::partition), which the threads walk and steal from each other. f is called
+    // concurrently and in no particular order.
+    template <typename F>
+    void parallel_for_each(F&& f, WorkStealingPool& pool) const {
+        const auto pieces = this->partition(pool.size() * Base::PARALLEL_PIECES_PER_THREAD);
+        pool.run(pieces.size(), [&](size_t p) {
+            Base::forEachSlotIn(pieces[p], [&f](BNode* node, size_t i) { visitSlot(f, node, i); });
+        });
+    }
+
+    // threads as for WorkStealingPool; the pool lives for this call only.
+    template <typename F>
+    void parallel_for_each(F&& f, size_t threads = 0) const {
+        WorkStealingPool pool(threads);
+        parallel_for_each(std::forward<F>(f), pool);
+    }
+
+    // Aggregates the keys in parallel: every piece of the partition is walked into its own copy
+    // of init, called like a traverse functor, and the results are folded left to right with
+    // combine(U& total, U&& part) in key order. init is copied once per piece, so it should be
+    // empty, e.g. a fresh TraverseCounter.
+    template <typename U, typename Combine>
+    U parallel_reduce(const U& init, Combine&& combine, WorkStealingPool& pool) const {
+        const auto pieces = this->partition(pool.size() * Base::PARALLEL_PIECES_PER_THREAD);
+        if (pieces.empty()) return init;
+
+        std::vector<U> parts(pieces.size(), init);
+        pool.run(pieces.size(), [&](size_t p) {
+            // Folded into a local first: neighbouring parts share cache lines.
+            U part(init);
+            Base::forEachSlotIn(pieces[p], [&part](BNode* node, size_t i) { visitSlot(part, node, i); });
+            parts[p] = std::move(part);
+        });
+
+        U total(std::move(parts[0]));
+        for (size_t p = 1; p < parts.size(); ++p)
+            combine(total, std::move(parts[p]));
+        return total;
+    }
+
+    template <typename U, typename Combine>
+    U parallel_reduce(const U& init, Combine&& combine, size_t threads = 0) const {
+        WorkStealingPool pool(threads);
+        return parallel_reduce(init, std::forward<Combine>(combine), pool);
+    }
+
+    BNode* search(const T& key) {
+        [[maybe_unused]] const auto timer = this->stats_.timeSearch();
+        return (this->root_ == nullptr) ? nullptr : this->root_->template search<Search>(key, this->comp_);
+    }
+
+    // The key is compared in place and only copied (or moved) once, into its final slot.
+    // Returns whether a slot was taken: always under multi_keys, only for a new key otherwise
+    // (a counted repeat bumps the counter instead, throwing std::overflow_error when it is full).
+    bool insert(const T& key) {
+        [[maybe_unused]] const auto timer = this->stats_.timeInsert();
+        return insertKey(key, [&](BNode& node, size_t i) { this->constructKey(node, i, key); });
+    }
+
+    bool insert(T&& key) {
+        [[maybe_unused]] const auto timer = this->stats_.timeInsert();
+        return insertKey(key, [&](BNode& node, size_t i) { this->constructKey(node, i, std::move(key)); });
+    }
+
+    // Inserts count keys in one go. They are sorted first, then every descent fills all of its
+    // leaf's share of the batch with a single merge (see insertSorted). Unique and counted trees
+    // insert the sorted keys one by one, which still walks the tree in order.
+    void insert_batch(const T* keys, size_t count) {
+        std::vector<T> sorted(keys, keys + count);
+        std::sort(sorted.begin(), sorted.end(), this->comp_);
+        if constexpr (Duplicates::UNIQUE) {
+            for (T& key : sorted)
+                insert(std::move(key));
+        } else {
+            this->insertSorted(sorted.data(), sorted.size());
+        }
+    }
+
+    // Sets found[j] to whether keys[j] is present and returns the number of hits. The lookups are
+    // sorted and interleaved with prefetching (see findBatch), which pays off once the tree no
+    // longer fits in cache.
+    size_t search_batch(const T* keys, size_t count, bool* found) const {
+        size_t hits = 0;
+        this->findBatch(keys, count, [&](size_t j, const BNode* node, size_t) {
+            found[j] = node != nullptr;
+            hits += found[j];
+        });
+        return hits;
+    }
+
+    // The key has to exist before its position is known, so it is built once here and then
+    // moved into the slot.
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        insert(T(std::forward<Args>(args)...));
+    }
+
+    // Replaces the contents with the keys of [first, last), which must be sorted. Nodes are
+    // packed bottom-up in O(n) instead of descending and splitting per key. fill (0, 1] is the
+    // share of each node's key capacity to use; anything below half a node is raised to the
+    // B-tree minimum. Leave headroom when the tree will keep taking inserts.
+    template <typename InputIt>
+    void bulk_load(InputIt first, InputIt last, double fill = 1.0) {
+        using Category = typename std::iterator_traits<InputIt>::iterator_category;
+        if constexpr (Duplicates::UNIQUE) {
+            std::vector<T> keys(first, last);
+            buildRuns(keys, fill);
+        } else if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value) {
+            const size_t n = static_cast<size_t>(std::distance(first, last));
+            this->buildSorted(n, fill, [&](BNode& node, size_t i) {
+                this->constructKey(node, i, *first);
+                ++first;
+            });
+        } else {
+            std::vector<T> keys(first, last);
+            bulk_load(std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.end()), fill);
+        }
+    }
+
+    // bulk_load for input in any order: the keys are gathered and sorted first.
+    template <typename InputIt>
+    void bulk_load_unsorted(InputIt first, InputIt last, double fill = 1.0) {
+        std::vector<T> keys(first, last);
+        std::sort(keys.begin(), keys.end(), this->comp_);
+        bulk_load(std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.end()), fill);
+    }
+
+    // bulk_load_unsorted spread over a pool. The keys are sorted in one chunk per thread and the
+    // chunks merged pairwise, then the tree is built in one run per thread that are joined at the
+    // end (see BTreeBase::buildSortedParallel). Nodes are allocated from several threads at
+    // once, so the allocator must allow that (std::allocator does, the custom list heap does not).
+    template <typename InputIt>
+    void parallel_build(InputIt first, InputIt last, WorkStealingPool& pool, double fill = 1.0) {
+        std::vector<T> keys(first, last);
+        sortParallel(keys, pool);
+        if constexpr (Duplicates::UNIQUE) {
+            const std::vector<size_t> ends = runEnds(keys);
+            this->buildSortedParallel(
+                ends.size(), fill, pool,
+                [&](BNode& node, size_t i, size_t run) {
+                    const size_t begin = run == 0 ? 0 : ends[run - 1];
+                    this->constructKey(node, i, std::move(keys[begin]));
+                    if constexpr (Duplicates::COUNTED) this->constructValue(node, i, static_cast<Count>(ends[run] - begin));
+                },
+                [&](size_t run) {
+                    const size_t begin = run == 0 ? 0 : ends[run - 1];
+                    if constexpr (Duplicates::COUNTED)
+                        return Entry{std::move(keys[begin]), static_cast<Count>(ends[run] - begin)};
+                    else
+                        return Entry{std::move(keys[begin])};
+                });
+        } else {
+            this->buildSortedParallel(
+                keys.size(), fill, pool,
+                [&](BNode& node, size_t i, size_t k) { this->constructKey(node, i, std::move(keys[k])); },
+                [&](size_t k) { return Entry{std::move(keys[k])}; });
+        }
+    }
+
+    // threads as for WorkStealingPool; the pool lives for this call only.
+    template <typename InputIt>
+    void parallel_build(InputIt first, InputIt last, size_t threads = 0, double fill = 1.0) {
+        WorkStealingPool pool(threads);
+        parallel_build(first, last, pool, fill);
+    }
+
+    // Writes a snapshot of the keys (see btree_serialize.hpp) to a stream, or appends it to a
+    // byte vector. Throws std::runtime_error when the stream fails.
+    void save(std::ostream& os) const {
+        SnapshotWriter writer(os);
+        saveTo(writer);
+    }
+
+    void save(std::vector<unsigned char>& buffer) const {
+        SnapshotWriter writer(buffer);
+        saveTo(writer);
+    }
+
+    // Replaces the contents with a snapshot written by save, streamed straight into a bottom-up
+    // build (see bulk_load). Throws std::runtime_error for a snapshot of another key type, format
+    // version or byte order, for truncated input and for a checksum mismatch. Problems spotted
+    // before the first key is read leave the tree as it was, later ones leave it empty. Unique
+    // and counted trees read the whole snapshot before building, so they always keep their keys.
+    void load(std::istream& is, double fill = 1.0) {
+        SnapshotReader reader(is);
+        loadFrom(reader, fill);
+    }
+
+    void load(const unsigned char* data, size_t size, double fill = 1.0) {
+        SnapshotReader reader(data, size);
+        loadFrom(reader, fill);
+    }
+
+    // Copies of key held by the tree.
+    size_t count(const T& key) const {
+        if constexpr (Duplicates::COUNTED) {
+            const auto it = this->find(key);
+            return it == this->end() ? 0 : static_cast<size_t>((*it).second);
+        } else if constexpr (Duplicates::UNIQUE) {
+            return this->contains(key) ? 1 : 0;
+        } else {
+            const auto range = this->equal_range(key);
+            return static_cast<size_t>(std::distance(range.first, range.second));
+        }
+    }
+
+    // Removes the key at pos, returns an iterator to the key that followed it. A counted key
+    // with copies left only loses one, and pos then still addresses the next copy.
+    iterator erase(const_iterator pos) {
+        if constexpr (Duplicates::COUNTED) {
+            Count& copies = pos.node()->values()[pos.index()];
+            if (copies > 1) {
+                copies -= 1;
+                return pos;
+            }
+        }
+        return Base::erase(pos);
+    }
+
+    // Removes every copy of key and returns how many were removed.
+    size_t erase(const T& key) {
+        if constexpr (Duplicates::COUNTED) {
+            const size_t removed = count(key);
+            if (removed > 0) this->eraseOne(key);
+            return removed;
+        } else {
+            size_t removed = 0;
+            while (this->eraseOne(key))
+                ++removed;
+            return removed;
+        }
+    }
+
+    // Removes a single copy of key; a counted key only loses its slot with its last copy.
+    bool erase_one(const T& key) {
+        if constexpr (Duplicates::COUNTED) {
+            const const_iterator it = find(key);
+            if (it == end()) return false;
+            Count& copies = it.node()->values()[it.index()];
+            if (copies > 1) {
+                copies -= 1;
+                return true;
+            }
+        }
+        return this->eraseOne(key);
+    }
+
+private:
+    template <typename Make>
+    bool insertKey(const T& key, Make&& make) {
+        if constexpr (Duplicates::COUNTED) {
+            const auto res = this->template insertSlot<true>(this->root_, key, [&](BNode& node, size_t i) {
+                make(node, i);
+                this->constructValue(node, i, Count(1));
+            });
+            if (!res.second) {
+                Count& copies = res.first.node_->values()[res.first.index_];
+                if (copies == std::numeric_limits<Count>::max())
+                    throw std::overflow_error("BTree counted_keys: count overflow");
+                copies += 1;
+            }
+            return res.second;
+        } else {
+            return this->template insertSlot<Duplicates::UNIQUE>(this->root_, key, std::forward<Make>(make)).second;
+        }
+    }
+
+    // bulk_load for unique and counted trees: one slot per run of equivalent keys in the sorted
+    // keys, holding the run's length when counted.
+    void buildRuns(std::vector<T>& keys, double fill) {
+        const std::vector<size_t> ends = runEnds(keys);
+        size_t run = 0;
+        this->buildSorted(ends.size(), fill, [&](BNode& node, size_t i) {
+            const size_t begin = run == 0 ? 0 : ends[run - 1];
+            this->constructKey(node, i, std::move(keys[begin]));
+            if constexpr (Duplicates::COUNTED) this->constructValue(node, i, static_cast<Count>(ends[run] - begin));
+            ++run;
+        });
+    }
+
+    // Where each run of equivalent keys in the sorted keys ends. Throws std::overflow_error for a
+    // run too long to count.
+    std::vector<size_t> runEnds(const std::vector<T>& keys) const {
+        std::vector<size_t> ends;
+        for (size_t j = 0; j < keys.size(); ++j) {
+            if (j + 1 < keys.size() && !this->comp_(keys[j], keys[j + 1])) continue;
+            if constexpr (Duplicates::COUNTED) {
+                const size_t begin = ends.empty() ? 0 : ends.back();
+                if (j + 1 - begin > std::numeric_limits<Count>::max())
+                    throw std::overflow_error("BTree counted_keys: count overflow");
+            }
+            ends.push_back(j + 1);
+        }
+        return ends;
+    }
+
+    // Sorts one chunk per thread, then merges neighbouring chunks pairwise, each round in parallel.
+    void sortParallel(std::vector<T>& keys, WorkStealingPool& pool) const {
+        const size_t chunks = std::max<size_t>(1, std::min(pool.size(), keys.size() / Base::PARALLEL_RUN_ENTRIES));
+        std::vector<size_t> bounds(chunks + 1);
+        for (size_t c = 0; c <= chunks; ++c)
+            bounds[c] = keys.size() * c / chunks;
+
+        const auto at = [&keys](size_t k) { return keys.begin() + static_cast<std::ptrdiff_t>(k); };
+        pool.run(chunks, [&](size_t c) { std::sort(at(bounds[c]), at(bounds[c + 1]), this->comp_); });
+        for (size_t width = 1; width < chunks; width *= 2) {
+            pool.run((chunks + 2 * width - 1) / (2 * width), [&](size_t m) {
+                const size_t lo = 2 * width * m;
+                const size_t mid = std::min(lo + width, chunks);
+                const size_t hi = std::min(lo + 2 * width, chunks);
+                std::inplace_merge(at(bounds[lo]), at(bounds[mid]), at(bounds[hi]), this->comp_);
+            });
+        }
+    }
+
+    template <typename U>
+    __attribute__((always_inline)) static void visitSlot(U& u, BNode* node, size_t i) {
+        if constexpr (Duplicates::COUNTED) {
+            for (Count c = node->values()[i]; c > 0; --c)
+                u(node->keys()[i]);
+        } else {
+            u(node->keys()[i]);
+        }
+    }
+
+    // Counted keys are written once per copy, so a snapshot loads into a tree of any policy.
+    void saveTo(SnapshotWriter& writer) const {
+        size_t n = 0;
+        this->forEachSlot([&n](BNode* node, size_t i) {
+            if constexpr (Duplicates::COUNTED)
+                n += node->values()[i];
+            else
+                ++n;
+        });
+
+        const SnapshotHeader header = makeSnapshotHeader<T>(ORDER, n);
+        if (std::is_trivially_copyable<T>::value) writer.reserve(sizeof(header) + n * sizeof(T) + sizeof(uint64_t));
+        writer.write(&header, sizeof(header));
+        this->forEachSlot([&writer](BNode* node, size_t i) {
+            size_t copies = 1;
+            if constexpr (Duplicates::COUNTED) copies = node->values()[i];
+            for (; copies > 0; --copies) {
+                if constexpr (std::is_trivially_copyable<T>::value)
+                    writer.write(node->keys() + i, sizeof(T));
+                else
+                    SnapshotCodec<T>::write(writer, node->keys()[i]);
+            }
+        });
+        writer.finish();
+    }
+
+    void loadFrom(SnapshotReader& reader, double fill) {
+        SnapshotHeader header;
+        reader.read(&header, sizeof(header));
+        checkSnapshotHeader<T>(header);
+        if (std::is_trivially_copyable<T>::value && header.count_ > reader.remaining() / sizeof(T))
+            throw std::runtime_error("BTree snapshot: unexpected end of input");
+
+        if constexpr (Duplicates::UNIQUE) {
+            std::vector<T> keys;
+            if (std::is_trivially_copyable<T>::value) keys.reserve(static_cast<size_t>(header.count_));
+            for (uint64_t k = 0; k < header.count_; ++k) {
+                if constexpr (std::is_trivially_copyable<T>::value) {
+                    alignas(T) unsigned char raw[sizeof(T)];
+                    reader.read(raw, sizeof(T));
+                    keys.push_back(*std::launder(reinterpret_cast<T*>(raw)));
+                } else {
+                    keys.push_back(SnapshotCodec<T>::read(reader));
+                }
+            }
+            if (!reader.finish()) throw std::runtime_error("BTree snapshot: checksum mismatch");
+            buildRuns(keys, fill);
+            return;
+        }
+
+        this->buildSorted(static_cast<size_t>(header.count_), fill, [&](BNode& node, size_t i) {
+            if constexpr (std::is_trivially_copyable<T>::value)
+                reader.read(node.keys() + i, sizeof(T));
+            else
+                this->constructKey(node, i, SnapshotCodec<T>::read(reader));
+        });
+
+        const auto reset = [this] { this->buildSorted(0, 1.0, [](BNode&, size_t) {}); };
+        bool intact;
+        try {
+            intact = reader.finish();
+        } catch (...) {
+            reset();
+            throw;
+        }
+        if (!intact) {
+            reset();
+            throw std::runtime_error("BTree snapshot: checksum mismatch");
+        }
+    }
+};
+
+// BTree with ORDER picked from the key size: the largest whose internal node fits in
+// TARGET_BYTES (see auto_order). The default of 16 cache lines was the fastest for integer
+// keys in bench/auto_order_bench.cpp.
+template <typename T, size_t TARGET_BYTES = 16 * CACHE_LINE_SIZE, typename Alloc = std::allocator<T>,
+          typename Search = default_search, typename Stats = no_stats, typename Duplicates = multi_keys>
+using AutoBTree =
+    BTree<T, auto_order<T, TARGET_BYTES, typename Duplicates::count_type>, Alloc, Search, Stats, Duplicates>;
+
+}  // namespace btree
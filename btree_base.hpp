@@ -0,0 +1,1307 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "btree_iterator.hpp"
+#include "btree_node.hpp"
+#include "btree_stats.hpp"
+#include "work_stealing_pool.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// A key (and, for maps, its value) lifted out of a node slot while the tree is restructured.
+template <typename T, typename V>
+struct NodeEntry {
+    T key_;
+    V value_;
+};
+
+template <typename T>
+struct NodeEntry<T, void> {
+    T key_;
+};
+
+// Heterogeneous lookup is only offered for comparators that opt in through is_transparent. K
+// takes part so the check stays dependent and merely removes the overload when it fails.
+template <typename Compare, typename K, typename = void>
+struct IsTransparent : std::false_type {};
+
+template <typename Compare, typename K>
+struct IsTransparent<Compare, K, std::void_t<typename Compare::is_transparent>> : std::true_type {};
+
+// Storage and rebalancing machinery shared by BTree (keys only) and BTreeMap (keys with values
+// in a parallel per-node array). Every node slot below keys_count_ holds a live key (and value),
+// everything above it is raw memory: entries are constructed in place when they become live and
+// relocated (move-construct + destroy) whenever the tree reshapes. Stats is a policy from
+// btree_stats.hpp that sees splits, merges, searches and inserts.
+template <typename T, typename V, size_t ORDER, typename Compare, typename Alloc, typename Search, typename Stats>
+class BTreeBase {
+protected:
+    using BNode = BTreeNode<T, ORDER, Alloc, V>;
+    using Entry = NodeEntry<T, V>;
+
+    static constexpr bool HAS_VALUES = !std::is_void<V>::value;
+
+    // Nothing to destroy and nothing to give back: dropped subtrees are simply forgotten.
+    static constexpr bool DROP_WITHOUT_WALK =
+        IsMonotonicAllocator<Alloc>::value && std::is_trivially_destructible<T>::value &&
+        std::is_trivially_destructible<std::conditional_t<HAS_VALUES, V, T>>::value;
+
+    // Fewest entries buildSortedParallel gives a thread, and subtrees per thread partition aims
+    // for so that stealing can even out uneven work.
+    static constexpr size_t PARALLEL_RUN_ENTRIES = size_t(1) << 14;
+    static constexpr size_t PARALLEL_PIECES_PER_THREAD = 4;
+
+    typedef std::allocator_traits<Alloc> alloc_traits;
+    using BlockAllocator = typename alloc_traits::template rebind_alloc<CacheLine>;
+    using KeysAllocator = typename alloc_traits::template rebind_alloc<T>;
+    using ValuesAllocator = typename alloc_traits::template rebind_alloc<std::conditional_t<HAS_VALUES, V, T>>;
+
+public:
+    using key_type = T;
+    using key_compare = Compare;
+    using allocator_type = Alloc;
+    using size_type = size_t;
+
+    using iterator = BTreeIterator<BNode, !HAS_VALUES>;
+    using const_iterator = BTreeIterator<BNode, true>;
+
+protected:
+    // Detached subtree used while splitting and joining trees; height 0 is the empty tree.
+    struct Subtree {
+        BNode* root_;
+        size_t height_;
+    };
+
+    // A stretch of the in-order sequence: a whole subtree, or the single entry i of node.
+    struct Piece {
+        BNode* node_;
+        size_t index_;
+        bool subtree_;
+    };
+
+    // Position of a live entry.
+    struct Slot {
+        BNode* node_;
+        size_t index_;
+    };
+
+    template <typename K>
+    using enable_if_transparent = std::enable_if_t<IsTransparent<Compare, K>::value, K>;
+
+protected:
+    BlockAllocator block_alloc_;
+    KeysAllocator keys_alloc_;
+    ValuesAllocator values_alloc_;
+    Compare comp_;
+    BNode* root_;
+    mutable Stats stats_;
+
+protected:
+    BTreeBase(const Compare& comp, const Alloc& alloc)
+        : block_alloc_(BlockAllocator(alloc))
+        , keys_alloc_(KeysAllocator(alloc))
+        , values_alloc_(ValuesAllocator(alloc))
+        , comp_(comp)
+        , root_(createNode(true)) {}
+
+    ~BTreeBase() { clear(root_); }
+
+public:
+    BTreeBase(const BTreeBase& other) = delete;
+    BTreeBase& operator=(const BTreeBase& other) = delete;
+
+protected:
+    // Takes over other's nodes and allocator in O(1). other is left empty, without a root node
+    // until it is used again.
+    BTreeBase(BTreeBase&& other) noexcept
+        : block_alloc_(std::move(other.block_alloc_))
+        , keys_alloc_(std::move(other.keys_alloc_))
+        , values_alloc_(std::move(other.values_alloc_))
+        , comp_(std::move(other.comp_))
+        , root_(other.root_)
+        , stats_(std::move(other.stats_)) {
+        other.root_ = nullptr;
+    }
+
+    // Allocator-aware like the standard containers: the nodes change hands in O(1) when the
+    // allocator propagates on move assignment or both allocators are equal. Otherwise this
+    // tree's allocator could not free other's nodes, so the entries are moved into a bottom-up
+    // build of new ones instead.
+    BTreeBase& operator=(BTreeBase&& other) noexcept(alloc_traits::propagate_on_container_move_assignment::value ||
+                                                     alloc_traits::is_always_equal::value) {
+        if (this == &other) return *this;
+        if constexpr (alloc_traits::propagate_on_container_move_assignment::value) {
+            clear(root_);
+            root_ = nullptr;
+            block_alloc_ = std::move(other.block_alloc_);
+            keys_alloc_ = std::move(other.keys_alloc_);
+            values_alloc_ = std::move(other.values_alloc_);
+        } else {
+            if (!(block_alloc_ == other.block_alloc_)) {
+                comp_ = other.comp_;
+                std::vector<Entry> entries = other.drainEntries();
+                rebuild(entries, 1.0);
+                return *this;
+            }
+            clear(root_);
+            root_ = nullptr;
+        }
+        comp_ = std::move(other.comp_);
+        root_ = other.root_;
+        other.root_ = nullptr;
+        stats_ = std::move(other.stats_);
+        return *this;
+    }
+
+    // Exchanges the contents in O(1). Allocators are exchanged too when they propagate on swap,
+    // and must be equal otherwise.
+    void swapWith(BTreeBase& other) noexcept {
+        using std::swap;
+        if constexpr (alloc_traits::propagate_on_container_swap::value) {
+            swap(block_alloc_, other.block_alloc_);
+            swap(keys_alloc_, other.keys_alloc_);
+            swap(values_alloc_, other.values_alloc_);
+        }
+        swap(comp_, other.comp_);
+        swap(root_, other.root_);
+        swap(stats_, other.stats_);
+    }
+
+public:
+    iterator begin() noexcept { return iterator::first(root_); }
+
+    const_iterator begin() const noexcept { return const_iterator::first(root_); }
+
+    iterator end() noexcept { return iterator::last(root_); }
+
+    const_iterator end() const noexcept { return const_iterator::last(root_); }
+
+    bool empty() const noexcept { return root_ == nullptr || root_->keys_count_ == 0; }
+
+    key_compare key_comp() const { return comp_; }
+
+    allocator_type get_allocator() const { return allocator_type(block_alloc_); }
+
+    iterator find(const T& key) {
+        [[maybe_unused]] const auto timer = stats_.timeSearch();
+        return iterator::template find<Search>(root_, key, comp_);
+    }
+
+    const_iterator find(const T& key) const {
+        [[maybe_unused]] const auto timer = stats_.timeSearch();
+        return const_iterator::template find<Search>(root_, key, comp_);
+    }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    iterator find(const K& key) {
+        [[maybe_unused]] const auto timer = stats_.timeSearch();
+        return iterator::template find<Search>(root_, key, comp_);
+    }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    const_iterator find(const K& key) const {
+        [[maybe_unused]] const auto timer = stats_.timeSearch();
+        return const_iterator::template find<Search>(root_, key, comp_);
+    }
+
+    bool contains(const T& key) const { return find(key) != end(); }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    bool contains(const K& key) const {
+        return find(key) != end();
+    }
+
+    iterator lower_bound(const T& key) { return iterator::template lowerBound<Search>(root_, key, comp_); }
+
+    const_iterator lower_bound(const T& key) const {
+        return const_iterator::template lowerBound<Search>(root_, key, comp_);
+    }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    iterator lower_bound(const K& key) {
+        return iterator::template lowerBound<Search>(root_, key, comp_);
+    }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    const_iterator lower_bound(const K& key) const {
+        return const_iterator::template lowerBound<Search>(root_, key, comp_);
+    }
+
+    iterator upper_bound(const T& key) { return iterator::template upperBound<Search>(root_, key, comp_); }
+
+    const_iterator upper_bound(const T& key) const {
+        return const_iterator::template upperBound<Search>(root_, key, comp_);
+    }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    iterator upper_bound(const K& key) {
+        return iterator::template upperBound<Search>(root_, key, comp_);
+    }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    const_iterator upper_bound(const K& key) const {
+        return const_iterator::template upperBound<Search>(root_, key, comp_);
+    }
+
+    std::pair<iterator, iterator> equal_range(const T& key) { return {lower_bound(key), upper_bound(key)}; }
+
+    std::pair<const_iterator, const_iterator> equal_range(const T& key) const {
+        return {lower_bound(key), upper_bound(key)};
+    }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    std::pair<iterator, iterator> equal_range(const K& key) {
+        return {lower_bound(key), upper_bound(key)};
+    }
+
+    template <typename K, typename = enable_if_transparent<K>>
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+        return {lower_bound(key), upper_bound(key)};
+    }
+
+    // Keys in [lo, hi). Only the two boundary paths are searched; iterating the view visits the
+    // keys of the range and nothing else, and any iterator of it can be kept to resume a scan.
+    BTreeRange<iterator> range(const T& lo, const T& hi) {
+        if (!comp_(lo, hi)) return {end(), end()};
+        return {lower_bound(lo), lower_bound(hi)};
+    }
+
+    BTreeRange<const_iterator> range(const T& lo, const T& hi) const {
+        if (!comp_(lo, hi)) return {end(), end()};
+        return {lower_bound(lo), lower_bound(hi)};
+    }
+
+    // Removes the entry at pos, returns an iterator to the entry that followed it. Entries
+    // equivalent to the removed one are told apart by how many of them came before pos.
+    iterator erase(const_iterator pos) {
+        size_t before = 0;
+        const const_iterator first = const_iterator::first(root_);
+        for (const_iterator it = pos; it != first;) {
+            --it;
+            if (comp_(it.key(), pos.key())) break;
+            ++before;
+        }
+
+        const Entry removed = eraseAt(pos);
+        iterator next = iterator::template lowerBound<Search>(root_, removed.key_, comp_);
+        for (; before > 0; --before)
+            ++next;
+        return next;
+    }
+
+    // Removes all keys in [lo, hi). The tree is cut at lo and hi, the middle part is released
+    // subtree by subtree and the two outer parts are joined back, so only the nodes on the two
+    // boundary paths are restructured and the keys inside the range are never searched.
+    void erase_range(const T& lo, const T& hi) {
+        if (!comp_(lo, hi) || empty()) return;
+
+        Subtree whole{root_, height(root_)};
+        root_ = nullptr;
+
+        Subtree left, rest, middle, right;
+        splitTree(whole, lo, left, rest);
+        splitTree(rest, hi, middle, right);
+        clear(middle.root_);
+
+        root_ = joinTrees(left, right).root_;
+        if (root_ == nullptr) root_ = createNode(true);
+    }
+
+    // Measures the shape of the tree in one walk over the nodes and adds the counters of the
+    // Stats policy, see TreeStats.
+    TreeStats stats() const {
+        TreeStats s;
+        s.order_ = ORDER;
+
+        std::vector<const BNode*> level, next;
+        if (root_ != nullptr) level.push_back(root_);
+        while (!level.empty()) {
+            s.nodes_per_level_.push_back(level.size());
+            next.clear();
+            for (const BNode* node : level) {
+                s.keys_ += node->keys_count_;
+                s.bytes_ += BNode::blockCount(node->leaf_) * CACHE_LINE_SIZE;
+                s.fill_[std::min(TreeStats::FILL_BUCKETS - 1, node->keys_count_ * TreeStats::FILL_BUCKETS / BNode::MAX_KEYS)] += 1;
+                if (!node->leaf_) next.insert(next.end(), node->childs(), node->childs() + node->keys_count_ + 1);
+            }
+            s.nodes_ += level.size();
+            level.swap(next);
+        }
+        s.height_ = s.nodes_per_level_.size();
+        if (s.nodes_ > 0) s.average_fill_ = static_cast<double>(s.keys_) / static_cast<double>(s.nodes_ * BNode::MAX_KEYS);
+
+        if constexpr (Stats::ENABLED) {
+            s.counters_ = true;
+            s.splits_ = stats_.splits_.load();
+            s.merges_ = stats_.merges_.load();
+            s.searches_ = stats_.searches_.load();
+            s.inserts_ = stats_.inserts_.load();
+            s.search_latency_ = stats_.search_latency_.snapshot();
+            s.insert_latency_ = stats_.insert_latency_.snapshot();
+        }
+        return s;
+    }
+
+protected:
+    // Descends from root splitting full nodes on the way, so the slot can always be opened
+    // without walking back up. With UNIQUE the descent stops at an entry equivalent to key and
+    // reports it instead; otherwise the new entry goes after any equivalent ones. make(node, i)
+    // constructs the new entry into the raw slot i. When path is given it receives the cursor
+    // to the resulting slot, rooted at the final root so it can also step back from end().
+    template <bool UNIQUE, typename K, typename Make>
+    std::pair<Slot, bool> insertSlot(BNode*& root, const K& key, Make&& make, iterator* path = nullptr) {
+        if (root == nullptr) root = createNode(true);
+
+        if (root->keys_count_ == BNode::MAX_KEYS) {
+            BNode* s = createNode(false);
+            s->childs()[0] = root;
+            splitChild(*s, 0, *root);
+            root = s;
+        }
+        if (path) path->root_ = root;
+
+        BNode* node = root;
+        for (;;) {
+            size_t i = UNIQUE ? node->template lowerBound<Search>(key, comp_)
+                              : node->template upperBound<Search>(key, comp_);
+
+            if (UNIQUE && i < node->keys_count_ && !comp_(key, node->keys()[i])) {
+                if (path) path->push(node, i);
+                return {Slot{node, i}, false};
+            }
+
+            if (node->leaf_) {
+                relocateSlots(*node, i, node->keys_count_, *node, i + 1);
+                try {
+                    make(*node, i);
+                } catch (...) {
+                    relocateSlots(*node, i + 1, node->keys_count_ + 1, *node, i);
+                    throw;
+                }
+                node->keys_count_ += 1;
+                if (path) path->push(node, i);
+                return {Slot{node, i}, true};
+            }
+
+            BNode** childs = node->childs();
+            if (childs[i]->keys_count_ == BNode::MAX_KEYS) {
+                splitChild(*node, i, *childs[i]);
+
+                const T& median = node->keys()[i];
+                if (UNIQUE && !comp_(key, median) && !comp_(median, key)) {
+                    if (path) path->push(node, i);
+                    return {Slot{node, i}, false};
+                }
+                if (comp_(median, key)) i++;
+            }
+            if (path) path->push(node, i);
+            node = childs[i];
+        }
+    }
+
+    void splitChild(BNode& node, size_t i, BNode& y) {
+        stats_.onSplit();
+        BNode* z = createNode(y.leaf_);
+
+        relocateSlots(y, ORDER, BNode::MAX_KEYS, *z, 0);
+        if (!y.leaf_) std::copy(y.childs() + ORDER, y.childs() + BNode::MAX_CHILDS, z->childs());
+        z->keys_count_ = ORDER - 1;
+
+        BNode** childs = node.childs();
+        std::copy_backward(childs + i + 1, childs + node.keys_count_ + 1, childs + node.keys_count_ + 2);
+        childs[i + 1] = z;
+
+        relocateSlots(node, i, node.keys_count_, node, i + 1);
+        relocateSlots(y, ORDER - 1, ORDER, node, i);
+        y.keys_count_ = ORDER - 1;
+        node.keys_count_ += 1;
+    }
+
+protected:
+    // Looks up count keys at once and calls f(j, node, i) with the slot of an entry equivalent to
+    // keys[j], or with a null node when there is none. Probes are taken in key order, so
+    // neighbours share the upper levels of their paths while those are still cached, and run in
+    // groups that descend side by side one level per round: every probe prefetches the node it
+    // moves to, and the misses of a group overlap instead of being paid one after another.
+    template <typename K, typename F>
+    void findBatch(const K* keys, size_t count, F&& f) const {
+        constexpr size_t GROUP = 16;
+
+        std::vector<size_t> order;
+        if (count > GROUP) {
+            order.resize(count);
+            for (size_t j = 0; j < count; ++j)
+                order[j] = j;
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return comp_(keys[a], keys[b]); });
+        }
+
+        for (size_t first = 0; first < count; first += GROUP) {
+            size_t probes[GROUP];
+            BNode* nodes[GROUP];
+            size_t active = std::min(GROUP, count - first);
+            for (size_t g = 0; g < active; ++g) {
+                probes[g] = order.empty() ? first + g : order[first + g];
+                nodes[g] = root_;
+            }
+
+            while (active > 0) {
+                for (size_t g = 0; g < active;) {
+                    BNode* node = nodes[g];
+                    const K& key = keys[probes[g]];
+                    if (node != nullptr) {
+                        const size_t i = node->template lowerBound<Search>(key, comp_);
+                        if (i < node->keys_count_ && !comp_(key, node->keys()[i])) {
+                            f(probes[g], node, i);
+                        } else if (node->leaf_) {
+                            f(probes[g], static_cast<BNode*>(nullptr), size_t(0));
+                        } else {
+                            nodes[g] = node->childs()[i];
+                            nodes[g]->prefetchKeys();
+                            ++g;
+                            continue;
+                        }
+                    } else {
+                        f(probes[g], static_cast<BNode*>(nullptr), size_t(0));
+                    }
+                    active -= 1;
+                    probes[g] = probes[active];
+                    nodes[g] = nodes[active];
+                }
+            }
+        }
+    }
+
+    // Inserts count keys sorted by comp_, moving them out of the array. One descent serves every
+    // following key that still belongs to the same leaf, and all of them are merged into it with
+    // each resident key shifted once. Keys that may throw while being moved go one by one, since
+    // a half-done merge could not be rolled back.
+    void insertSorted(T* keys, size_t count) {
+        if constexpr (!std::is_nothrow_move_constructible<T>::value) {
+            for (size_t j = 0; j < count; ++j)
+                insertSlot<false>(root_, keys[j],
+                                  [&](BNode& node, size_t i) { constructKey(node, i, std::move(keys[j])); });
+        } else {
+            for (size_t j = 0; j < count;) {
+                const T* bound = nullptr;
+                BNode* leaf = descendToLeaf(keys[j], bound);
+
+                const size_t room = BNode::MAX_KEYS - leaf->keys_count_;
+                size_t m = 1;
+                while (m < room && j + m < count && (bound == nullptr || comp_(keys[j + m], *bound)))
+                    ++m;
+
+                mergeIntoLeaf(*leaf, keys + j, m);
+                j += m;
+            }
+        }
+    }
+
+private:
+    // The descent of a non-unique insertSlot, stopping at the (never full) leaf. bound is left at
+    // the closest separator above the leaf, if any: keys below it belong in the same leaf.
+    BNode* descendToLeaf(const T& key, const T*& bound) {
+        if (root_ == nullptr) root_ = createNode(true);
+
+        if (root_->keys_count_ == BNode::MAX_KEYS) {
+            BNode* s = createNode(false);
+            s->childs()[0] = root_;
+            splitChild(*s, 0, *root_);
+            root_ = s;
+        }
+
+        BNode* node = root_;
+        while (!node->leaf_) {
+            size_t i = node->template upperBound<Search>(key, comp_);
+
+            BNode** childs = node->childs();
+            if (childs[i]->keys_count_ == BNode::MAX_KEYS) {
+                splitChild(*node, i, *childs[i]);
+                if (comp_(node->keys()[i], key)) i++;
+            }
+            if (i < node->keys_count_) bound = node->keys() + i;
+            node = childs[i];
+        }
+        return node;
+    }
+
+    // Places the m sorted keys of src among the leaf's entries, after any equivalent ones. The
+    // target slots are worked out first, so nothing can throw once entries start moving.
+    void mergeIntoLeaf(BNode& leaf, T* src, size_t m) {
+        size_t at[BNode::MAX_KEYS];
+        for (size_t k = 0, i = 0; k < m; ++k) {
+            i += Search::upper_bound(leaf.keys() + i, leaf.keys_count_ - i, src[k], comp_);
+            at[k] = i;
+        }
+
+        size_t last = leaf.keys_count_;
+        for (size_t k = m; k-- > 0;) {
+            relocateSlots(leaf, at[k], last, leaf, at[k] + k + 1);
+            constructKey(leaf, at[k] + k, std::move(src[k]));
+            last = at[k];
+        }
+        leaf.keys_count_ += m;
+    }
+
+protected:
+    // Calls f(node, i) for every entry in order without recursion.
+    template <typename F>
+    void forEachSlot(F&& f) const {
+        const_iterator::forEach(root_, std::forward<F>(f));
+    }
+
+    // Cuts the in-order sequence into pieces for parallel walks: the top levels are opened one at
+    // a time until there are at least target subtrees or only leaves are left, and the entries of
+    // the opened nodes stay in between as single pieces.
+    std::vector<Piece> partition(size_t target) const {
+        std::vector<Piece> pieces;
+        if (root_ == nullptr) return pieces;
+        pieces.push_back(Piece{root_, 0, true});
+        for (size_t subtrees = 1; subtrees < target && !pieces.front().node_->leaf_;) {
+            std::vector<Piece> opened;
+            subtrees = 0;
+            for (const Piece& piece : pieces) {
+                if (!piece.subtree_) {
+                    opened.push_back(piece);
+                    continue;
+                }
+                BNode* node = piece.node_;
+                for (size_t i = 0; i < node->keys_count_; ++i) {
+                    opened.push_back(Piece{node->childs()[i], 0, true});
+                    opened.push_back(Piece{node, i, false});
+                }
+                opened.push_back(Piece{node->childs()[node->keys_count_], 0, true});
+                subtrees += node->keys_count_ + 1;
+            }
+            pieces.swap(opened);
+        }
+        return pieces;
+    }
+
+    // Calls f(node, i) for every entry of the piece in order.
+    template <typename F>
+    static void forEachSlotIn(const Piece& piece, F&& f) {
+        if (piece.subtree_)
+            const_iterator::forEach(piece.node_, std::forward<F>(f));
+        else
+            f(piece.node_, piece.index_);
+    }
+
+protected:
+    // Replaces the contents with n entries arriving in ascending order, built bottom-up in O(n)
+    // without a single comparison. The number of nodes per level is planned up front from n and
+    // the target fill so every node ends up with MIN_KEYS..MAX_KEYS entries; entries are then
+    // streamed into the rightmost open node of the lowest level that still has room, which is
+    // exactly the in-order position of the next entry. produce(node, i) constructs the next
+    // entry into the raw slot i.
+    template <typename Produce>
+    void buildSorted(size_t n, double fill, Produce&& produce) {
+        clear(root_);
+        root_ = nullptr;
+        if (n == 0) {
+            root_ = createNode(true);
+            return;
+        }
+        try {
+            root_ = buildNodes(n, fill, produce);
+        } catch (...) {
+            root_ = createNode(true);
+            throw;
+        }
+    }
+
+    // buildSorted spread over a pool. The entries are cut into one run per thread with a single
+    // entry between neighbouring runs; the runs are built bottom-up side by side and then joined
+    // with those entries as separators, which only touches the spines. produce(node, i, k)
+    // constructs entry k into slot i of a run, make(k) returns entry k as a separator. The
+    // allocator must allow concurrent allocation. Joins relocate entries and could not be rolled
+    // back halfway, so entries that may throw while being moved are built as a single run.
+    template <typename Produce, typename Make>
+    void buildSortedParallel(size_t n, double fill, WorkStealingPool& pool, Produce&& produce, Make&& make) {
+        constexpr bool NOTHROW_MOVE = std::is_nothrow_move_constructible<T>::value &&
+                                      std::is_nothrow_move_constructible<std::conditional_t<HAS_VALUES, V, T>>::value;
+        const size_t runs =
+            NOTHROW_MOVE ? std::max<size_t>(1, std::min(pool.size(), (n + 1) / PARALLEL_RUN_ENTRIES)) : 1;
+        if (runs == 1) {
+            size_t k = 0;
+            buildSorted(n, fill, [&](BNode& node, size_t i) { produce(node, i, k++); });
+            return;
+        }
+
+        clear(root_);
+        root_ = nullptr;
+        // Run r holds entries [r * stride, r * stride + stride - 1), the last one everything left.
+        const size_t stride = (n + 1) / runs;
+        std::vector<BNode*> roots(runs, nullptr);
+        Subtree t{nullptr, 0};
+        try {
+            pool.run(runs, [&](size_t r) {
+                const size_t first = r * stride;
+                const size_t last = r + 1 == runs ? n : first + stride - 1;
+                size_t k = first;
+                roots[r] = buildNodes(last - first, fill, [&](BNode& node, size_t i) { produce(node, i, k++); });
+            });
+            // A join allocates before it links the next run in, so should it throw, that run is
+            // still whole and stays in roots to be freed.
+            t = Subtree{roots[0], height(roots[0])};
+            roots[0] = nullptr;
+            for (size_t r = 1; r < runs; ++r) {
+                t = joinTrees(t, make(r * stride - 1), Subtree{roots[r], height(roots[r])});
+                roots[r] = nullptr;
+            }
+        } catch (...) {
+            clear(t.root_);
+            for (BNode* root : roots)
+                clear(root);
+            root_ = createNode(true);
+            throw;
+        }
+        root_ = t.root_;
+    }
+
+    // Builds n > 0 entries into new nodes, see buildSorted, and returns the root.
+    template <typename Produce>
+    BNode* buildNodes(size_t n, double fill, Produce&& produce) {
+        struct Level {
+            size_t base_;   // entries per node ...
+            size_t extra_;  // ... plus one for the first extra_ nodes
+            size_t index_;  // node currently filled
+            BNode* node_;
+        };
+
+        const double packed = fill * static_cast<double>(BNode::MAX_KEYS) + 0.5;
+        const size_t target = packed >= static_cast<double>(BNode::MAX_KEYS) ? BNode::MAX_KEYS
+                              : packed <= static_cast<double>(BNode::MIN_KEYS) ? BNode::MIN_KEYS
+                                                                                : static_cast<size_t>(packed);
+
+        Level levels[BNode::MAX_HEIGHT];
+        size_t height = 0;
+        for (size_t count = n;;) {
+            const size_t lo = (count + BNode::MAX_KEYS + 1) / (BNode::MAX_KEYS + 1);
+            const size_t hi = (count + 1) / (BNode::MIN_KEYS + 1);
+            size_t nodes = (count + target + 1) / (target + 1);
+            nodes = std::min(std::max(nodes, lo), std::max(hi, lo));
+
+            const size_t entries = count - (nodes - 1);
+            levels[height++] = Level{entries / nodes, entries % nodes, 0, nullptr};
+            if (nodes == 1) break;
+            count = nodes - 1;
+        }
+
+        // A child slot is cleared before its node is allocated, so that an allocation failure
+        // leaves a tree clear() can walk.
+        BNode* root = nullptr;
+        try {
+            for (size_t h = height; h-- > 0;) {
+                if (h + 1 < height) levels[h + 1].node_->childs()[0] = nullptr;
+                levels[h].node_ = createNode(h == 0);
+                if (h + 1 == height)
+                    root = levels[h].node_;
+                else
+                    levels[h + 1].node_->childs()[0] = levels[h].node_;
+            }
+
+            for (size_t k = 0; k < n; ++k) {
+                size_t h = 0;
+                while (h + 1 < height &&
+                       levels[h].node_->keys_count_ == levels[h].base_ + (levels[h].index_ < levels[h].extra_))
+                    ++h;
+
+                BNode* node = levels[h].node_;
+                produce(*node, node->keys_count_);
+                node->keys_count_ += 1;
+
+                for (size_t g = h; g-- > 0;) {
+                    BNode* parent = levels[g + 1].node_;
+                    levels[g].index_ += 1;
+                    parent->childs()[parent->keys_count_] = nullptr;
+                    levels[g].node_ = createNode(g == 0);
+                    parent->childs()[parent->keys_count_] = levels[g].node_;
+                }
+            }
+        } catch (...) {
+            clear(root);
+            throw;
+        }
+        return root;
+    }
+
+protected:
+    template <typename K>
+    bool eraseOne(const K& key) {
+        if (root_ == nullptr) return false;
+
+        const bool erased = eraseFrom(root_, key);
+        if (root_->keys_count_ == 0 && !root_->leaf_) {
+            BNode* old = root_;
+            root_ = old->childs()[0];
+            deleteNode(old);
+        }
+        return erased;
+    }
+
+    // Single top-down pass: before descending into a child it is topped up to at least ORDER
+    // keys, so removing a key below never has to walk back up to fix an underflow.
+    template <typename K>
+    bool eraseFrom(BNode* node, const K& key) {
+        for (;;) {
+            const size_t i = node->template lowerBound<Search>(key, comp_);
+            const bool found = i < node->keys_count_ && !comp_(key, node->keys()[i]);
+
+            if (node->leaf_) {
+                if (!found) return false;
+                destroySlot(*node, i);
+                relocateSlots(*node, i + 1, node->keys_count_, *node, i);
+                node->keys_count_ -= 1;
+                return true;
+            }
+
+            BNode** childs = node->childs();
+            if (!found) {
+                node = fillChild(*node, i);
+                continue;
+            }
+
+            if (childs[i]->keys_count_ >= ORDER) {
+                replaceWithMax(*node, i, childs[i]);
+                return true;
+            }
+            if (childs[i + 1]->keys_count_ >= ORDER) {
+                replaceWithMin(*node, i, childs[i + 1]);
+                return true;
+            }
+            mergeChilds(*node, i);
+            node = childs[i];
+        }
+    }
+
+    // Takes the entry at pos out, working bottom-up along pos's path: an entry of an internal
+    // node is replaced by its predecessor, the last entry of a leaf, and a leaf left with too few
+    // entries borrows one from a sibling or merges with it, which may repeat at the parent.
+    Entry eraseAt(const const_iterator& pos) {
+        BNode* path[BNode::MAX_HEIGHT + 1];
+        size_t slots[BNode::MAX_HEIGHT + 1];
+        size_t depth = pos.depth_;
+        for (size_t h = 0; h < depth; ++h) {
+            path[h] = pos.path_[h].node_;
+            slots[h] = pos.path_[h].index_;
+        }
+
+        BNode* node = path[depth - 1];
+        const size_t i = slots[depth - 1];
+        Entry entry = takeEntry(*node, i);
+        if (node->leaf_) {
+            relocateSlots(*node, i + 1, node->keys_count_, *node, i);
+        } else {
+            BNode* leaf = node->childs()[i];
+            for (;;) {
+                path[depth++] = leaf;
+                if (leaf->leaf_) break;
+                slots[depth - 1] = leaf->keys_count_;
+                leaf = leaf->childs()[leaf->keys_count_];
+            }
+            relocateSlots(*leaf, leaf->keys_count_ - 1, leaf->keys_count_, *node, i);
+            node = leaf;
+        }
+        node->keys_count_ -= 1;
+
+        for (size_t h = depth - 1; h > 0 && path[h]->keys_count_ < BNode::MIN_KEYS; --h) {
+            BNode& parent = *path[h - 1];
+            const size_t c = slots[h - 1];
+            if (c > 0 && parent.childs()[c - 1]->keys_count_ > BNode::MIN_KEYS) {
+                rotateRight(parent, c - 1, 1);
+                break;
+            }
+            if (c < parent.keys_count_ && parent.childs()[c + 1]->keys_count_ > BNode::MIN_KEYS) {
+                rotateLeft(parent, c, 1);
+                break;
+            }
+            mergeChilds(parent, c > 0 ? c - 1 : c);
+        }
+
+        if (root_->keys_count_ == 0 && !root_->leaf_) {
+            BNode* old = root_;
+            root_ = old->childs()[0];
+            deleteNode(old);
+        }
+        return entry;
+    }
+
+    // Overwrites slot i of dst with the largest entry below node, removing it there.
+    void replaceWithMax(BNode& dst, size_t i, BNode* node) {
+        while (!node->leaf_)
+            node = fillChild(*node, node->keys_count_);
+        destroySlot(dst, i);
+        relocateSlots(*node, node->keys_count_ - 1, node->keys_count_, dst, i);
+        node->keys_count_ -= 1;
+    }
+
+    // Overwrites slot i of dst with the smallest entry below node, removing it there.
+    void replaceWithMin(BNode& dst, size_t i, BNode* node) {
+        while (!node->leaf_)
+            node = fillChild(*node, 0);
+        destroySlot(dst, i);
+        relocateSlots(*node, 0, 1, dst, i);
+        relocateSlots(*node, 1, node->keys_count_, *node, 0);
+        node->keys_count_ -= 1;
+    }
+
+    // Removes and returns the smallest entry below node. Only joins use it, so its merges are
+    // not counted as erase merges.
+    Entry takeMin(BNode* node) {
+        while (!node->leaf_)
+            node = fillChild<false>(*node, 0);
+        Entry entry = takeEntry(*node, 0);
+        relocateSlots(*node, 1, node->keys_count_, *node, 0);
+        node->keys_count_ -= 1;
+        return entry;
+    }
+
+    // Makes sure childs()[i] holds at least ORDER keys by borrowing from a sibling or merging
+    // with one. Returns the child to continue with.
+    template <bool COUNT_MERGE = true>
+    BNode* fillChild(BNode& node, size_t i) {
+        BNode** childs = node.childs();
+        if (childs[i]->keys_count_ >= ORDER) return childs[i];
+
+        if (i > 0 && childs[i - 1]->keys_count_ >= ORDER) {
+            rotateRight(node, i - 1, 1);
+            return childs[i];
+        }
+        if (i < node.keys_count_ && childs[i + 1]->keys_count_ >= ORDER) {
+            rotateLeft(node, i, 1);
+            return childs[i];
+        }
+        const size_t m = i < node.keys_count_ ? i : i - 1;
+        if (COUNT_MERGE)
+            mergeChilds(node, m);
+        else
+            foldChilds(node, m);
+        return childs[m];
+    }
+
+    // Moves m entries from childs()[s] into childs()[s + 1] through separator s.
+    void rotateRight(BNode& parent, size_t s, size_t m) {
+        BNode& left = *parent.childs()[s];
+        BNode& right = *parent.childs()[s + 1];
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        relocateSlots(right, 0, rn, right, m);
+        relocateSlots(parent, s, s + 1, right, m - 1);
+        relocateSlots(left, ln - m + 1, ln, right, 0);
+        relocateSlots(left, ln - m, ln - m + 1, parent, s);
+
+        if (!left.leaf_) {
+            BNode** lchilds = left.childs();
+            BNode** rchilds = right.childs();
+            std::copy_backward(rchilds, rchilds + rn + 1, rchilds + rn + 1 + m);
+            std::copy(lchilds + ln - m + 1, lchilds + ln + 1, rchilds);
+        }
+        left.keys_count_ -= m;
+        right.keys_count_ += m;
+    }
+
+    // Moves m entries from childs()[s + 1] into childs()[s] through separator s.
+    void rotateLeft(BNode& parent, size_t s, size_t m) {
+        BNode& left = *parent.childs()[s];
+        BNode& right = *parent.childs()[s + 1];
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        relocateSlots(parent, s, s + 1, left, ln);
+        relocateSlots(right, 0, m - 1, left, ln + 1);
+        relocateSlots(right, m - 1, m, parent, s);
+        relocateSlots(right, m, rn, right, 0);
+
+        if (!left.leaf_) {
+            BNode** lchilds = left.childs();
+            BNode** rchilds = right.childs();
+            std::copy(rchilds, rchilds + m, lchilds + ln + 1);
+            std::copy(rchilds + m, rchilds + rn + 1, rchilds);
+        }
+        left.keys_count_ += m;
+        right.keys_count_ -= m;
+    }
+
+    // A merge on the erase path, the only kind merges_ counts; joins fold nodes as well.
+    void mergeChilds(BNode& node, size_t i) {
+        stats_.onMerge();
+        foldChilds(node, i);
+    }
+
+    // Folds separator i and childs()[i + 1] into childs()[i] and releases the emptied sibling.
+    void foldChilds(BNode& node, size_t i) {
+        BNode** childs = node.childs();
+        BNode& left = *childs[i];
+
+        relocateSlots(node, i, i + 1, left, left.keys_count_);
+        left.keys_count_ += 1;
+        appendNode(left, childs[i + 1]);
+
+        relocateSlots(node, i + 1, node.keys_count_, node, i);
+        std::copy(childs + i + 2, childs + node.keys_count_ + 1, childs + i + 1);
+        node.keys_count_ -= 1;
+    }
+
+    // Moves everything in right behind the entries of left, then releases right.
+    void appendNode(BNode& left, BNode* right) {
+        const size_t ln = left.keys_count_;
+        const size_t rn = right->keys_count_;
+
+        relocateSlots(*right, 0, rn, left, ln);
+        if (!left.leaf_) std::copy(right->childs(), right->childs() + rn + 1, left.childs() + ln);
+        left.keys_count_ = ln + rn;
+
+        right->keys_count_ = 0;
+        deleteNode(right);
+    }
+
+protected:
+    // Moves every entry out, in order, and drops the nodes. The vector is sized up front, so
+    // nothing can throw once entries start moving unless moving an entry does.
+    std::vector<Entry> drainEntries() {
+        size_t n = 0;
+        forEachSlot([&n](BNode*, size_t) { ++n; });
+        std::vector<Entry> entries;
+        entries.reserve(n);
+        forEachSlot([&](BNode* node, size_t i) { entries.push_back(makeEntry(*node, i)); });
+        clear(root_);
+        root_ = nullptr;
+        return entries;
+    }
+
+    // Replaces the contents with the sorted entries, moved out of the vector.
+    void rebuild(std::vector<Entry>& entries, double fill) {
+        size_t k = 0;
+        buildSorted(entries.size(), fill, [&](BNode& node, size_t i) { putEntry(node, i, std::move(entries[k++])); });
+    }
+
+    // Moves every entry of other in and leaves other empty: both in-order sequences are merged
+    // in one pass and the result is built bottom-up, O(n + m) however they interleave. Of
+    // equivalent entries this tree's come first; with UNIQUE only the first is kept and
+    // combine(kept, dropped) sees each one that is not. When anything throws the entries are
+    // lost and both trees end up empty.
+    template <bool UNIQUE, typename Combine>
+    void mergeWith(BTreeBase& other, double fill, Combine&& combine) {
+        if (&other == this) return;
+        std::vector<Entry> mine = drainEntries();
+        std::vector<Entry> theirs = other.drainEntries();
+
+        std::vector<Entry> merged;
+        merged.reserve(mine.size() + theirs.size());
+        const auto put = [&](Entry& entry) {
+            if constexpr (UNIQUE) {
+                if (!merged.empty() && !comp_(merged.back().key_, entry.key_)) {
+                    combine(merged.back(), entry);
+                    return;
+                }
+            }
+            merged.push_back(std::move(entry));
+        };
+
+        size_t i = 0, j = 0;
+        while (i < mine.size() && j < theirs.size()) {
+            if (comp_(theirs[j].key_, mine[i].key_))
+                put(theirs[j++]);
+            else
+                put(mine[i++]);
+        }
+        for (; i < mine.size(); ++i)
+            put(mine[i]);
+        for (; j < theirs.size(); ++j)
+            put(theirs[j]);
+
+        rebuild(merged, fill);
+    }
+
+    // Moves the entries not less than k into upper, an empty tree with an equal allocator, in
+    // O(height) node operations (see splitTree).
+    void splitOff(const T& k, BTreeBase& upper) {
+        Subtree left, right;
+        splitTree(detach(), k, left, right);
+        upper.clear(upper.root_);
+        upper.root_ = right.root_;
+        root_ = left.root_;
+        if (root_ == nullptr) root_ = createNode(true);
+        if (upper.root_ == nullptr) upper.root_ = upper.createNode(true);
+    }
+
+    // Appends the entries of other, none of which may order before this tree's, and leaves other
+    // empty. The allocators must be equal: other's nodes become this tree's as they are.
+    void joinWith(BTreeBase& other) {
+        root_ = joinTrees(detach(), other.detach()).root_;
+        if (root_ == nullptr) root_ = createNode(true);
+    }
+
+    // Takes the nodes out of the tree; an empty one gives the empty subtree.
+    Subtree detach() {
+        Subtree t{nullptr, 0};
+        if (empty())
+            clear(root_);
+        else
+            t = Subtree{root_, height(root_)};
+        root_ = nullptr;
+        return t;
+    }
+
+protected:
+    static size_t height(const BNode* node) noexcept {
+        size_t h = 0;
+        for (; node != nullptr; node = node->leaf_ ? nullptr : node->childs()[0])
+            ++h;
+        return h;
+    }
+
+    // Collapses key-less roots left behind by splitting or merging.
+    Subtree normalize(Subtree t) {
+        while (t.root_ != nullptr && t.root_->keys_count_ == 0) {
+            BNode* old = t.root_;
+            t.root_ = old->leaf_ ? nullptr : old->childs()[0];
+            t.height_ -= 1;
+            deleteNode(old);
+        }
+        return t;
+    }
+
+    // Cuts t into left (keys < k) and right (keys >= k) in O(height) node operations: each level
+    // contributes the fragments on either side of the descent path, which are joined with the
+    // parts returned from below.
+    void splitTree(Subtree t, const T& k, Subtree& left, Subtree& right) {
+        if (t.root_ == nullptr) {
+            left = right = Subtree{nullptr, 0};
+            return;
+        }
+
+        BNode* x = t.root_;
+        const size_t n = x->keys_count_;
+        const size_t i = x->template lowerBound<Search>(k, comp_);
+
+        if (x->leaf_) {
+            BNode* r = createNode(true);
+            relocateSlots(*x, i, n, *r, 0);
+            r->keys_count_ = n - i;
+            x->keys_count_ = i;
+            left = normalize(Subtree{x, 1});
+            right = normalize(Subtree{r, 1});
+            return;
+        }
+
+        BNode** childs = x->childs();
+        Subtree below_left, below_right;
+        splitTree(Subtree{childs[i], t.height_ - 1}, k, below_left, below_right);
+
+        if (i == n) {
+            right = below_right;
+        } else {
+            Entry separator = takeEntry(*x, i);
+            Subtree fragment{childs[i + 1], t.height_ - 1};
+            if (n - i - 1 != 0) {
+                BNode* r = createNode(false);
+                relocateSlots(*x, i + 1, n, *r, 0);
+                std::copy(childs + i + 1, childs + n + 1, r->childs());
+                r->keys_count_ = n - i - 1;
+                fragment = Subtree{r, t.height_};
+            }
+            right = joinTrees(below_right, std::move(separator), fragment);
+        }
+
+        if (i == 0) {
+            x->keys_count_ = 0;
+            deleteNode(x);
+            left = below_left;
+        } else {
+            Entry separator = takeEntry(*x, i - 1);
+            Subtree fragment{x, t.height_};
+            x->keys_count_ = i - 1;
+            if (i - 1 == 0) {
+                fragment = Subtree{childs[0], t.height_ - 1};
+                deleteNode(x);
+            }
+            left = joinTrees(fragment, std::move(separator), below_left);
+        }
+    }
+
+    // Concatenates two trees where every key of a is not greater than any key of b.
+    Subtree joinTrees(Subtree a, Subtree b) {
+        if (a.root_ == nullptr) return b;
+        if (b.root_ == nullptr) return a;
+
+        Entry separator = takeMin(b.root_);
+        b = normalize(b);
+        return joinTrees(a, std::move(separator), b);
+    }
+
+    // Concatenates a, separator and b. The shorter tree is hung off the facing spine of the
+    // taller one at the matching level; splits on the way down keep room for the separator.
+    Subtree joinTrees(Subtree a, Entry&& separator, Subtree b) {
+        if (a.root_ == nullptr || b.root_ == nullptr) {
+            Subtree t = a.root_ == nullptr ? b : a;
+            BNode* root = t.root_;
+            insertSlot<false>(root, separator.key_, [&](BNode& node, size_t i) { putEntry(node, i, std::move(separator)); });
+            if (root != t.root_) t.height_ += 1;
+            return Subtree{root, t.height_};
+        }
+
+        if (a.height_ == b.height_) {
+            BNode& l = *a.root_;
+            BNode& r = *b.root_;
+            if (l.keys_count_ + 1 + r.keys_count_ <= BNode::MAX_KEYS) {
+                putEntry(l, l.keys_count_, std::move(separator));
+                l.keys_count_ += 1;
+                appendNode(l, b.root_);
+                return a;
+            }
+
+            BNode* s = createNode(false);
+            putEntry(*s, 0, std::move(separator));
+            s->childs()[0] = a.root_;
+            s->childs()[1] = b.root_;
+            s->keys_count_ = 1;
+
+            const size_t half = (l.keys_count_ + r.keys_count_) / 2;
+            if (l.keys_count_ > half)
+                rotateRight(*s, 0, l.keys_count_ - half);
+            else if (l.keys_count_ < half)
+                rotateLeft(*s, 0, half - l.keys_count_);
+            return Subtree{s, a.height_ + 1};
+        }
+
+        const bool right_spine = a.height_ > b.height_;
+        Subtree tall = right_spine ? a : b;
+        const Subtree& shorter = right_spine ? b : a;
+
+        if (tall.root_->keys_count_ == BNode::MAX_KEYS) {
+            BNode* s = createNode(false);
+            s->childs()[0] = tall.root_;
+            splitChild(*s, 0, *tall.root_);
+            tall = Subtree{s, tall.height_ + 1};
+        }
+
+        BNode* p = tall.root_;
+        for (size_t h = tall.height_; h > shorter.height_ + 1; --h) {
+            size_t i = right_spine ? p->keys_count_ : 0;
+            if (p->childs()[i]->keys_count_ == BNode::MAX_KEYS) {
+                splitChild(*p, i, *p->childs()[i]);
+                if (right_spine) i += 1;
+            }
+            p = p->childs()[i];
+        }
+
+        BNode** childs = p->childs();
+        const size_t n = p->keys_count_;
+        if (right_spine) {
+            putEntry(*p, n, std::move(separator));
+            childs[n + 1] = shorter.root_;
+            p->keys_count_ = n + 1;
+
+            BNode& l = *childs[n];
+            BNode& r = *childs[n + 1];
+            if (r.keys_count_ < BNode::MIN_KEYS) {
+                if (l.keys_count_ + 1 + r.keys_count_ <= BNode::MAX_KEYS)
+                    foldChilds(*p, n);
+                else
+                    rotateRight(*p, n, BNode::MIN_KEYS - r.keys_count_);
+            }
+        } else {
+            relocateSlots(*p, 0, n, *p, 1);
+            std::copy_backward(childs, childs + n + 1, childs + n + 2);
+            putEntry(*p, 0, std::move(separator));
+            childs[0] = shorter.root_;
+            p->keys_count_ = n + 1;
+
+            BNode& l = *childs[0];
+            BNode& r = *childs[1];
+            if (l.keys_count_ < BNode::MIN_KEYS) {
+                if (l.keys_count_ + 1 + r.keys_count_ <= BNode::MAX_KEYS)
+                    foldChilds(*p, 0);
+                else
+                    rotateLeft(*p, 0, BNode::MIN_KEYS - l.keys_count_);
+            }
+        }
+        return tall;
+    }
+
+protected:
+    // Moves the live entries [first, last) of src into the slots starting at at of dst. The
+    // destination slots must be raw (or part of the source range when src and dst coincide);
+    // the source slots are raw afterwards.
+    void relocateSlots(BNode& src, size_t first, size_t last, BNode& dst, size_t at) {
+        if (first == last) return;
+
+        relocateArray(keys_alloc_, src.keys() + first, dst.keys() + at, last - first);
+        if constexpr (HAS_VALUES) relocateArray(values_alloc_, src.values() + first, dst.values() + at, last - first);
+    }
+
+    void destroySlot(BNode& node, size_t i) {
+        std::allocator_traits<KeysAllocator>::destroy(keys_alloc_, node.keys() + i);
+        if constexpr (HAS_VALUES) std::allocator_traits<ValuesAllocator>::destroy(values_alloc_, node.values() + i);
+    }
+
+    template <typename... Args>
+    void constructKey(BNode& node, size_t i, Args&&... args) {
+        std::allocator_traits<KeysAllocator>::construct(keys_alloc_, node.keys() + i, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void constructValue(BNode& node, size_t i, Args&&... args) {
+        std::allocator_traits<ValuesAllocator>::construct(values_alloc_, node.values() + i, std::forward<Args>(args)...);
+    }
+
+    Entry takeEntry(BNode& node, size_t i) {
+        Entry entry = makeEntry(node, i);
+        destroySlot(node, i);
+        return entry;
+    }
+
+    Entry makeEntry(BNode& node, size_t i) {
+        if constexpr (HAS_VALUES)
+            return Entry{std::move(node.keys()[i]), std::move(node.values()[i])};
+        else
+            return Entry{std::move(node.keys()[i])};
+    }
+
+    void putEntry(BNode& node, size_t i, Entry&& entry) {
+        std::allocator_traits<KeysAllocator>::construct(keys_alloc_, node.keys() + i, std::move(entry.key_));
+        if constexpr (HAS_VALUES)
+            std::allocator_traits<ValuesAllocator>::construct(values_alloc_, node.values() + i, std::move(entry.value_));
+    }
+
+protected:
+    // One allocation per node: header, keys, values and (for internal nodes only) child pointers
+    // share a cache-line aligned block obtained from the rebound allocator.
+    BNode* createNode(bool isLeaf) {
+        const size_t blocks = BNode::blockCount(isLeaf);
+        CacheLine* block = std::allocator_traits<BlockAllocator>::allocate(block_alloc_, blocks);
+        return ::new (static_cast<void*>(block)) BNode(isLeaf);
+    }
+
+    void deleteNode(BNode* node) {
+        for (size_t i = 0; i < node->keys_count_; ++i)
+            destroySlot(*node, i);
+
+        const size_t blocks = BNode::blockCount(node->isLeaf());
+        node->~BNode();
+        std::allocator_traits<BlockAllocator>::deallocate(block_alloc_, reinterpret_cast<CacheLine*>(node), blocks);
+    }
+
+    void clear(BNode* node) {
+        if constexpr (DROP_WITHOUT_WALK) return;
+        if (!node) return;
+        if (!node->isLeaf()) {
+            for (size_t i = 0; i <= node->size(); ++i)
+                clear(node->childs()[i]);
+        }
+        deleteNode(node);
+    }
+};
+
+}  // namespace btree
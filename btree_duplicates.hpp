@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+namespace btree {
+
+// Policies for BTree's Duplicates parameter: what inserting a key that is already present does.
+//
+// multi_keys, the default, stores every copy in a slot of its own, after the equivalent ones.
+struct multi_keys {
+    using count_type = void;
+
+    static constexpr bool UNIQUE = false;
+    static constexpr bool COUNTED = false;
+};
+
+// Keeps the first copy and ignores the others, like std::set.
+struct unique_keys {
+    using count_type = void;
+
+    static constexpr bool UNIQUE = true;
+    static constexpr bool COUNTED = false;
+};
+
+// One slot per distinct key with a Count next to it, in the node's value array: another copy
+// only bumps the counter. The tree still acts as the multiset it stands for (count, erase_one,
+// traverse and save see every copy), but only holds as many slots as there are distinct keys.
+template <typename Count = uint32_t>
+struct counted_keys {
+    using count_type = Count;
+
+    static constexpr bool UNIQUE = true;
+    static constexpr bool COUNTED = true;
+};
+
+}  // namespace btree
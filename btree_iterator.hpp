@@ -0,0 +1,332 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace btree {
+
+using std::size_t;
+
+template <typename T, typename V, size_t ORDER, typename Compare, typename Alloc, typename Search, typename Stats>
+class BTreeBase;
+
+template <typename T, size_t ORDER, typename Alloc, typename Search>
+class CowBTree;
+
+template <typename T, size_t ORDER, typename Alloc, typename Search>
+class CowSnapshot;
+
+// What dereferencing yields: the key itself for sets, a (key, value) pair of references for maps.
+template <typename Node, bool CONST, bool MAP = !std::is_void<typename Node::mapped_type>::value>
+struct IteratorValue {
+    using value_type = typename Node::key_type;
+    using reference = const value_type&;
+    using pointer = const value_type*;
+
+    static reference get(Node* node, size_t i) noexcept { return node->keys()[i]; }
+
+    static pointer arrow(Node* node, size_t i) noexcept { return &node->keys()[i]; }
+};
+
+template <typename Node, bool CONST>
+struct IteratorValue<Node, CONST, true> {
+    using key_type = typename Node::key_type;
+    using mapped_type = std::conditional_t<CONST, const typename Node::mapped_type, typename Node::mapped_type>;
+
+    using value_type = std::pair<const key_type, typename Node::mapped_type>;
+    using reference = std::pair<const key_type&, mapped_type&>;
+
+    // operator-> has to return something that outlives the full expression, so the pair of
+    // references is carried by value.
+    struct pointer {
+        reference ref_;
+        const reference* operator->() const noexcept { return &ref_; }
+    };
+
+    static reference get(Node* node, size_t i) noexcept { return reference(node->keys()[i], node->values()[i]); }
+
+    static pointer arrow(Node* node, size_t i) noexcept { return pointer{get(node, i)}; }
+};
+
+// Bidirectional cursor over the keys of a tree. Nodes carry no parent links, so the iterator
+// keeps the root-to-node path in a fixed array sized from the maximal height a tree of that
+// ORDER can reach; moving it around never recurses and never allocates.
+//
+// A frame {node, i} on top of the path addresses node->keys()[i]; every frame below it means
+// "currently inside childs()[i]", i.e. keys()[i] is the next key of that node to visit and
+// keys()[i - 1] the previous one. The end iterator has an empty path and only remembers the
+// root, which is where --end() starts from.
+template <typename Node, bool CONST = true>
+class BTreeIterator {
+    using Value = IteratorValue<Node, CONST>;
+
+public:
+    using key_type = typename Node::key_type;
+
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename Value::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = typename Value::pointer;
+    using reference = typename Value::reference;
+
+private:
+    struct Frame {
+        Node* node_;
+        size_t index_;
+    };
+
+    Node* root_;
+    Frame path_[Node::MAX_HEIGHT];
+    size_t depth_;
+
+    template <typename, bool>
+    friend class BTreeIterator;
+
+    template <typename, typename, size_t, typename, typename, typename, typename>
+    friend class BTreeBase;
+
+    template <typename, size_t, typename, typename>
+    friend class CowBTree;
+
+    template <typename, size_t, typename, typename>
+    friend class CowSnapshot;
+
+    friend Node;
+
+public:
+    BTreeIterator() noexcept : root_(nullptr), depth_(0) {}
+
+    BTreeIterator(const BTreeIterator& other) noexcept : root_(other.root_), depth_(other.depth_) {
+        copyPath(other);
+    }
+
+    // iterator -> const_iterator
+    template <bool OTHER_CONST, typename = std::enable_if_t<CONST && !OTHER_CONST>>
+    BTreeIterator(const BTreeIterator<Node, OTHER_CONST>& other) noexcept
+        : root_(other.root_), depth_(other.depth_) {
+        copyPath(other);
+    }
+
+    BTreeIterator& operator=(const BTreeIterator& other) noexcept {
+        root_ = other.root_;
+        depth_ = other.depth_;
+        copyPath(other);
+        return *this;
+    }
+
+public:
+    reference operator*() const noexcept { return Value::get(top().node_, top().index_); }
+
+    pointer operator->() const noexcept { return Value::arrow(top().node_, top().index_); }
+
+    const key_type& key() const noexcept { return top().node_->keys()[top().index_]; }
+
+    BTreeIterator& operator++() noexcept {
+        increment();
+        return *this;
+    }
+
+    BTreeIterator operator++(int) noexcept {
+        BTreeIterator tmp(*this);
+        increment();
+        return tmp;
+    }
+
+    BTreeIterator& operator--() noexcept {
+        decrement();
+        return *this;
+    }
+
+    BTreeIterator operator--(int) noexcept {
+        BTreeIterator tmp(*this);
+        decrement();
+        return tmp;
+    }
+
+    friend bool operator==(const BTreeIterator& lhs, const BTreeIterator& rhs) noexcept {
+        if (lhs.depth_ != rhs.depth_) return false;
+        if (lhs.depth_ == 0) return true;
+        return lhs.top().node_ == rhs.top().node_ && lhs.top().index_ == rhs.top().index_;
+    }
+
+    friend bool operator!=(const BTreeIterator& lhs, const BTreeIterator& rhs) noexcept { return !(lhs == rhs); }
+
+public:
+    // Node holding the current key and the key's slot in it.
+    Node* node() const noexcept { return top().node_; }
+
+    size_t index() const noexcept { return top().index_; }
+
+private:
+    static BTreeIterator first(Node* root) noexcept {
+        BTreeIterator it = last(root);
+        if (root != nullptr && root->keys_count_ != 0) it.pushLeftmost(root);
+        return it;
+    }
+
+    // The end iterator of the tree under root.
+    static BTreeIterator last(Node* root) noexcept {
+        BTreeIterator it;
+        it.root_ = root;
+        return it;
+    }
+
+    // First key that is not less than k.
+    template <typename Search, typename K, typename Compare>
+    static BTreeIterator lowerBound(Node* root, const K& k, const Compare& comp) {
+        return bound<Search, false>(root, k, comp);
+    }
+
+    // First key that is greater than k.
+    template <typename Search, typename K, typename Compare>
+    static BTreeIterator upperBound(Node* root, const K& k, const Compare& comp) {
+        return bound<Search, true>(root, k, comp);
+    }
+
+    template <typename Search, bool UPPER, typename K, typename Compare>
+    static BTreeIterator bound(Node* root, const K& k, const Compare& comp) {
+        BTreeIterator it = last(root);
+        if (root == nullptr || root->keys_count_ == 0) return it;
+
+        Node* node = root;
+        for (;;) {
+            const size_t i = UPPER ? node->template upperBound<Search>(k, comp)
+                                   : node->template lowerBound<Search>(k, comp);
+            it.push(node, i);
+            if (node->leaf_) break;
+            node = node->childs()[i];
+        }
+        it.settle();
+        return it;
+    }
+
+    // Any key equivalent to k; stops at the first node that holds one.
+    template <typename Search, typename K, typename Compare>
+    static BTreeIterator find(Node* root, const K& k, const Compare& comp) {
+        BTreeIterator it = last(root);
+        if (root == nullptr) return it;
+
+        Node* node = root;
+        for (;;) {
+            const size_t i = node->template lowerBound<Search>(k, comp);
+            it.push(node, i);
+            if (i < node->keys_count_ && !comp(k, node->keys()[i])) return it;
+            if (node->leaf_) return last(root);
+            node = node->childs()[i];
+        }
+    }
+
+    // In-order walk calling f(node, i) for every key. Same path as operator++, but the keys of a
+    // leaf are handed out in one tight loop instead of one increment each.
+    template <typename F>
+    static void forEach(Node* root, F&& f) {
+        BTreeIterator it = first(root);
+        while (it.depth_ != 0) {
+            Frame& frame = it.top();
+            Node* node = frame.node_;
+            if (node->leaf_) {
+                for (size_t i = frame.index_; i < node->keys_count_; ++i)
+                    f(node, i);
+                frame.index_ = node->keys_count_;
+                it.settle();
+            } else {
+                f(node, frame.index_);
+                it.increment();
+            }
+        }
+    }
+
+private:
+    template <typename Other>
+    void copyPath(const Other& other) noexcept {
+        for (size_t i = 0; i < depth_; ++i)
+            path_[i] = Frame{other.path_[i].node_, other.path_[i].index_};
+    }
+
+    Frame& top() noexcept { return path_[depth_ - 1]; }
+
+    const Frame& top() const noexcept { return path_[depth_ - 1]; }
+
+    void push(Node* node, size_t index) noexcept { path_[depth_++] = Frame{node, index}; }
+
+    void pushLeftmost(Node* node) noexcept {
+        for (;;) {
+            push(node, 0);
+            if (node->leaf_) return;
+            node = node->childs()[0];
+        }
+    }
+
+    void pushRightmost(Node* node) noexcept {
+        for (;;) {
+            if (node->leaf_) {
+                push(node, node->keys_count_ - 1);
+                return;
+            }
+            push(node, node->keys_count_);
+            node = node->childs()[node->keys_count_];
+        }
+    }
+
+    // Climbs out of exhausted nodes until the top frame addresses a key (or the path is empty).
+    void settle() noexcept {
+        while (depth_ != 0 && top().index_ == top().node_->keys_count_)
+            --depth_;
+    }
+
+    void increment() noexcept {
+        Frame& f = top();
+        if (!f.node_->leaf_) {
+            f.index_ += 1;
+            pushLeftmost(f.node_->childs()[f.index_]);
+            return;
+        }
+        f.index_ += 1;
+        settle();
+    }
+
+    void decrement() noexcept {
+        if (depth_ == 0) {
+            if (root_ != nullptr && root_->keys_count_ != 0) pushRightmost(root_);
+            return;
+        }
+
+        Frame& f = top();
+        if (!f.node_->leaf_) {
+            pushRightmost(f.node_->childs()[f.index_]);
+            return;
+        }
+        if (f.index_ != 0) {
+            f.index_ -= 1;
+            return;
+        }
+
+        // Leftmost key of a leaf: climb to the first ancestor entered from a non-first child.
+        do {
+            --depth_;
+        } while (depth_ != 0 && top().index_ == 0);
+        if (depth_ != 0) top().index_ -= 1;
+    }
+};
+
+// Half-open run of keys [begin, end) of a tree, as returned by range(lo, hi).
+template <typename Iterator>
+class BTreeRange {
+    Iterator first_;
+    Iterator last_;
+
+public:
+    using iterator = Iterator;
+
+    BTreeRange(Iterator first, Iterator last) noexcept : first_(first), last_(last) {}
+
+    Iterator begin() const noexcept { return first_; }
+
+    Iterator end() const noexcept { return last_; }
+
+    bool empty() const noexcept { return first_ == last_; }
+};
+
+}  // namespace btree
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "btree_base.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Ordered map on top of the B-tree core. Values live in a per-node array parallel to the keys,
+// so descending the tree only ever touches key memory. With a transparent comparator (e.g.
+// std::less<>) lookups accept any type comparable with K, such as std::string_view probes
+// against std::string keys, without materialising a K.
+template <typename K, typename V, size_t ORDER, typename Compare = std::less<K>,
+          typename Alloc = std::allocator<std::pair<const K, V>>, typename Search = default_search>
+class BTreeMap : public BTreeBase<K, V, ORDER, Compare, Alloc, Search, no_stats> {
+    using Base = BTreeBase<K, V, ORDER, Compare, Alloc, Search, no_stats>;
+    using BNode = typename Base::BNode;
+    using Slot = typename Base::Slot;
+
+public:
+    using mapped_type = V;
+    using value_type = std::pair<const K, V>;
+
+    using typename Base::const_iterator;
+    using typename Base::iterator;
+
+public:
+    BTreeMap() : Base(Compare(), Alloc()) {}
+
+    explicit BTreeMap(const Compare& comp, const Alloc& alloc = Alloc()) : Base(comp, alloc) {}
+
+    explicit BTreeMap(const Alloc& alloc) : Base(Compare(), alloc) {}
+
+    BTreeMap(BTreeMap&& other) noexcept = default;
+    BTreeMap& operator=(BTreeMap&& other) = default;
+
+public:
+    void swap(BTreeMap& other) noexcept { this->swapWith(other); }
+
+    friend void swap(BTreeMap& lhs, BTreeMap& rhs) noexcept { lhs.swap(rhs); }
+
+    // Moves every entry of other in with one linear merge and a bottom-up rebuild, see
+    // BTree::merge. A key present in both keeps this map's value.
+    void merge(BTreeMap& other, double fill = 1.0) {
+        this->template mergeWith<true>(other, fill, [](auto&, auto&) {});
+    }
+
+    // Moves the entries with keys not less than key into a new map, in O(log n).
+    BTreeMap split_at(const K& key) {
+        BTreeMap upper(this->comp_, this->get_allocator());
+        this->splitOff(key, upper);
+        return upper;
+    }
+
+    // Concatenates two maps where every key of left is below every key of right, in O(log n).
+    // Throws std::invalid_argument otherwise.
+    static BTreeMap join(BTreeMap left, BTreeMap right) {
+        if (!left.empty() && !right.empty() && !left.comp_(std::prev(left.end()).key(), right.begin().key()))
+            throw std::invalid_argument("BTreeMap::join: key ranges overlap");
+        if (left.get_allocator() == right.get_allocator())
+            left.joinWith(right);
+        else
+            left.merge(right);
+        return left;
+    }
+
+public:
+    // Inserts (key, V(args...)) unless key is already present; nothing is constructed then.
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+        iterator it;
+        const bool inserted = emplaceSlot(&it, key, std::forward<Args>(args)...).second;
+        return {it, inserted};
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        iterator it;
+        const bool inserted = emplaceSlot(&it, std::move(key), std::forward<Args>(args)...).second;
+        return {it, inserted};
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const K& key, M&& obj) {
+        iterator it;
+        const std::pair<Slot, bool> res = emplaceSlot(&it, key, std::forward<M>(obj));
+        if (!res.second) valueAt(res.first) = std::forward<M>(obj);
+        return {it, res.second};
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(K&& key, M&& obj) {
+        iterator it;
+        const std::pair<Slot, bool> res = emplaceSlot(&it, std::move(key), std::forward<M>(obj));
+        if (!res.second) valueAt(res.first) = std::forward<M>(obj);
+        return {it, res.second};
+    }
+
+    V& operator[](const K& key) { return valueAt(emplaceSlot(nullptr, key).first); }
+
+    V& operator[](K&& key) { return valueAt(emplaceSlot(nullptr, std::move(key)).first); }
+
+    V& at(const K& key) {
+        iterator it = this->find(key);
+        if (it == this->end()) throw std::out_of_range("BTreeMap::at: key not found");
+        return (*it).second;
+    }
+
+    const V& at(const K& key) const {
+        const_iterator it = this->find(key);
+        if (it == this->end()) throw std::out_of_range("BTreeMap::at: key not found");
+        return (*it).second;
+    }
+
+    size_t count(const K& key) const { return this->contains(key) ? 1 : 0; }
+
+    template <typename Key, typename = typename Base::template enable_if_transparent<Key>>
+    size_t count(const Key& key) const {
+        return this->contains(key) ? 1 : 0;
+    }
+
+    using Base::erase;
+
+    size_t erase(const K& key) { return this->eraseOne(key) ? 1 : 0; }
+
+private:
+    template <typename KeyArg, typename... Args>
+    std::pair<Slot, bool> emplaceSlot(iterator* path, KeyArg&& key, Args&&... args) {
+        return this->template insertSlot<true>(
+            this->root_, key,
+            [&](BNode& node, size_t i) {
+                this->constructKey(node, i, std::forward<KeyArg>(key));
+                try {
+                    this->constructValue(node, i, std::forward<Args>(args)...);
+                } catch (...) {
+                    std::allocator_traits<typename Base::KeysAllocator>::destroy(this->keys_alloc_, node.keys() + i);
+                    throw;
+                }
+            },
+            path);
+    }
+
+    static V& valueAt(const Slot& slot) noexcept { return slot.node_->values()[slot.index_]; }
+};
+
+}  // namespace btree
@@ -1,70 +1,236 @@
-#pragma once
-
-#include <iostream>
-#include <memory>
-#include <stdexcept>
-#include <type_traits>
-#include <vector>
-
-namespace btree {
-
-using std::size_t;
-
-template <typename T, size_t ORDER, typename Alloc = std::allocator<T>>
-struct BTreeNode {
-    T* keys_;
-    BTreeNode** childs_;
-    size_t keys_count_;
-    bool leaf_;
-
-public:
-    BTreeNode(bool leaf, T* keys, BTreeNode** childs);
-    ~BTreeNode() {}
-
-    void insertNonFull(T key);
-    void splitChild(size_t i, BTreeNode& y);
-
-    template <typename U>
-    void traverse(U& u = U());
-
-    BTreeNode* search(T key);
-
-public:
-    __attribute__((always_inline)) bool isLeaf() const noexcept { return leaf_; }
-
-    __attribute__((always_inline)) size_t size() const noexcept { return keys_count_; }
-};
-
-template <typename T, size_t ORDER, typename Alloc>
-BTreeNode<T, ORDER, Alloc>::BTreeNode(bool leaf, T* keys, BTreeNode** childs)
-    : keys_(keys), childs_(childs), keys_count_(0), leaf_(leaf) {
-}
-
-template <typename T, size_t ORDER, typename Alloc>
-template <typename U>
-void BTreeNode<T, ORDER, Alloc>::traverse(U& u) {
-    size_t i;
-    for (i = 0; i < keys_count_; i++) {
-        if (leaf_ == false) {
-            childs_[i]->traverse(u);
-        }
-        u(keys_[i]);
-    }
-
-    if (leaf_ == false) childs_[i]->traverse(u);
-}
-
-template <typename T, size_t ORDER, typename Alloc>
-BTreeNode<T, ORDER, Alloc>* BTreeNode<T, ORDER, Alloc>::search(T k) {
-    size_t i = 0;
-    while (i < keys_count_ && k > keys_[i])
-        ++i;
-
-    if (keys_[i] == k) return this;
-
-    if (leaf_) return nullptr;
-
-    return childs_[i]->search(k);
-}
-
-}  // namespace btree
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "btree_iterator.hpp"
+#include "btree_search.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Unit of node allocation: every node lives in a run of whole cache lines.
+struct alignas(CACHE_LINE_SIZE) CacheLine {
+    unsigned char bytes_[CACHE_LINE_SIZE];
+};
+
+constexpr size_t floorLog2(size_t n) noexcept { return n < 2 ? 0 : 1 + floorLog2(n / 2); }
+
+// Storage footprint of the per-slot mapped value; sets (V = void) store none.
+template <typename V>
+struct MappedSlot {
+    static constexpr size_t SIZE = sizeof(V);
+    static constexpr size_t ALIGN = alignof(V);
+};
+
+template <>
+struct MappedSlot<void> {
+    static constexpr size_t SIZE = 0;
+    static constexpr size_t ALIGN = 1;
+};
+
+// Moves count live objects from src into the raw slots at dst; the source slots are raw afterwards.
+// Trivially copyable types are relocated with a single memmove; anything else is move-constructed
+// into place, walking in the direction that keeps overlapping ranges intact.
+template <typename Allocator, typename U>
+void relocateArray(Allocator& alloc, U* src, U* dst, size_t count) {
+    if constexpr (std::is_trivially_copyable<U>::value) {
+        std::memmove(static_cast<void*>(dst), static_cast<const void*>(src), count * sizeof(U));
+    } else if (std::less<U*>()(src, dst)) {
+        for (size_t j = count; j-- > 0;) {
+            std::allocator_traits<Allocator>::construct(alloc, dst + j, std::move(src[j]));
+            std::allocator_traits<Allocator>::destroy(alloc, src + j);
+        }
+    } else {
+        for (size_t j = 0; j < count; ++j) {
+            std::allocator_traits<Allocator>::construct(alloc, dst + j, std::move(src[j]));
+            std::allocator_traits<Allocator>::destroy(alloc, src + j);
+        }
+    }
+}
+
+// Allocators whose deallocate does nothing (see ArenaAllocator) say so with is_monotonic. Trees
+// then drop whole subtrees without visiting them when nothing in the nodes needs destroying.
+template <typename Allocator, typename = void>
+struct IsMonotonicAllocator : std::false_type {};
+
+template <typename Allocator>
+struct IsMonotonicAllocator<Allocator, std::void_t<typename Allocator::is_monotonic>>
+    : std::bool_constant<Allocator::is_monotonic::value> {};
+
+// A node is a single contiguous block:
+//
+//   [ header | keys[2 * ORDER - 1] | values[2 * ORDER - 1] | childs[2 * ORDER] ]
+//
+// The value array only exists for maps (V != void) and is kept apart from the keys so key scans
+// stay dense. The child array is only present in internal nodes, leaves end right after the
+// keys (or values). Slots past keys_count_ are raw storage, nothing is constructed there.
+template <typename T, size_t ORDER, typename Alloc = std::allocator<T>, typename V = void>
+struct BTreeNode {
+    static_assert(ORDER >= 2, "BTree ORDER must be at least 2");
+    static_assert(alignof(T) <= CACHE_LINE_SIZE, "over-aligned keys are not supported");
+    static_assert(MappedSlot<V>::ALIGN <= CACHE_LINE_SIZE, "over-aligned values are not supported");
+
+    using key_type = T;
+    using mapped_type = V;
+
+    static constexpr size_t MAX_KEYS = 2 * ORDER - 1;
+    static constexpr size_t MAX_CHILDS = 2 * ORDER;
+    static constexpr size_t MIN_KEYS = ORDER - 1;
+
+    // Upper bound on the number of levels: a tree of height h holds at least 2 * ORDER^(h-1) - 1 keys.
+    static constexpr size_t MAX_HEIGHT = 2 + 64 / floorLog2(ORDER);
+
+    size_t keys_count_;
+    bool leaf_;
+
+public:
+    explicit BTreeNode(bool leaf);
+    ~BTreeNode() {}
+
+    BTreeNode(const BTreeNode& other) = delete;
+    BTreeNode& operator=(const BTreeNode& other) = delete;
+
+    template <typename U>
+    void traverse(U& u = U());
+
+    template <typename Search = default_search, typename Compare = std::less<T>>
+    BTreeNode* search(const T& key, const Compare& comp = Compare());
+
+    template <typename Search, typename K, typename Compare>
+    __attribute__((always_inline)) size_t lowerBound(const K& key, const Compare& comp) const {
+        return Search::lower_bound(keys(), keys_count_, key, comp);
+    }
+
+    template <typename Search, typename K, typename Compare>
+    __attribute__((always_inline)) size_t upperBound(const K& key, const Compare& comp) const {
+        return Search::upper_bound(keys(), keys_count_, key, comp);
+    }
+
+    // Asks for the header and key lines ahead of a search, so the miss overlaps other work.
+    __attribute__((always_inline)) void prefetchKeys() const noexcept {
+        constexpr size_t LINES = (keysOffset() + MAX_KEYS * sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+        const char* p = reinterpret_cast<const char*>(this);
+        for (size_t i = 0; i < LINES && i < 16; ++i)
+            __builtin_prefetch(p + i * CACHE_LINE_SIZE);
+    }
+
+public:
+    __attribute__((always_inline)) bool isLeaf() const noexcept { return leaf_; }
+
+    __attribute__((always_inline)) size_t size() const noexcept { return keys_count_; }
+
+    __attribute__((always_inline)) T* keys() noexcept {
+        return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) const T* keys() const noexcept {
+        return reinterpret_cast<const T*>(reinterpret_cast<const unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) V* values() noexcept {
+        return reinterpret_cast<V*>(reinterpret_cast<unsigned char*>(this) + valuesOffset());
+    }
+
+    __attribute__((always_inline)) const V* values() const noexcept {
+        return reinterpret_cast<const V*>(reinterpret_cast<const unsigned char*>(this) + valuesOffset());
+    }
+
+    __attribute__((always_inline)) BTreeNode** childs() noexcept {
+        return reinterpret_cast<BTreeNode**>(reinterpret_cast<unsigned char*>(this) + childsOffset());
+    }
+
+    __attribute__((always_inline)) BTreeNode* const* childs() const noexcept {
+        return reinterpret_cast<BTreeNode* const*>(reinterpret_cast<const unsigned char*>(this) + childsOffset());
+    }
+
+public:
+    static constexpr size_t alignUp(size_t n, size_t alignment) noexcept {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr size_t keysOffset() noexcept { return alignUp(sizeof(BTreeNode), alignof(T)); }
+
+    static constexpr size_t valuesOffset() noexcept {
+        return alignUp(keysOffset() + MAX_KEYS * sizeof(T), MappedSlot<V>::ALIGN);
+    }
+
+    static constexpr size_t childsOffset() noexcept { return alignUp(leafBytes(), alignof(BTreeNode*)); }
+
+    static constexpr size_t leafBytes() noexcept { return valuesOffset() + MAX_KEYS * MappedSlot<V>::SIZE; }
+
+    static constexpr size_t internalBytes() noexcept { return childsOffset() + MAX_CHILDS * sizeof(BTreeNode*); }
+
+    // Number of cache lines backing a node of the given kind.
+    static constexpr size_t blockCount(bool leaf) noexcept {
+        return alignUp(leaf ? leafBytes() : internalBytes(), CACHE_LINE_SIZE) / CACHE_LINE_SIZE;
+    }
+};
+
+// Bytes of an internal BTreeNode<T, order, *, V>, for any order without instantiating the node
+// for it. The header does not depend on ORDER, so any instance can stand in for it.
+template <typename T, typename V = void>
+constexpr size_t internalNodeBytes(size_t order) noexcept {
+    using Probe = BTreeNode<T, 2, std::allocator<T>, V>;
+    const size_t max_keys = 2 * order - 1;
+    const size_t values = Probe::alignUp(Probe::keysOffset() + max_keys * sizeof(T), MappedSlot<V>::ALIGN);
+    const size_t childs = Probe::alignUp(values + max_keys * MappedSlot<V>::SIZE, alignof(void*));
+    return childs + 2 * order * sizeof(void*);
+}
+
+// Largest ORDER whose internal node fits in TARGET_BYTES (but at least 2). A target of a few
+// cache lines keeps a node search within those lines, a page-sized one gives one node per page.
+template <typename T, size_t TARGET_BYTES, typename V = void>
+constexpr size_t autoOrder() noexcept {
+    size_t order = 2;
+    while (internalNodeBytes<T, V>(order + 1) <= TARGET_BYTES)
+        ++order;
+    return order;
+}
+
+template <typename T, size_t TARGET_BYTES, typename V = void>
+inline constexpr size_t auto_order = autoOrder<T, TARGET_BYTES, V>();
+
+template <typename T, size_t ORDER, typename Alloc, typename V>
+BTreeNode<T, ORDER, Alloc, V>::BTreeNode(bool leaf) : keys_count_(0), leaf_(leaf) {
+    // Checked here, where BTreeNode is complete.
+    static_assert(alignof(BTreeNode) <= CACHE_LINE_SIZE, "node header must not need more than cache line alignment");
+    static_assert(keysOffset() % alignof(T) == 0 && valuesOffset() % MappedSlot<V>::ALIGN == 0 &&
+                      childsOffset() % alignof(BTreeNode*) == 0,
+                  "misaligned node arrays");
+    static_assert(leafBytes() <= blockCount(true) * CACHE_LINE_SIZE &&
+                      internalBytes() <= blockCount(false) * CACHE_LINE_SIZE,
+                  "node does not fit its blocks");
+    static_assert(internalBytes() == internalNodeBytes<T, V>(ORDER), "internalNodeBytes is out of sync with the layout");
+}
+
+template <typename T, size_t ORDER, typename Alloc, typename V>
+template <typename U>
+void BTreeNode<T, ORDER, Alloc, V>::traverse(U& u) {
+    BTreeIterator<BTreeNode>::forEach(this, [&u](BTreeNode* node, size_t i) { u(node->keys()[i]); });
+}
+
+template <typename T, size_t ORDER, typename Alloc, typename V>
+template <typename Search, typename Compare>
+BTreeNode<T, ORDER, Alloc, V>* BTreeNode<T, ORDER, Alloc, V>::search(const T& k, const Compare& comp) {
+    BTreeNode* node = this;
+    for (;;) {
+        const size_t i = node->template lowerBound<Search>(k, comp);
+
+        if (i < node->keys_count_ && !comp(k, node->keys()[i])) return node;
+
+        if (node->leaf_) return nullptr;
+
+        node = node->childs()[i];
+    }
+}
+
+}  // namespace btree
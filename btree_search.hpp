@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace btree {
+
+using std::size_t;
+
+// Intra-node search policies. Every policy answers two questions over the sorted live keys of a node:
+//   lower_bound - index of the first key that is not less than k
+//   upper_bound - index of the first key that is greater than k
+// and is selected through the Search template parameter of BTree.
+
+// Plain scalar scan, the historical behaviour of the tree.
+struct linear_search {
+    template <typename T, typename K, typename Compare>
+    static size_t lower_bound(const T* keys, size_t n, const K& k, const Compare& comp) {
+        size_t i = 0;
+        while (i < n && comp(keys[i], k))
+            ++i;
+        return i;
+    }
+
+    template <typename T, typename K, typename Compare>
+    static size_t upper_bound(const T* keys, size_t n, const K& k, const Compare& comp) {
+        size_t i = 0;
+        while (i < n && !comp(k, keys[i]))
+            ++i;
+        return i;
+    }
+};
+
+// Branchless binary search: the loop body compiles to a conditional move, so the
+// trip count only depends on n and the branch predictor never sees the key.
+struct binary_search {
+    template <typename T, typename K, typename Compare>
+    static size_t lower_bound(const T* keys, size_t n, const K& k, const Compare& comp) {
+        if (n == 0) return 0;
+        const T* base = keys;
+        while (n > 1) {
+            const size_t half = n / 2;
+            base = comp(base[half], k) ? base + half : base;
+            n -= half;
+        }
+        return static_cast<size_t>(base - keys) + comp(*base, k);
+    }
+
+    template <typename T, typename K, typename Compare>
+    static size_t upper_bound(const T* keys, size_t n, const K& k, const Compare& comp) {
+        if (n == 0) return 0;
+        const T* base = keys;
+        while (n > 1) {
+            const size_t half = n / 2;
+            base = comp(k, base[half]) ? base : base + half;
+            n -= half;
+        }
+        return static_cast<size_t>(base - keys) + !comp(k, *base);
+    }
+};
+
+namespace detail {
+
+// Counts keys[i] < k (or keys[i] <= k when INCLUSIVE) in a sorted array. The vector kernels
+// compare a whole register of keys per step and stop at the first register that is not
+// entirely below k, since the remaining keys can only be greater. Key types without a kernel
+// in this build are left to the binary search (VECTOR is false): a scalar count would compare
+// every key of the node.
+template <typename T, bool INCLUSIVE, typename Enable = void>
+struct SimdCount {
+    static constexpr bool VECTOR = false;
+};
+
+template <typename T, bool INCLUSIVE>
+__attribute__((always_inline)) inline size_t countTail(const T* keys, size_t i, size_t n, const T& k) noexcept {
+    size_t c = 0;
+    for (; i < n; ++i)
+        c += INCLUSIVE ? !(k < keys[i]) : (keys[i] < k);
+    return c;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+// 32-bit integers. Unsigned keys are biased by the sign bit so the signed compare applies.
+template <typename T, bool INCLUSIVE>
+struct SimdCount<T, INCLUSIVE, std::enable_if_t<std::is_integral<T>::value && sizeof(T) == 4>> {
+    static constexpr bool VECTOR = true;
+
+    static size_t count(const T* keys, size_t n, const T& k) noexcept {
+        const int32_t bias = std::is_signed<T>::value ? 0 : INT32_MIN;
+        const int32_t key = static_cast<int32_t>(static_cast<uint32_t>(k) ^ static_cast<uint32_t>(bias));
+        size_t c = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256i kv = _mm256_set1_epi32(key);
+        const __m256i bv = _mm256_set1_epi32(bias);
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bv);
+            __m256i gt = INCLUSIVE ? _mm256_cmpgt_epi32(v, kv) : _mm256_cmpgt_epi32(kv, v);
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(gt)));
+            if (INCLUSIVE) mask = ~mask & 0xFFu;
+            c += static_cast<size_t>(__builtin_popcount(mask));
+            if (mask != 0xFFu) return c;
+        }
+#else
+        const __m128i kv = _mm_set1_epi32(key);
+        const __m128i bv = _mm_set1_epi32(bias);
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bv);
+            __m128i gt = INCLUSIVE ? _mm_cmpgt_epi32(v, kv) : _mm_cmpgt_epi32(kv, v);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(gt)));
+            if (INCLUSIVE) mask = ~mask & 0xFu;
+            c += static_cast<size_t>(__builtin_popcount(mask));
+            if (mask != 0xFu) return c;
+        }
+#endif
+        return c + countTail<T, INCLUSIVE>(keys, i, n, k);
+    }
+};
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+
+// 64-bit integers need pcmpgtq, i.e. SSE4.2 at least.
+template <typename T, bool INCLUSIVE>
+struct SimdCount<T, INCLUSIVE, std::enable_if_t<std::is_integral<T>::value && sizeof(T) == 8>> {
+    static constexpr bool VECTOR = true;
+
+    static size_t count(const T* keys, size_t n, const T& k) noexcept {
+        const int64_t bias = std::is_signed<T>::value ? 0 : INT64_MIN;
+        const int64_t key = static_cast<int64_t>(static_cast<uint64_t>(k) ^ static_cast<uint64_t>(bias));
+        size_t c = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256i kv = _mm256_set1_epi64x(key);
+        const __m256i bv = _mm256_set1_epi64x(bias);
+        for (; i + 4 <= n; i += 4) {
+            __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bv);
+            __m256i gt = INCLUSIVE ? _mm256_cmpgt_epi64(v, kv) : _mm256_cmpgt_epi64(kv, v);
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(gt)));
+            if (INCLUSIVE) mask = ~mask & 0xFu;
+            c += static_cast<size_t>(__builtin_popcount(mask));
+            if (mask != 0xFu) return c;
+        }
+#else
+        const __m128i kv = _mm_set1_epi64x(key);
+        const __m128i bv = _mm_set1_epi64x(bias);
+        for (; i + 2 <= n; i += 2) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bv);
+            __m128i gt = INCLUSIVE ? _mm_cmpgt_epi64(v, kv) : _mm_cmpgt_epi64(kv, v);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(gt)));
+            if (INCLUSIVE) mask = ~mask & 0x3u;
+            c += static_cast<size_t>(__builtin_popcount(mask));
+            if (mask != 0x3u) return c;
+        }
+#endif
+        return c + countTail<T, INCLUSIVE>(keys, i, n, k);
+    }
+};
+
+#endif  // __AVX2__ || __SSE4_2__
+
+template <bool INCLUSIVE>
+struct SimdCount<float, INCLUSIVE> {
+    static constexpr bool VECTOR = true;
+
+    static size_t count(const float* keys, size_t n, const float& k) noexcept {
+        size_t c = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256 kv = _mm256_set1_ps(k);
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_loadu_ps(keys + i);
+            __m256 lt = INCLUSIVE ? _mm256_cmp_ps(v, kv, _CMP_LE_OQ) : _mm256_cmp_ps(v, kv, _CMP_LT_OQ);
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(lt));
+            c += static_cast<size_t>(__builtin_popcount(mask));
+            if (mask != 0xFFu) return c;
+        }
+#else
+        const __m128 kv = _mm_set1_ps(k);
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(keys + i);
+            __m128 lt = INCLUSIVE ? _mm_cmple_ps(v, kv) : _mm_cmplt_ps(v, kv);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_ps(lt));
+            c += static_cast<size_t>(__builtin_popcount(mask));
+            if (mask != 0xFu) return c;
+        }
+#endif
+        return c + countTail<float, INCLUSIVE>(keys, i, n, k);
+    }
+};
+
+template <bool INCLUSIVE>
+struct SimdCount<double, INCLUSIVE> {
+    static constexpr bool VECTOR = true;
+
+    static size_t count(const double* keys, size_t n, const double& k) noexcept {
+        size_t c = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256d kv = _mm256_set1_pd(k);
+        for (; i + 4 <= n; i += 4) {
+            __m256d v = _mm256_loadu_pd(keys + i);
+            __m256d lt = INCLUSIVE ? _mm256_cmp_pd(v, kv, _CMP_LE_OQ) : _mm256_cmp_pd(v, kv, _CMP_LT_OQ);
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(lt));
+            c += static_cast<size_t>(__builtin_popcount(mask));
+            if (mask != 0xFu) return c;
+        }
+#else
+        const __m128d kv = _mm_set1_pd(k);
+        for (; i + 2 <= n; i += 2) {
+            __m128d v = _mm_loadu_pd(keys + i);
+            __m128d lt = INCLUSIVE ? _mm_cmple_pd(v, kv) : _mm_cmplt_pd(v, kv);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_pd(lt));
+            c += static_cast<size_t>(__builtin_popcount(mask));
+            if (mask != 0x3u) return c;
+        }
+#endif
+        return c + countTail<double, INCLUSIVE>(keys, i, n, k);
+    }
+};
+
+#endif  // __AVX2__ || __SSE2__
+
+// The vector kernels only apply when the tree orders plain arithmetic keys with operator<, and
+// only to the key types this build has a kernel for.
+template <typename T, typename K, typename Compare>
+constexpr bool simdEligible() noexcept {
+    return std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && std::is_same<T, K>::value &&
+           (std::is_same<Compare, std::less<T>>::value || std::is_same<Compare, std::less<>>::value) &&
+           SimdCount<T, false>::VECTOR;
+}
+
+}  // namespace detail
+
+// Vectorised search for arithmetic keys: AVX2 when compiled with -mavx2, SSE otherwise (64-bit
+// integers need SSE4.2). Key types without a kernel in the build, e.g. 64-bit integers on plain
+// x86-64, 8/16-bit integers and long double, and any other key type or comparator take the
+// branchless binary search.
+struct simd_search {
+    template <typename T, typename K, typename Compare>
+    static size_t lower_bound(const T* keys, size_t n, const K& k, const Compare& comp) {
+        if constexpr (detail::simdEligible<T, K, Compare>()) {
+            return detail::SimdCount<T, false>::count(keys, n, k);
+        } else {
+            return binary_search::lower_bound(keys, n, k, comp);
+        }
+    }
+
+    template <typename T, typename K, typename Compare>
+    static size_t upper_bound(const T* keys, size_t n, const K& k, const Compare& comp) {
+        if constexpr (detail::simdEligible<T, K, Compare>()) {
+            return detail::SimdCount<T, true>::count(keys, n, k);
+        } else {
+            return binary_search::upper_bound(keys, n, k, comp);
+        }
+    }
+};
+
+using default_search = simd_search;
+
+}  // namespace btree
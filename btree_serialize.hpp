@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace btree {
+
+using std::size_t;
+
+// Snapshot format written by BTree::save and read by BTree::load:
+//
+//   [ SnapshotHeader | keys in ascending order | checksum ]
+//
+// Trivially copyable keys are stored as their raw bytes, anything else goes through
+// SnapshotCodec<T>. The checksum covers the header and the keys, so a snapshot from a different
+// build, key type or byte order is rejected up front, and a damaged one once it has been read.
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint32_t SNAPSHOT_RAW_KEYS = 1;
+
+struct SnapshotHeader {
+    char magic_[8];
+    uint32_t version_;
+    uint32_t byte_order_;  // 0x01020304 as written by the saving machine
+    uint32_t order_;       // ORDER of the saved tree, for information: any ORDER can load it
+    uint32_t key_size_;
+    uint32_t flags_;
+    uint32_t reserved_;
+    uint64_t count_;
+};
+
+// 64-bit FNV-1a variant that folds in 8 bytes per step. The result depends only on the bytes,
+// not on how they were split across update calls.
+class SnapshotChecksum {
+    static constexpr uint64_t PRIME = 0x100000001b3ULL;
+
+    uint64_t hash_ = 0xcbf29ce484222325ULL;
+    unsigned char pending_[8];
+    size_t pending_bytes_ = 0;
+
+public:
+    void update(const void* data, size_t size) noexcept {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        while (size > 0 && pending_bytes_ != 0) {
+            push(*p++);
+            --size;
+        }
+        for (; size >= sizeof(uint64_t); p += sizeof(uint64_t), size -= sizeof(uint64_t))
+            mix(p);
+        while (size-- > 0)
+            push(*p++);
+    }
+
+    uint64_t value() const noexcept {
+        uint64_t hash = hash_;
+        for (size_t i = 0; i < pending_bytes_; ++i)
+            hash = (hash ^ pending_[i]) * PRIME;
+        return hash;
+    }
+
+private:
+    __attribute__((always_inline)) void mix(const unsigned char* word) noexcept {
+        uint64_t w;
+        std::memcpy(&w, word, sizeof(w));
+        hash_ = (hash_ ^ w) * PRIME;
+        hash_ ^= hash_ >> 29;
+    }
+
+    void push(unsigned char byte) noexcept {
+        pending_[pending_bytes_++] = byte;
+        if (pending_bytes_ == sizeof(pending_)) {
+            mix(pending_);
+            pending_bytes_ = 0;
+        }
+    }
+};
+
+// Buffered, checksummed output to a stream or to the end of a byte vector.
+class SnapshotWriter {
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    std::ostream* os_ = nullptr;
+    std::vector<unsigned char>* out_;
+    std::vector<unsigned char> buffer_;
+    SnapshotChecksum checksum_;
+
+public:
+    explicit SnapshotWriter(std::ostream& os) : os_(&os), out_(&buffer_) { buffer_.reserve(BUFFER_SIZE); }
+    explicit SnapshotWriter(std::vector<unsigned char>& out) : out_(&out) {}
+
+    SnapshotWriter(const SnapshotWriter& other) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter& other) = delete;
+
+    // Room for bytes more output when writing to a vector.
+    void reserve(size_t bytes) {
+        if (os_ == nullptr) out_->reserve(out_->size() + bytes);
+    }
+
+    void write(const void* data, size_t size) {
+        checksum_.update(data, size);
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        out_->insert(out_->end(), p, p + size);
+        if (os_ != nullptr && buffer_.size() >= BUFFER_SIZE) flush();
+    }
+
+    // Appends the checksum and flushes. Throws std::runtime_error when the stream failed.
+    void finish() {
+        const uint64_t checksum = checksum_.value();
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(&checksum);
+        out_->insert(out_->end(), p, p + sizeof(checksum));
+        if (os_ == nullptr) return;
+        flush();
+        os_->flush();
+        if (!*os_) throw std::runtime_error("BTree snapshot: write failed");
+    }
+
+private:
+    void flush() {
+        os_->write(reinterpret_cast<const char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+};
+
+// Buffered, checksummed input from a stream or a byte range. Running out of input throws.
+class SnapshotReader {
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    std::istream* is_ = nullptr;
+    std::vector<unsigned char> buffer_;
+    const unsigned char* cursor_;
+    const unsigned char* end_;
+    SnapshotChecksum checksum_;
+
+public:
+    explicit SnapshotReader(std::istream& is) : is_(&is), buffer_(BUFFER_SIZE), cursor_(nullptr), end_(nullptr) {}
+    SnapshotReader(const unsigned char* data, size_t size) : cursor_(data), end_(data + size) {}
+
+    SnapshotReader(const SnapshotReader& other) = delete;
+    SnapshotReader& operator=(const SnapshotReader& other) = delete;
+
+    void read(void* data, size_t size) {
+        readRaw(data, size);
+        checksum_.update(data, size);
+    }
+
+    // Bytes left in a byte range; streams do not know.
+    size_t remaining() const noexcept { return is_ == nullptr ? static_cast<size_t>(end_ - cursor_) : SIZE_MAX; }
+
+    // Reads the trailing checksum and compares it with everything read so far.
+    bool finish() {
+        const uint64_t expected = checksum_.value();
+        uint64_t stored;
+        readRaw(&stored, sizeof(stored));
+        return stored == expected;
+    }
+
+private:
+    void readRaw(void* data, size_t size) {
+        unsigned char* p = static_cast<unsigned char*>(data);
+        while (size > 0) {
+            if (cursor_ == end_ && !refill()) throw std::runtime_error("BTree snapshot: unexpected end of input");
+            const size_t n = std::min(size, static_cast<size_t>(end_ - cursor_));
+            std::memcpy(p, cursor_, n);
+            cursor_ += n;
+            p += n;
+            size -= n;
+        }
+    }
+
+    bool refill() {
+        if (is_ == nullptr) return false;
+        is_->read(reinterpret_cast<char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+        cursor_ = buffer_.data();
+        end_ = cursor_ + is_->gcount();
+        return cursor_ != end_;
+    }
+};
+
+// How keys that are not trivially copyable are written and read back. Specialize it for your
+// own key types; std::basic_string of trivially copyable characters is covered.
+template <typename T, typename = void>
+struct SnapshotCodec;
+
+template <typename CharT, typename Traits, typename A>
+struct SnapshotCodec<std::basic_string<CharT, Traits, A>, std::enable_if_t<std::is_trivially_copyable<CharT>::value>> {
+    using String = std::basic_string<CharT, Traits, A>;
+
+    static void write(SnapshotWriter& writer, const String& s) {
+        const uint64_t length = s.size();
+        writer.write(&length, sizeof(length));
+        writer.write(s.data(), s.size() * sizeof(CharT));
+    }
+
+    static String read(SnapshotReader& reader) {
+        uint64_t length;
+        reader.read(&length, sizeof(length));
+        if (length > reader.remaining() / sizeof(CharT)) throw std::runtime_error("BTree snapshot: unexpected end of input");
+        String s(static_cast<size_t>(length), CharT());
+        reader.read(&s[0], s.size() * sizeof(CharT));
+        return s;
+    }
+};
+
+template <typename T>
+SnapshotHeader makeSnapshotHeader(size_t order, size_t count) {
+    SnapshotHeader header;
+    std::memcpy(header.magic_, "BTSNAPSH", sizeof(header.magic_));
+    header.version_ = SNAPSHOT_VERSION;
+    header.byte_order_ = 0x01020304;
+    header.order_ = static_cast<uint32_t>(order);
+    header.key_size_ = sizeof(T);
+    header.flags_ = std::is_trivially_copyable<T>::value ? SNAPSHOT_RAW_KEYS : 0;
+    header.reserved_ = 0;
+    header.count_ = count;
+    return header;
+}
+
+// Throws std::runtime_error unless the header describes a snapshot of T this build can read.
+template <typename T>
+void checkSnapshotHeader(const SnapshotHeader& header) {
+    const SnapshotHeader expected = makeSnapshotHeader<T>(0, 0);
+    if (std::memcmp(header.magic_, expected.magic_, sizeof(header.magic_)) != 0)
+        throw std::runtime_error("BTree snapshot: not a snapshot");
+    if (header.version_ != SNAPSHOT_VERSION)
+        throw std::runtime_error("BTree snapshot: unsupported version " + std::to_string(header.version_));
+    if (header.byte_order_ != expected.byte_order_) throw std::runtime_error("BTree snapshot: saved with another byte order");
+    if (header.key_size_ != expected.key_size_ || header.flags_ != expected.flags_)
+        throw std::runtime_error("BTree snapshot: saved with another key type");
+}
+
+}  // namespace btree
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace btree {
+
+using std::size_t;
+
+// Latencies in power-of-two buckets: bucket b counts samples of [2^b, 2^(b+1)) ns, bucket 0
+// also takes 0 ns.
+struct LatencyHistogram {
+    static constexpr size_t BUCKETS = 40;
+
+    uint64_t counts_[BUCKETS] = {};
+    uint64_t samples_ = 0;
+
+    void record(uint64_t ns) noexcept {
+        counts_[bucketOf(ns)] += 1;
+        samples_ += 1;
+    }
+
+    static size_t bucketOf(uint64_t ns) noexcept {
+        size_t b = 0;
+        while (b + 1 < BUCKETS && (ns >> (b + 1)) != 0)
+            ++b;
+        return b;
+    }
+
+    // Upper end of the bucket holding the q-quantile, 0 without samples.
+    uint64_t quantile(double q) const noexcept {
+        const double rank = q * static_cast<double>(samples_);
+        uint64_t seen = 0;
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            seen += counts_[b];
+            if (seen > 0 && static_cast<double>(seen) >= rank) return (uint64_t(2) << b) - 1;
+        }
+        return 0;
+    }
+};
+
+// Counter that threads may bump concurrently: const lookups count themselves, and a const tree
+// is read from many threads at once like the standard containers. Relaxed, since the totals
+// order nothing. A copy takes a snapshot, so the stats holding it still copy, move and swap.
+class RelaxedCounter {
+    std::atomic<uint64_t> value_{0};
+
+public:
+    RelaxedCounter() noexcept = default;
+
+    RelaxedCounter(const RelaxedCounter& other) noexcept : value_(other.load()) {}
+
+    RelaxedCounter& operator=(const RelaxedCounter& other) noexcept {
+        value_.store(other.load(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    uint64_t load() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+    // Returns the new value.
+    uint64_t increment() noexcept { return value_.fetch_add(1, std::memory_order_relaxed) + 1; }
+};
+
+// LatencyHistogram for concurrent recording; snapshot() copies it into a plain one.
+struct SharedLatencyHistogram {
+    RelaxedCounter counts_[LatencyHistogram::BUCKETS];
+    RelaxedCounter samples_;
+
+    void record(uint64_t ns) noexcept {
+        counts_[LatencyHistogram::bucketOf(ns)].increment();
+        samples_.increment();
+    }
+
+    LatencyHistogram snapshot() const noexcept {
+        LatencyHistogram h;
+        for (size_t b = 0; b < LatencyHistogram::BUCKETS; ++b)
+            h.counts_[b] = counts_[b].load();
+        h.samples_ = samples_.load();
+        return h;
+    }
+};
+
+// Stats policies for the trees' Stats parameter. They see splits and merges as they happen and
+// wrap searches and inserts in a timer; the shape of the tree is not tracked but measured when
+// stats() is asked for.
+//
+// no_stats, the default, records nothing and every hook compiles away.
+struct no_stats {
+    static constexpr bool ENABLED = false;
+
+    struct Timer {};
+
+    void onSplit() noexcept {}
+    void onMerge() noexcept {}
+
+    Timer timeSearch() noexcept { return Timer(); }
+    Timer timeInsert() noexcept { return Timer(); }
+};
+
+// Counts splits and merges and times every SAMPLE_EVERY-th search and insert. Searches on a
+// const tree may run on several threads, so everything is counted with relaxed atomics.
+template <size_t SAMPLE_EVERY = 64>
+struct collect_stats {
+    static_assert(SAMPLE_EVERY > 0, "SAMPLE_EVERY must be positive");
+
+    static constexpr bool ENABLED = true;
+
+    RelaxedCounter splits_;
+    RelaxedCounter merges_;
+    RelaxedCounter searches_;
+    RelaxedCounter inserts_;
+    SharedLatencyHistogram search_latency_;
+    SharedLatencyHistogram insert_latency_;
+
+    // Records the time until it goes out of scope, unless the operation was not sampled.
+    class Timer {
+        SharedLatencyHistogram* histogram_;
+        std::chrono::steady_clock::time_point start_;
+
+    public:
+        explicit Timer(SharedLatencyHistogram* histogram) noexcept : histogram_(histogram) {
+            if (histogram_ != nullptr) start_ = std::chrono::steady_clock::now();
+        }
+
+        Timer(const Timer& other) = delete;
+        Timer& operator=(const Timer& other) = delete;
+
+        ~Timer() {
+            if (histogram_ == nullptr) return;
+            const auto elapsed = std::chrono::steady_clock::now() - start_;
+            histogram_->record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    };
+
+    void onSplit() noexcept { splits_.increment(); }
+    void onMerge() noexcept { merges_.increment(); }
+
+    Timer timeSearch() noexcept {
+        return Timer(searches_.increment() % SAMPLE_EVERY == 0 ? &search_latency_ : nullptr);
+    }
+
+    Timer timeInsert() noexcept {
+        return Timer(inserts_.increment() % SAMPLE_EVERY == 0 ? &insert_latency_ : nullptr);
+    }
+};
+
+// Snapshot returned by stats(). Levels count from the root. A node's fill is keys_count_ over
+// its key capacity; fill_[b] counts the nodes with fill in [b / 10, (b + 1) / 10), full nodes
+// land in the last bucket. A tree fed ascending keys shows up as most nodes near one half.
+// bytes_ is what the nodes hold from the allocator. Counters stay zero under no_stats.
+struct TreeStats {
+    static constexpr size_t FILL_BUCKETS = 10;
+
+    size_t order_ = 0;
+    size_t height_ = 0;
+    size_t nodes_ = 0;
+    size_t keys_ = 0;
+    size_t bytes_ = 0;
+    std::vector<size_t> nodes_per_level_;
+    size_t fill_[FILL_BUCKETS] = {};
+    double average_fill_ = 0;
+
+    bool counters_ = false;
+    uint64_t splits_ = 0;
+    uint64_t merges_ = 0;
+    uint64_t searches_ = 0;
+    uint64_t inserts_ = 0;
+    LatencyHistogram search_latency_;
+    LatencyHistogram insert_latency_;
+
+    std::string to_json() const {
+        std::string json = "{";
+        field(json, "order", order_);
+        field(json, "height", height_);
+        field(json, "nodes", nodes_);
+        field(json, "keys", keys_);
+        field(json, "bytes", bytes_);
+        json += "\"nodes_per_level\":" + array(nodes_per_level_.data(), nodes_per_level_.size()) + ",";
+        json += "\"fill_histogram\":" + array(fill_, FILL_BUCKETS) + ",";
+
+        char fill[32];
+        std::snprintf(fill, sizeof(fill), "%.4f", average_fill_);
+        json += "\"average_fill\":" + std::string(fill) + ",";
+
+        json += "\"counters\":" + std::string(counters_ ? "true" : "false");
+        if (counters_) {
+            json += ",";
+            field(json, "splits", splits_);
+            field(json, "merges", merges_);
+            field(json, "searches", searches_);
+            field(json, "inserts", inserts_);
+            json += "\"search_latency_ns\":" + histogram(search_latency_) + ",";
+            json += "\"insert_latency_ns\":" + histogram(insert_latency_);
+        }
+        return json + "}";
+    }
+
+private:
+    template <typename N>
+    static void field(std::string& json, const char* name, N value) {
+        json += "\"" + std::string(name) + "\":" + std::to_string(value) + ",";
+    }
+
+    template <typename N>
+    static std::string array(const N* values, size_t count) {
+        std::string s = "[";
+        for (size_t i = 0; i < count; ++i)
+            s += (i > 0 ? "," : "") + std::to_string(values[i]);
+        return s + "]";
+    }
+
+    // Buckets are listed up to the last non-empty one; bucket b starts at 2^b ns.
+    static std::string histogram(const LatencyHistogram& h) {
+        size_t used = LatencyHistogram::BUCKETS;
+        while (used > 0 && h.counts_[used - 1] == 0)
+            --used;
+        return "{\"samples\":" + std::to_string(h.samples_) + ",\"p50\":" + std::to_string(h.quantile(0.5)) +
+               ",\"p99\":" + std::to_string(h.quantile(0.99)) + ",\"log2_buckets\":" + array(h.counts_, used) + "}";
+    }
+};
+
+}  // namespace btree
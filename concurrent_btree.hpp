@@ -0,0 +1,604 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "btree_search.hpp"
+#include "concurrent_node.hpp"
+#include "epoch.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Thread-safe BTree built on optimistic lock coupling (Leis et al.). Every node carries a version
+// lock:
+//   - lookups take no lock at all; they read a node, validate its version and restart from the
+//     root when a writer got in the way,
+//   - inserts descend the same way and reuse the preemptive splits of BTree::insert: a full node
+//     met on the way down is split right away, so only that node and its parent are ever locked
+//     and nothing has to be fixed on the way back up,
+//   - erases descend optimistically as well and only lock the leaf when it can spare the key;
+//     keys in internal nodes and leaves at the minimum take the pessimistic path, which locks
+//     top-down (parent, then child, then a sibling when the child has to be refilled) and
+//     releases each node once its child is safe, mirroring BTree::erase.
+//
+// Keys must be trivially copyable since readers may look at a slot while it is being written.
+// Nodes unlinked by merges or clear() are retired rather than freed: every operation pins an
+// epoch, and retired nodes go back to the allocator in batches once no pinned thread can still
+// be inside them. The allocator is called from any thread.
+template <typename T, size_t ORDER, typename Alloc = std::allocator<T>, typename Search = default_search>
+class ConcurrentBTree {
+    using BNode = ConcurrentNode<T, ORDER>;
+
+    typedef std::allocator_traits<Alloc> alloc_traits;
+    using BlockAllocator = typename alloc_traits::template rebind_alloc<CacheLine>;
+
+    // Retired nodes are handed back once this many have piled up.
+    static constexpr size_t RECLAIM_BATCH = 64;
+
+public:
+    using key_type = T;
+    using key_compare = std::less<T>;
+    using allocator_type = Alloc;
+    using size_type = size_t;
+
+private:
+    struct Retired {
+        BNode* node_;
+        uint64_t epoch_;
+    };
+
+private:
+    BlockAllocator block_alloc_;
+    std::less<T> comp_;
+    std::atomic<BNode*> root_;
+
+    mutable EpochDomain epochs_;
+    std::mutex retired_mutex_;
+    std::vector<Retired> retired_;
+    std::atomic<size_t> retired_count_{0};
+
+public:
+    explicit ConcurrentBTree(const Alloc& alloc = Alloc()) : block_alloc_(BlockAllocator(alloc)) {
+        root_.store(createNode(true), std::memory_order_relaxed);
+    }
+
+    ~ConcurrentBTree() {
+        clear(root_.load(std::memory_order_relaxed));
+        for (const Retired& r : retired_)
+            deleteNode(r.node_);
+    }
+
+    ConcurrentBTree(const ConcurrentBTree& other) = delete;
+    ConcurrentBTree(ConcurrentBTree&& other) = delete;
+
+    ConcurrentBTree& operator=(const ConcurrentBTree& other) = delete;
+    ConcurrentBTree& operator=(ConcurrentBTree&& other) = delete;
+
+public:
+    void insert(const T& key) {
+        auto guard = epochs_.pin();
+        while (!tryInsert(key)) {
+        }
+    }
+
+    bool contains(const T& key) const {
+        auto guard = epochs_.pin();
+        bool found = false;
+        while (!tryContains(key, found)) {
+        }
+        return found;
+    }
+
+    // Removes every copy of key and returns how many were removed. Each copy is removed
+    // atomically, the call as a whole is not.
+    size_t erase(const T& key) {
+        size_t removed = 0;
+        {
+            auto guard = epochs_.pin();
+            for (;;) {
+                bool erased;
+                bool locked;
+                while (!tryEraseFromLeaf(key, erased, locked)) {
+                }
+                if (locked) {
+                    while (!tryErase(key, erased)) {
+                    }
+                }
+                if (!erased) break;
+                ++removed;
+            }
+        }
+        reclaimIfDue();
+        return removed;
+    }
+
+    // Swaps in an empty root, then walks the old tree top-down, locking each node in turn (so
+    // writers still working in it finish first), marking it obsolete and retiring it. Writers
+    // that reach an obsolete node restart in the new tree.
+    void clear() {
+        {
+            auto guard = epochs_.pin();
+            BNode* empty = createNode(true);
+            BNode* old;
+            for (;;) {
+                old = root_.load(std::memory_order_acquire);
+                if (!old->lock_.writeLock()) continue;
+                if (old == root_.load(std::memory_order_acquire)) break;
+                old->lock_.writeUnlock();
+            }
+            root_.store(empty, std::memory_order_release);
+            retireTree(old);
+        }
+        reclaimIfDue();
+    }
+
+    bool empty() const {
+        auto guard = epochs_.pin();
+        for (;;) {
+            BNode* root = root_.load(std::memory_order_acquire);
+            uint64_t v;
+            if (!root->lock_.readLock(v)) continue;
+            const bool result = root->count() == 0;
+            if (root->lock_.validate(v)) return result;
+        }
+    }
+
+    // In-order walk. Only valid while no other thread modifies the tree.
+    template <typename U>
+    void traverse(U& u = U()) const {
+        root_.load(std::memory_order_acquire)->traverse(u);
+    }
+
+private:
+    // One optimistic attempt; false means "restart from the root".
+    bool tryContains(const T& key, bool& found) const {
+        BNode* node = root_.load(std::memory_order_acquire);
+        uint64_t v;
+        if (!node->lock_.readLock(v) || node != root_.load(std::memory_order_acquire)) return false;
+
+        for (;;) {
+            const size_t i = node->template lowerBound<Search>(key, comp_);
+            if (i < node->count() && !comp_(key, node->keys()[i])) {
+                found = true;
+                return node->lock_.validate(v);
+            }
+            if (node->leaf_) {
+                found = false;
+                return node->lock_.validate(v);
+            }
+
+            // The child pointer is only trusted once the node is known to be unchanged, and the
+            // node is validated again after the child's version is taken, which hands the
+            // "nothing moved" guarantee from one level to the next.
+            BNode* child = node->childs()[i];
+            if (!node->lock_.validate(v)) return false;
+            uint64_t cv;
+            if (!child->lock_.readLock(cv) || !node->lock_.validate(v)) return false;
+            node = child;
+            v = cv;
+        }
+    }
+
+    bool tryInsert(const T& key) {
+        BNode* node = root_.load(std::memory_order_acquire);
+        uint64_t v;
+        if (!node->lock_.readLock(v) || node != root_.load(std::memory_order_acquire)) return false;
+
+        BNode* parent = nullptr;
+        uint64_t pv = 0;
+        size_t pi = 0;
+        for (;;) {
+            if (node->keys_count_ == BNode::MAX_KEYS) {
+                // Preemptive split: the parent was not full when we passed it, and upgrading
+                // with the version we read proves it still is not.
+                if (parent != nullptr && !parent->lock_.upgrade(pv)) return false;
+                if (!node->lock_.upgrade(v)) {
+                    if (parent != nullptr) parent->lock_.writeUnlock();
+                    return false;
+                }
+                if (parent == nullptr && node != root_.load(std::memory_order_acquire)) {
+                    node->lock_.writeUnlock();
+                    return false;
+                }
+
+                splitChild(parent, pi, node);
+                node->lock_.writeUnlock();
+                if (parent != nullptr) parent->lock_.writeUnlock();
+                return false;
+            }
+
+            if (node->leaf_) {
+                if (!node->lock_.upgrade(v)) return false;
+                if (parent != nullptr && !parent->lock_.validate(pv)) {
+                    node->lock_.writeUnlock();
+                    return false;
+                }
+
+                T* keys = node->keys();
+                const size_t n = node->keys_count_;
+                const size_t i = node->template upperBound<Search>(key, comp_);
+                std::memmove(static_cast<void*>(keys + i + 1), static_cast<const void*>(keys + i), (n - i) * sizeof(T));
+                keys[i] = key;
+                node->keys_count_ = n + 1;
+                node->lock_.writeUnlock();
+                return true;
+            }
+
+            const size_t i = node->template upperBound<Search>(key, comp_);
+            BNode* child = node->childs()[i];
+            if (!node->lock_.validate(v)) return false;
+            uint64_t cv;
+            if (!child->lock_.readLock(cv) || !node->lock_.validate(v)) return false;
+
+            parent = node;
+            pv = v;
+            pi = i;
+            node = child;
+            v = cv;
+        }
+    }
+
+    // Splits the full, write-locked node y, child i of the write-locked parent (or the root when
+    // parent is null), exactly as BTree does: the median moves up, the upper half goes to a new
+    // right sibling that nobody can reach before the parent is unlocked.
+    void splitChild(BNode* parent, size_t i, BNode* y) {
+        BNode* z = createNode(y->leaf_);
+        BNode* s = nullptr;
+        if (parent == nullptr) {
+            try {
+                s = createNode(false);
+            } catch (...) {
+                deleteNode(z);
+                throw;
+            }
+        }
+
+        std::memcpy(static_cast<void*>(z->keys()), static_cast<const void*>(y->keys() + ORDER),
+                    (BNode::MAX_KEYS - ORDER) * sizeof(T));
+        if (!y->leaf_) std::copy(y->childs() + ORDER, y->childs() + BNode::MAX_CHILDS, z->childs());
+        z->keys_count_ = BNode::MAX_KEYS - ORDER;
+        const T median = y->keys()[ORDER - 1];
+        y->keys_count_ = ORDER - 1;
+
+        if (parent == nullptr) {
+            s->keys()[0] = median;
+            s->childs()[0] = y;
+            s->childs()[1] = z;
+            s->keys_count_ = 1;
+            root_.store(s, std::memory_order_release);
+            return;
+        }
+
+        const size_t n = parent->keys_count_;
+        T* keys = parent->keys();
+        std::memmove(static_cast<void*>(keys + i + 1), static_cast<const void*>(keys + i), (n - i) * sizeof(T));
+        keys[i] = median;
+        std::copy_backward(parent->childs() + i + 1, parent->childs() + n + 1, parent->childs() + n + 2);
+        parent->childs()[i + 1] = z;
+        parent->keys_count_ = n + 1;
+    }
+
+private:
+    // Optimistic removal for the common case: the key sits in a leaf that stays at or above
+    // MIN_KEYS, so only that leaf is locked. Anything else sets locked and leaves the key alone.
+    bool tryEraseFromLeaf(const T& key, bool& erased, bool& locked) {
+        erased = false;
+        locked = false;
+        BNode* node = root_.load(std::memory_order_acquire);
+        uint64_t v;
+        if (!node->lock_.readLock(v) || node != root_.load(std::memory_order_acquire)) return false;
+
+        BNode* parent = nullptr;
+        uint64_t pv = 0;
+        for (;;) {
+            const size_t i = node->template lowerBound<Search>(key, comp_);
+            const bool here = i < node->count() && !comp_(key, node->keys()[i]);
+
+            if (node->leaf_ || here) {
+                if (!here || !node->leaf_ || (parent != nullptr && node->keys_count_ <= BNode::MIN_KEYS)) {
+                    locked = here;
+                    return node->lock_.validate(v);
+                }
+                if (!node->lock_.upgrade(v)) return false;
+                if (parent != nullptr && !parent->lock_.validate(pv)) {
+                    node->lock_.writeUnlock();
+                    return false;
+                }
+                removeAt(*node, i);
+                node->lock_.writeUnlock();
+                erased = true;
+                return true;
+            }
+
+            BNode* child = node->childs()[i];
+            if (!node->lock_.validate(v)) return false;
+            uint64_t cv;
+            if (!child->lock_.readLock(cv) || !node->lock_.validate(v)) return false;
+            parent = node;
+            pv = v;
+            node = child;
+            v = cv;
+        }
+    }
+
+    bool tryErase(const T& key, bool& erased) {
+        BNode* x = root_.load(std::memory_order_acquire);
+        if (!x->lock_.writeLock()) return false;
+        if (x != root_.load(std::memory_order_acquire)) {
+            x->lock_.writeUnlock();
+            return false;
+        }
+        erased = eraseFrom(x, key);
+        return true;
+    }
+
+    // Top-down removal of one copy of key, entered with x write-locked. Before the descent enters
+    // a child holding only MIN_KEYS keys, the child is refilled from a sibling or merged with it,
+    // so a removal never has to climb back; x is released as soon as its child is locked and safe.
+    bool eraseFrom(BNode* x, const T& key) {
+        for (;;) {
+            const size_t i = x->template lowerBound<Search>(key, comp_);
+            const bool here = i < x->keys_count_ && !comp_(key, x->keys()[i]);
+
+            if (x->leaf_) {
+                if (here) removeAt(*x, i);
+                x->lock_.writeUnlock();
+                return here;
+            }
+
+            if (here) {
+                // The key is replaced by its predecessor or successor, taken from whichever
+                // neighbouring child can spare one; otherwise both children and the key merge.
+                BNode* y = x->childs()[i];
+                y->lock_.writeLock();
+                if (y->keys_count_ > BNode::MIN_KEYS) {
+                    x->keys()[i] = takeMax(y);
+                    x->lock_.writeUnlock();
+                    return true;
+                }
+                BNode* z = x->childs()[i + 1];
+                z->lock_.writeLock();
+                if (z->keys_count_ > BNode::MIN_KEYS) {
+                    y->lock_.writeUnlock();
+                    x->keys()[i] = takeMin(z);
+                    x->lock_.writeUnlock();
+                    return true;
+                }
+                mergeChilds(*x, i);
+                x = handOver(x, y);
+                continue;
+            }
+
+            BNode* c = x->childs()[i];
+            c->lock_.writeLock();
+            if (c->keys_count_ == BNode::MIN_KEYS) c = fillChild(*x, i, c);
+            x = handOver(x, c);
+        }
+    }
+
+    // Releases x once the descent moved on to its locked child c. A root emptied by its last
+    // merge is replaced by c and retired.
+    BNode* handOver(BNode* x, BNode* c) {
+        if (x->keys_count_ == 0) {
+            root_.store(c, std::memory_order_release);
+            x->lock_.writeUnlockObsolete();
+            retire(x);
+        } else {
+            x->lock_.writeUnlock();
+        }
+        return c;
+    }
+
+    // Removes the largest key under the write-locked y, which can spare one, and unlocks y.
+    T takeMax(BNode* y) {
+        for (;;) {
+            if (y->leaf_) {
+                const T key = y->keys()[y->keys_count_ - 1];
+                y->keys_count_ -= 1;
+                y->lock_.writeUnlock();
+                return key;
+            }
+            const size_t n = y->keys_count_;
+            BNode* c = y->childs()[n];
+            c->lock_.writeLock();
+            if (c->keys_count_ == BNode::MIN_KEYS) c = fillChild(*y, n, c);
+            y->lock_.writeUnlock();
+            y = c;
+        }
+    }
+
+    T takeMin(BNode* y) {
+        for (;;) {
+            if (y->leaf_) {
+                const T key = y->keys()[0];
+                removeAt(*y, 0);
+                y->lock_.writeUnlock();
+                return key;
+            }
+            BNode* c = y->childs()[0];
+            c->lock_.writeLock();
+            if (c->keys_count_ == BNode::MIN_KEYS) c = fillChild(*y, 0, c);
+            y->lock_.writeUnlock();
+            y = c;
+        }
+    }
+
+    // Child i of the write-locked x is write-locked and has MIN_KEYS keys. Borrows one key from a
+    // sibling or merges with it and returns the locked node the descent continues in.
+    BNode* fillChild(BNode& x, size_t i, BNode* c) {
+        BNode* left = nullptr;
+        if (i > 0) {
+            left = x.childs()[i - 1];
+            left->lock_.writeLock();
+            if (left->keys_count_ > BNode::MIN_KEYS) {
+                rotateRight(x, i - 1);
+                left->lock_.writeUnlock();
+                return c;
+            }
+        }
+
+        if (i < x.keys_count_) {
+            BNode* right = x.childs()[i + 1];
+            right->lock_.writeLock();
+            if (left != nullptr) left->lock_.writeUnlock();
+            if (right->keys_count_ > BNode::MIN_KEYS) {
+                rotateLeft(x, i);
+                right->lock_.writeUnlock();
+            } else {
+                mergeChilds(x, i);
+            }
+            return c;
+        }
+
+        mergeChilds(x, i - 1);
+        return left;
+    }
+
+    // Moves the last key of child s up into separator s and the separator down into child s + 1.
+    void rotateRight(BNode& x, size_t s) {
+        BNode& left = *x.childs()[s];
+        BNode& right = *x.childs()[s + 1];
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        std::memmove(static_cast<void*>(right.keys() + 1), static_cast<const void*>(right.keys()), rn * sizeof(T));
+        right.keys()[0] = x.keys()[s];
+        if (!right.leaf_) {
+            std::copy_backward(right.childs(), right.childs() + rn + 1, right.childs() + rn + 2);
+            right.childs()[0] = left.childs()[ln];
+        }
+        x.keys()[s] = left.keys()[ln - 1];
+        left.keys_count_ = ln - 1;
+        right.keys_count_ = rn + 1;
+    }
+
+    // Mirror of rotateRight: the first key of child s + 1 goes up, separator s comes down.
+    void rotateLeft(BNode& x, size_t s) {
+        BNode& left = *x.childs()[s];
+        BNode& right = *x.childs()[s + 1];
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        left.keys()[ln] = x.keys()[s];
+        if (!left.leaf_) {
+            left.childs()[ln + 1] = right.childs()[0];
+            std::copy(right.childs() + 1, right.childs() + rn + 1, right.childs());
+        }
+        x.keys()[s] = right.keys()[0];
+        std::memmove(static_cast<void*>(right.keys()), static_cast<const void*>(right.keys() + 1), (rn - 1) * sizeof(T));
+        left.keys_count_ = ln + 1;
+        right.keys_count_ = rn - 1;
+    }
+
+    // Folds child s + 1 and separator s into child s. The right child is unlinked, marked obsolete
+    // so optimistic readers still inside it restart, and retired.
+    void mergeChilds(BNode& x, size_t s) {
+        BNode& left = *x.childs()[s];
+        BNode* right = x.childs()[s + 1];
+        const size_t ln = left.keys_count_;
+        const size_t rn = right->keys_count_;
+        const size_t n = x.keys_count_;
+
+        left.keys()[ln] = x.keys()[s];
+        std::memcpy(static_cast<void*>(left.keys() + ln + 1), static_cast<const void*>(right->keys()), rn * sizeof(T));
+        if (!left.leaf_) std::copy(right->childs(), right->childs() + rn + 1, left.childs() + ln + 1);
+        left.keys_count_ = ln + 1 + rn;
+
+        std::memmove(static_cast<void*>(x.keys() + s), static_cast<const void*>(x.keys() + s + 1), (n - s - 1) * sizeof(T));
+        std::copy(x.childs() + s + 2, x.childs() + n + 1, x.childs() + s + 1);
+        x.keys_count_ = n - 1;
+
+        right->lock_.writeUnlockObsolete();
+        retire(right);
+    }
+
+    // node is write-locked; its subtree is locked node by node as the walk reaches it.
+    void retireTree(BNode* node) {
+        BNode* childs[BNode::MAX_CHILDS];
+        const size_t n = node->leaf_ ? 0 : node->keys_count_ + 1;
+        std::copy(node->childs(), node->childs() + n, childs);
+        node->lock_.writeUnlockObsolete();
+        retire(node);
+
+        for (size_t i = 0; i < n; ++i) {
+            childs[i]->lock_.writeLock();
+            retireTree(childs[i]);
+        }
+    }
+
+    void removeAt(BNode& node, size_t i) {
+        std::memmove(static_cast<void*>(node.keys() + i), static_cast<const void*>(node.keys() + i + 1),
+                     (node.keys_count_ - i - 1) * sizeof(T));
+        node.keys_count_ -= 1;
+    }
+
+private:
+    // node is unlinked and obsolete; it is freed once the epoch has moved two steps past now.
+    void retire(BNode* node) {
+        const uint64_t epoch = epochs_.epoch();
+        std::lock_guard<std::mutex> guard(retired_mutex_);
+        retired_.push_back(Retired{node, epoch});
+        retired_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Called outside any pin, so this thread never holds the epoch back itself. Only one thread
+    // reclaims at a time; the others just carry on.
+    void reclaimIfDue() {
+        if (retired_count_.load(std::memory_order_relaxed) < RECLAIM_BATCH) return;
+
+        std::unique_lock<std::mutex> guard(retired_mutex_, std::try_to_lock);
+        if (!guard.owns_lock()) return;
+
+        const uint64_t current = epochs_.tryAdvance();
+        std::vector<CacheLine*> leaves;
+        std::vector<CacheLine*> internals;
+        size_t kept = 0;
+        for (const Retired& r : retired_) {
+            if (!EpochDomain::safe(r.epoch_, current)) {
+                retired_[kept++] = r;
+                continue;
+            }
+            const bool leaf = r.node_->isLeaf();
+            r.node_->~BNode();
+            (leaf ? leaves : internals).push_back(reinterpret_cast<CacheLine*>(r.node_));
+        }
+        retired_.resize(kept);
+        retired_count_.store(kept, std::memory_order_relaxed);
+
+        deallocateBatch(block_alloc_, leaves.data(), leaves.size(), BNode::blockCount(true));
+        deallocateBatch(block_alloc_, internals.data(), internals.size(), BNode::blockCount(false));
+    }
+
+    BNode* createNode(bool isLeaf) {
+        const size_t blocks = BNode::blockCount(isLeaf);
+        CacheLine* block = std::allocator_traits<BlockAllocator>::allocate(block_alloc_, blocks);
+        return ::new (static_cast<void*>(block)) BNode(isLeaf);
+    }
+
+    void deleteNode(BNode* node) {
+        const size_t blocks = BNode::blockCount(node->isLeaf());
+        node->~BNode();
+        std::allocator_traits<BlockAllocator>::deallocate(block_alloc_, reinterpret_cast<CacheLine*>(node), blocks);
+    }
+
+    void clear(BNode* node) {
+        if constexpr (IsMonotonicAllocator<Alloc>::value) return;
+        if (!node) return;
+        if (!node->isLeaf()) {
+            for (size_t i = 0; i <= node->size(); ++i)
+                clear(node->childs()[i]);
+        }
+        deleteNode(node);
+    }
+};
+
+}  // namespace btree
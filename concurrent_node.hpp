@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+#include "btree_iterator.hpp"
+#include "btree_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+__attribute__((always_inline)) inline void cpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Version lock for optimistic lock coupling. The word counts modifications in steps of 4, bit 1
+// is the write lock and bit 0 marks a node that has been unlinked from the tree. Readers take
+// no lock: they remember the version, read, and validate that the version did not move.
+class OptimisticLock {
+    static constexpr uint64_t OBSOLETE = 1;
+    static constexpr uint64_t LOCKED = 2;
+
+    std::atomic<uint64_t> version_{4};
+
+public:
+    // Waits out a writer; false when the node is obsolete.
+    bool readLock(uint64_t& version) const noexcept {
+        uint64_t v = version_.load(std::memory_order_acquire);
+        while (v & LOCKED) {
+            cpuRelax();
+            v = version_.load(std::memory_order_acquire);
+        }
+        version = v;
+        return !(v & OBSOLETE);
+    }
+
+    // True when nothing was written since readLock returned version.
+    bool validate(uint64_t version) const noexcept {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version_.load(std::memory_order_relaxed) == version;
+    }
+
+    // Turns an optimistic read into the write lock, provided nobody wrote in between.
+    bool upgrade(uint64_t& version) noexcept {
+        if (!version_.compare_exchange_strong(version, version + LOCKED, std::memory_order_acquire)) return false;
+        version += LOCKED;
+        return true;
+    }
+
+    // Blocking write lock; false when the node is obsolete.
+    bool writeLock() noexcept {
+        for (;;) {
+            uint64_t v;
+            if (!readLock(v)) return false;
+            if (upgrade(v)) return true;
+            cpuRelax();
+        }
+    }
+
+    void writeUnlock() noexcept { version_.fetch_add(LOCKED, std::memory_order_release); }
+
+    void writeUnlockObsolete() noexcept { version_.fetch_add(LOCKED + OBSOLETE, std::memory_order_release); }
+};
+
+// Node of ConcurrentBTree: the BTreeNode block layout with a version lock in the header.
+//
+//   [ lock | header | keys[2 * ORDER - 1] | childs[2 * ORDER] ]
+//
+// Readers look at keys_count_, keys and childs while a writer may be changing them, so only
+// trivially copyable keys are allowed and every value read is validated before it is trusted.
+template <typename T, size_t ORDER>
+struct ConcurrentNode {
+    static_assert(ORDER >= 2, "ConcurrentBTree ORDER must be at least 2");
+    static_assert(std::is_trivially_copyable<T>::value, "optimistic readers need trivially copyable keys");
+    static_assert(alignof(T) <= CACHE_LINE_SIZE, "over-aligned keys are not supported");
+
+    using key_type = T;
+    using mapped_type = void;
+
+    static constexpr size_t MAX_KEYS = 2 * ORDER - 1;
+    static constexpr size_t MAX_CHILDS = 2 * ORDER;
+    static constexpr size_t MIN_KEYS = ORDER - 1;
+
+    static constexpr size_t MAX_HEIGHT = 2 + 64 / floorLog2(ORDER);
+
+    OptimisticLock lock_;
+    size_t keys_count_;
+    bool leaf_;
+
+public:
+    explicit ConcurrentNode(bool leaf) : keys_count_(0), leaf_(leaf) {
+        static_assert(alignof(ConcurrentNode) <= CACHE_LINE_SIZE, "node header must not need more than cache line alignment");
+        static_assert(keysOffset() % alignof(T) == 0 && childsOffset() % alignof(ConcurrentNode*) == 0, "misaligned node arrays");
+        static_assert(internalBytes() <= blockCount(false) * CACHE_LINE_SIZE, "node does not fit its blocks");
+    }
+    ~ConcurrentNode() {}
+
+    ConcurrentNode(const ConcurrentNode& other) = delete;
+    ConcurrentNode& operator=(const ConcurrentNode& other) = delete;
+
+    // Not synchronized: only for a tree nobody else is modifying.
+    template <typename U>
+    void traverse(U& u) {
+        BTreeIterator<ConcurrentNode>::forEach(this, [&u](ConcurrentNode* node, size_t i) { u(node->keys()[i]); });
+    }
+
+    // keys_count_ as seen by an optimistic reader, clamped so a torn view never reads past the block.
+    __attribute__((always_inline)) size_t count() const noexcept {
+        const size_t n = keys_count_;
+        return n < MAX_KEYS ? n : MAX_KEYS;
+    }
+
+    template <typename Search, typename Compare>
+    __attribute__((always_inline)) size_t lowerBound(const T& key, const Compare& comp) const {
+        return Search::lower_bound(keys(), count(), key, comp);
+    }
+
+    template <typename Search, typename Compare>
+    __attribute__((always_inline)) size_t upperBound(const T& key, const Compare& comp) const {
+        return Search::upper_bound(keys(), count(), key, comp);
+    }
+
+public:
+    __attribute__((always_inline)) bool isLeaf() const noexcept { return leaf_; }
+
+    __attribute__((always_inline)) size_t size() const noexcept { return keys_count_; }
+
+    __attribute__((always_inline)) T* keys() noexcept {
+        return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) const T* keys() const noexcept {
+        return reinterpret_cast<const T*>(reinterpret_cast<const unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) ConcurrentNode** childs() noexcept {
+        return reinterpret_cast<ConcurrentNode**>(reinterpret_cast<unsigned char*>(this) + childsOffset());
+    }
+
+    __attribute__((always_inline)) ConcurrentNode* const* childs() const noexcept {
+        return reinterpret_cast<ConcurrentNode* const*>(reinterpret_cast<const unsigned char*>(this) + childsOffset());
+    }
+
+public:
+    static constexpr size_t alignUp(size_t n, size_t alignment) noexcept {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr size_t keysOffset() noexcept { return alignUp(sizeof(ConcurrentNode), alignof(T)); }
+
+    static constexpr size_t leafBytes() noexcept { return keysOffset() + MAX_KEYS * sizeof(T); }
+
+    static constexpr size_t childsOffset() noexcept { return alignUp(leafBytes(), alignof(ConcurrentNode*)); }
+
+    static constexpr size_t internalBytes() noexcept {
+        return childsOffset() + MAX_CHILDS * sizeof(ConcurrentNode*);
+    }
+
+    static constexpr size_t blockCount(bool leaf) noexcept {
+        return alignUp(leaf ? leafBytes() : internalBytes(), CACHE_LINE_SIZE) / CACHE_LINE_SIZE;
+    }
+};
+
+}  // namespace btree
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "btree_search.hpp"
+#include "cow_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Node storage a CowBTree shares with its snapshots: creates, copies and releases nodes. The
+// last reference to a node may be dropped on any thread, by a snapshot going away there, so
+// with snapshots handed to other threads the allocator is called from those threads too.
+template <typename T, size_t ORDER, typename Alloc>
+class CowNodes {
+    using BNode = CowNode<T, ORDER>;
+
+    typedef std::allocator_traits<Alloc> alloc_traits;
+    using BlockAllocator = typename alloc_traits::template rebind_alloc<CacheLine>;
+
+public:
+    using KeysAllocator = typename alloc_traits::template rebind_alloc<T>;
+
+private:
+    KeysAllocator keys_alloc_;
+    BlockAllocator block_alloc_;
+
+public:
+    explicit CowNodes(const Alloc& alloc) : keys_alloc_(alloc), block_alloc_(alloc) {}
+
+public:
+    KeysAllocator& keysAllocator() noexcept { return keys_alloc_; }
+
+    BNode* create(bool leaf) {
+        CacheLine* block = std::allocator_traits<BlockAllocator>::allocate(block_alloc_, BNode::blockCount(leaf));
+        return ::new (static_cast<void*>(block)) BNode(leaf);
+    }
+
+    // A private copy of node: the same keys and the same childs, which gain a reference each.
+    BNode* clone(const BNode& node) {
+        BNode* copy = create(node.leaf_);
+        size_t i = 0;
+        try {
+            for (; i < node.keys_count_; ++i)
+                std::allocator_traits<KeysAllocator>::construct(keys_alloc_, copy->keys() + i, node.keys()[i]);
+        } catch (...) {
+            copy->keys_count_ = i;
+            destroy(copy);
+            throw;
+        }
+        copy->keys_count_ = node.keys_count_;
+        if (!node.leaf_) {
+            for (size_t j = 0; j <= node.keys_count_; ++j) {
+                copy->childs()[j] = node.childs()[j];
+                retain(copy->childs()[j]);
+            }
+        }
+        return copy;
+    }
+
+    static void retain(BNode* node) noexcept { node->refs_.fetch_add(1, std::memory_order_relaxed); }
+
+    // Whether the caller holds the only reference to node. Nobody can add one behind its back,
+    // see CowNode, and acquire pairs with the release of whoever dropped the others.
+    static bool exclusive(const BNode* node) noexcept { return node->refs_.load(std::memory_order_acquire) == 1; }
+
+    // Drops a reference; the last one frees the node and drops its references to its childs.
+    void release(BNode* node) noexcept {
+        if (node->refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        if (!node->leaf_) {
+            for (size_t i = 0; i <= node->keys_count_; ++i)
+                release(node->childs()[i]);
+        }
+        destroy(node);
+    }
+
+    // Frees a node without touching its childs, whose references went elsewhere.
+    void destroy(BNode* node) noexcept {
+        for (size_t i = 0; i < node->keys_count_; ++i)
+            std::allocator_traits<KeysAllocator>::destroy(keys_alloc_, node->keys() + i);
+
+        const size_t blocks = BNode::blockCount(node->isLeaf());
+        node->~BNode();
+        std::allocator_traits<BlockAllocator>::deallocate(block_alloc_, reinterpret_cast<CacheLine*>(node), blocks);
+    }
+};
+
+// Read-only view of a CowBTree as it was when snapshot() returned it. It shares every node the
+// tree has not changed since, and the tree never changes a shared node, so reading a snapshot
+// takes no lock and never waits for (or holds up) the tree's writer, whatever thread it is on.
+// Copies are O(1); the nodes only snapshots still hold are freed with the last copy.
+template <typename T, size_t ORDER, typename Alloc = std::allocator<T>, typename Search = default_search>
+class CowSnapshot {
+    using BNode = CowNode<T, ORDER>;
+    using Nodes = CowNodes<T, ORDER, Alloc>;
+
+public:
+    using key_type = T;
+    using key_compare = std::less<T>;
+    using size_type = size_t;
+    using const_iterator = BTreeIterator<BNode, true>;
+    using iterator = const_iterator;
+
+private:
+    Nodes nodes_;
+    std::less<T> comp_;
+    BNode* root_;
+    size_t size_;
+
+    friend class CowBTree<T, ORDER, Alloc, Search>;
+
+    CowSnapshot(const Nodes& nodes, BNode* root, size_t size) : nodes_(nodes), root_(root), size_(size) {
+        Nodes::retain(root_);
+    }
+
+public:
+    // An empty view, for slots a snapshot is stored into later.
+    explicit CowSnapshot(const Alloc& alloc = Alloc()) : nodes_(alloc), root_(nullptr), size_(0) {}
+
+    CowSnapshot(const CowSnapshot& other) : nodes_(other.nodes_), root_(other.root_), size_(other.size_) {
+        if (root_) Nodes::retain(root_);
+    }
+
+    CowSnapshot(CowSnapshot&& other) noexcept : nodes_(other.nodes_), root_(other.root_), size_(other.size_) {
+        other.root_ = nullptr;
+        other.size_ = 0;
+    }
+
+    CowSnapshot& operator=(CowSnapshot other) noexcept {
+        std::swap(nodes_, other.nodes_);
+        std::swap(root_, other.root_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    ~CowSnapshot() {
+        if (root_) nodes_.release(root_);
+    }
+
+public:
+    bool contains(const T& key) const { return root_ != nullptr && root_->template contains<Search>(key, comp_); }
+
+    size_t size() const noexcept { return size_; }
+
+    bool empty() const noexcept { return size_ == 0; }
+
+    const_iterator begin() const noexcept { return const_iterator::first(root_); }
+
+    const_iterator end() const noexcept { return const_iterator::last(root_); }
+
+    const_iterator lower_bound(const T& key) const { return const_iterator::template lowerBound<Search>(root_, key, comp_); }
+
+    const_iterator upper_bound(const T& key) const { return const_iterator::template upperBound<Search>(root_, key, comp_); }
+
+    // Keys in [lo, hi).
+    BTreeRange<const_iterator> range(const T& lo, const T& hi) const {
+        return BTreeRange<const_iterator>(lower_bound(lo), lower_bound(hi));
+    }
+
+    template <typename U>
+    void traverse(U& u) const {
+        const_iterator::forEach(root_, [&u](BNode* node, size_t i) { u(node->keys()[i]); });
+    }
+};
+
+// BTree of distinct keys with O(1) snapshots. Nodes are reference counted and shared between
+// the tree and the snapshots taken from it: snapshot() only adds a reference to the root, and
+// from then on the writer copies each shared node it is about to change (path copying), so an
+// insert or erase copies at most the nodes on its root-to-leaf path plus the siblings it borrows
+// from or merges with. Nodes nobody shares are changed in place, as in BTree, so a tree without
+// live snapshots pays one atomic load per node visited and nothing else. An insert of a present
+// key or an erase of a missing one may still copy the shared nodes on its path.
+//
+// The tree itself is not thread-safe: insert, erase, clear and snapshot() belong to one writer
+// (or need a lock around them). The snapshots it returns can go to any thread and be read,
+// copied and dropped there while the writer carries on.
+template <typename T, size_t ORDER, typename Alloc = std::allocator<T>, typename Search = default_search>
+class CowBTree {
+    using BNode = CowNode<T, ORDER>;
+    using Nodes = CowNodes<T, ORDER, Alloc>;
+    using KeysAllocator = typename Nodes::KeysAllocator;
+
+public:
+    using key_type = T;
+    using key_compare = std::less<T>;
+    using allocator_type = Alloc;
+    using size_type = size_t;
+    using snapshot_type = CowSnapshot<T, ORDER, Alloc, Search>;
+    using const_iterator = BTreeIterator<BNode, true>;
+    using iterator = const_iterator;
+
+private:
+    Nodes nodes_;
+    std::less<T> comp_;
+    BNode* root_;
+    size_t size_;
+
+public:
+    explicit CowBTree(const Alloc& alloc = Alloc()) : nodes_(alloc), root_(nodes_.create(true)), size_(0) {}
+
+    ~CowBTree() { nodes_.release(root_); }
+
+    // A snapshot is the cheap copy.
+    CowBTree(const CowBTree& other) = delete;
+    CowBTree(CowBTree&& other) = delete;
+
+    CowBTree& operator=(const CowBTree& other) = delete;
+    CowBTree& operator=(CowBTree&& other) = delete;
+
+public:
+    snapshot_type snapshot() const { return snapshot_type(nodes_, root_, size_); }
+
+    // Returns false, changing nothing, when an equivalent key is present.
+    bool insert(const T& key) {
+        BNode* node = own(root_);
+        if (node->keys_count_ == BNode::MAX_KEYS) {
+            BNode* s = nodes_.create(false);
+            s->childs()[0] = node;
+            root_ = s;
+            splitChild(*s, 0, *node);
+            node = s;
+        }
+
+        for (;;) {
+            size_t i = node->template lowerBound<Search>(key, comp_);
+            if (i < node->keys_count_ && !comp_(key, node->keys()[i])) return false;
+
+            if (node->leaf_) {
+                relocateSlots(*node, i, node->keys_count_, *node, i + 1);
+                try {
+                    std::allocator_traits<KeysAllocator>::construct(nodes_.keysAllocator(), node->keys() + i, key);
+                } catch (...) {
+                    relocateSlots(*node, i + 1, node->keys_count_ + 1, *node, i);
+                    throw;
+                }
+                node->keys_count_ += 1;
+                size_ += 1;
+                return true;
+            }
+
+            BNode* child = own(node->childs()[i]);
+            if (child->keys_count_ == BNode::MAX_KEYS) {
+                splitChild(*node, i, *child);
+
+                const T& median = node->keys()[i];
+                if (!comp_(key, median) && !comp_(median, key)) return false;
+                if (comp_(median, key)) i++;
+                child = node->childs()[i];
+            }
+            node = child;
+        }
+    }
+
+    bool erase(const T& key) {
+        BNode* root = own(root_);
+        const bool erased = eraseFrom(root, key);
+        if (root->keys_count_ == 0 && !root->leaf_) {
+            root_ = root->childs()[0];
+            nodes_.destroy(root);
+        }
+        if (erased) size_ -= 1;
+        return erased;
+    }
+
+    // Snapshots keep what they share with the old contents.
+    void clear() {
+        BNode* empty = nodes_.create(true);
+        nodes_.release(root_);
+        root_ = empty;
+        size_ = 0;
+    }
+
+    bool contains(const T& key) const { return root_->template contains<Search>(key, comp_); }
+
+    size_t size() const noexcept { return size_; }
+
+    bool empty() const noexcept { return size_ == 0; }
+
+    const_iterator begin() const noexcept { return const_iterator::first(root_); }
+
+    const_iterator end() const noexcept { return const_iterator::last(root_); }
+
+    const_iterator lower_bound(const T& key) const { return const_iterator::template lowerBound<Search>(root_, key, comp_); }
+
+    template <typename U>
+    void traverse(U& u) const {
+        const_iterator::forEach(root_, [&u](BNode* node, size_t i) { u(node->keys()[i]); });
+    }
+
+private:
+    // The node in slot, made the tree's own: a shared one is replaced by a private copy. The
+    // node holding slot must be the tree's own already.
+    BNode* own(BNode*& slot) {
+        BNode* node = slot;
+        if (Nodes::exclusive(node)) return node;
+        BNode* copy = nodes_.clone(*node);
+        nodes_.release(node);
+        slot = copy;
+        return copy;
+    }
+
+    // Splits the full child y (owned) at i of node (owned), as BTree does.
+    void splitChild(BNode& node, size_t i, BNode& y) {
+        BNode* z = nodes_.create(y.leaf_);
+
+        relocateSlots(y, ORDER, BNode::MAX_KEYS, *z, 0);
+        if (!y.leaf_) std::copy(y.childs() + ORDER, y.childs() + BNode::MAX_CHILDS, z->childs());
+        z->keys_count_ = ORDER - 1;
+
+        BNode** childs = node.childs();
+        std::copy_backward(childs + i + 1, childs + node.keys_count_ + 1, childs + node.keys_count_ + 2);
+        childs[i + 1] = z;
+
+        relocateSlots(node, i, node.keys_count_, node, i + 1);
+        relocateSlots(y, ORDER - 1, ORDER, node, i);
+        y.keys_count_ = ORDER - 1;
+        node.keys_count_ += 1;
+    }
+
+    // BTree's single top-down pass, on owned nodes only: every child is owned before it is
+    // topped up or descended into.
+    bool eraseFrom(BNode* node, const T& key) {
+        for (;;) {
+            const size_t i = node->template lowerBound<Search>(key, comp_);
+            const bool found = i < node->keys_count_ && !comp_(key, node->keys()[i]);
+
+            if (node->leaf_) {
+                if (!found) return false;
+                destroySlot(*node, i);
+                relocateSlots(*node, i + 1, node->keys_count_, *node, i);
+                node->keys_count_ -= 1;
+                return true;
+            }
+
+            BNode** childs = node->childs();
+            if (!found) {
+                node = fillChild(*node, i);
+                continue;
+            }
+
+            if (childs[i]->keys_count_ >= ORDER) {
+                replaceWithMax(*node, i, own(childs[i]));
+                return true;
+            }
+            if (childs[i + 1]->keys_count_ >= ORDER) {
+                replaceWithMin(*node, i, own(childs[i + 1]));
+                return true;
+            }
+            node = mergeChilds(*node, i);
+        }
+    }
+
+    // Overwrites slot i of dst with the largest key below node, removing it there.
+    void replaceWithMax(BNode& dst, size_t i, BNode* node) {
+        while (!node->leaf_)
+            node = fillChild(*node, node->keys_count_);
+        destroySlot(dst, i);
+        relocateSlots(*node, node->keys_count_ - 1, node->keys_count_, dst, i);
+        node->keys_count_ -= 1;
+    }
+
+    // Overwrites slot i of dst with the smallest key below node, removing it there.
+    void replaceWithMin(BNode& dst, size_t i, BNode* node) {
+        while (!node->leaf_)
+            node = fillChild(*node, 0);
+        destroySlot(dst, i);
+        relocateSlots(*node, 0, 1, dst, i);
+        relocateSlots(*node, 1, node->keys_count_, *node, 0);
+        node->keys_count_ -= 1;
+    }
+
+    // Makes sure childs()[i] holds at least ORDER keys by borrowing from a sibling or merging
+    // with one, owning whatever changes. Returns the (owned) child to continue with.
+    BNode* fillChild(BNode& node, size_t i) {
+        BNode** childs = node.childs();
+        if (childs[i]->keys_count_ >= ORDER) return own(childs[i]);
+
+        if (i > 0 && childs[i - 1]->keys_count_ >= ORDER) {
+            rotateRight(node, i - 1);
+            return childs[i];
+        }
+        if (i < node.keys_count_ && childs[i + 1]->keys_count_ >= ORDER) {
+            rotateLeft(node, i);
+            return childs[i];
+        }
+        if (i < node.keys_count_) return mergeChilds(node, i);
+        return mergeChilds(node, i - 1);
+    }
+
+    // Moves the last key of childs()[s] up into separator s, and that one down into
+    // childs()[s + 1].
+    void rotateRight(BNode& parent, size_t s) {
+        BNode& left = *own(parent.childs()[s]);
+        BNode& right = *own(parent.childs()[s + 1]);
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        relocateSlots(right, 0, rn, right, 1);
+        relocateSlots(parent, s, s + 1, right, 0);
+        relocateSlots(left, ln - 1, ln, parent, s);
+
+        if (!left.leaf_) {
+            BNode** rchilds = right.childs();
+            std::copy_backward(rchilds, rchilds + rn + 1, rchilds + rn + 2);
+            rchilds[0] = left.childs()[ln];
+        }
+        left.keys_count_ -= 1;
+        right.keys_count_ += 1;
+    }
+
+    // Moves the first key of childs()[s + 1] up into separator s, and that one down into
+    // childs()[s].
+    void rotateLeft(BNode& parent, size_t s) {
+        BNode& left = *own(parent.childs()[s]);
+        BNode& right = *own(parent.childs()[s + 1]);
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        relocateSlots(parent, s, s + 1, left, ln);
+        relocateSlots(right, 0, 1, parent, s);
+        relocateSlots(right, 1, rn, right, 0);
+
+        if (!left.leaf_) {
+            BNode** rchilds = right.childs();
+            left.childs()[ln + 1] = rchilds[0];
+            std::copy(rchilds + 1, rchilds + rn + 1, rchilds);
+        }
+        left.keys_count_ += 1;
+        right.keys_count_ -= 1;
+    }
+
+    // Folds separator i and childs()[i + 1] into childs()[i], frees the emptied sibling and
+    // returns the merged child.
+    BNode* mergeChilds(BNode& node, size_t i) {
+        BNode** childs = node.childs();
+        BNode& left = *own(childs[i]);
+        BNode* right = own(childs[i + 1]);
+        const size_t ln = left.keys_count_;
+        const size_t rn = right->keys_count_;
+
+        relocateSlots(node, i, i + 1, left, ln);
+        relocateSlots(*right, 0, rn, left, ln + 1);
+        if (!left.leaf_) std::copy(right->childs(), right->childs() + rn + 1, left.childs() + ln + 1);
+        left.keys_count_ = ln + 1 + rn;
+        right->keys_count_ = 0;
+        nodes_.destroy(right);
+
+        relocateSlots(node, i + 1, node.keys_count_, node, i);
+        std::copy(childs + i + 2, childs + node.keys_count_ + 1, childs + i + 1);
+        node.keys_count_ -= 1;
+        return &left;
+    }
+
+private:
+    void relocateSlots(BNode& src, size_t first, size_t last, BNode& dst, size_t at) {
+        if (first == last) return;
+        relocateArray(nodes_.keysAllocator(), src.keys() + first, dst.keys() + at, last - first);
+    }
+
+    void destroySlot(BNode& node, size_t i) {
+        std::allocator_traits<KeysAllocator>::destroy(nodes_.keysAllocator(), node.keys() + i);
+    }
+};
+
+}  // namespace btree
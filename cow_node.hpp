@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "btree_iterator.hpp"
+#include "btree_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Node of CowBTree: the BTreeNode block layout with a reference count in the header.
+//
+//   [ refs | header | keys[2 * ORDER - 1] | childs[2 * ORDER] ]
+//
+// refs_ counts the child slots and roots (of the tree and of its snapshots) that point at the
+// node. Only the tree's writer adds references, so a node it reaches through nodes with a single
+// reference and finds with a single reference itself is its own to change. Every other node is
+// frozen: whoever wants it different works on a copy.
+template <typename T, size_t ORDER>
+struct CowNode {
+    static_assert(ORDER >= 2, "CowBTree ORDER must be at least 2");
+    static_assert(alignof(T) <= CACHE_LINE_SIZE, "over-aligned keys are not supported");
+
+    using key_type = T;
+    using mapped_type = void;
+
+    static constexpr size_t MAX_KEYS = 2 * ORDER - 1;
+    static constexpr size_t MAX_CHILDS = 2 * ORDER;
+    static constexpr size_t MIN_KEYS = ORDER - 1;
+
+    static constexpr size_t MAX_HEIGHT = 2 + 64 / floorLog2(ORDER);
+
+    std::atomic<uint32_t> refs_;
+    size_t keys_count_;
+    bool leaf_;
+
+public:
+    explicit CowNode(bool leaf) : refs_(1), keys_count_(0), leaf_(leaf) {
+        static_assert(alignof(CowNode) <= CACHE_LINE_SIZE, "node header must not need more than cache line alignment");
+        static_assert(keysOffset() % alignof(T) == 0 && childsOffset() % alignof(CowNode*) == 0, "misaligned node arrays");
+    }
+    ~CowNode() {}
+
+    CowNode(const CowNode& other) = delete;
+    CowNode& operator=(const CowNode& other) = delete;
+
+    template <typename Search, typename Compare>
+    __attribute__((always_inline)) size_t lowerBound(const T& key, const Compare& comp) const {
+        return Search::lower_bound(keys(), keys_count_, key, comp);
+    }
+
+    template <typename Search, typename Compare>
+    __attribute__((always_inline)) size_t upperBound(const T& key, const Compare& comp) const {
+        return Search::upper_bound(keys(), keys_count_, key, comp);
+    }
+
+    // Looks key up in the subtree under this node.
+    template <typename Search, typename Compare>
+    bool contains(const T& key, const Compare& comp) const {
+        const CowNode* node = this;
+        for (;;) {
+            const size_t i = node->template lowerBound<Search>(key, comp);
+            if (i < node->keys_count_ && !comp(key, node->keys()[i])) return true;
+            if (node->leaf_) return false;
+            node = node->childs()[i];
+        }
+    }
+
+public:
+    __attribute__((always_inline)) bool isLeaf() const noexcept { return leaf_; }
+
+    __attribute__((always_inline)) size_t size() const noexcept { return keys_count_; }
+
+    __attribute__((always_inline)) T* keys() noexcept {
+        return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) const T* keys() const noexcept {
+        return reinterpret_cast<const T*>(reinterpret_cast<const unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) CowNode** childs() noexcept {
+        return reinterpret_cast<CowNode**>(reinterpret_cast<unsigned char*>(this) + childsOffset());
+    }
+
+    __attribute__((always_inline)) CowNode* const* childs() const noexcept {
+        return reinterpret_cast<CowNode* const*>(reinterpret_cast<const unsigned char*>(this) + childsOffset());
+    }
+
+public:
+    static constexpr size_t alignUp(size_t n, size_t alignment) noexcept {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr size_t keysOffset() noexcept { return alignUp(sizeof(CowNode), alignof(T)); }
+
+    static constexpr size_t leafBytes() noexcept { return keysOffset() + MAX_KEYS * sizeof(T); }
+
+    static constexpr size_t childsOffset() noexcept { return alignUp(leafBytes(), alignof(CowNode*)); }
+
+    static constexpr size_t internalBytes() noexcept { return childsOffset() + MAX_CHILDS * sizeof(CowNode*); }
+
+    static constexpr size_t blockCount(bool leaf) noexcept {
+        return alignUp(leaf ? leafBytes() : internalBytes(), CACHE_LINE_SIZE) / CACHE_LINE_SIZE;
+    }
+};
+
+}  // namespace btree
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "btree_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Epoch-based reclamation. Threads pin the domain for the duration of an operation, which
+// announces the global epoch they started in. The global epoch only moves forward once every
+// pinned thread has caught up with it, so by the time it is two steps past the epoch an object
+// was retired in, no thread that could still hold a pointer to the object is left.
+class EpochDomain {
+    static constexpr uint64_t QUIESCENT = 0;
+
+    struct alignas(CACHE_LINE_SIZE) Participant {
+        std::atomic<uint64_t> epoch_{QUIESCENT};
+        size_t depth_ = 0;  // nested pins, only touched by the owner
+        std::thread::id owner_;
+        Participant* next_ = nullptr;
+    };
+
+    struct LocalCache {
+        uint64_t domain_;
+        Participant* participant_;
+    };
+
+    std::atomic<uint64_t> global_{1};
+    std::atomic<Participant*> participants_{nullptr};
+    const uint64_t id_;
+
+public:
+    // Keeps the calling thread pinned while alive.
+    class Guard {
+        EpochDomain* domain_;
+
+    public:
+        explicit Guard(EpochDomain& domain) : domain_(&domain) { domain_->enter(); }
+        ~Guard() { domain_->exit(); }
+
+        Guard(const Guard& other) = delete;
+        Guard& operator=(const Guard& other) = delete;
+    };
+
+public:
+    EpochDomain() : id_(nextId()) {}
+
+    ~EpochDomain() {
+        Participant* p = participants_.load(std::memory_order_relaxed);
+        while (p != nullptr) {
+            Participant* next = p->next_;
+            delete p;
+            p = next;
+        }
+    }
+
+    EpochDomain(const EpochDomain& other) = delete;
+    EpochDomain& operator=(const EpochDomain& other) = delete;
+
+public:
+    Guard pin() { return Guard(*this); }
+
+    // Epoch to stamp an object with once it has been unlinked.
+    uint64_t epoch() const noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return global_.load(std::memory_order_relaxed);
+    }
+
+    // Moves the global epoch forward when every pinned thread has observed it and returns the
+    // (possibly new) global epoch. Objects retired in epoch r are safe to free once it is >= r + 2.
+    uint64_t tryAdvance() noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t e = global_.load(std::memory_order_relaxed);
+        for (Participant* p = participants_.load(std::memory_order_acquire); p != nullptr; p = p->next_) {
+            const uint64_t pe = p->epoch_.load(std::memory_order_relaxed);
+            if (pe != QUIESCENT && pe != e) return e;
+        }
+        if (global_.compare_exchange_strong(e, e + 1)) return e + 1;
+        return e;
+    }
+
+    static bool safe(uint64_t retired, uint64_t current) noexcept { return retired + 2 <= current; }
+
+private:
+    void enter() {
+        Participant* p = local();
+        if (p->depth_++ != 0) return;
+        p->epoch_.store(global_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void exit() noexcept {
+        Participant* p = local();
+        if (--p->depth_ == 0) p->epoch_.store(QUIESCENT, std::memory_order_release);
+    }
+
+    // Slot of the calling thread, registered on first use. Slots are never unlinked; a thread id
+    // is only reused after its thread is gone, so a new thread may inherit an idle slot.
+    Participant* local() {
+        thread_local LocalCache cache{0, nullptr};
+        if (cache.domain_ == id_) return cache.participant_;
+
+        const std::thread::id self = std::this_thread::get_id();
+        Participant* p = participants_.load(std::memory_order_acquire);
+        while (p != nullptr && p->owner_ != self)
+            p = p->next_;
+
+        if (p == nullptr) {
+            p = new Participant();
+            p->owner_ = self;
+            p->next_ = participants_.load(std::memory_order_relaxed);
+            while (!participants_.compare_exchange_weak(p->next_, p, std::memory_order_release,
+                                                        std::memory_order_relaxed)) {
+            }
+        }
+        cache = LocalCache{id_, p};
+        return p;
+    }
+
+    static uint64_t nextId() noexcept {
+        static std::atomic<uint64_t> counter{0};
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+};
+
+// Allocators may offer deallocate_batch(pointers, count, n) to take back many blocks of the same
+// size at once; the reclaimers hand their batches to it and fall back to one deallocate each.
+template <typename Allocator, typename = void>
+struct HasDeallocateBatch : std::false_type {};
+
+template <typename Allocator>
+struct HasDeallocateBatch<Allocator, std::void_t<decltype(std::declval<Allocator&>().deallocate_batch(
+                                         std::declval<typename std::allocator_traits<Allocator>::pointer*>(),
+                                         size_t(), size_t()))>> : std::true_type {};
+
+// Returns count blocks of n elements each. The pointer array may be reordered or overwritten.
+template <typename Allocator>
+void deallocateBatch(Allocator& alloc, typename std::allocator_traits<Allocator>::pointer* pointers, size_t count,
+                     size_t n) {
+    if (count == 0) return;
+    if constexpr (HasDeallocateBatch<Allocator>::value) {
+        alloc.deallocate_batch(pointers, count, n);
+    } else {
+        for (size_t i = 0; i < count; ++i)
+            std::allocator_traits<Allocator>::deallocate(alloc, pointers[i], n);
+    }
+}
+
+}  // namespace btree
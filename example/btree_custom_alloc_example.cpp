@@ -31,6 +31,12 @@ struct TraverseCounter {
     }
 };
 
+// Adds up the counters of two parts of the tree, for parallel_reduce.
+void combine_counters(TraverseCounter& total, TraverseCounter&& part) {
+    total.count += part.count;
+    total.sum += part.sum;
+}
+
 void perform_btree_operations(const std::string& allocator_name,
                               btree::BTree<uint32_t, 64, smpl_alloc<uint32_t>>& btree_instance,
                               size_t num_insertions) {
@@ -60,6 +66,20 @@ void perform_btree_operations(const std::string& allocator_name,
     std::cout << "Traversal finished in: " << elapsed_seconds.count() << " seconds." << std::endl;
     std::cout << "Keys traversed (functor calls): " << counter.count << std::endl;
 
+    // Reading the tree needs no allocation, so this works on any allocator, the custom list too.
+    btree::WorkStealingPool pool;
+    std::cout << "Traversing B-Tree with " << pool.size() << " thread(s)..." << std::endl;
+    start_time = std::chrono::high_resolution_clock::now();
+
+    TraverseCounter parallel_counter = btree_instance.parallel_reduce(TraverseCounter(), combine_counters, pool);
+
+    end_time = std::chrono::high_resolution_clock::now();
+    elapsed_seconds = end_time - start_time;
+
+    std::cout << "Parallel traversal finished in: " << elapsed_seconds.count() << " seconds." << std::endl;
+    std::cout << "Keys traversed in parallel: " << parallel_counter.count << " (sum " << parallel_counter.sum
+              << ", sequential sum " << counter.sum << ")" << std::endl;
+
     uint32_t search_key = num_insertions / 2 % 1000;
     std::cout << "Searching for key: " << search_key << std::endl;
 
@@ -74,6 +94,33 @@ void perform_btree_operations(const std::string& allocator_name,
     } else {
         std::cout << "Key " << search_key << " NOT found." << std::endl;
     }
+
+    std::cout << "Erasing keys in [0, 500)..." << std::endl;
+    start_time = std::chrono::high_resolution_clock::now();
+
+    btree_instance.erase_range(0, 500);
+
+    end_time = std::chrono::high_resolution_clock::now();
+    elapsed_seconds = end_time - start_time;
+    std::cout << "Range erase finished in: " << elapsed_seconds.count() << " seconds." << std::endl;
+
+    TraverseCounter remaining;
+    btree_instance.traverse(remaining);
+    std::cout << "Keys left after erase: " << remaining.count << std::endl;
+
+    std::vector<uint32_t> sorted_keys(btree_instance.begin(), btree_instance.end());
+    std::cout << "Bulk loading " << sorted_keys.size() << " sorted keys..." << std::endl;
+    start_time = std::chrono::high_resolution_clock::now();
+
+    btree_instance.bulk_load(sorted_keys.begin(), sorted_keys.end());
+
+    end_time = std::chrono::high_resolution_clock::now();
+    elapsed_seconds = end_time - start_time;
+    std::cout << "Bulk load finished in: " << elapsed_seconds.count() << " seconds." << std::endl;
+
+    TraverseCounter reloaded;
+    btree_instance.traverse(reloaded);
+    std::cout << "Keys after bulk load: " << reloaded.count << std::endl;
 }
 
 int main() {
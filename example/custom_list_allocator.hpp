@@ -7,29 +7,106 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #define CUSTOM_LIST_HEAP_SIZE (1024 * 1024 * 100)
 
+/* Heaps mapped with huge pages are sized in multiples of this (the usual x86-64 huge page). */
+#define CUSTOM_LIST_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define CUSTOM_LIST_MAX_NUMA_NODES 1024
+
+/* ALLOC_POLICY_SIZE_CLASS: the first CUSTOM_LIST_MAX_SIZE_CLASSES distinct block sizes up to
+ * CUSTOM_LIST_MAX_CLASS_BLOCK get a size class on first use. A class carves its blocks out of
+ * CUSTOM_LIST_SLAB_SIZE slabs taken from the list and recycles them through its own free list,
+ * so allocating and freeing them is O(1). All other sizes use the list with first-fit. */
+#define CUSTOM_LIST_MAX_SIZE_CLASSES 8
+#define CUSTOM_LIST_MAX_CLASS_BLOCK (16 * 1024)
+#define CUSTOM_LIST_SLAB_SIZE (64 * 1024)
+
+/* Set in the size header of every block a size class carves, so that freeing tells them from
+ * list blocks of the same size. Sizes are multiples of the pointer size, the low bit is free. */
+#define CUSTOM_LIST_CLASS_BLOCK_FLAG ((size_t) 1)
+
 typedef struct custom_list_allocator_s custom_list_allocator_t;
 
-typedef enum { ALLOC_POLICY_FIRST_FIT, ALLOC_POLICY_BEST_FIT } alloc_policy_t;
+typedef enum { ALLOC_POLICY_FIRST_FIT, ALLOC_POLICY_BEST_FIT, ALLOC_POLICY_SIZE_CLASS } alloc_policy_t;
+
+/* What backs the heap. custom_list_alloc_create uses HEAP_PAGES_MALLOC; the others map the heap
+ * with mmap. HEAP_PAGES_HUGETLB takes pages from the reserved hugetlbfs pool and falls back to
+ * HEAP_PAGES_TRANSPARENT when none are reserved, which aligns the heap to huge pages and asks
+ * for transparent ones with madvise(MADV_HUGEPAGE). Without mmap (not Linux) it is always malloc. */
+typedef enum { HEAP_PAGES_MALLOC, HEAP_PAGES_MMAP, HEAP_PAGES_TRANSPARENT, HEAP_PAGES_HUGETLB } heap_pages_t;
+
+typedef struct custom_list_heap_options_s {
+    heap_pages_t pages;
+    int populate;     /* fault every page in when a chunk is created, not on first touch */
+    int numa_node;    /* bind the heap to this node with mbind, -1 for the default policy */
+    size_t grow_size; /* map chunks of at least this when the heap runs out, 0 to fail instead */
+} custom_list_heap_options_t;
+
+/* One region of the heap: the one it was created with, then one per growth. */
+typedef struct heap_chunk_s {
+    struct heap_chunk_s* next;
+    uint8_t* memory;
+    size_t size;
+    heap_pages_t pages; /* what it got, which may be less than asked for */
+    int numa_node;      /* -1 unless mbind succeeded */
+} heap_chunk_t;
 
 typedef struct free_node_s {
     struct free_node_s* next;
     size_t size;
 } free_node_t;
 
+/* Blocks of a class keep their flagged size header while free; the link lives right after it.
+ * Blocks of an aligned class have no header, the link simply sits at the same offset. */
+typedef struct free_block_s {
+    size_t size;
+    struct free_block_s* next;
+} free_block_t;
+
+/* A class with an alignment serves custom_list_malloc_aligned: its blocks start on the
+ * alignment and carry no header, since custom_list_free_aligned is told size and alignment again
+ * and finds the class from those. */
+typedef struct size_class_s {
+    size_t block_size; /* including the size header, if any */
+    size_t alignment;  /* 0 for blocks with a size header */
+    free_block_t* free_blocks;
+    uint8_t* bump; /* unused tail of the newest slab */
+    uint8_t* bump_end;
+    size_t slabs;
+    size_t blocks_in_use;
+} size_class_t;
+
 struct custom_list_allocator_s {
-    uint8_t* heap_memory;
+    uint8_t* heap_memory; /* the first chunk */
+    heap_chunk_t* chunks; /* newest first */
+    custom_list_heap_options_t options;
     free_node_t* free_list_head;
     size_t total_size;
     size_t used_size;
     alloc_policy_t policy;
+    size_class_t classes[CUSTOM_LIST_MAX_SIZE_CLASSES];
+    size_t class_count;
 };
 
 custom_list_allocator_t* custom_list_alloc_create(size_t heap_size, alloc_policy_t policy);
+custom_list_allocator_t* custom_list_alloc_create_ex(size_t heap_size, alloc_policy_t policy,
+                                                     const custom_list_heap_options_t* options);
+custom_list_heap_options_t custom_list_default_heap_options(void);
 void custom_list_alloc_destroy(custom_list_allocator_t* alloc);
 void* custom_list_malloc(custom_list_allocator_t* alloc, size_t size);
+void* custom_list_malloc_aligned(custom_list_allocator_t* alloc, size_t size, size_t alignment);
 void custom_list_free(custom_list_allocator_t* alloc, void* ptr);
+void custom_list_free_aligned(custom_list_allocator_t* alloc, void* ptr, size_t size, size_t alignment);
+void custom_list_free_batch(custom_list_allocator_t* alloc, void** ptrs, size_t count);
+void custom_list_free_aligned_batch(custom_list_allocator_t* alloc, void** ptrs, size_t count, size_t size,
+                                    size_t alignment);
 void custom_list_print_info(const custom_list_allocator_t* alloc);
 
 static inline size_t align_size(size_t size) {
@@ -37,6 +114,11 @@ static inline size_t align_size(size_t size) {
     return (size + alignment - 1) & ~(alignment - 1);
 }
 
+/* alignment must be a power of two. */
+static inline uint8_t* align_pointer(uint8_t* ptr, size_t alignment) {
+    return (uint8_t*) (((uintptr_t) ptr + alignment - 1) & ~(uintptr_t) (alignment - 1));
+}
+
 static void node_find_first(custom_list_allocator_t* alloc, size_t size, free_node_t** out_prev, free_node_t** out_cur) {
     free_node_t* prev = NULL;
     free_node_t* cur = alloc->free_list_head;
@@ -81,6 +163,7 @@ static void node_find_best(custom_list_allocator_t* alloc, size_t size, free_nod
 static void node_find(custom_list_allocator_t* alloc, size_t size, free_node_t** out_prev, free_node_t** out_cur) {
     switch (alloc->policy) {
         case ALLOC_POLICY_FIRST_FIT:
+        case ALLOC_POLICY_SIZE_CLASS:
             node_find_first(alloc, size, out_prev, out_cur);
             return;
         case ALLOC_POLICY_BEST_FIT:
@@ -132,7 +215,164 @@ static void coalesce_free_nodes(custom_list_allocator_t* alloc) {
     }
 }
 
+custom_list_heap_options_t custom_list_default_heap_options(void) {
+    custom_list_heap_options_t options;
+    options.pages = HEAP_PAGES_MALLOC;
+    options.populate = 0;
+    options.numa_node = -1;
+    options.grow_size = 0;
+    return options;
+}
+
+#ifdef __linux__
+static size_t round_up(size_t size, size_t multiple) {
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+/* Maps size bytes starting on an alignment boundary by over-mapping and trimming both ends. */
+static uint8_t* heap_map_aligned(size_t size, size_t alignment) {
+    uint8_t* raw = (uint8_t*) mmap(NULL, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == (uint8_t*) MAP_FAILED) {
+        return NULL;
+    }
+    uint8_t* memory = (uint8_t*) (((uintptr_t) raw + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    if (memory > raw) {
+        munmap(raw, (size_t) (memory - raw));
+    }
+    size_t tail = (size_t) (raw + size + alignment - (memory + size));
+    if (tail > 0) {
+        munmap(memory + size, tail);
+    }
+    return memory;
+}
+
+/* Sets an MPOL_BIND policy for the range. Raw syscall, so the heap needs no libnuma. */
+static int heap_bind_node(uint8_t* memory, size_t size, int node) {
+    const size_t bits = 8 * sizeof(unsigned long);
+    unsigned long mask[CUSTOM_LIST_MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+    if (node < 0 || node >= CUSTOM_LIST_MAX_NUMA_NODES) {
+        return 0;
+    }
+    mask[node / bits] |= 1UL << (node % bits);
+    return syscall(SYS_mbind, memory, size, MPOL_BIND, mask, (unsigned long) CUSTOM_LIST_MAX_NUMA_NODES + 1, 0) == 0;
+}
+#endif
+
+/* Creates a chunk of at least size bytes as the options ask. Its pages are only faulted in up
+ * front with populate: with MAP_POPULATE when the mapping is final as soon as it exists, by
+ * touching each page once madvise and mbind have had their say otherwise. */
+static heap_chunk_t* heap_chunk_create(size_t size, const custom_list_heap_options_t* options) {
+    heap_chunk_t* chunk = (heap_chunk_t*) malloc(sizeof(heap_chunk_t));
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->memory = NULL;
+    chunk->size = size;
+    chunk->pages = HEAP_PAGES_MALLOC;
+    chunk->numa_node = -1;
+
+#ifdef __linux__
+    heap_pages_t pages = options->pages;
+    if (pages == HEAP_PAGES_MALLOC && (options->populate || options->numa_node >= 0)) {
+        pages = HEAP_PAGES_MMAP;
+    }
+    const int bind = options->numa_node >= 0;
+    const int map_populate = options->populate && !bind ? MAP_POPULATE : 0;
+
+    if (pages == HEAP_PAGES_HUGETLB) {
+        chunk->size = round_up(size, CUSTOM_LIST_HUGE_PAGE_SIZE);
+        void* memory = mmap(NULL, chunk->size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | map_populate, -1, 0);
+        if (memory != MAP_FAILED) {
+            chunk->memory = (uint8_t*) memory;
+        } else {
+            pages = HEAP_PAGES_TRANSPARENT;
+        }
+    }
+    if (pages == HEAP_PAGES_TRANSPARENT) {
+        chunk->size = round_up(size, CUSTOM_LIST_HUGE_PAGE_SIZE);
+        chunk->memory = heap_map_aligned(chunk->size, CUSTOM_LIST_HUGE_PAGE_SIZE);
+        if (chunk->memory) {
+            madvise(chunk->memory, chunk->size, MADV_HUGEPAGE);
+        }
+    }
+    if (pages == HEAP_PAGES_MMAP) {
+        chunk->size = round_up(size, (size_t) sysconf(_SC_PAGESIZE));
+        void* memory = mmap(NULL, chunk->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | map_populate, -1, 0);
+        chunk->memory = memory != MAP_FAILED ? (uint8_t*) memory : NULL;
+    }
+
+    if (pages != HEAP_PAGES_MALLOC) {
+        if (!chunk->memory) {
+            free(chunk);
+            return NULL;
+        }
+        chunk->pages = pages;
+        if (bind && heap_bind_node(chunk->memory, chunk->size, options->numa_node)) {
+            chunk->numa_node = options->numa_node;
+        }
+        if (options->populate && (bind || pages == HEAP_PAGES_TRANSPARENT)) {
+            const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+            for (size_t offset = 0; offset < chunk->size; offset += page_size) {
+                ((volatile uint8_t*) chunk->memory)[offset] = 0;
+            }
+        }
+        return chunk;
+    }
+#else
+    (void) options;
+#endif
+
+    chunk->memory = (uint8_t*) malloc(size);
+    if (!chunk->memory) {
+        free(chunk);
+        return NULL;
+    }
+    return chunk;
+}
+
+static void heap_chunk_destroy(heap_chunk_t* chunk) {
+#ifdef __linux__
+    if (chunk->pages != HEAP_PAGES_MALLOC) {
+        munmap(chunk->memory, chunk->size);
+        free(chunk);
+        return;
+    }
+#endif
+    free(chunk->memory);
+    free(chunk);
+}
+
+/* Adds a chunk big enough for a block of size bytes to the free list. */
+static int heap_grow(custom_list_allocator_t* alloc, size_t size) {
+    if (alloc->options.grow_size == 0) {
+        return 0;
+    }
+    heap_chunk_t* chunk = heap_chunk_create(size > alloc->options.grow_size ? size : alloc->options.grow_size,
+                                            &alloc->options);
+    if (!chunk) {
+        return 0;
+    }
+    chunk->next = alloc->chunks;
+    alloc->chunks = chunk;
+    alloc->total_size += chunk->size;
+
+    free_node_t* node = (free_node_t*) chunk->memory;
+    node->size = chunk->size;
+    insert_free_node(alloc, node);
+    coalesce_free_nodes(alloc); /* mappings may land right next to each other */
+    return 1;
+}
+
 custom_list_allocator_t* custom_list_alloc_create(size_t heap_size, alloc_policy_t policy) {
+    return custom_list_alloc_create_ex(heap_size, policy, NULL);
+}
+
+/* Like custom_list_alloc_create, with the heap backed and grown as options say (NULL for the
+ * defaults: malloc, fixed size). */
+custom_list_allocator_t* custom_list_alloc_create_ex(size_t heap_size, alloc_policy_t policy,
+                                                     const custom_list_heap_options_t* options) {
     if (heap_size < sizeof(free_node_t) + sizeof(size_t)) {
         return NULL;
     }
@@ -142,18 +382,21 @@ custom_list_allocator_t* custom_list_alloc_create(size_t heap_size, alloc_policy
         return NULL;
     }
 
-    alloc->heap_memory = (uint8_t*) malloc(heap_size);
-    if (!alloc->heap_memory) {
+    alloc->options = options ? *options : custom_list_default_heap_options();
+    alloc->chunks = heap_chunk_create(heap_size, &alloc->options);
+    if (!alloc->chunks) {
         free(alloc);
         return NULL;
     }
+    alloc->heap_memory = alloc->chunks->memory;
 
-    alloc->total_size = heap_size;
+    alloc->total_size = alloc->chunks->size;
     alloc->used_size = 0;
     alloc->policy = policy;
+    alloc->class_count = 0;
 
     alloc->free_list_head = (free_node_t*) alloc->heap_memory;
-    alloc->free_list_head->size = heap_size;
+    alloc->free_list_head->size = alloc->total_size;
     alloc->free_list_head->next = NULL;
 
     return alloc;
@@ -161,26 +404,27 @@ custom_list_allocator_t* custom_list_alloc_create(size_t heap_size, alloc_policy
 
 void custom_list_alloc_destroy(custom_list_allocator_t* alloc) {
     if (!alloc) return;
-    free(alloc->heap_memory);
+    while (alloc->chunks) {
+        heap_chunk_t* next = alloc->chunks->next;
+        heap_chunk_destroy(alloc->chunks);
+        alloc->chunks = next;
+    }
     free(alloc);
 }
 
-void* custom_list_malloc(custom_list_allocator_t* alloc, size_t user_size) {
-    if (!alloc || user_size == 0) {
-        return NULL;
-    }
-
-    size_t actual_requested_size = align_size(user_size + sizeof(size_t));
-    if (actual_requested_size < sizeof(free_node_t)) {
-        actual_requested_size = sizeof(free_node_t);
-    }
-
+static void* list_malloc(custom_list_allocator_t* alloc, size_t actual_requested_size) {
     free_node_t* prev_found = NULL;
     free_node_t* found_node = NULL;
     node_find(alloc, actual_requested_size, &prev_found, &found_node);
 
     if (!found_node) {
-        return NULL;
+        if (!heap_grow(alloc, actual_requested_size)) {
+            return NULL;
+        }
+        node_find(alloc, actual_requested_size, &prev_found, &found_node);
+        if (!found_node) {
+            return NULL;
+        }
     }
 
     if (found_node->size >= actual_requested_size + sizeof(free_node_t)) {
@@ -202,12 +446,214 @@ void* custom_list_malloc(custom_list_allocator_t* alloc, size_t user_size) {
     return (void*) ((uint8_t*) found_node + sizeof(size_t));
 }
 
+/* First fit for a block of size bytes whose payload starts on alignment: the node it goes into
+ * and the payload address. The gap in front of the block stays a free node, so it is either
+ * empty or big enough for one. */
+static void node_find_aligned(custom_list_allocator_t* alloc, size_t size, size_t alignment, free_node_t** out_prev,
+                              free_node_t** out_cur, uint8_t** out_payload) {
+    free_node_t* prev = NULL;
+    free_node_t* cur = alloc->free_list_head;
+    *out_prev = NULL;
+    *out_cur = NULL;
+
+    while (cur) {
+        uint8_t* payload = align_pointer((uint8_t*) cur + sizeof(size_t), alignment);
+        size_t gap = (size_t) (payload - sizeof(size_t) - (uint8_t*) cur);
+        if (gap != 0 && gap < sizeof(free_node_t)) {
+            payload += alignment;
+            gap += alignment;
+        }
+        if (gap + size <= cur->size) {
+            *out_prev = prev;
+            *out_cur = cur;
+            *out_payload = payload;
+            return;
+        }
+        prev = cur;
+        cur = cur->next;
+    }
+}
+
+/* list_malloc for a payload starting on alignment. The block keeps its size header, so it is
+ * freed like any other list block. */
+static void* list_malloc_aligned(custom_list_allocator_t* alloc, size_t actual_requested_size, size_t alignment) {
+    free_node_t* prev_found = NULL;
+    free_node_t* found_node = NULL;
+    uint8_t* payload = NULL;
+    node_find_aligned(alloc, actual_requested_size, alignment, &prev_found, &found_node, &payload);
+
+    if (!found_node) {
+        if (!heap_grow(alloc, actual_requested_size + alignment + sizeof(free_node_t))) {
+            return NULL;
+        }
+        node_find_aligned(alloc, actual_requested_size, alignment, &prev_found, &found_node, &payload);
+        if (!found_node) {
+            return NULL;
+        }
+    }
+
+    free_node_t* block = (free_node_t*) (payload - sizeof(size_t));
+    const size_t gap = (size_t) ((uint8_t*) block - (uint8_t*) found_node);
+    size_t block_size = found_node->size - gap;
+    if (gap == 0) {
+        remove_free_node(alloc, prev_found, found_node);
+    } else {
+        found_node->size = gap;
+    }
+    if (block_size >= actual_requested_size + sizeof(free_node_t)) {
+        free_node_t* rest = (free_node_t*) ((uint8_t*) block + actual_requested_size);
+        rest->size = block_size - actual_requested_size;
+        insert_free_node(alloc, rest);
+        block_size = actual_requested_size;
+    }
+
+    *((size_t*) block) = block_size;
+    alloc->used_size += block_size;
+    return payload;
+}
+
+static size_class_t* size_class_find(custom_list_allocator_t* alloc, size_t block_size, size_t alignment) {
+    for (size_t i = 0; i < alloc->class_count; ++i) {
+        if (alloc->classes[i].block_size == block_size && alloc->classes[i].alignment == alignment) {
+            return &alloc->classes[i];
+        }
+    }
+    return NULL;
+}
+
+static size_class_t* size_class_find_or_add(custom_list_allocator_t* alloc, size_t block_size, size_t alignment) {
+    size_class_t* size_class = size_class_find(alloc, block_size, alignment);
+    if (size_class || block_size > CUSTOM_LIST_MAX_CLASS_BLOCK || alloc->class_count == CUSTOM_LIST_MAX_SIZE_CLASSES) {
+        return size_class;
+    }
+
+    size_class = &alloc->classes[alloc->class_count++];
+    memset(size_class, 0, sizeof(*size_class));
+    size_class->block_size = block_size;
+    size_class->alignment = alignment;
+    return size_class;
+}
+
+/* The class an aligned block of user_size bytes belongs to, if it has one. */
+static size_class_t* size_class_find_aligned(custom_list_allocator_t* alloc, size_t user_size, size_t alignment) {
+    if (alloc->policy != ALLOC_POLICY_SIZE_CLASS) {
+        return NULL;
+    }
+    return size_class_find(alloc, (user_size + alignment - 1) & ~(alignment - 1), alignment);
+}
+
+/* Pops a recycled block, or cuts the next one off the newest slab. NULL when no slab fits. */
+static void* size_class_malloc(custom_list_allocator_t* alloc, size_class_t* size_class) {
+    free_block_t* block = size_class->free_blocks;
+    if (block) {
+        size_class->free_blocks = block->next;
+    } else {
+        if ((size_t) (size_class->bump_end - size_class->bump) < size_class->block_size) {
+            uint8_t* slab = (uint8_t*) list_malloc(alloc, align_size(CUSTOM_LIST_SLAB_SIZE));
+            if (!slab) {
+                return NULL;
+            }
+            size_class->bump = size_class->alignment ? align_pointer(slab, size_class->alignment) : slab;
+            size_class->bump_end = slab + CUSTOM_LIST_SLAB_SIZE - sizeof(size_t);
+            size_class->slabs++;
+        }
+        block = (free_block_t*) size_class->bump;
+        if (!size_class->alignment) {
+            block->size = size_class->block_size | CUSTOM_LIST_CLASS_BLOCK_FLAG;
+        }
+        size_class->bump += size_class->block_size;
+    }
+
+    size_class->blocks_in_use++;
+    if (size_class->alignment) {
+        return (void*) block;
+    }
+    return (void*) ((uint8_t*) block + sizeof(size_t));
+}
+
+static void size_class_free(size_class_t* size_class, free_block_t* block) {
+    block->next = size_class->free_blocks;
+    size_class->free_blocks = block;
+    size_class->blocks_in_use--;
+}
+
+void* custom_list_malloc(custom_list_allocator_t* alloc, size_t user_size) {
+    if (!alloc || user_size == 0) {
+        return NULL;
+    }
+
+    size_t actual_requested_size = align_size(user_size + sizeof(size_t));
+    if (actual_requested_size < sizeof(free_node_t)) {
+        actual_requested_size = sizeof(free_node_t);
+    }
+
+    if (alloc->policy == ALLOC_POLICY_SIZE_CLASS) {
+        size_class_t* size_class = size_class_find_or_add(alloc, actual_requested_size, 0);
+        if (size_class) {
+            void* mem = size_class_malloc(alloc, size_class);
+            if (mem) {
+                return mem;
+            }
+        }
+    }
+
+    return list_malloc(alloc, actual_requested_size);
+}
+
+/* Like custom_list_malloc, with the block starting on alignment (a power of two). Free it with
+ * custom_list_free_aligned and the same size and alignment. Under ALLOC_POLICY_SIZE_CLASS it
+ * comes from a class of its own whose blocks have no header, so a node made of whole cache lines
+ * takes exactly its size; such a class does not fall back to the list when no slab fits. Other
+ * blocks are cut from the list at an aligned address, and the gap in front stays free. */
+void* custom_list_malloc_aligned(custom_list_allocator_t* alloc, size_t user_size, size_t alignment) {
+    if (alignment <= sizeof(void*)) {
+        return custom_list_malloc(alloc, user_size);
+    }
+    if (!alloc || user_size == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    if (alloc->policy == ALLOC_POLICY_SIZE_CLASS) {
+        size_t block_size = (user_size + alignment - 1) & ~(alignment - 1);
+        size_class_t* size_class = size_class_find_or_add(alloc, block_size, alignment);
+        if (size_class) {
+            return size_class_malloc(alloc, size_class);
+        }
+    }
+
+    size_t actual_requested_size = align_size(user_size + sizeof(size_t));
+    if (actual_requested_size < sizeof(free_node_t)) {
+        actual_requested_size = sizeof(free_node_t);
+    }
+    return list_malloc_aligned(alloc, actual_requested_size, alignment);
+}
+
+/* Hands a block back to its size class, if a class carved it. Only the flag in the header
+ * decides: a list block of a class size (a first-fit remainder, or a fallback when no slab fit)
+ * goes back to the list it came from. */
+static int size_class_take_back(custom_list_allocator_t* alloc, uint8_t* block_start) {
+    const size_t header = *((size_t*) block_start);
+    if (alloc->policy != ALLOC_POLICY_SIZE_CLASS || !(header & CUSTOM_LIST_CLASS_BLOCK_FLAG)) {
+        return 0;
+    }
+    size_class_t* size_class = size_class_find(alloc, header & ~CUSTOM_LIST_CLASS_BLOCK_FLAG, 0);
+    if (!size_class) {
+        return 0;
+    }
+    size_class_free(size_class, (free_block_t*) block_start);
+    return 1;
+}
+
 void custom_list_free(custom_list_allocator_t* alloc, void* ptr) {
     if (!alloc || !ptr) {
         return;
     }
 
     uint8_t* block_start = (uint8_t*) ptr - sizeof(size_t);
+    if (size_class_take_back(alloc, block_start)) {
+        return;
+    }
+
     free_node_t* node_to_free = (free_node_t*) block_start;
 
     node_to_free->size = *((size_t*) block_start);
@@ -218,6 +664,90 @@ void custom_list_free(custom_list_allocator_t* alloc, void* ptr) {
     coalesce_free_nodes(alloc);
 }
 
+/* Frees a block of custom_list_malloc_aligned; size and alignment must be the ones it was asked
+ * for with. */
+void custom_list_free_aligned(custom_list_allocator_t* alloc, void* ptr, size_t user_size, size_t alignment) {
+    if (!alloc || !ptr) {
+        return;
+    }
+    if (alignment > sizeof(void*)) {
+        size_class_t* size_class = size_class_find_aligned(alloc, user_size, alignment);
+        if (size_class) {
+            size_class_free(size_class, (free_block_t*) ptr);
+            return;
+        }
+    }
+    custom_list_free(alloc, ptr);
+}
+
+static int compare_addresses(const void* lhs, const void* rhs) {
+    uintptr_t a = (uintptr_t) *(void* const*) lhs;
+    uintptr_t b = (uintptr_t) *(void* const*) rhs;
+    return (a > b) - (a < b);
+}
+
+/* Frees count blocks at once: the blocks are sorted by address and merged into the sorted free
+ * list in a single walk, followed by one coalescing pass, instead of one list walk and one
+ * coalescing pass per block. ptrs is reordered. */
+void custom_list_free_batch(custom_list_allocator_t* alloc, void** ptrs, size_t count) {
+    if (!alloc || !ptrs || count == 0) {
+        return;
+    }
+
+    size_t list_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (ptrs[i] && !size_class_take_back(alloc, (uint8_t*) ptrs[i] - sizeof(size_t))) {
+            ptrs[list_count++] = ptrs[i];
+        }
+    }
+    if (list_count == 0) {
+        return;
+    }
+
+    qsort(ptrs, list_count, sizeof(void*), compare_addresses);
+
+    free_node_t* prev = NULL;
+    free_node_t* curr = alloc->free_list_head;
+    for (size_t i = 0; i < list_count; ++i) {
+
+        free_node_t* node_to_free = (free_node_t*) ((uint8_t*) ptrs[i] - sizeof(size_t));
+        node_to_free->size = *((size_t*) node_to_free);
+        alloc->used_size -= node_to_free->size;
+
+        while (curr != NULL && curr < node_to_free) {
+            prev = curr;
+            curr = curr->next;
+        }
+        node_to_free->next = curr;
+        if (prev == NULL) {
+            alloc->free_list_head = node_to_free;
+        } else {
+            prev->next = node_to_free;
+        }
+        prev = node_to_free;
+    }
+
+    coalesce_free_nodes(alloc);
+}
+
+/* custom_list_free_batch for count blocks of custom_list_malloc_aligned(size, alignment). */
+void custom_list_free_aligned_batch(custom_list_allocator_t* alloc, void** ptrs, size_t count, size_t user_size,
+                                    size_t alignment) {
+    if (!alloc || !ptrs || count == 0) {
+        return;
+    }
+    size_class_t* size_class = alignment > sizeof(void*) ? size_class_find_aligned(alloc, user_size, alignment) : NULL;
+    if (!size_class) {
+        custom_list_free_batch(alloc, ptrs, count);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (ptrs[i]) {
+            size_class_free(size_class, (free_block_t*) ptrs[i]);
+        }
+    }
+}
+
 void custom_list_print_info(const custom_list_allocator_t* alloc) {
     if (!alloc) {
         printf("Allocator not initialized.\n");
@@ -227,7 +757,25 @@ void custom_list_print_info(const custom_list_allocator_t* alloc) {
     printf("  Total Size: %zu bytes\n", alloc->total_size);
     printf("  Used Size:  %zu bytes\n", alloc->used_size);
     printf("  Free Size:  %zu bytes\n", alloc->total_size - alloc->used_size);
-    printf("  Policy:     %s\n", alloc->policy == ALLOC_POLICY_FIRST_FIT ? "First-Fit" : "Best-Fit");
+    printf("  Policy:     %s\n", alloc->policy == ALLOC_POLICY_FIRST_FIT  ? "First-Fit"
+                                 : alloc->policy == ALLOC_POLICY_BEST_FIT ? "Best-Fit"
+                                                                          : "Size-Class");
+    static const char* const page_names[] = {"malloc", "mmap", "transparent huge pages", "hugetlb"};
+    size_t chunk_index = 0;
+    for (const heap_chunk_t* chunk = alloc->chunks; chunk; chunk = chunk->next) {
+        printf("  Chunk %zu: Address=%p, Size=%zu bytes, Pages=%s", ++chunk_index, (void*) chunk->memory, chunk->size,
+               page_names[chunk->pages]);
+        if (chunk->numa_node >= 0) {
+            printf(", NUMA node=%d", chunk->numa_node);
+        }
+        printf("\n");
+    }
+    for (size_t i = 0; i < alloc->class_count; ++i) {
+        const size_class_t* size_class = &alloc->classes[i];
+        printf("  Size class %zu: Block=%zu bytes, Alignment=%zu, Slabs=%zu, Blocks in use=%zu\n", i + 1,
+               size_class->block_size, size_class->alignment ? size_class->alignment : sizeof(void*),
+               size_class->slabs, size_class->blocks_in_use);
+    }
     printf("  Free List:\n");
 
     free_node_t* node = alloc->free_list_head;
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+#include "custom_list_allocator.hpp"
+
+/* Thread-safe front end for the custom list allocator, one heap shared by many threads.
+ *
+ * Block sizes get a size class on first use, as with ALLOC_POLICY_SIZE_CLASS. Every thread keeps
+ * a cache per allocator with a free list per class, so a malloc or free from the owning thread
+ * touches no lock and no atomic. Caches refill from and flush to the shared pool
+ * CUSTOM_MT_CACHE_BATCH blocks at a time; only then is the lock taken, and the shared pool in
+ * turn carves its blocks out of CUSTOM_LIST_SLAB_SIZE slabs of the locked list. A block
+ * remembers the cache it was handed out by: freed by another thread, it is pushed onto that
+ * cache's remote list for its class with a CAS, and the owner takes the whole list back with one
+ * exchange when its own list runs dry.
+ *
+ * When a thread exits, its caches go back to the shared pool and are marked retired; the next
+ * thread that needs a cache for that allocator adopts one, remote lists included. Sizes without
+ * a class go straight to the list under the lock.
+ *
+ * custom_mt_malloc_aligned serves blocks that start on an alignment from classes of their own,
+ * whose blocks have no header. Such a block cannot tell who handed it out, so whichever thread
+ * frees it (custom_mt_free_aligned, with the same size and alignment) keeps it in its cache. */
+#define CUSTOM_MT_CACHE_BATCH 32
+#define CUSTOM_MT_CACHE_LIMIT (4 * CUSTOM_MT_CACHE_BATCH)
+#define CUSTOM_MT_THREAD_ALLOCATORS 8 /* allocators a thread keeps a cache for, others go through the lock */
+
+typedef struct custom_mt_allocator_s custom_mt_allocator_t;
+
+/* Header in front of every block. While the block is free the link replaces the owner. */
+typedef struct mt_block_s {
+    union {
+        struct mt_cache_s* owner; /* NULL when handed out without a cache */
+        struct mt_block_s* next;
+    };
+    size_t size_class; /* index + 1, 0 for blocks taken from the list directly */
+} mt_block_t;
+
+typedef struct mt_class_s {
+    size_t block_size; /* including the header, if any */
+    size_t alignment;  /* 0 for blocks with a header */
+    mt_block_t* free_blocks;
+    size_t free_count;
+    uint8_t* bump; /* unused tail of the newest slab */
+    uint8_t* bump_end;
+    size_t slabs;
+} mt_class_t;
+
+typedef struct mt_cache_s {
+    mt_block_t* local[CUSTOM_LIST_MAX_SIZE_CLASSES];
+    size_t local_count[CUSTOM_LIST_MAX_SIZE_CLASSES];
+    std::atomic<mt_block_t*> remote[CUSTOM_LIST_MAX_SIZE_CLASSES];
+    std::atomic<bool> retired;
+    struct mt_cache_s* next_cache;
+} mt_cache_t;
+
+struct custom_mt_allocator_s {
+    std::mutex lock; /* guards heap, the shared pool of every class and the cache list */
+    custom_list_allocator_t* heap;
+    mt_class_t classes[CUSTOM_LIST_MAX_SIZE_CLASSES];
+    std::atomic<size_t> class_count;
+    mt_cache_t* caches;
+    uint64_t id;
+    custom_mt_allocator_t* next_live;
+    std::atomic<size_t> refills;
+    std::atomic<size_t> flushes;
+    std::atomic<size_t> remote_frees;
+};
+
+custom_mt_allocator_t* custom_mt_alloc_create(size_t heap_size);
+void custom_mt_alloc_destroy(custom_mt_allocator_t* alloc);
+void* custom_mt_malloc(custom_mt_allocator_t* alloc, size_t size);
+void* custom_mt_malloc_aligned(custom_mt_allocator_t* alloc, size_t size, size_t alignment);
+void custom_mt_free(custom_mt_allocator_t* alloc, void* ptr);
+void custom_mt_free_aligned(custom_mt_allocator_t* alloc, void* ptr, size_t size, size_t alignment);
+void custom_mt_print_info(custom_mt_allocator_t* alloc);
+
+/* Live allocators, so a thread that exits after an allocator was destroyed leaves it alone.
+ * Ids are never reused. */
+inline std::mutex mt_registry_lock;
+inline custom_mt_allocator_t* mt_live_allocators = NULL;
+inline uint64_t mt_next_id = 1;
+
+static void mt_cache_retire(uint64_t id, mt_cache_t* cache);
+
+/* The caches of the calling thread, by allocator id; retired when the thread exits. */
+struct mt_thread_caches {
+    uint64_t ids[CUSTOM_MT_THREAD_ALLOCATORS] = {};
+    mt_cache_t* caches[CUSTOM_MT_THREAD_ALLOCATORS] = {};
+    size_t count = 0;
+
+    ~mt_thread_caches() {
+        for (size_t i = 0; i < count; ++i) {
+            mt_cache_retire(ids[i], caches[i]);
+        }
+    }
+};
+
+inline thread_local mt_thread_caches mt_this_thread;
+
+custom_mt_allocator_t* custom_mt_alloc_create(size_t heap_size) {
+    custom_list_allocator_t* heap = custom_list_alloc_create(heap_size, ALLOC_POLICY_FIRST_FIT);
+    if (!heap) {
+        return NULL;
+    }
+
+    custom_mt_allocator_t* alloc = new (std::nothrow) custom_mt_allocator_t();
+    if (!alloc) {
+        custom_list_alloc_destroy(heap);
+        return NULL;
+    }
+    alloc->heap = heap;
+    alloc->caches = NULL;
+
+    std::lock_guard<std::mutex> guard(mt_registry_lock);
+    alloc->id = mt_next_id++;
+    alloc->next_live = mt_live_allocators;
+    mt_live_allocators = alloc;
+    return alloc;
+}
+
+/* Every thread must be done with the allocator; their caches simply go with the heap. */
+void custom_mt_alloc_destroy(custom_mt_allocator_t* alloc) {
+    if (!alloc) return;
+    {
+        std::lock_guard<std::mutex> guard(mt_registry_lock);
+        custom_mt_allocator_t** link = &mt_live_allocators;
+        while (*link != alloc) {
+            link = &(*link)->next_live;
+        }
+        *link = alloc->next_live;
+    }
+
+    mt_cache_t* cache = alloc->caches;
+    while (cache) {
+        mt_cache_t* next = cache->next_cache;
+        delete cache;
+        cache = next;
+    }
+    custom_list_alloc_destroy(alloc->heap);
+    delete alloc;
+}
+
+/* Index + 1 of the class for block_size and alignment among the first count, 0 when none. */
+static size_t mt_class_find(custom_mt_allocator_t* alloc, size_t count, size_t block_size, size_t alignment) {
+    for (size_t i = 0; i < count; ++i) {
+        if (alloc->classes[i].block_size == block_size && alloc->classes[i].alignment == alignment) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/* Index + 1 of the class for block_size and alignment, 0 when it has none. Published classes
+ * never change, so the lookup runs without the lock. */
+static size_t mt_class_find_or_add(custom_mt_allocator_t* alloc, size_t block_size, size_t alignment) {
+    size_t count = alloc->class_count.load(std::memory_order_acquire);
+    size_t found = mt_class_find(alloc, count, block_size, alignment);
+    if (found || block_size > CUSTOM_LIST_MAX_CLASS_BLOCK || count == CUSTOM_LIST_MAX_SIZE_CLASSES) {
+        return found;
+    }
+
+    std::lock_guard<std::mutex> guard(alloc->lock);
+    count = alloc->class_count.load(std::memory_order_relaxed);
+    found = mt_class_find(alloc, count, block_size, alignment);
+    if (found || count == CUSTOM_LIST_MAX_SIZE_CLASSES) {
+        return found;
+    }
+    mt_class_t* size_class = &alloc->classes[count];
+    memset(size_class, 0, sizeof(*size_class));
+    size_class->block_size = block_size;
+    size_class->alignment = alignment;
+    alloc->class_count.store(count + 1, std::memory_order_release);
+    return count + 1;
+}
+
+/* Forgets the caches of allocators destroyed since, to make room for new ones. */
+static void mt_thread_prune(mt_thread_caches& mine) {
+    std::lock_guard<std::mutex> registry(mt_registry_lock);
+    size_t kept = 0;
+    for (size_t i = 0; i < mine.count; ++i) {
+        custom_mt_allocator_t* alloc = mt_live_allocators;
+        while (alloc && alloc->id != mine.ids[i]) {
+            alloc = alloc->next_live;
+        }
+        if (alloc) {
+            mine.ids[kept] = mine.ids[i];
+            mine.caches[kept] = mine.caches[i];
+            kept++;
+        }
+    }
+    mine.count = kept;
+}
+
+static mt_cache_t* mt_cache_get(custom_mt_allocator_t* alloc) {
+    mt_thread_caches& mine = mt_this_thread;
+    for (size_t i = 0; i < mine.count; ++i) {
+        if (mine.ids[i] == alloc->id) {
+            return mine.caches[i];
+        }
+    }
+    if (mine.count == CUSTOM_MT_THREAD_ALLOCATORS) {
+        mt_thread_prune(mine);
+        if (mine.count == CUSTOM_MT_THREAD_ALLOCATORS) return NULL;
+    }
+
+    std::lock_guard<std::mutex> guard(alloc->lock);
+    mt_cache_t* cache = alloc->caches;
+    while (cache && !cache->retired.load(std::memory_order_relaxed)) {
+        cache = cache->next_cache;
+    }
+    if (!cache) {
+        cache = new (std::nothrow) mt_cache_t();
+        if (!cache) {
+            return NULL;
+        }
+        cache->next_cache = alloc->caches;
+        alloc->caches = cache;
+    }
+    cache->retired.store(false, std::memory_order_relaxed);
+
+    mine.ids[mine.count] = alloc->id;
+    mine.caches[mine.count] = cache;
+    mine.count++;
+    return cache;
+}
+
+/* Puts the chain first..last of count blocks back into the shared pool. Lock held. */
+static void mt_pool_push(mt_class_t* size_class, mt_block_t* first, mt_block_t* last, size_t count) {
+    last->next = size_class->free_blocks;
+    size_class->free_blocks = first;
+    size_class->free_count += count;
+}
+
+/* Takes up to wanted blocks from the shared pool, cutting new ones off the slab once it is
+ * empty. Returns the chain and its length in *count, NULL when the heap is full. */
+static mt_block_t* mt_pool_take(custom_mt_allocator_t* alloc, size_t c, size_t wanted, size_t* count) {
+    mt_class_t* size_class = &alloc->classes[c];
+    mt_block_t* chain = NULL;
+    size_t taken = 0;
+
+    std::lock_guard<std::mutex> guard(alloc->lock);
+    while (taken < wanted) {
+        mt_block_t* block = size_class->free_blocks;
+        if (block) {
+            size_class->free_blocks = block->next;
+            size_class->free_count--;
+        } else {
+            if ((size_t) (size_class->bump_end - size_class->bump) < size_class->block_size) {
+                if (taken > 0) break;
+                uint8_t* slab = (uint8_t*) custom_list_malloc(alloc->heap, CUSTOM_LIST_SLAB_SIZE);
+                if (!slab) break;
+                size_class->bump = size_class->alignment ? align_pointer(slab, size_class->alignment) : slab;
+                size_class->bump_end = slab + CUSTOM_LIST_SLAB_SIZE;
+                size_class->slabs++;
+            }
+            block = (mt_block_t*) size_class->bump;
+            block->size_class = c + 1;
+            size_class->bump += size_class->block_size;
+        }
+        block->next = chain;
+        chain = block;
+        taken++;
+    }
+    *count = taken;
+    return chain;
+}
+
+/* Own list of class c is past its limit: all but one batch goes back to the shared pool. */
+static void mt_cache_flush(custom_mt_allocator_t* alloc, mt_cache_t* cache, size_t c) {
+    mt_block_t* last = cache->local[c];
+    for (size_t i = 1; i < CUSTOM_MT_CACHE_BATCH; ++i) {
+        last = last->next;
+    }
+    mt_block_t* first = last->next;
+    mt_block_t* tail = first;
+    size_t count = 1;
+    while (tail->next) {
+        tail = tail->next;
+        count++;
+    }
+    last->next = NULL;
+    cache->local_count[c] = CUSTOM_MT_CACHE_BATCH;
+
+    std::lock_guard<std::mutex> guard(alloc->lock);
+    mt_pool_push(&alloc->classes[c], first, tail, count);
+    alloc->flushes.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* Pushes a block of class c onto the calling thread's own list. */
+static void mt_cache_put(custom_mt_allocator_t* alloc, mt_cache_t* cache, size_t c, mt_block_t* block) {
+    block->next = cache->local[c];
+    cache->local[c] = block;
+    if (++cache->local_count[c] > CUSTOM_MT_CACHE_LIMIT) {
+        mt_cache_flush(alloc, cache, c);
+    }
+}
+
+static void mt_cache_retire(uint64_t id, mt_cache_t* cache) {
+    std::lock_guard<std::mutex> registry(mt_registry_lock);
+    custom_mt_allocator_t* alloc = mt_live_allocators;
+    while (alloc && alloc->id != id) {
+        alloc = alloc->next_live;
+    }
+    if (!alloc) return;
+
+    std::lock_guard<std::mutex> guard(alloc->lock);
+    for (size_t c = 0; c < CUSTOM_LIST_MAX_SIZE_CLASSES; ++c) {
+        mt_block_t* lists[2] = {cache->local[c], cache->remote[c].exchange(NULL, std::memory_order_acquire)};
+        for (mt_block_t* first : lists) {
+            if (!first) continue;
+            mt_block_t* last = first;
+            size_t count = 1;
+            while (last->next) {
+                last = last->next;
+                count++;
+            }
+            mt_pool_push(&alloc->classes[c], first, last, count);
+        }
+        cache->local[c] = NULL;
+        cache->local_count[c] = 0;
+    }
+    cache->retired.store(true, std::memory_order_release);
+}
+
+/* A block of class c from the calling thread's cache, its owner set to that cache. */
+static mt_block_t* mt_class_malloc(custom_mt_allocator_t* alloc, size_t c) {
+    mt_cache_t* cache = mt_cache_get(alloc);
+    mt_block_t* block;
+    if (!cache) {
+        size_t count;
+        block = mt_pool_take(alloc, c, 1, &count);
+        if (!block) return NULL;
+        block->owner = NULL;
+        return block;
+    }
+
+    block = cache->local[c];
+    if (!block) {
+        block = cache->remote[c].exchange(NULL, std::memory_order_acquire);
+        size_t count = 0;
+        for (mt_block_t* b = block; b; b = b->next) {
+            count++;
+        }
+        if (!block) {
+            block = mt_pool_take(alloc, c, CUSTOM_MT_CACHE_BATCH, &count);
+            if (!block) return NULL;
+            alloc->refills.fetch_add(1, std::memory_order_relaxed);
+        }
+        cache->local_count[c] = count;
+    }
+    cache->local[c] = block->next;
+    cache->local_count[c]--;
+    block->owner = cache;
+    return block;
+}
+
+void* custom_mt_malloc(custom_mt_allocator_t* alloc, size_t user_size) {
+    if (!alloc || user_size == 0) {
+        return NULL;
+    }
+
+    const size_t block_size = align_size(user_size + sizeof(mt_block_t));
+    const size_t size_class = mt_class_find_or_add(alloc, block_size, 0);
+    if (size_class == 0) {
+        std::lock_guard<std::mutex> guard(alloc->lock);
+        mt_block_t* block = (mt_block_t*) custom_list_malloc(alloc->heap, block_size);
+        if (!block) return NULL;
+        block->owner = NULL;
+        block->size_class = 0;
+        return block + 1;
+    }
+
+    mt_block_t* block = mt_class_malloc(alloc, size_class - 1);
+    return block ? block + 1 : NULL;
+}
+
+/* Like custom_mt_malloc, with the block starting on alignment (a power of two). Free it with
+ * custom_mt_free_aligned and the same size and alignment. */
+void* custom_mt_malloc_aligned(custom_mt_allocator_t* alloc, size_t user_size, size_t alignment) {
+    if (alignment <= sizeof(void*)) {
+        return custom_mt_malloc(alloc, user_size);
+    }
+    if (!alloc || user_size == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    const size_t block_size = (user_size + alignment - 1) & ~(alignment - 1);
+    const size_t size_class = mt_class_find_or_add(alloc, block_size, alignment);
+    if (size_class == 0) {
+        std::lock_guard<std::mutex> guard(alloc->lock);
+        return custom_list_malloc_aligned(alloc->heap, user_size, alignment);
+    }
+    return mt_class_malloc(alloc, size_class - 1);
+}
+
+void custom_mt_free(custom_mt_allocator_t* alloc, void* ptr) {
+    if (!alloc || !ptr) {
+        return;
+    }
+
+    mt_block_t* block = (mt_block_t*) ptr - 1;
+    if (block->size_class == 0) {
+        std::lock_guard<std::mutex> guard(alloc->lock);
+        custom_list_free(alloc->heap, block);
+        return;
+    }
+
+    const size_t c = block->size_class - 1;
+    mt_cache_t* owner = block->owner;
+    mt_cache_t* cache = owner ? mt_cache_get(alloc) : NULL;
+    if (owner && owner == cache) {
+        mt_cache_put(alloc, cache, c, block);
+    } else if (owner && !owner->retired.load(std::memory_order_acquire)) {
+        mt_block_t* head = owner->remote[c].load(std::memory_order_relaxed);
+        do {
+            block->next = head;
+        } while (!owner->remote[c].compare_exchange_weak(head, block, std::memory_order_release,
+                                                         std::memory_order_relaxed));
+        alloc->remote_frees.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        std::lock_guard<std::mutex> guard(alloc->lock);
+        mt_pool_push(&alloc->classes[c], block, block, 1);
+    }
+}
+
+/* Frees a block of custom_mt_malloc_aligned; size and alignment must be the ones it was asked
+ * for with. */
+void custom_mt_free_aligned(custom_mt_allocator_t* alloc, void* ptr, size_t user_size, size_t alignment) {
+    if (alignment <= sizeof(void*)) {
+        custom_mt_free(alloc, ptr);
+        return;
+    }
+    if (!alloc || !ptr) {
+        return;
+    }
+
+    const size_t block_size = (user_size + alignment - 1) & ~(alignment - 1);
+    const size_t size_class =
+        mt_class_find(alloc, alloc->class_count.load(std::memory_order_acquire), block_size, alignment);
+    if (size_class == 0) {
+        std::lock_guard<std::mutex> guard(alloc->lock);
+        custom_list_free(alloc->heap, ptr);
+        return;
+    }
+
+    const size_t c = size_class - 1;
+    mt_block_t* block = (mt_block_t*) ptr;
+    mt_cache_t* cache = mt_cache_get(alloc);
+    if (cache) {
+        mt_cache_put(alloc, cache, c, block);
+    } else {
+        std::lock_guard<std::mutex> guard(alloc->lock);
+        mt_pool_push(&alloc->classes[c], block, block, 1);
+    }
+}
+
+void custom_mt_print_info(custom_mt_allocator_t* alloc) {
+    if (!alloc) {
+        printf("Allocator not initialized.\n");
+        return;
+    }
+    std::lock_guard<std::mutex> guard(alloc->lock);
+    size_t caches = 0;
+    for (mt_cache_t* cache = alloc->caches; cache; cache = cache->next_cache) {
+        caches++;
+    }
+    printf("Custom MT Allocator Info:\n");
+    printf("  Heap used:    %zu of %zu bytes\n", alloc->heap->used_size, alloc->heap->total_size);
+    printf("  Thread caches: %zu\n", caches);
+    printf("  Refills: %zu, Flushes: %zu, Remote frees: %zu\n", alloc->refills.load(), alloc->flushes.load(),
+           alloc->remote_frees.load());
+    for (size_t i = 0; i < alloc->class_count.load(); ++i) {
+        const mt_class_t* size_class = &alloc->classes[i];
+        printf("  Size class %zu: Block=%zu bytes, Alignment=%zu, Slabs=%zu, Free in shared pool=%zu\n", i + 1,
+               size_class->block_size, size_class->alignment ? size_class->alignment : sizeof(void*),
+               size_class->slabs, size_class->free_count);
+    }
+    printf("\n");
+}
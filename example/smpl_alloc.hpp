@@ -9,6 +9,10 @@
 #include "custom_list_allocator.hpp"
 #endif
 
+#ifdef USE_CUSTOM_MT_ALLOCATOR
+#include "custom_mt_allocator.hpp"
+#endif
+
 template <typename T>
 struct smpl_alloc {
     using value_type = T;
@@ -24,24 +28,33 @@ struct smpl_alloc {
         using other = smpl_alloc<U>;
     };
 
-#ifdef USE_CUSTOM_LIST_ALLOCATOR
+#if defined(USE_CUSTOM_LIST_ALLOCATOR)
     custom_list_allocator_t* custom_alloc_instance_ = nullptr;
 
     explicit smpl_alloc(custom_list_allocator_t* alloc_instance = nullptr) noexcept : custom_alloc_instance_(alloc_instance) {}
+#elif defined(USE_CUSTOM_MT_ALLOCATOR)
+    // One heap may back the trees of many threads, see custom_mt_allocator.hpp.
+    custom_mt_allocator_t* custom_alloc_instance_ = nullptr;
+
+    explicit smpl_alloc(custom_mt_allocator_t* alloc_instance = nullptr) noexcept : custom_alloc_instance_(alloc_instance) {}
 #else
     smpl_alloc() noexcept {}
 #endif
 
     template <typename U>
     smpl_alloc(const smpl_alloc<U>& other) noexcept {
-#ifdef USE_CUSTOM_LIST_ALLOCATOR
+#if defined(USE_CUSTOM_LIST_ALLOCATOR) || defined(USE_CUSTOM_MT_ALLOCATOR)
         custom_alloc_instance_ = other.custom_alloc_instance_;
+#else
+        (void) other;
 #endif
     }
 
     smpl_alloc(const smpl_alloc& other) noexcept {
-#ifdef USE_CUSTOM_LIST_ALLOCATOR
+#if defined(USE_CUSTOM_LIST_ALLOCATOR) || defined(USE_CUSTOM_MT_ALLOCATOR)
         custom_alloc_instance_ = other.custom_alloc_instance_;
+#else
+        (void) other;
 #endif
     }
 
@@ -50,40 +63,85 @@ struct smpl_alloc {
             throw std::bad_alloc();
         }
 #if defined(MALLOC_SYSTEM_DEFAULT)
+        if (alignof(value_type) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return static_cast<pointer>(::operator new(n * sizeof(value_type), std::align_val_t(alignof(value_type))));
+        }
         return static_cast<pointer>(::operator new(n * sizeof(value_type)));
-#elif defined(USE_CUSTOM_LIST_ALLOCATOR)
+#elif defined(USE_CUSTOM_LIST_ALLOCATOR) || defined(USE_CUSTOM_MT_ALLOCATOR)
         if (!custom_alloc_instance_) {
             throw std::runtime_error("Custom list allocator instance not set for smpl_alloc during allocate");
         }
-        void* mem = custom_list_malloc(custom_alloc_instance_, n * sizeof(value_type));
+        void* mem = raw_malloc(n * sizeof(value_type));
         if (!mem) throw std::bad_alloc();
         return static_cast<pointer>(mem);
 #else
-        throw std::runtime_error(
-            "No allocation strategy defined for smpl_alloc (MALLOC_SYSTEM_DEFAULT or USE_CUSTOM_LIST_ALLOCATOR)");
+        throw std::runtime_error("No allocation strategy defined for smpl_alloc (MALLOC_SYSTEM_DEFAULT, "
+                                 "USE_CUSTOM_LIST_ALLOCATOR or USE_CUSTOM_MT_ALLOCATOR)");
 #endif
     }
 
     void deallocate(pointer p, size_type n) noexcept {
-        (void) n;
 #if defined(MALLOC_SYSTEM_DEFAULT)
+        (void) n;
+        if (alignof(value_type) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(p, std::align_val_t(alignof(value_type)));
+            return;
+        }
         ::operator delete(p);
-#elif defined(USE_CUSTOM_LIST_ALLOCATOR)
+#elif defined(USE_CUSTOM_LIST_ALLOCATOR) || defined(USE_CUSTOM_MT_ALLOCATOR)
         if (!custom_alloc_instance_) {
             // This is a severe issue, deallocating without a valid allocator instance
             // For robustness, one might log this or assert in debug, but not throw from noexcept
             return;
         }
-        custom_list_free(custom_alloc_instance_, p);
+        raw_free(p, n * sizeof(value_type));
 #else
+        (void) p;
+        (void) n;
         // No deallocation strategy
 #endif
     }
+
+    // Takes back count blocks of n elements each in one go (see btree::deallocateBatch); the
+    // custom list merges them into its free list with a single walk. ptrs is overwritten.
+    void deallocate_batch(pointer* ptrs, size_type count, size_type n) noexcept {
+#if defined(USE_CUSTOM_LIST_ALLOCATOR)
+        if (!custom_alloc_instance_) return;
+        void** raw = reinterpret_cast<void**>(ptrs);
+        custom_list_free_aligned_batch(custom_alloc_instance_, raw, count, n * sizeof(value_type), alignof(value_type));
+#else
+        for (size_type i = 0; i < count; ++i)
+            deallocate(ptrs[i], n);
+#endif
+    }
+
+#if defined(USE_CUSTOM_LIST_ALLOCATOR) || defined(USE_CUSTOM_MT_ALLOCATOR)
+private:
+    // Over-aligned types (e.g. the cache-line blocks BTree nodes are made of) go to the heaps'
+    // aligned entry points, which cut them at the alignment instead of padding each block.
+#ifdef USE_CUSTOM_MT_ALLOCATOR
+    void* raw_malloc(size_type bytes) {
+        return custom_mt_malloc_aligned(custom_alloc_instance_, bytes, alignof(value_type));
+    }
+
+    void raw_free(void* p, size_type bytes) noexcept {
+        custom_mt_free_aligned(custom_alloc_instance_, p, bytes, alignof(value_type));
+    }
+#else
+    void* raw_malloc(size_type bytes) {
+        return custom_list_malloc_aligned(custom_alloc_instance_, bytes, alignof(value_type));
+    }
+
+    void raw_free(void* p, size_type bytes) noexcept {
+        custom_list_free_aligned(custom_alloc_instance_, p, bytes, alignof(value_type));
+    }
+#endif
+#endif
 };
 
 template <typename T, typename U>
 bool operator==(const smpl_alloc<T>& lhs, const smpl_alloc<U>& rhs) {
-#ifdef USE_CUSTOM_LIST_ALLOCATOR
+#if defined(USE_CUSTOM_LIST_ALLOCATOR) || defined(USE_CUSTOM_MT_ALLOCATOR)
     return lhs.custom_alloc_instance_ == rhs.custom_alloc_instance_;
 #else
     return true;
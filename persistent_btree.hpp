@@ -0,0 +1,455 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "btree_search.hpp"
+#include "persistent_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// BTree whose nodes are the pages of a file mapped with mmap. Page 0 holds a small header (root,
+// page count, free page list), every other page is a node or sits on the free list. Childs are
+// page numbers, so reopening a file is just mapping it again: nothing is read or rebuilt up front.
+//
+// Same multiset semantics and rebalancing as BTree (preemptive splits on insert, top-down
+// borrow/merge on erase); pages freed by merges are reused before the file grows. Writes go
+// straight to the mapping and reach the disk whenever the kernel writes the pages back, or at
+// sync(). There is no journal: a crash in the middle of an operation can leave the file torn.
+template <typename T, size_t PAGE_BYTES = 4096, typename Search = default_search>
+class PersistentBTree {
+    using BNode = PersistentNode<T, PAGE_BYTES>;
+    using PageId = typename BNode::PageId;
+
+    static constexpr uint32_t FORMAT = 1;
+    static constexpr size_t INITIAL_PAGES = 16;
+
+    struct FileHeader {
+        char magic_[8];
+        uint32_t format_;
+        uint32_t page_size_;
+        uint32_t key_size_;
+        uint32_t order_;
+        PageId root_;
+        PageId pages_;      // pages in use, header included; the file may be longer
+        PageId free_head_;  // 0 when no page is free
+    };
+
+    static_assert(sizeof(FileHeader) <= PAGE_BYTES, "PAGE_BYTES is too small for the file header");
+
+public:
+    using key_type = T;
+    using key_compare = std::less<T>;
+    using size_type = size_t;
+
+    static constexpr size_t ORDER = BNode::ORDER;
+
+private:
+    int fd_ = -1;
+    unsigned char* base_ = nullptr;
+    size_t capacity_ = 0;  // pages currently mapped
+    std::less<T> comp_;
+
+public:
+    // Opens the tree stored at path, creating an empty one if the file does not exist or is
+    // empty. Throws std::system_error when the file cannot be opened or mapped, and
+    // std::runtime_error when it holds something else (or a tree of another key size or page size).
+    explicit PersistentBTree(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "PersistentBTree: cannot open " + path);
+
+        try {
+            struct stat st;
+            if (::fstat(fd_, &st) != 0) throwErrno("fstat");
+
+            if (st.st_size == 0) {
+                resize(INITIAL_PAGES);
+                FileHeader* h = header();
+                std::memcpy(h->magic_, MAGIC, sizeof(h->magic_));
+                h->format_ = FORMAT;
+                h->page_size_ = PAGE_BYTES;
+                h->key_size_ = sizeof(T);
+                h->order_ = ORDER;
+                h->pages_ = 1;
+                h->free_head_ = 0;
+                header()->root_ = allocatePage(true);
+            } else {
+                if (static_cast<size_t>(st.st_size) % PAGE_BYTES != 0 || static_cast<size_t>(st.st_size) < 2 * PAGE_BYTES)
+                    throw std::runtime_error("PersistentBTree: " + path + " is not a tree file");
+                map(static_cast<size_t>(st.st_size) / PAGE_BYTES);
+                checkHeader(path);
+            }
+        } catch (...) {
+            unmap();
+            ::close(fd_);
+            throw;
+        }
+    }
+
+    // Trims the file to the pages in use and unmaps it; dirty pages still reach the disk.
+    ~PersistentBTree() {
+        const size_t pages = header()->pages_;
+        unmap();
+        if (::ftruncate(fd_, static_cast<off_t>(pages * PAGE_BYTES)) != 0) {
+            // The file just stays longer than needed.
+        }
+        ::close(fd_);
+    }
+
+    PersistentBTree(const PersistentBTree& other) = delete;
+    PersistentBTree& operator=(const PersistentBTree& other) = delete;
+
+public:
+    bool empty() const { return node(header()->root_)->keys_count_ == 0; }
+
+    bool contains(const T& key) const {
+        PageId x = header()->root_;
+        for (;;) {
+            const BNode* n = node(x);
+            const size_t i = n->template lowerBound<Search>(key, comp_);
+            if (i < n->keys_count_ && !comp_(key, n->keys()[i])) return true;
+            if (n->isLeaf()) return false;
+            x = n->childs()[i];
+        }
+    }
+
+    size_t count(const T& key) const { return countFrom(header()->root_, key); }
+
+    template <typename U>
+    void traverse(U& u = U()) const {
+        traverseFrom(header()->root_, u);
+    }
+
+    void insert(const T& key) {
+        if (node(header()->root_)->keys_count_ == BNode::MAX_KEYS) {
+            const PageId old_root = header()->root_;
+            const PageId s = allocatePage(false);
+            node(s)->childs()[0] = old_root;
+            header()->root_ = s;
+            splitChild(s, 0);
+        }
+
+        PageId x = header()->root_;
+        for (;;) {
+            BNode* n = node(x);
+            size_t i = n->template upperBound<Search>(key, comp_);
+
+            if (n->isLeaf()) {
+                T* keys = n->keys();
+                std::memmove(static_cast<void*>(keys + i + 1), static_cast<const void*>(keys + i),
+                             (n->keys_count_ - i) * sizeof(T));
+                keys[i] = key;
+                n->keys_count_ += 1;
+                return;
+            }
+
+            if (node(n->childs()[i])->keys_count_ == BNode::MAX_KEYS) {
+                splitChild(x, i);
+                n = node(x);  // the split may have grown, and so remapped, the file
+                if (comp_(n->keys()[i], key)) i++;
+            }
+            x = n->childs()[i];
+        }
+    }
+
+    // Removes every copy of key and returns how many were removed.
+    size_t erase(const T& key) {
+        size_t removed = 0;
+        while (eraseOne(key))
+            ++removed;
+        return removed;
+    }
+
+    // Blocks until every page written so far is on disk.
+    void sync() {
+        if (::msync(base_, capacity_ * PAGE_BYTES, MS_SYNC) != 0) throwErrno("msync");
+    }
+
+    // Pages in use, the header page included.
+    size_t pages() const noexcept { return header()->pages_; }
+
+private:
+    static constexpr char MAGIC[8] = {'B', 'T', 'R', 'E', 'E', 'P', 'G', '\0'};
+
+    [[noreturn]] static void throwErrno(const char* what) {
+        throw std::system_error(errno, std::generic_category(), std::string("PersistentBTree: ") + what);
+    }
+
+    void checkHeader(const std::string& path) const {
+        const FileHeader* h = header();
+        if (std::memcmp(h->magic_, MAGIC, sizeof(MAGIC)) != 0 || h->format_ != FORMAT)
+            throw std::runtime_error("PersistentBTree: " + path + " is not a tree file");
+        if (h->page_size_ != PAGE_BYTES || h->key_size_ != sizeof(T) || h->order_ != ORDER)
+            throw std::runtime_error("PersistentBTree: " + path + " was written with another page or key size");
+        if (h->pages_ < 2 || h->pages_ > capacity_ || h->root_ == 0 || h->root_ >= h->pages_)
+            throw std::runtime_error("PersistentBTree: " + path + " has a damaged header");
+    }
+
+    __attribute__((always_inline)) FileHeader* header() noexcept { return reinterpret_cast<FileHeader*>(base_); }
+
+    __attribute__((always_inline)) const FileHeader* header() const noexcept {
+        return reinterpret_cast<const FileHeader*>(base_);
+    }
+
+    __attribute__((always_inline)) BNode* node(PageId id) noexcept {
+        return reinterpret_cast<BNode*>(base_ + id * PAGE_BYTES);
+    }
+
+    __attribute__((always_inline)) const BNode* node(PageId id) const noexcept {
+        return reinterpret_cast<const BNode*>(base_ + id * PAGE_BYTES);
+    }
+
+    void map(size_t pages) {
+        void* p = ::mmap(nullptr, pages * PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) throwErrno("mmap");
+        base_ = static_cast<unsigned char*>(p);
+        capacity_ = pages;
+    }
+
+    void unmap() noexcept {
+        if (base_ != nullptr) ::munmap(base_, capacity_ * PAGE_BYTES);
+        base_ = nullptr;
+        capacity_ = 0;
+    }
+
+    // Grows the file to pages and maps it again. Every BNode* taken before is stale afterwards.
+    void resize(size_t pages) {
+        if (::ftruncate(fd_, static_cast<off_t>(pages * PAGE_BYTES)) != 0) throwErrno("ftruncate");
+        unmap();
+        map(pages);
+    }
+
+    // Takes a page off the free list or from the end of the file, which doubles when full.
+    PageId allocatePage(bool leaf) {
+        FileHeader* h = header();
+        PageId id = h->free_head_;
+        if (id != 0) {
+            std::memcpy(&h->free_head_, node(id), sizeof(PageId));
+        } else {
+            if (h->pages_ == capacity_) {
+                resize(capacity_ * 2);
+                h = header();
+            }
+            id = h->pages_++;
+        }
+
+        BNode* n = node(id);
+        n->keys_count_ = 0;
+        n->leaf_ = leaf;
+        return id;
+    }
+
+    void freePage(PageId id) noexcept {
+        FileHeader* h = header();
+        std::memcpy(node(id), &h->free_head_, sizeof(PageId));
+        h->free_head_ = id;
+    }
+
+    size_t countFrom(PageId x, const T& key) const {
+        const BNode* n = node(x);
+        const size_t lo = n->template lowerBound<Search>(key, comp_);
+        const size_t hi = n->template upperBound<Search>(key, comp_);
+        size_t result = hi - lo;
+        if (!n->isLeaf()) {
+            for (size_t i = lo; i <= hi; ++i)
+                result += countFrom(n->childs()[i], key);
+        }
+        return result;
+    }
+
+    template <typename U>
+    void traverseFrom(PageId x, U& u) const {
+        const BNode* n = node(x);
+        for (size_t i = 0; i < n->keys_count_; ++i) {
+            if (!n->isLeaf()) traverseFrom(n->childs()[i], u);
+            u(n->keys()[i]);
+        }
+        if (!n->isLeaf()) traverseFrom(n->childs()[n->keys_count_], u);
+    }
+
+    // Splits the full child i of the internal page x around its median.
+    void splitChild(PageId x, size_t i) {
+        const PageId zid = allocatePage(node(node(x)->childs()[i])->isLeaf());
+        BNode* n = node(x);
+        BNode* y = node(n->childs()[i]);
+        BNode* z = node(zid);
+
+        std::memcpy(static_cast<void*>(z->keys()), static_cast<const void*>(y->keys() + ORDER),
+                    (BNode::MAX_KEYS - ORDER) * sizeof(T));
+        if (!y->isLeaf()) std::copy(y->childs() + ORDER, y->childs() + BNode::MAX_CHILDS, z->childs());
+        z->keys_count_ = BNode::MAX_KEYS - ORDER;
+
+        const size_t count = n->keys_count_;
+        std::copy_backward(n->childs() + i + 1, n->childs() + count + 1, n->childs() + count + 2);
+        n->childs()[i + 1] = zid;
+        std::memmove(static_cast<void*>(n->keys() + i + 1), static_cast<const void*>(n->keys() + i),
+                     (count - i) * sizeof(T));
+        n->keys()[i] = y->keys()[ORDER - 1];
+        n->keys_count_ = count + 1;
+        y->keys_count_ = ORDER - 1;
+    }
+
+    // Top-down removal of one copy of key: a child with only MIN_KEYS keys is refilled from a
+    // sibling or merged with it before the descent enters it, so nothing has to be fixed on the
+    // way back. Erasing never allocates, so page pointers stay valid throughout.
+    bool eraseOne(const T& key) {
+        PageId x = header()->root_;
+        for (;;) {
+            BNode* n = node(x);
+            const size_t i = n->template lowerBound<Search>(key, comp_);
+            const bool here = i < n->keys_count_ && !comp_(key, n->keys()[i]);
+
+            if (n->isLeaf()) {
+                if (here) removeAt(*n, i);
+                return here;
+            }
+
+            if (here) {
+                if (node(n->childs()[i])->keys_count_ > BNode::MIN_KEYS) {
+                    n->keys()[i] = takeMax(n->childs()[i]);
+                    return true;
+                }
+                if (node(n->childs()[i + 1])->keys_count_ > BNode::MIN_KEYS) {
+                    n->keys()[i] = takeMin(n->childs()[i + 1]);
+                    return true;
+                }
+                mergeChilds(*n, i);
+                x = collapseRoot(x, n->childs()[i]);
+                continue;
+            }
+
+            PageId c = n->childs()[i];
+            if (node(c)->keys_count_ == BNode::MIN_KEYS) c = fillChild(*n, i);
+            x = collapseRoot(x, c);
+        }
+    }
+
+    // A root emptied by the merge of its last two childs hands the root over to c.
+    PageId collapseRoot(PageId x, PageId c) noexcept {
+        if (node(x)->keys_count_ == 0) {
+            header()->root_ = c;
+            freePage(x);
+        }
+        return c;
+    }
+
+    T takeMax(PageId y) {
+        for (;;) {
+            BNode* n = node(y);
+            if (n->isLeaf()) {
+                n->keys_count_ -= 1;
+                return n->keys()[n->keys_count_];
+            }
+            const size_t last = n->keys_count_;
+            y = node(n->childs()[last])->keys_count_ == BNode::MIN_KEYS ? fillChild(*n, last) : n->childs()[last];
+        }
+    }
+
+    T takeMin(PageId y) {
+        for (;;) {
+            BNode* n = node(y);
+            if (n->isLeaf()) {
+                const T key = n->keys()[0];
+                removeAt(*n, 0);
+                return key;
+            }
+            y = node(n->childs()[0])->keys_count_ == BNode::MIN_KEYS ? fillChild(*n, 0) : n->childs()[0];
+        }
+    }
+
+    // Child i of x has MIN_KEYS keys: borrows one from a sibling or merges with one, and returns
+    // the page the descent continues in.
+    PageId fillChild(BNode& x, size_t i) {
+        if (i > 0 && node(x.childs()[i - 1])->keys_count_ > BNode::MIN_KEYS) {
+            rotateRight(x, i - 1);
+            return x.childs()[i];
+        }
+        if (i < x.keys_count_) {
+            if (node(x.childs()[i + 1])->keys_count_ > BNode::MIN_KEYS)
+                rotateLeft(x, i);
+            else
+                mergeChilds(x, i);
+            return x.childs()[i];
+        }
+        mergeChilds(x, i - 1);
+        return x.childs()[i - 1];
+    }
+
+    // Moves the last key of child s up into separator s and the separator down into child s + 1.
+    void rotateRight(BNode& x, size_t s) {
+        BNode& left = *node(x.childs()[s]);
+        BNode& right = *node(x.childs()[s + 1]);
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        std::memmove(static_cast<void*>(right.keys() + 1), static_cast<const void*>(right.keys()), rn * sizeof(T));
+        right.keys()[0] = x.keys()[s];
+        if (!right.isLeaf()) {
+            std::copy_backward(right.childs(), right.childs() + rn + 1, right.childs() + rn + 2);
+            right.childs()[0] = left.childs()[ln];
+        }
+        x.keys()[s] = left.keys()[ln - 1];
+        left.keys_count_ = ln - 1;
+        right.keys_count_ = rn + 1;
+    }
+
+    // Mirror of rotateRight: the first key of child s + 1 goes up, separator s comes down.
+    void rotateLeft(BNode& x, size_t s) {
+        BNode& left = *node(x.childs()[s]);
+        BNode& right = *node(x.childs()[s + 1]);
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+
+        left.keys()[ln] = x.keys()[s];
+        if (!left.isLeaf()) {
+            left.childs()[ln + 1] = right.childs()[0];
+            std::copy(right.childs() + 1, right.childs() + rn + 1, right.childs());
+        }
+        x.keys()[s] = right.keys()[0];
+        std::memmove(static_cast<void*>(right.keys()), static_cast<const void*>(right.keys() + 1), (rn - 1) * sizeof(T));
+        left.keys_count_ = ln + 1;
+        right.keys_count_ = rn - 1;
+    }
+
+    // Folds child s + 1 and separator s into child s and frees the page of child s + 1.
+    void mergeChilds(BNode& x, size_t s) {
+        BNode& left = *node(x.childs()[s]);
+        const PageId right_id = x.childs()[s + 1];
+        BNode& right = *node(right_id);
+        const size_t ln = left.keys_count_;
+        const size_t rn = right.keys_count_;
+        const size_t n = x.keys_count_;
+
+        left.keys()[ln] = x.keys()[s];
+        std::memcpy(static_cast<void*>(left.keys() + ln + 1), static_cast<const void*>(right.keys()), rn * sizeof(T));
+        if (!left.isLeaf()) std::copy(right.childs(), right.childs() + rn + 1, left.childs() + ln + 1);
+        left.keys_count_ = ln + 1 + rn;
+
+        std::memmove(static_cast<void*>(x.keys() + s), static_cast<const void*>(x.keys() + s + 1), (n - s - 1) * sizeof(T));
+        std::copy(x.childs() + s + 2, x.childs() + n + 1, x.childs() + s + 1);
+        x.keys_count_ = n - 1;
+
+        freePage(right_id);
+    }
+
+    void removeAt(BNode& n, size_t i) {
+        std::memmove(static_cast<void*>(n.keys() + i), static_cast<const void*>(n.keys() + i + 1),
+                     (n.keys_count_ - i - 1) * sizeof(T));
+        n.keys_count_ -= 1;
+    }
+};
+
+}  // namespace btree
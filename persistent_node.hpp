@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "btree_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Node of PersistentBTree: one fixed-size page of the backing file.
+//
+//   leaf:      [ header | keys[MAX_KEYS] ]
+//   internal:  [ header | keys[MAX_KEYS] | childs[MAX_KEYS + 1] ]
+//
+// Childs are page numbers rather than pointers, so a page means the same thing wherever the
+// file happens to be mapped. ORDER is the largest one whose internal node still fits the page.
+template <typename T, size_t PAGE_BYTES>
+struct PersistentNode {
+    static_assert(std::is_trivially_copyable<T>::value, "keys are stored in the file as raw bytes");
+    static_assert(alignof(T) <= CACHE_LINE_SIZE, "over-aligned keys are not supported");
+    static_assert(PAGE_BYTES % CACHE_LINE_SIZE == 0, "PAGE_BYTES must be a multiple of the cache line size");
+
+    using key_type = T;
+    using PageId = uint64_t;
+
+    uint32_t keys_count_;
+    uint32_t leaf_;
+
+public:
+    static constexpr size_t alignUp(size_t n, size_t alignment) noexcept {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    // sizeof(PersistentNode), which is not known yet where ORDER is worked out.
+    static constexpr size_t HEADER_BYTES = 2 * sizeof(uint32_t);
+
+    static constexpr size_t keysOffset() noexcept { return alignUp(HEADER_BYTES, alignof(T)); }
+
+    static constexpr size_t childsOffset(size_t max_keys) noexcept {
+        return alignUp(keysOffset() + max_keys * sizeof(T), alignof(PageId));
+    }
+
+    static constexpr size_t internalBytes(size_t order) noexcept {
+        return childsOffset(2 * order - 1) + 2 * order * sizeof(PageId);
+    }
+
+    static constexpr size_t orderFor(size_t page_size) noexcept {
+        size_t order = 1;
+        while (internalBytes(order + 1) <= page_size)
+            ++order;
+        return order;
+    }
+
+public:
+    static constexpr size_t ORDER = orderFor(PAGE_BYTES);
+
+    static_assert(ORDER >= 2, "PAGE_BYTES is too small for this key type");
+    static_assert(internalBytes(ORDER) <= PAGE_BYTES, "node does not fit its page");
+    static_assert(keysOffset() % alignof(T) == 0 && childsOffset(2 * ORDER - 1) % alignof(PageId) == 0,
+                  "misaligned node arrays");
+
+    static constexpr size_t MAX_KEYS = 2 * ORDER - 1;
+    static constexpr size_t MAX_CHILDS = 2 * ORDER;
+    static constexpr size_t MIN_KEYS = ORDER - 1;
+
+public:
+    template <typename Search, typename Compare>
+    __attribute__((always_inline)) size_t lowerBound(const T& key, const Compare& comp) const {
+        return Search::lower_bound(keys(), keys_count_, key, comp);
+    }
+
+    template <typename Search, typename Compare>
+    __attribute__((always_inline)) size_t upperBound(const T& key, const Compare& comp) const {
+        return Search::upper_bound(keys(), keys_count_, key, comp);
+    }
+
+public:
+    __attribute__((always_inline)) bool isLeaf() const noexcept { return leaf_ != 0; }
+
+    __attribute__((always_inline)) size_t size() const noexcept { return keys_count_; }
+
+    __attribute__((always_inline)) T* keys() noexcept {
+        return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) const T* keys() const noexcept {
+        return reinterpret_cast<const T*>(reinterpret_cast<const unsigned char*>(this) + keysOffset());
+    }
+
+    __attribute__((always_inline)) PageId* childs() noexcept {
+        return reinterpret_cast<PageId*>(reinterpret_cast<unsigned char*>(this) + childsOffset(MAX_KEYS));
+    }
+
+    __attribute__((always_inline)) const PageId* childs() const noexcept {
+        return reinterpret_cast<const PageId*>(reinterpret_cast<const unsigned char*>(this) + childsOffset(MAX_KEYS));
+    }
+};
+
+}  // namespace btree
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "btree_node.hpp"
+#include "string_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+template <size_t NODE_BYTES, typename Alloc>
+class StringBTree;
+
+// Forward cursor over the leaf chain. Keys are not stored whole in a node, so the iterator
+// keeps the current one decoded and dereferences to that copy.
+template <typename Node>
+class StringBTreeIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string*;
+    using reference = const std::string&;
+
+private:
+    const Node* node_;
+    size_t index_;
+    std::string key_;
+
+    template <size_t, typename>
+    friend class StringBTree;
+
+    StringBTreeIterator(const Node* node, size_t index) : node_(node), index_(index) { load(); }
+
+public:
+    StringBTreeIterator() noexcept : node_(nullptr), index_(0) {}
+
+public:
+    reference operator*() const noexcept { return key_; }
+
+    pointer operator->() const noexcept { return &key_; }
+
+    StringBTreeIterator& operator++() {
+        if (++index_ == node_->count_) {
+            node_ = node_->next_;
+            index_ = 0;
+        }
+        load();
+        return *this;
+    }
+
+    StringBTreeIterator operator++(int) {
+        StringBTreeIterator tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    friend bool operator==(const StringBTreeIterator& lhs, const StringBTreeIterator& rhs) noexcept {
+        return lhs.node_ == rhs.node_ && lhs.index_ == rhs.index_;
+    }
+
+    friend bool operator!=(const StringBTreeIterator& lhs, const StringBTreeIterator& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+
+private:
+    void load() {
+        key_.clear();
+        if (node_ != nullptr) node_->appendKey(index_, key_);
+    }
+};
+
+// B+-tree of distinct strings whose nodes hold the key bytes themselves instead of std::string
+// objects pointing at heap copies. A node is NODE_BYTES of raw memory (see StringNode): keys are
+// stored once without the prefix every key of the node shares, and a search mostly compares
+// 8-byte integers held in the slots, touching key bytes only to break ties. Separators in
+// internal nodes are cut down to the shortest string that still separates two leaves.
+//
+// Keys may hold any bytes, '\0' included, and are ordered like std::string. Keys longer than
+// MAX_KEY_BYTES (about a quarter of a node) are rejected with std::length_error.
+template <size_t NODE_BYTES = 2048, typename Alloc = std::allocator<char>>
+class StringBTree {
+    using Node = StringNode<NODE_BYTES>;
+
+    typedef std::allocator_traits<Alloc> alloc_traits;
+    using BlockAllocator = typename alloc_traits::template rebind_alloc<CacheLine>;
+
+    static constexpr size_t BLOCKS = NODE_BYTES / CACHE_LINE_SIZE;
+    static constexpr bool DROP_WITHOUT_WALK = IsMonotonicAllocator<Alloc>::value;
+
+public:
+    using key_type = std::string;
+    using value_type = std::string;
+    using allocator_type = Alloc;
+    using size_type = size_t;
+
+    using const_iterator = StringBTreeIterator<Node>;
+    using iterator = const_iterator;
+
+    static constexpr size_t MAX_KEY_BYTES = Node::MAX_KEY_BYTES;
+
+private:
+    // One step of a root-to-leaf path: the node and the child that was descended into.
+    struct Frame {
+        Node* node_;
+        size_t index_;
+    };
+
+    // A key taken out of a node while it is rebuilt or split, with the child right of it.
+    struct Entry {
+        size_t offset_;
+        size_t length_;
+        Node* child_;
+    };
+
+private:
+    BlockAllocator block_alloc_;
+    Node* root_;
+    Node* head_;  // first and last leaf of the chain
+    Node* tail_;
+    size_t size_;
+    size_t nodes_;
+
+    // Scratch reused by every insert and erase.
+    std::vector<Frame> path_;
+    std::string keys_;
+    std::vector<Entry> entries_;
+    std::string separator_;
+
+public:
+    explicit StringBTree(const Alloc& alloc = Alloc())
+        : block_alloc_(BlockAllocator(alloc)), root_(nullptr), size_(0), nodes_(0) {
+        root_ = head_ = tail_ = createNode(true);
+    }
+
+    ~StringBTree() { clear(root_); }
+
+    StringBTree(const StringBTree& other) = delete;
+    StringBTree(StringBTree&& other) = delete;
+
+    StringBTree& operator=(const StringBTree& other) = delete;
+    StringBTree& operator=(StringBTree&& other) = delete;
+
+public:
+    const_iterator begin() const { return size_ == 0 ? end() : const_iterator(head_, 0); }
+
+    const_iterator end() const noexcept { return const_iterator(); }
+
+    bool empty() const noexcept { return size_ == 0; }
+
+    size_t size() const noexcept { return size_; }
+
+    // Nodes held from the allocator, NODE_BYTES each.
+    size_t nodes() const noexcept { return nodes_; }
+
+    // In-order walk over the leaf chain; u sees each key as a string_view valid for the call.
+    template <typename U>
+    void traverse(U& u = U()) const {
+        std::string key;
+        for (const Node* leaf = head_; leaf != nullptr; leaf = leaf->next_) {
+            for (size_t i = 0; i < leaf->count_; ++i) {
+                key.clear();
+                leaf->appendKey(i, key);
+                u(std::string_view(key));
+            }
+        }
+    }
+
+    bool contains(std::string_view key) const {
+        const Node* node = root_;
+        while (!node->leaf_)
+            node = node->child(route(*node, key));
+
+        bool exact;
+        node->lowerBound(key, exact);
+        return exact;
+    }
+
+    size_t count(std::string_view key) const { return contains(key) ? 1 : 0; }
+
+public:
+    // Adds key unless it is already there; returns whether it was added.
+    bool insert(std::string_view key) {
+        if (key.size() > MAX_KEY_BYTES) throw std::length_error("StringBTree key longer than MAX_KEY_BYTES");
+
+        Node* leaf = descend(key);
+        bool exact;
+        const size_t i = leaf->lowerBound(key, exact);
+        if (exact) return false;
+
+        if (!leaf->tryInsert(i, key, nullptr)) {
+            keys_.clear();
+            entries_.clear();
+            collect(*leaf, 0, i);
+            add(key, nullptr);
+            collect(*leaf, i, leaf->count_);
+            overflowLeaf(*leaf, i);
+        }
+        size_ += 1;
+        return true;
+    }
+
+    // Removes key if present; returns how many keys were removed (0 or 1).
+    size_t erase(std::string_view key) {
+        Node* leaf = descend(key);
+        bool exact;
+        const size_t i = leaf->lowerBound(key, exact);
+        if (!exact) return 0;
+
+        leaf->remove(i);
+        size_ -= 1;
+
+        if (leaf->count_ == 0) {
+            if (head_ != tail_) {
+                unlink(*leaf);
+                deleteNode(leaf);
+                removeChild(path_.size() - 1);
+            }
+        } else if (leaf->usedBytes() < Node::CAPACITY / 4 && !path_.empty()) {
+            mergeLeaf();
+        }
+        return 1;
+    }
+
+    void clear() {
+        Node* empty = createNode(true);
+        clear(root_);
+        nodes_ = 1;
+        root_ = head_ = tail_ = empty;
+        size_ = 0;
+    }
+
+private:
+    // Child of an internal node that holds key: separator i is the smallest key of child i + 1.
+    static size_t route(const Node& node, std::string_view key) noexcept {
+        bool exact;
+        const size_t i = node.lowerBound(key, exact);
+        return exact ? i + 1 : i;
+    }
+
+    Node* descend(std::string_view key) {
+        path_.clear();
+        Node* node = root_;
+        while (!node->leaf_) {
+            const size_t i = route(*node, key);
+            path_.push_back(Frame{node, i});
+            node = node->child(i);
+        }
+        return node;
+    }
+
+private:
+    std::string_view entryKey(size_t e) const noexcept {
+        return std::string_view(keys_.data() + entries_[e].offset_, entries_[e].length_);
+    }
+
+    void add(std::string_view key, Node* child) {
+        entries_.push_back(Entry{keys_.size(), key.size(), child});
+        keys_.append(key);
+    }
+
+    void collect(const Node& node, size_t from, size_t to) {
+        for (size_t i = from; i < to; ++i) {
+            const size_t offset = keys_.size();
+            node.appendKey(i, keys_);
+            entries_.push_back(Entry{offset, keys_.size() - offset, node.leaf_ ? nullptr : node.child(i + 1)});
+        }
+    }
+
+    // Prefix that keeps entries [b, e) smallest: shared by all of them and no longer than needed
+    // to strip the tails of all but the longest key, past which it saves nothing.
+    size_t bestPrefix(size_t b, size_t e) const noexcept {
+        if (e - b < 2) return 0;
+
+        const std::string_view first = entryKey(b);
+        const std::string_view last = entryKey(e - 1);
+        const size_t n = std::min(first.size(), last.size());
+        size_t lcp = 0;
+        while (lcp < n && first[lcp] == last[lcp])
+            ++lcp;
+
+        size_t longest = 0, second = 0;
+        for (size_t j = b; j < e; ++j) {
+            const size_t length = entries_[j].length_;
+            if (length > longest) {
+                second = longest;
+                longest = length;
+            } else if (length > second) {
+                second = length;
+            }
+        }
+        return std::min(lcp, second > Node::HEAD_BYTES ? second - Node::HEAD_BYTES : 0);
+    }
+
+    size_t bytesFor(size_t b, size_t e, bool leaf) const noexcept {
+        const size_t prefix = bestPrefix(b, e);
+        size_t bytes = prefix;
+        for (size_t j = b; j < e; ++j)
+            bytes += Node::entryBytes(entries_[j].length_ - prefix, leaf);
+        return bytes;
+    }
+
+    bool fits(size_t b, size_t e, bool leaf) const noexcept { return bytesFor(b, e, leaf) <= Node::CAPACITY; }
+
+    // Rewrites node with entries [b, e); internal nodes keep their first child.
+    void fill(Node& node, size_t b, size_t e) noexcept {
+        node.reset(entryKey(b < e ? b : 0).substr(0, bestPrefix(b, e)));
+        for (size_t j = b; j < e; ++j)
+            node.tryInsert(node.count_, entryKey(j), entries_[j].child_);
+    }
+
+    // Where to split n collected entries. Halves of equal bytes do unless the new entry, at
+    // index added, does not share the prefix of the others: it then sits at one end and the
+    // node splits right beside it. The entry at the split point goes up from internal nodes.
+    size_t splitPoint(size_t n, size_t added, bool leaf) const noexcept {
+        const size_t up = leaf ? 0 : 1;
+        auto ok = [&](size_t m) { return (m > 0 || !leaf) && m < n && fits(0, m, leaf) && fits(m + up, n, leaf); };
+
+        size_t total = 0;
+        for (size_t j = 0; j < n; ++j)
+            total += Node::entryBytes(entries_[j].length_, leaf);
+
+        size_t m = 0, acc = 0;
+        while (m + 1 < n && acc < total / 2)
+            acc += Node::entryBytes(entries_[m++].length_, leaf);
+        m = std::max<size_t>(m, 1);
+        if (!leaf) m = std::min(m, n - 2);
+
+        if (ok(m)) return m;
+        return ok(added) ? added : added + 1;
+    }
+
+    void overflowLeaf(Node& leaf, size_t added) {
+        const size_t n = entries_.size();
+        if (fits(0, n, true)) {
+            fill(leaf, 0, n);
+            return;
+        }
+
+        Node* right = createNode(true);
+        const size_t m = splitPoint(n, added, true);
+        fill(leaf, 0, m);
+        fill(*right, m, n);
+        linkAfter(leaf, *right);
+
+        // The shortest string above every key on the left that is not above the right's first.
+        const std::string_view lo = entryKey(m - 1);
+        const std::string_view hi = entryKey(m);
+        size_t lcp = 0;
+        while (lcp < lo.size() && lo[lcp] == hi[lcp])
+            ++lcp;
+        separator_.assign(hi.data(), lcp + 1);
+
+        insertSeparator(right);
+    }
+
+    // Hangs right, holding the keys >= separator_, next to the last node on path_, splitting
+    // internal nodes on the way up as needed.
+    void insertSeparator(Node* right) {
+        while (!path_.empty()) {
+            const Frame f = path_.back();
+            path_.pop_back();
+            Node& parent = *f.node_;
+            if (parent.tryInsert(f.index_, separator_, right)) return;
+
+            keys_.clear();
+            entries_.clear();
+            collect(parent, 0, f.index_);
+            add(separator_, right);
+            collect(parent, f.index_, parent.count_);
+
+            const size_t n = entries_.size();
+            if (fits(0, n, false)) {
+                fill(parent, 0, n);
+                return;
+            }
+
+            Node* sibling = createNode(false);
+            const size_t m = splitPoint(n, f.index_, false);
+            sibling->first_child_ = entries_[m].child_;
+            fill(parent, 0, m);
+            fill(*sibling, m + 1, n);
+            separator_.assign(entryKey(m));
+            right = sibling;
+        }
+
+        Node* root = createNode(false);
+        root->first_child_ = root_;
+        root->tryInsert(0, separator_, right);
+        root_ = root;
+    }
+
+private:
+    // The leaf at the end of path_ fell under a quarter full: fold it and a neighbour under the
+    // same parent into one node if the keys of both fit.
+    void mergeLeaf() {
+        Frame& f = path_.back();
+        Node& parent = *f.node_;
+        if (parent.count_ == 0) return;
+        if (f.index_ == parent.count_) f.index_ -= 1;
+
+        Node& left = *parent.child(f.index_);
+        Node* right = parent.child(f.index_ + 1);
+        if (left.usedBytes() + right->usedBytes() > Node::CAPACITY * 3 / 4) return;
+
+        keys_.clear();
+        entries_.clear();
+        collect(left, 0, left.count_);
+        collect(*right, 0, right->count_);
+        if (!fits(0, entries_.size(), true)) return;
+
+        fill(left, 0, entries_.size());
+        unlink(*right);
+        deleteNode(right);
+        f.index_ += 1;
+        removeChild(path_.size() - 1);
+    }
+
+    // The child path_[level] descended into is gone. Internal nodes left without children go
+    // as well, and a root with a single child hands over to it.
+    void removeChild(size_t level) noexcept {
+        while (path_[level].node_->count_ == 0) {
+            deleteNode(path_[level].node_);
+            --level;
+        }
+
+        Node& node = *path_[level].node_;
+        const size_t i = path_[level].index_;
+        if (i == 0) node.first_child_ = node.child(1);
+        node.remove(i == 0 ? 0 : i - 1);
+
+        while (!root_->leaf_ && root_->count_ == 0) {
+            Node* old = root_;
+            root_ = old->first_child_;
+            deleteNode(old);
+        }
+    }
+
+    void linkAfter(Node& left, Node& right) noexcept {
+        right.prev_ = &left;
+        right.next_ = left.next_;
+        if (left.next_ != nullptr)
+            left.next_->prev_ = &right;
+        else
+            tail_ = &right;
+        left.next_ = &right;
+    }
+
+    void unlink(Node& leaf) noexcept {
+        if (leaf.prev_ != nullptr)
+            leaf.prev_->next_ = leaf.next_;
+        else
+            head_ = leaf.next_;
+        if (leaf.next_ != nullptr)
+            leaf.next_->prev_ = leaf.prev_;
+        else
+            tail_ = leaf.prev_;
+    }
+
+private:
+    Node* createNode(bool isLeaf) {
+        CacheLine* block = std::allocator_traits<BlockAllocator>::allocate(block_alloc_, BLOCKS);
+        nodes_ += 1;
+        return ::new (static_cast<void*>(block)) Node(isLeaf);
+    }
+
+    void deleteNode(Node* node) noexcept {
+        nodes_ -= 1;
+        node->~Node();
+        std::allocator_traits<BlockAllocator>::deallocate(block_alloc_, reinterpret_cast<CacheLine*>(node), BLOCKS);
+    }
+
+    void clear(Node* node) noexcept {
+        if constexpr (DROP_WITHOUT_WALK) return;
+        if (!node->leaf_) {
+            for (size_t i = 0; i <= node->count_; ++i)
+                clear(node->child(i));
+        }
+        deleteNode(node);
+    }
+};
+
+}  // namespace btree
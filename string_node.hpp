@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "btree_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Fixed-width part of a key in a StringNode. head_ holds the first 8 key bytes after the node
+// prefix as a big-endian integer (zero padded), so comparing heads orders keys like memcmp on
+// those bytes. The bytes after the head, the tail, live in the node's byte area at tail_.
+struct StringSlot {
+    uint64_t head_;
+    uint16_t tail_;
+    uint16_t length_;  // key bytes after the node prefix, head included
+};
+
+// Node of StringBTree: one block of NODE_BYTES holding a variable number of string keys.
+//
+//   [ header | slots -> ... free ... <- tails | prefix ]
+//
+// Every key of a node starts with the node's prefix, stored once at the end of the block; slots
+// keep the rest as head + tail. Tails are allocated downwards from the prefix and are not reused
+// when a key goes away (garbage_ counts them) until the node is rebuilt. Internal slots also
+// carry the child holding the keys >= their separator; first_child_ holds the keys below the
+// first separator. Leaves are chained in key order through prev_ / next_.
+template <size_t NODE_BYTES>
+struct StringNode {
+    static_assert(NODE_BYTES % CACHE_LINE_SIZE == 0, "NODE_BYTES must be a multiple of the cache line size");
+    static_assert(NODE_BYTES >= 512 && NODE_BYTES <= 32768, "NODE_BYTES must be within [512, 32768]");
+
+    static constexpr size_t HEAD_BYTES = sizeof(uint64_t);
+
+    uint16_t count_;
+    uint16_t prefix_length_;
+    uint16_t heap_;     // lowest byte of the tail area
+    uint16_t garbage_;  // tail bytes no slot refers to any more
+    bool leaf_;
+    StringNode* prev_;  // neighbouring leaves, unused in internal nodes
+    StringNode* next_;
+    StringNode* first_child_;  // unused in leaves
+
+public:
+    explicit StringNode(bool leaf)
+        : count_(0)
+        , prefix_length_(0)
+        , heap_(NODE_BYTES)
+        , garbage_(0)
+        , leaf_(leaf)
+        , prev_(nullptr)
+        , next_(nullptr)
+        , first_child_(nullptr) {
+        static_assert(alignof(StringNode) <= CACHE_LINE_SIZE, "node header must not need more than cache line alignment");
+        static_assert(SLOTS_OFFSET % alignof(StringSlot) == 0 && LEAF_STRIDE % alignof(StringNode*) == 0,
+                      "misaligned node arrays");
+        static_assert(SLOTS_OFFSET + 4 * INNER_STRIDE <= NODE_BYTES, "node too small for its header");
+    }
+
+    StringNode(const StringNode& other) = delete;
+    StringNode& operator=(const StringNode& other) = delete;
+
+public:
+    static constexpr size_t alignUp(size_t n, size_t alignment) noexcept {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr size_t SLOTS_OFFSET = alignUp(sizeof(StringNode), alignof(StringSlot));
+    static constexpr size_t LEAF_STRIDE = sizeof(StringSlot);
+    static constexpr size_t INNER_STRIDE = sizeof(StringSlot) + sizeof(StringNode*);
+    static constexpr size_t CAPACITY = NODE_BYTES - SLOTS_OFFSET;
+
+    // Longest key a tree accepts. Any entry then takes at most a quarter of a node, so two nodes
+    // always hold a full node plus one entry, and a split can put each half in its own node.
+    static constexpr size_t MAX_KEY_BYTES = CAPACITY / 4 - INNER_STRIDE + HEAD_BYTES;
+
+    // Bytes a key of the given length (after the prefix) takes, slot included.
+    static constexpr size_t entryBytes(size_t length, bool leaf) noexcept {
+        return (leaf ? LEAF_STRIDE : INNER_STRIDE) + (length > HEAD_BYTES ? length - HEAD_BYTES : 0);
+    }
+
+    static uint64_t loadHead(const char* p, size_t length) noexcept {
+        unsigned char bytes[HEAD_BYTES] = {};
+        if (length > 0) std::memcpy(bytes, p, std::min(length, HEAD_BYTES));
+        uint64_t head;
+        std::memcpy(&head, bytes, sizeof(head));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        head = __builtin_bswap64(head);
+#endif
+        return head;
+    }
+
+public:
+    __attribute__((always_inline)) size_t stride() const noexcept { return leaf_ ? LEAF_STRIDE : INNER_STRIDE; }
+
+    __attribute__((always_inline)) unsigned char* bytes() noexcept { return reinterpret_cast<unsigned char*>(this); }
+
+    __attribute__((always_inline)) const unsigned char* bytes() const noexcept {
+        return reinterpret_cast<const unsigned char*>(this);
+    }
+
+    __attribute__((always_inline)) StringSlot& slot(size_t i) noexcept {
+        return *reinterpret_cast<StringSlot*>(bytes() + SLOTS_OFFSET + i * stride());
+    }
+
+    __attribute__((always_inline)) const StringSlot& slot(size_t i) const noexcept {
+        return *reinterpret_cast<const StringSlot*>(bytes() + SLOTS_OFFSET + i * stride());
+    }
+
+    // Child i of an internal node, 0 <= i <= count_.
+    StringNode*& child(size_t i) noexcept {
+        if (i == 0) return first_child_;
+        return *reinterpret_cast<StringNode**>(bytes() + SLOTS_OFFSET + (i - 1) * INNER_STRIDE + sizeof(StringSlot));
+    }
+
+    StringNode* child(size_t i) const noexcept { return const_cast<StringNode*>(this)->child(i); }
+
+    std::string_view prefix() const noexcept {
+        return std::string_view(reinterpret_cast<const char*>(bytes()) + NODE_BYTES - prefix_length_, prefix_length_);
+    }
+
+    const char* tail(size_t i) const noexcept { return reinterpret_cast<const char*>(bytes()) + slot(i).tail_; }
+
+    size_t freeBytes() const noexcept { return heap_ - SLOTS_OFFSET - count_ * stride(); }
+
+    // Bytes the live keys take, prefix included.
+    size_t usedBytes() const noexcept { return count_ * stride() + (NODE_BYTES - heap_ - garbage_); }
+
+    void appendKey(size_t i, std::string& out) const {
+        const StringSlot& s = slot(i);
+        out.append(prefix());
+        unsigned char head[HEAD_BYTES];
+        uint64_t h = s.head_;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        h = __builtin_bswap64(h);
+#endif
+        std::memcpy(head, &h, sizeof(head));
+        out.append(reinterpret_cast<const char*>(head), std::min<size_t>(s.length_, HEAD_BYTES));
+        if (s.length_ > HEAD_BYTES) out.append(tail(i), s.length_ - HEAD_BYTES);
+    }
+
+    // Orders slot i against a key whose bytes after the prefix are suffix, with head = its head.
+    // Equal heads leave the tails and then the lengths to decide; a key shorter than the head is
+    // zero padded, which is only ever equal to real bytes of a longer key it is a prefix of.
+    int compare(size_t i, uint64_t head, std::string_view suffix) const noexcept {
+        const StringSlot& s = slot(i);
+        if (s.head_ != head) return s.head_ < head ? -1 : 1;
+        if (s.length_ > HEAD_BYTES && suffix.size() > HEAD_BYTES) {
+            const size_t n = std::min<size_t>(s.length_, suffix.size()) - HEAD_BYTES;
+            const int c = std::memcmp(tail(i), suffix.data() + HEAD_BYTES, n);
+            if (c != 0) return c;
+        }
+        return s.length_ < suffix.size() ? -1 : s.length_ > suffix.size() ? 1 : 0;
+    }
+
+    // Index of the first key not less than key; exact tells whether it equals key.
+    size_t lowerBound(std::string_view key, bool& exact) const noexcept {
+        exact = false;
+        const std::string_view p = prefix();
+        const int c = key.substr(0, p.size()).compare(p);  // below p also when key is a prefix of it
+        if (c < 0) return 0;
+        if (c > 0) return count_;
+
+        const std::string_view suffix = key.substr(p.size());
+        const uint64_t head = loadHead(suffix.data(), suffix.size());
+        size_t lo = 0, hi = count_;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if (compare(mid, head, suffix) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        exact = lo < count_ && compare(lo, head, suffix) == 0;
+        return lo;
+    }
+
+    // Puts key at slot i when it shares the prefix and fits in the free space; internal nodes
+    // give the child that holds keys >= key. Returns false, leaving the node as it was, otherwise.
+    bool tryInsert(size_t i, std::string_view key, StringNode* right_child) noexcept {
+        const std::string_view p = prefix();
+        if (key.substr(0, p.size()) != p) return false;
+
+        const std::string_view suffix = key.substr(p.size());
+        if (entryBytes(suffix.size(), leaf_) > freeBytes()) return false;
+
+        unsigned char* at = bytes() + SLOTS_OFFSET + i * stride();
+        std::memmove(at + stride(), at, (count_ - i) * stride());
+        count_ += 1;
+
+        StringSlot& s = slot(i);
+        s.head_ = loadHead(suffix.data(), suffix.size());
+        s.length_ = static_cast<uint16_t>(suffix.size());
+        if (suffix.size() > HEAD_BYTES) {
+            heap_ -= static_cast<uint16_t>(suffix.size() - HEAD_BYTES);
+            std::memcpy(bytes() + heap_, suffix.data() + HEAD_BYTES, suffix.size() - HEAD_BYTES);
+        }
+        s.tail_ = heap_;
+        if (!leaf_) child(i + 1) = right_child;
+        return true;
+    }
+
+    // Drops slot i (with, in internal nodes, the child right of it).
+    void remove(size_t i) noexcept {
+        const StringSlot& s = slot(i);
+        if (s.length_ > HEAD_BYTES) garbage_ += static_cast<uint16_t>(s.length_ - HEAD_BYTES);
+
+        unsigned char* at = bytes() + SLOTS_OFFSET + i * stride();
+        std::memmove(at, at + stride(), (count_ - i - 1) * stride());
+        count_ -= 1;
+    }
+
+    // Empties the node and sets a new prefix, ready for tryInsert in key order.
+    void reset(std::string_view prefix) noexcept {
+        count_ = 0;
+        garbage_ = 0;
+        prefix_length_ = static_cast<uint16_t>(prefix.size());
+        heap_ = static_cast<uint16_t>(NODE_BYTES - prefix.size());
+        if (!prefix.empty()) std::memcpy(bytes() + heap_, prefix.data(), prefix.size());
+    }
+};
+
+}  // namespace btree
@@ -0,0 +1,189 @@
+/* Assertion test of MonotonicArena and differential test of trees on an ArenaAllocator.
+ *
+ * The arena hands out blocks of random sizes and alignments, some bigger than any chunk, that
+ * must be aligned and must not overlap, and it must be reusable after release(). BTree,
+ * BPlusTree and StringBTree on an arena run random inserts, erases and range erases against
+ * their std:: counterparts; trees of trivially destructible keys drop what they erase without
+ * a walk, so the test also checks that nothing the trees still use is dropped with it. Keys that
+ * are not trivially destructible must all be destroyed all the same. The optional argument is
+ * the number of random operations per tree (20000).
+ *
+ * g++ arena_test.cpp -o arena_test -std=c++17 -O2
+ *
+ */
+
+#include "../arena.hpp"
+#include "../bplus_tree.hpp"
+#include "../btree.hpp"
+#include "../string_btree.hpp"
+#include "test_util.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using btree::ArenaAllocator;
+using btree::MonotonicArena;
+
+using Model = std::multiset<int>;
+
+struct Block {
+    unsigned char* ptr;
+    size_t size;
+    unsigned char fill;
+};
+
+static void arena_blocks(std::mt19937& rng) {
+    static const size_t ALIGNMENTS[] = {1, 2, 8, 16, 64, 256, 4096};
+
+    MonotonicArena arena(1);
+    for (int round = 0; round < 2; ++round) {
+        CHECK(arena.reserved() == 0);
+        std::vector<Block> blocks;
+        size_t bytes = 0;
+        for (int i = 0; i < 4000; ++i) {
+            const size_t size = (i % 500 == 499) ? (1 << 20) + rng() % 4096 : 1 + rng() % 3000;
+            const size_t alignment = ALIGNMENTS[rng() % 7];
+            Block block{static_cast<unsigned char*>(arena.allocate(size, alignment)), size,
+                        static_cast<unsigned char>(rng())};
+            CHECK(reinterpret_cast<uintptr_t>(block.ptr) % alignment == 0);
+            std::fill(block.ptr, block.ptr + size, block.fill);
+            blocks.push_back(block);
+            bytes += size;
+        }
+        CHECK(arena.reserved() >= bytes);
+        for (const Block& block : blocks)
+            CHECK(std::all_of(block.ptr, block.ptr + block.size, [&](unsigned char c) { return c == block.fill; }));
+        arena.release();
+    }
+    CHECK(arena.reserved() == 0);
+
+    MonotonicArena other;
+    ArenaAllocator<int> ints(arena);
+    ArenaAllocator<double> doubles(ints);
+    CHECK(ints == doubles && !(ints != doubles));
+    CHECK(ints != ArenaAllocator<int>(other));
+    CHECK(&doubles.arena() == &arena);
+}
+
+template <typename Tree>
+static void check_tree(const Tree& tree, const Model& model) {
+    CHECK(tree.empty() == model.empty());
+    CHECK(same_keys(tree, model));
+}
+
+// BPlusTree has no erase_range, so RANGES is off for it.
+template <typename Tree, bool RANGES>
+static void random_ops(std::mt19937& rng, size_t ops, int key_range) {
+    MonotonicArena arena;
+    Tree tree{ArenaAllocator<int>(arena)};
+    Model model;
+    size_t reserved = 0;
+
+    for (size_t op = 0; op < ops; ++op) {
+        const int k = static_cast<int>(rng() % key_range);
+        switch (rng() % 8) {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+                tree.insert(k);
+                model.insert(k);
+                break;
+            case 4:
+            case 5:
+                CHECK(tree.erase(k) == model.erase(k));
+                break;
+            case 6:
+                CHECK(tree.contains(k) == (model.count(k) != 0));
+                break;
+            case 7:
+                if constexpr (RANGES) {
+                    if (rng() % 16 == 0) {
+                        const int hi = k + static_cast<int>(rng() % 64);
+                        tree.erase_range(k, hi);
+                        model.erase(model.lower_bound(k), model.lower_bound(hi));
+                    }
+                }
+                break;
+        }
+        if (op % 256 == 0) {
+            check_tree(tree, model);
+            CHECK(arena.reserved() >= reserved);
+            reserved = arena.reserved();
+        }
+    }
+    check_tree(tree, model);
+    CHECK(arena.reserved() > 0);
+}
+
+// Counts the keys alive, so a tree on an arena can be seen to destroy every one.
+struct Tracked {
+    static inline long live = 0;
+    int value;
+
+    Tracked(int v) : value(v) { ++live; }
+    Tracked(const Tracked& other) : value(other.value) { ++live; }
+    Tracked& operator=(const Tracked& other) = default;
+    ~Tracked() { --live; }
+
+    bool operator<(const Tracked& other) const { return value < other.value; }
+    bool operator==(const Tracked& other) const { return value == other.value; }
+};
+
+static void tracked_keys(std::mt19937& rng, size_t ops) {
+    MonotonicArena arena;
+    {
+        btree::BTree<Tracked, 3, ArenaAllocator<Tracked>> tree{ArenaAllocator<Tracked>(arena)};
+        Model model;
+        for (size_t op = 0; op < ops; ++op) {
+            const int k = static_cast<int>(rng() % 4096);
+            if (rng() % 3 != 0) {
+                tree.insert(Tracked(k));
+                model.insert(k);
+            } else {
+                tree.erase_range(Tracked(k), Tracked(k + 32));
+                model.erase(model.lower_bound(k), model.lower_bound(k + 32));
+            }
+        }
+        check_tree(tree, model);
+        CHECK(Tracked::live == static_cast<long>(model.size()));
+    }
+    CHECK(Tracked::live == 0);
+}
+
+static void string_keys(std::mt19937& rng, size_t ops) {
+    MonotonicArena arena;
+    btree::StringBTree<512, ArenaAllocator<char>> tree{ArenaAllocator<char>(arena)};
+    std::set<std::string> model;
+    for (size_t op = 0; op < ops; ++op) {
+        const std::string key = "key/" + std::to_string(rng() % 2048);
+        if (rng() % 3 != 0)
+            CHECK(tree.insert(key) == model.insert(key).second);
+        else
+            CHECK(tree.erase(key) == model.erase(key));
+    }
+    CHECK(same_keys(tree, model));
+    tree.clear();
+    CHECK(tree.empty());
+    CHECK(tree.insert("again"));
+}
+
+int main(int argc, char** argv) {
+    size_t ops = 20000;
+    if (argc > 1) ops = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    arena_blocks(rng);
+    for (int key_range : {64, 4096}) {
+        random_ops<btree::BTree<int, 2, ArenaAllocator<int>>, true>(rng, ops, key_range);
+        random_ops<btree::BTree<int, 16, ArenaAllocator<int>>, true>(rng, ops, key_range);
+        random_ops<btree::BPlusTree<int, 3, ArenaAllocator<int>>, false>(rng, ops, key_range);
+    }
+    tracked_keys(rng, ops);
+    string_keys(rng, ops);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/* Differential test of BTree::insert_batch and search_batch against std::multiset and std::set.
+ *
+ * Batches of random size, from empty to a few hundred keys, unsorted and full of repeats, are
+ * inserted into multi, unique and counted trees at a few ORDERs, in between single inserts and
+ * erases, and the tree must match its std:: counterpart after each one. Every batch lookup, of
+ * keys present and absent, must agree with the model and with contains() key by key, whether the
+ * batch is short enough to go unsorted or not. A key type whose move may throw takes the one by
+ * one path of insert_batch. The optional argument is the number of batches per tree (500).
+ *
+ * g++ batch_test.cpp -o batch_test -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include "test_util.hpp"
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <set>
+#include <type_traits>
+#include <vector>
+
+template <typename Key, size_t ORDER, typename Duplicates>
+using Tree = btree::BTree<Key, ORDER, std::allocator<Key>, btree::default_search, btree::no_stats, Duplicates>;
+
+template <typename Duplicates>
+using Model = std::conditional_t<Duplicates::UNIQUE && !Duplicates::COUNTED, std::set<int>, std::multiset<int>>;
+
+// An int whose move constructor is not noexcept.
+struct ThrowingMove {
+    int value;
+
+    ThrowingMove(int v) : value(v) {}
+    ThrowingMove(const ThrowingMove& other) = default;
+    ThrowingMove(ThrowingMove&& other) noexcept(false) : value(other.value) {}
+    ThrowingMove& operator=(const ThrowingMove& other) = default;
+    ThrowingMove& operator=(ThrowingMove&& other) = default;
+
+    operator int() const { return value; }
+    bool operator<(const ThrowingMove& other) const { return value < other.value; }
+};
+
+template <typename Tree, typename Model>
+static void check_tree(Tree& tree, const Model& model) {
+    CHECK(tree.empty() == model.empty());
+    CHECK(traversed<int>(tree) == std::vector<int>(model.begin(), model.end()));
+}
+
+template <typename Key, typename Tree, typename Model>
+static void check_search(const Tree& tree, const Model& model, std::mt19937& rng, int key_range) {
+    const size_t count = (rng() % 2) ? rng() % 17 : rng() % 400;
+    std::vector<Key> probes;
+    for (size_t j = 0; j < count; ++j)
+        probes.push_back(static_cast<int>(rng() % (key_range + key_range / 4)) - key_range / 8);
+
+    std::unique_ptr<bool[]> found(new bool[count + 1]);
+    found[count] = true;
+    const size_t hits = tree.search_batch(probes.data(), count, found.get());
+    size_t expected = 0;
+    for (size_t j = 0; j < count; ++j) {
+        const bool present = model.find(probes[j]) != model.end();
+        CHECK(found[j] == present);
+        CHECK(tree.contains(probes[j]) == present);
+        expected += present;
+    }
+    CHECK(hits == expected);
+    CHECK(found[count]);
+}
+
+template <typename Key, size_t ORDER, typename Duplicates>
+static void random_batches(std::mt19937& rng, size_t batches, int key_range) {
+    Tree<Key, ORDER, Duplicates> tree;
+    Model<Duplicates> model;
+
+    for (size_t b = 0; b < batches; ++b) {
+        const size_t count = (rng() % 4 == 0) ? rng() % 400 : rng() % 32;
+        std::vector<Key> keys;
+        for (size_t j = 0; j < count; ++j)
+            keys.push_back(static_cast<int>(rng() % key_range));
+        tree.insert_batch(keys.data(), keys.size());
+        for (const Key& key : keys)
+            model.insert(key);
+
+        // A few single operations in between, so batches also land in trees that shrank.
+        for (int op = 0; op < 8; ++op) {
+            const int k = static_cast<int>(rng() % key_range);
+            if (rng() % 3 == 0) {
+                tree.insert(k);
+                model.insert(k);
+            } else {
+                const auto m = model.find(k);
+                CHECK(tree.erase_one(k) == (m != model.end()));
+                if (m != model.end()) model.erase(m);
+            }
+        }
+        if (b % 32 == 0) check_tree(tree, model);
+        check_search<Key>(tree, model, rng, key_range);
+    }
+    check_tree(tree, model);
+
+    Tree<Key, ORDER, Duplicates> empty;
+    empty.insert_batch(nullptr, 0);
+    check_tree(empty, Model<Duplicates>());
+    check_search<Key>(empty, Model<Duplicates>(), rng, key_range);
+}
+
+template <typename Key, size_t ORDER, typename Duplicates>
+static void run(std::mt19937& rng, size_t batches) {
+    random_batches<Key, ORDER, Duplicates>(rng, batches, 64);
+    random_batches<Key, ORDER, Duplicates>(rng, batches, 1 << 16);
+}
+
+int main(int argc, char** argv) {
+    size_t batches = 500;
+    if (argc > 1) batches = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    run<int, 2, btree::multi_keys>(rng, batches);
+    run<int, 3, btree::multi_keys>(rng, batches);
+    run<int, 16, btree::multi_keys>(rng, batches);
+    run<int, 2, btree::unique_keys>(rng, batches);
+    run<int, 16, btree::unique_keys>(rng, batches);
+    run<int, 3, btree::counted_keys<>>(rng, batches);
+    run<ThrowingMove, 3, btree::multi_keys>(rng, batches / 4);
+    return 0;
+}
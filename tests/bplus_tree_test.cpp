@@ -0,0 +1,118 @@
+/* Differential test of BPlusTree against std::multiset.
+ *
+ * Random inserts, erases by key and by position, bound queries and range views run on both
+ * side by side at a few ORDERs, with keys drawn from a small range so runs of copies straddle
+ * leaves. The optional argument is the number of random operations per tree (20000).
+ *
+ * g++ bplus_tree_test.cpp -o bplus_tree_test -std=c++17 -O2
+ *
+ */
+
+#include "../bplus_tree.hpp"
+#include "test_util.hpp"
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+using Model = std::multiset<int>;
+
+template <typename Tree>
+static void check_tree(const Tree& tree, const Model& model) {
+    CHECK(tree.empty() == model.empty());
+    CHECK(same_keys(tree, model));
+    CHECK(same_keys_backwards(tree, model));
+    CHECK(traversed<int>(tree) == std::vector<int>(model.begin(), model.end()));
+}
+
+template <size_t ORDER>
+static void random_ops(std::mt19937& rng, size_t ops, int key_range) {
+    using Tree = btree::BPlusTree<int, ORDER>;
+    Tree tree;
+    Model model;
+    for (size_t i = 0; i < 2 * static_cast<size_t>(key_range); ++i) {
+        const int k = static_cast<int>(rng() % key_range);
+        tree.insert(k);
+        model.insert(k);
+    }
+    check_tree(tree, model);
+
+    for (size_t op = 0; op < ops; ++op) {
+        const int k = static_cast<int>(rng() % key_range);
+        switch (rng() % 6) {
+            case 0:
+            case 1:
+                tree.insert(k);
+                model.insert(k);
+                break;
+            case 2:
+                CHECK(tree.erase(k) == model.erase(k));
+                break;
+            case 3: {
+                // Erase at a random position and check the returned successor.
+                if (model.empty()) break;
+                const auto i = static_cast<std::ptrdiff_t>(rng() % model.size());
+                const auto next = tree.erase(std::next(tree.begin(), i));
+                CHECK(index_of(tree, next) == index_of(model, model.erase(std::next(model.begin(), i))));
+                break;
+            }
+            case 4: {
+                const int hi = k + static_cast<int>(rng() % 16);
+                const auto range = tree.range(k, hi);
+                CHECK(same_keys(range, std::vector<int>(model.lower_bound(k), model.lower_bound(hi))));
+                break;
+            }
+            case 5: {
+                CHECK(index_of(tree, tree.lower_bound(k)) == index_of(model, model.lower_bound(k)));
+                CHECK(index_of(tree, tree.upper_bound(k)) == index_of(model, model.upper_bound(k)));
+                const auto found = tree.find(k);
+                CHECK((found == tree.end()) == (model.find(k) == model.end()));
+                if (found != tree.end()) CHECK(*found == k);
+                CHECK(tree.contains(k) == (model.count(k) != 0));
+                break;
+            }
+        }
+        if (op % 64 == 0) check_tree(tree, model);
+    }
+    check_tree(tree, model);
+
+    // Emptying the tree through the iterators erase(pos) hands back, every other key first.
+    for (auto it = tree.begin(); it != tree.end();) {
+        it = tree.erase(it);
+        if (it != tree.end()) ++it;
+    }
+    for (auto it = tree.begin(); it != tree.end();)
+        it = tree.erase(it);
+    check_tree(tree, Model());
+
+    tree.insert(1);
+    tree.clear();
+    check_tree(tree, Model());
+}
+
+// erase(pos) must remove the copy at pos even when the run of equal keys spans several leaves.
+static void erase_every_other() {
+    btree::BPlusTree<int, 2> tree;
+    for (int k : {5, 5, 5, 5, 6, 6})
+        tree.insert(k);
+    for (auto it = tree.begin(); it != tree.end();) {
+        it = tree.erase(it);
+        if (it != tree.end()) ++it;
+    }
+    check_tree(tree, Model{5, 5, 6});
+}
+
+int main(int argc, char** argv) {
+    size_t ops = 20000;
+    if (argc > 1) ops = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    erase_every_other();
+    for (int key_range : {16, 64, 4096}) {
+        random_ops<2>(rng, ops, key_range);
+        random_ops<3>(rng, ops, key_range);
+        random_ops<16>(rng, ops, key_range);
+    }
+    return 0;
+}
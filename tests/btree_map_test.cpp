@@ -0,0 +1,184 @@
+/* Differential test of BTreeMap against std::map.
+ *
+ * Random try_emplace, insert_or_assign, operator[], erases by key and by position and lookups
+ * run on both maps side by side at a few ORDERs, then split_at, join and merge are checked
+ * against the same cuts and unions of a std::map. The optional argument is the number of random
+ * operations per map (20000).
+ *
+ * g++ btree_map_test.cpp -o btree_map_test -std=c++17 -O2
+ *
+ */
+
+#include "../btree_map.hpp"
+#include "test_util.hpp"
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+template <size_t ORDER>
+using Map = btree::BTreeMap<int, std::string, ORDER>;
+
+using Model = std::map<int, std::string>;
+
+template <size_t ORDER>
+static void check_map(const Map<ORDER>& map, const Model& model) {
+    CHECK(map.empty() == model.empty());
+
+    auto it = map.begin();
+    for (const auto& entry : model) {
+        CHECK(it != map.end());
+        CHECK((*it).first == entry.first);
+        CHECK(it->second == entry.second);
+        ++it;
+    }
+    CHECK(it == map.end());
+
+    for (auto m = model.rbegin(); m != model.rend(); ++m) {
+        CHECK(it != map.begin());
+        --it;
+        CHECK(it.key() == m->first);
+    }
+    CHECK(it == map.begin());
+}
+
+// An iterator returned by an insert steps forward and back like one from find(), also through end().
+template <typename Iterator>
+static bool steps_back(Iterator it, int key) {
+    ++it;
+    --it;
+    return it.key() == key;
+}
+
+template <size_t ORDER>
+static void random_ops(std::mt19937& rng, size_t ops, int key_range) {
+    Map<ORDER> map;
+    Model model;
+    const Map<ORDER>& m = map;
+
+    for (size_t op = 0; op < ops; ++op) {
+        const int k = static_cast<int>(rng() % key_range);
+        const std::string value = std::to_string(rng() % 1000);
+        switch (rng() % 8) {
+            case 0: {
+                const auto res = map.try_emplace(k, value);
+                const auto expected = model.try_emplace(k, value);
+                CHECK(res.second == expected.second);
+                CHECK(res.first.key() == k);
+                CHECK((*res.first).second == expected.first->second);
+                CHECK(steps_back(res.first, k));
+                break;
+            }
+            case 1: {
+                const auto res = map.insert_or_assign(k, value);
+                CHECK(res.second == model.insert_or_assign(k, value).second);
+                CHECK((*res.first).second == value);
+                CHECK(steps_back(res.first, k));
+                break;
+            }
+            case 2:
+                map[k] += "x";
+                model[k] += "x";
+                break;
+            case 3:
+                CHECK(map.erase(k) == model.erase(k));
+                break;
+            case 4: {
+                if (model.empty()) break;
+                const auto i = static_cast<std::ptrdiff_t>(rng() % model.size());
+                const typename Map<ORDER>::const_iterator next = map.erase(std::next(m.begin(), i));
+                CHECK(index_of(m, next) == index_of(model, model.erase(std::next(model.begin(), i))));
+                break;
+            }
+            case 5: {
+                // Values reached through a mutable iterator are the map's own.
+                const auto found = map.find(k);
+                CHECK((found == map.end()) == (model.find(k) == model.end()));
+                if (found != map.end()) {
+                    (*found).second = value;
+                    model[k] = value;
+                    CHECK(m.at(k) == value);
+                }
+                bool thrown = false;
+                try {
+                    map.at(key_range);
+                } catch (const std::out_of_range&) {
+                    thrown = true;
+                }
+                CHECK(thrown);
+                break;
+            }
+            default:
+                CHECK(m.count(k) == model.count(k));
+                CHECK(index_of(m, m.lower_bound(k)) == index_of(model, model.lower_bound(k)));
+                CHECK(index_of(m, m.upper_bound(k)) == index_of(model, model.upper_bound(k)));
+                break;
+        }
+        if (op % 64 == 0) check_map(map, model);
+    }
+    check_map(map, model);
+}
+
+template <size_t ORDER>
+static void repartition(std::mt19937& rng, int key_range) {
+    for (int round = 0; round < 50; ++round) {
+        Map<ORDER> map;
+        Model model;
+        for (size_t i = rng() % 3000; i > 0; --i) {
+            const int k = static_cast<int>(rng() % key_range);
+            map.try_emplace(k, std::to_string(k));
+            model.try_emplace(k, std::to_string(k));
+        }
+
+        const int k = static_cast<int>(rng() % key_range);
+        Map<ORDER> upper = map.split_at(k);
+        check_map(map, Model(model.begin(), model.lower_bound(k)));
+        check_map(upper, Model(model.lower_bound(k), model.end()));
+
+        Map<ORDER> joined = Map<ORDER>::join(std::move(map), std::move(upper));
+        check_map(joined, model);
+
+        // A key in both maps keeps the value of the map merged into.
+        Map<ORDER> other;
+        for (size_t i = rng() % 3000; i > 0; --i) {
+            const int key = static_cast<int>(rng() % key_range);
+            other.try_emplace(key, "other");
+            model.try_emplace(key, "other");
+        }
+        joined.merge(other);
+        CHECK(other.empty());
+        check_map(joined, model);
+
+        Map<ORDER> high = joined.split_at(k);
+        if (!joined.empty() && !high.empty()) {
+            bool thrown = false;
+            try {
+                Map<ORDER>::join(std::move(high), std::move(joined));
+            } catch (const std::invalid_argument&) {
+                thrown = true;
+            }
+            CHECK(thrown);
+        }
+    }
+}
+
+template <size_t ORDER>
+static void run(std::mt19937& rng, size_t ops) {
+    random_ops<ORDER>(rng, ops, 64);
+    random_ops<ORDER>(rng, ops, 4096);
+    repartition<ORDER>(rng, 1000);
+}
+
+int main(int argc, char** argv) {
+    size_t ops = 20000;
+    if (argc > 1) ops = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    run<2>(rng, ops);
+    run<3>(rng, ops);
+    run<16>(rng, ops);
+    return 0;
+}
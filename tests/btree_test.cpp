@@ -0,0 +1,282 @@
+/* Differential test of BTree against std::multiset and std::set.
+ *
+ * Random inserts, erases (by key, one copy, by position and by range) and bound queries run on a
+ * tree and on its std:: counterpart side by side, for multi, unique and counted trees at a few
+ * ORDERs, with keys drawn from a small range so there are plenty of copies. Then split_at, join
+ * and merge are checked against the same cuts and unions of the std:: containers, and save/load
+ * round trips against the keys saved. The optional argument is the number of random operations
+ * per tree (20000).
+ *
+ * g++ btree_test.cpp -o btree_test -std=c++17 -O2
+ *
+ */
+
+#include "../btree.hpp"
+#include "test_util.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <size_t ORDER, typename Duplicates>
+using Tree = btree::BTree<int, ORDER, std::allocator<int>, btree::default_search, btree::no_stats, Duplicates>;
+
+// What the tree stands for: a set for unique trees, a multiset for multi and counted ones.
+template <typename Duplicates>
+using Model = std::conditional_t<Duplicates::UNIQUE && !Duplicates::COUNTED, std::set<int>, std::multiset<int>>;
+
+template <size_t ORDER, typename Duplicates>
+static void check_tree(Tree<ORDER, Duplicates>& tree, const Model<Duplicates>& model) {
+    const Tree<ORDER, Duplicates>& t = tree;
+    CHECK(t.empty() == model.empty());
+    CHECK(traversed<int>(tree) == std::vector<int>(model.begin(), model.end()));
+
+    if constexpr (Duplicates::COUNTED) {
+        // One (key, count) pair per distinct key.
+        auto it = t.begin();
+        for (auto m = model.begin(); m != model.end(); m = model.upper_bound(*m)) {
+            CHECK(it != t.end());
+            CHECK((*it).first == *m);
+            CHECK(static_cast<size_t>((*it).second) == model.count(*m));
+            ++it;
+        }
+        CHECK(it == t.end());
+    } else {
+        CHECK(same_keys(t, model));
+        CHECK(same_keys_backwards(t, model));
+    }
+}
+
+template <size_t ORDER, typename Duplicates>
+static void fill(Tree<ORDER, Duplicates>& tree, Model<Duplicates>& model, std::mt19937& rng, size_t n, int key_range) {
+    for (size_t i = 0; i < n; ++i) {
+        const int k = static_cast<int>(rng() % key_range);
+        tree.insert(k);
+        model.insert(k);
+    }
+}
+
+// Position i of the tree's iteration order, which for counted trees only has the distinct keys.
+template <typename Duplicates>
+static int distinct_key(const Model<Duplicates>& model, size_t i) {
+    auto m = model.begin();
+    for (; i > 0; --i)
+        m = model.upper_bound(*m);
+    return *m;
+}
+
+template <size_t ORDER, typename Duplicates>
+static void random_ops(std::mt19937& rng, size_t ops, int key_range) {
+    Tree<ORDER, Duplicates> tree;
+    Model<Duplicates> model;
+    const Tree<ORDER, Duplicates>& t = tree;
+    fill(tree, model, rng, 2 * static_cast<size_t>(key_range), key_range);
+    check_tree(tree, model);
+
+    for (size_t op = 0; op < ops; ++op) {
+        const int k = static_cast<int>(rng() % key_range);
+        switch (rng() % 8) {
+            case 0:
+            case 1:
+            case 2: {
+                const bool fresh = model.find(k) == model.end();
+                const bool inserted = tree.insert(k);
+                model.insert(k);
+                CHECK(inserted == (Duplicates::UNIQUE ? fresh : true));
+                break;
+            }
+            case 3:
+                CHECK(tree.erase(k) == model.erase(k));
+                break;
+            case 4: {
+                const auto m = model.find(k);
+                CHECK(tree.erase_one(k) == (m != model.end()));
+                if (m != model.end()) model.erase(m);
+                break;
+            }
+            case 5: {
+                // Erase at a random position and check the returned successor.
+                if (model.empty()) break;
+                const size_t distinct = static_cast<size_t>(std::distance(t.begin(), t.end()));
+                const size_t i = rng() % distinct;
+                const auto pos = std::next(t.begin(), static_cast<std::ptrdiff_t>(i));
+                const typename Tree<ORDER, Duplicates>::const_iterator next = tree.erase(pos);
+                if constexpr (Duplicates::COUNTED) {
+                    const int key = distinct_key<Duplicates>(model, i);
+                    model.erase(model.find(key));
+                    const auto m = model.lower_bound(key);
+                    CHECK((next == t.end()) == (m == model.end()));
+                    if (m != model.end()) CHECK(next.key() == *m);
+                } else {
+                    const auto m = model.erase(std::next(model.begin(), static_cast<std::ptrdiff_t>(i)));
+                    CHECK(index_of(t, next) == index_of(model, m));
+                }
+                break;
+            }
+            case 6: {
+                const auto lower = t.lower_bound(k);
+                const auto upper = t.upper_bound(k);
+                const auto found = t.find(k);
+                CHECK((found == t.end()) == (model.find(k) == model.end()));
+                if (found != t.end()) CHECK(found.key() == k);
+                CHECK(t.count(k) == model.count(k));
+                CHECK(t.contains(k) == (model.count(k) != 0));
+                if constexpr (Duplicates::COUNTED) {
+                    CHECK((lower == t.end()) == (model.lower_bound(k) == model.end()));
+                    if (lower != t.end()) CHECK(lower.key() == *model.lower_bound(k));
+                    CHECK((upper == t.end()) == (model.upper_bound(k) == model.end()));
+                    if (upper != t.end()) CHECK(upper.key() == *model.upper_bound(k));
+                } else {
+                    CHECK(index_of(t, lower) == index_of(model, model.lower_bound(k)));
+                    CHECK(index_of(t, upper) == index_of(model, model.upper_bound(k)));
+                }
+                break;
+            }
+            case 7: {
+                const int hi = k + static_cast<int>(rng() % 16);
+                tree.erase_range(k, hi);
+                model.erase(model.lower_bound(k), model.lower_bound(hi));
+                break;
+            }
+        }
+        if (op % 64 == 0) check_tree(tree, model);
+    }
+    check_tree(tree, model);
+
+    // Emptying the tree through the iterators erase(pos) hands back.
+    for (auto it = t.begin(); it != t.end();)
+        it = tree.erase(it);
+    CHECK(t.begin() == t.end());
+    model.clear();
+    check_tree(tree, model);
+}
+
+// erase(pos) on a run of equal keys removes the copy at pos, not the first one.
+static void erase_every_other() {
+    Tree<3, btree::multi_keys> tree;
+    for (int k : {5, 5, 5, 5, 6, 6})
+        tree.insert(k);
+    for (auto it = tree.begin(); it != tree.end();) {
+        it = tree.erase(it);
+        if (it != tree.end()) ++it;
+    }
+    const std::multiset<int> expected{5, 5, 6};
+    check_tree(tree, expected);
+}
+
+template <size_t ORDER, typename Duplicates>
+static void repartition(std::mt19937& rng, int key_range) {
+    for (int round = 0; round < 50; ++round) {
+        Tree<ORDER, Duplicates> tree;
+        Model<Duplicates> model;
+        fill(tree, model, rng, rng() % 3000, key_range);
+
+        const int k = static_cast<int>(rng() % key_range);
+        Tree<ORDER, Duplicates> upper = tree.split_at(k);
+        const Model<Duplicates> model_lower(model.begin(), model.lower_bound(k));
+        const Model<Duplicates> model_upper(model.lower_bound(k), model.end());
+        check_tree(tree, model_lower);
+        check_tree(upper, model_upper);
+
+        Tree<ORDER, Duplicates> joined = Tree<ORDER, Duplicates>::join(std::move(tree), std::move(upper));
+        check_tree(joined, model);
+
+        Tree<ORDER, Duplicates> other;
+        Model<Duplicates> model_other;
+        fill(other, model_other, rng, rng() % 3000, key_range);
+        joined.merge(other, (round % 2) ? 1.0 : 0.5);
+        model.insert(model_other.begin(), model_other.end());
+        CHECK(other.empty());
+        check_tree(joined, model);
+
+        // Joining the two halves of a split the wrong way round is refused.
+        Tree<ORDER, Duplicates> high = joined.split_at(k);
+        if (!joined.empty() && !high.empty()) {
+            bool thrown = false;
+            try {
+                Tree<ORDER, Duplicates>::join(std::move(high), std::move(joined));
+            } catch (const std::invalid_argument&) {
+                thrown = true;
+            }
+            CHECK(thrown);
+        }
+    }
+}
+
+template <size_t ORDER, typename Duplicates>
+static void save_load(std::mt19937& rng, int key_range) {
+    for (int round = 0; round < 20; ++round) {
+        Tree<ORDER, Duplicates> tree;
+        Model<Duplicates> model;
+        fill(tree, model, rng, rng() % 5000, key_range);
+
+        std::vector<unsigned char> buffer;
+        tree.save(buffer);
+        Tree<ORDER, Duplicates> loaded;
+        loaded.insert(-1);
+        loaded.load(buffer.data(), buffer.size(), (round % 2) ? 1.0 : 0.6);
+        check_tree(loaded, model);
+
+        std::stringstream stream;
+        tree.save(stream);
+        Tree<ORDER, Duplicates> streamed;
+        streamed.load(stream);
+        check_tree(streamed, model);
+
+        // Truncated and corrupted snapshots are refused.
+        bool thrown = false;
+        try {
+            streamed.load(buffer.data(), buffer.size() - 1);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+
+        if (!model.empty()) {
+            buffer[buffer.size() / 2] ^= 0x5a;
+            thrown = false;
+            try {
+                streamed.load(buffer.data(), buffer.size());
+            } catch (const std::runtime_error&) {
+                thrown = true;
+            }
+            CHECK(thrown);
+        }
+
+        // bulk_load from the sorted keys builds the same tree.
+        const std::vector<int> sorted(model.begin(), model.end());
+        Tree<ORDER, Duplicates> bulk(sorted.begin(), sorted.end(), 0.7);
+        check_tree(bulk, model);
+    }
+}
+
+template <size_t ORDER, typename Duplicates>
+static void run(std::mt19937& rng, size_t ops) {
+    random_ops<ORDER, Duplicates>(rng, ops, 64);
+    random_ops<ORDER, Duplicates>(rng, ops, 4096);
+    repartition<ORDER, Duplicates>(rng, 1000);
+    save_load<ORDER, Duplicates>(rng, 1000);
+}
+
+int main(int argc, char** argv) {
+    size_t ops = 20000;
+    if (argc > 1) ops = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    erase_every_other();
+
+    run<2, btree::multi_keys>(rng, ops);
+    run<3, btree::multi_keys>(rng, ops);
+    run<16, btree::multi_keys>(rng, ops);
+    run<2, btree::unique_keys>(rng, ops);
+    run<8, btree::unique_keys>(rng, ops);
+    run<2, btree::counted_keys<>>(rng, ops);
+    run<8, btree::counted_keys<uint16_t>>(rng, ops);
+    return 0;
+}
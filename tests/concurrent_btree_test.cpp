@@ -0,0 +1,105 @@
+/* Differential test of ConcurrentBTree against std::multiset.
+ *
+ * First single-threaded: random inserts, erases and lookups run on both side by side. Then
+ * threads (4 unless given as the first argument) insert and erase keys of their own, each checks
+ * its keys as it goes and the tree is compared with the union of what the threads kept at the end.
+ *
+ * g++ concurrent_btree_test.cpp -o concurrent_btree_test -std=c++17 -O2 -pthread
+ *
+ */
+
+#include "../concurrent_btree.hpp"
+#include "test_util.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+using Tree = btree::ConcurrentBTree<uint64_t, 3>;
+using Model = std::multiset<uint64_t>;
+
+static void check_tree(const Tree& tree, const Model& model) {
+    CHECK(tree.empty() == model.empty());
+    CHECK(traversed<uint64_t>(tree) == std::vector<uint64_t>(model.begin(), model.end()));
+}
+
+static void random_ops(std::mt19937_64& rng, size_t ops, uint64_t key_range) {
+    Tree tree;
+    Model model;
+    for (size_t op = 0; op < ops; ++op) {
+        const uint64_t k = rng() % key_range;
+        switch (rng() % 4) {
+            case 0:
+            case 1:
+                tree.insert(k);
+                model.insert(k);
+                break;
+            case 2:
+                CHECK(tree.erase(k) == model.erase(k));
+                break;
+            case 3:
+                CHECK(tree.contains(k) == (model.count(k) != 0));
+                break;
+        }
+        if (op % 64 == 0) check_tree(tree, model);
+    }
+    check_tree(tree, model);
+
+    tree.clear();
+    check_tree(tree, Model());
+    tree.insert(7);
+    check_tree(tree, Model{7});
+}
+
+// Thread t owns the keys equal to t modulo the thread count.
+static void threaded(size_t threads, size_t ops) {
+    Tree tree;
+    std::vector<Model> kept(threads);
+    std::atomic<bool> failed{false};
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            Model& model = kept[t];
+            for (size_t op = 0; op < ops; ++op) {
+                const uint64_t k = (rng() % 2048) * threads + t;
+                switch (rng() % 4) {
+                    case 0:
+                    case 1:
+                        tree.insert(k);
+                        model.insert(k);
+                        break;
+                    case 2:
+                        if (tree.erase(k) != model.erase(k)) failed.store(true);
+                        break;
+                    case 3:
+                        if (tree.contains(k) != (model.count(k) != 0)) failed.store(true);
+                        break;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    CHECK(!failed.load());
+
+    Model all;
+    for (const Model& model : kept)
+        all.insert(model.begin(), model.end());
+    check_tree(tree, all);
+}
+
+int main(int argc, char** argv) {
+    size_t threads = 4;
+    if (argc > 1) threads = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937_64 rng(42);
+    for (uint64_t key_range : {16, 256, 8192})
+        random_ops(rng, 20000, key_range);
+    threaded(threads, 20000);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/* Differential test of CowBTree and its snapshots against std::set.
+ *
+ * Random inserts, erases and lookups run on a tree and on a std::set side by side. Every so
+ * often a snapshot is taken together with a copy of the set; each one must still match its copy
+ * after all the later writes, after some snapshots were dropped, after clear() and after the
+ * tree itself is gone. The optional argument is the number of random operations (20000).
+ *
+ * g++ cow_btree_test.cpp -o cow_btree_test -std=c++17 -O2
+ *
+ */
+
+#include "../cow_btree.hpp"
+#include "test_util.hpp"
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+using Model = std::set<int>;
+
+template <typename View>
+static void check_view(const View& view, const Model& model) {
+    CHECK(view.empty() == model.empty());
+    CHECK(view.size() == model.size());
+    CHECK(same_keys(view, model));
+    CHECK(same_keys_backwards(view, model));
+    CHECK(traversed<int>(view) == std::vector<int>(model.begin(), model.end()));
+}
+
+template <size_t ORDER>
+static void random_ops(std::mt19937& rng, size_t ops, int key_range) {
+    using Tree = btree::CowBTree<int, ORDER>;
+    using Snapshot = typename Tree::snapshot_type;
+
+    auto tree = std::make_unique<Tree>();
+    Model model;
+    std::vector<std::pair<Snapshot, Model>> snapshots;
+
+    for (size_t op = 0; op < ops; ++op) {
+        const int k = static_cast<int>(rng() % key_range);
+        switch (rng() % 5) {
+            case 0:
+            case 1:
+                CHECK(tree->insert(k) == model.insert(k).second);
+                break;
+            case 2:
+                CHECK(tree->erase(k) == (model.erase(k) != 0));
+                break;
+            case 3: {
+                CHECK(tree->contains(k) == (model.count(k) != 0));
+                CHECK(index_of(*tree, tree->lower_bound(k)) == index_of(model, model.lower_bound(k)));
+                break;
+            }
+            case 4:
+                if (rng() % 16 == 0) snapshots.emplace_back(tree->snapshot(), model);
+                if (rng() % 64 == 0 && !snapshots.empty())
+                    snapshots.erase(snapshots.begin() + static_cast<std::ptrdiff_t>(rng() % snapshots.size()));
+                break;
+        }
+        if (op % 64 == 0) check_view(*tree, model);
+    }
+    check_view(*tree, model);
+
+    for (const auto& snapshot : snapshots) {
+        check_view(snapshot.first, snapshot.second);
+        const int lo = static_cast<int>(rng() % key_range);
+        const int hi = lo + static_cast<int>(rng() % 64);
+        const Model& kept = snapshot.second;
+        CHECK(same_keys(snapshot.first.range(lo, hi), Model(kept.lower_bound(lo), kept.lower_bound(hi))));
+        CHECK(index_of(snapshot.first, snapshot.first.upper_bound(lo)) == index_of(kept, kept.upper_bound(lo)));
+        CHECK(snapshot.first.contains(lo) == (kept.count(lo) != 0));
+    }
+
+    // Snapshots keep their contents through clear() and the tree's destruction.
+    const Snapshot last = tree->snapshot();
+    tree->clear();
+    check_view(*tree, Model());
+    tree->insert(1);
+    check_view(*tree, Model{1});
+    tree.reset();
+
+    check_view(last, model);
+    for (const auto& snapshot : snapshots)
+        check_view(snapshot.first, snapshot.second);
+
+    // Copies and moves of a snapshot share its view.
+    if (!snapshots.empty()) {
+        const Model kept = snapshots.back().second;
+        const Snapshot copy = snapshots.back().first;
+        const Snapshot moved = std::move(snapshots.back().first);
+        snapshots.pop_back();
+        check_view(copy, kept);
+        check_view(moved, kept);
+    }
+    const Snapshot empty;
+    CHECK(empty.empty() && empty.begin() == empty.end() && !empty.contains(0));
+}
+
+int main(int argc, char** argv) {
+    size_t ops = 20000;
+    if (argc > 1) ops = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    for (int key_range : {64, 4096}) {
+        random_ops<2>(rng, ops, key_range);
+        random_ops<3>(rng, ops, key_range);
+        random_ops<16>(rng, ops, key_range);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+/* Assertion test of EpochDomain and deallocateBatch.
+ *
+ * Single-threaded: the epoch advances freely while nobody is pinned, at most one step past a
+ * pinned thread, not at all while a nested pin is still held, and domains do not hold each
+ * other back. Then a writer keeps swapping a shared object for a new one, retiring the old one
+ * with the epoch and poisoning it once it is safe, while readers (3 unless given as the first
+ * argument) pin, load the object and check it is not poisoned. Objects are only poisoned, never
+ * freed, so a reader that sees one too late fails a check rather than reading freed memory.
+ *
+ * g++ epoch_test.cpp -o epoch_test -std=c++17 -O2 -pthread
+ *
+ */
+
+#include "../epoch.hpp"
+#include "test_util.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using btree::EpochDomain;
+
+constexpr uint64_t LIVE = 0x600dcafe;
+constexpr uint64_t POISON = 0xdeadbeef;
+
+static void single_thread() {
+    EpochDomain domain;
+    const uint64_t start = domain.epoch();
+    CHECK(domain.tryAdvance() == start + 1);
+    CHECK(domain.tryAdvance() == start + 2);
+    CHECK(domain.epoch() == start + 2);
+
+    const uint64_t retired = domain.epoch();
+    {
+        auto guard = domain.pin();
+        // The global epoch may move past a pinned thread once, never twice.
+        CHECK(domain.tryAdvance() == retired + 1);
+        CHECK(domain.tryAdvance() == retired + 1);
+        CHECK(!EpochDomain::safe(retired, domain.tryAdvance()));
+        {
+            auto nested = domain.pin();
+            CHECK(domain.tryAdvance() == retired + 1);
+        }
+        CHECK(domain.tryAdvance() == retired + 1);
+
+        // Pins of another domain hold that domain back, not this one.
+        EpochDomain other;
+        auto other_guard = other.pin();
+        const uint64_t other_start = other.epoch();
+        CHECK(domain.tryAdvance() == retired + 1);
+        CHECK(other.tryAdvance() == other_start + 1);
+        CHECK(other.tryAdvance() == other_start + 1);
+    }
+    CHECK(domain.tryAdvance() == retired + 2);
+    CHECK(EpochDomain::safe(retired, domain.epoch()));
+
+    // A pin taken after the advance starts in the new epoch and holds that one back.
+    {
+        auto guard = domain.pin();
+        CHECK(domain.tryAdvance() == retired + 3);
+        CHECK(domain.tryAdvance() == retired + 3);
+    }
+}
+
+struct Object {
+    std::atomic<uint64_t> state{LIVE};
+};
+
+static void threaded(size_t readers, size_t swaps) {
+    EpochDomain domain;
+    std::deque<Object> objects(1);  // never shrinks, so a reader's pointer stays valid memory
+    std::atomic<Object*> current{&objects.front()};
+    std::atomic<bool> done{false};
+    std::atomic<bool> failed{false};
+
+    std::vector<std::thread> workers;
+    for (size_t r = 0; r < readers; ++r) {
+        workers.emplace_back([&] {
+            while (!done.load(std::memory_order_acquire)) {
+                auto guard = domain.pin();
+                Object* object = current.load(std::memory_order_acquire);
+                for (int i = 0; i < 8; ++i) {
+                    if (object->state.load(std::memory_order_relaxed) != LIVE) failed.store(true);
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<std::pair<Object*, uint64_t>> retired;
+    size_t poisoned = 0;
+    for (size_t swap = 0; swap < swaps; ++swap) {
+        objects.emplace_back();
+        Object* old = current.exchange(&objects.back(), std::memory_order_acq_rel);
+        retired.emplace_back(old, domain.epoch());
+
+        const uint64_t now = domain.tryAdvance();
+        size_t kept = 0;
+        for (const auto& r : retired) {
+            if (EpochDomain::safe(r.second, now)) {
+                r.first->state.store(POISON, std::memory_order_relaxed);
+                poisoned++;
+            } else {
+                retired[kept++] = r;
+            }
+        }
+        retired.resize(kept);
+        if (swap % 16 == 0) std::this_thread::yield();
+    }
+    done.store(true, std::memory_order_release);
+    for (std::thread& worker : workers)
+        worker.join();
+    CHECK(!failed.load());
+    CHECK(poisoned > 0);
+}
+
+// Counts the blocks it is given back, one at a time or in batches.
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    size_t* single_;
+
+    explicit CountingAllocator(size_t* single) : single_(single) {}
+
+    T* allocate(size_t n) { return std::allocator<T>().allocate(n); }
+    void deallocate(T* p, size_t n) {
+        ++*single_;
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T>
+struct BatchAllocator : CountingAllocator<T> {
+    size_t batches_ = 0;
+
+    using CountingAllocator<T>::CountingAllocator;
+
+    void deallocate_batch(T** ptrs, size_t count, size_t n) {
+        ++batches_;
+        for (size_t i = 0; i < count; ++i)
+            std::allocator<T>().deallocate(ptrs[i], n);
+    }
+};
+
+static void deallocate_batch() {
+    static_assert(!btree::HasDeallocateBatch<std::allocator<int>>::value);
+    static_assert(!btree::HasDeallocateBatch<CountingAllocator<int>>::value);
+    static_assert(btree::HasDeallocateBatch<BatchAllocator<int>>::value);
+
+    size_t single = 0;
+    CountingAllocator<int> counting(&single);
+    std::vector<int*> ptrs;
+    for (int i = 0; i < 5; ++i)
+        ptrs.push_back(counting.allocate(3));
+    btree::deallocateBatch(counting, ptrs.data(), ptrs.size(), 3);
+    CHECK(single == 5);
+
+    BatchAllocator<int> batch(&single);
+    ptrs.clear();
+    for (int i = 0; i < 5; ++i)
+        ptrs.push_back(batch.allocate(3));
+    btree::deallocateBatch(batch, ptrs.data(), ptrs.size(), 3);
+    btree::deallocateBatch(batch, ptrs.data(), 0, 3);
+    CHECK(batch.batches_ == 1 && single == 5);
+}
+
+int main(int argc, char** argv) {
+    size_t readers = 3;
+    if (argc > 1) readers = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    single_thread();
+    threaded(readers, 20000);
+    deallocate_batch();
+    return 0;
+}
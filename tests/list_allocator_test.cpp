@@ -0,0 +1,178 @@
+/* Assertion test of custom_list_allocator under its three policies.
+ *
+ * Random malloc and malloc_aligned calls, of sizes that fill the size classes and spill past
+ * them, run against frees of every kind: one at a time, aligned, and in batches. Each block is
+ * filled with a pattern of its own and checked when it is freed, so blocks that overlap show up.
+ * After every operation the free list and the used bytes must add up to the heap, which starts
+ * small and grows. Once everything is freed no class has a block in use and, outside the size
+ * class policy, no byte is used. The optional argument is the number of operations (20000).
+ *
+ * g++ list_allocator_test.cpp -o list_allocator_test -std=c++17 -O2
+ *
+ */
+
+#include "../example/custom_list_allocator.hpp"
+#include "test_util.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+struct Block {
+    uint8_t* ptr;
+    size_t size;
+    size_t alignment; // 0 for custom_list_malloc
+    uint8_t fill;
+};
+
+static size_t free_bytes(const custom_list_allocator_t* alloc) {
+    size_t bytes = 0;
+    for (const free_node_t* node = alloc->free_list_head; node; node = node->next)
+        bytes += node->size;
+    return bytes;
+}
+
+static size_t class_blocks_in_use(const custom_list_allocator_t* alloc) {
+    size_t blocks = 0;
+    for (size_t i = 0; i < alloc->class_count; ++i)
+        blocks += alloc->classes[i].blocks_in_use;
+    return blocks;
+}
+
+static size_t slab_bytes(const custom_list_allocator_t* alloc) {
+    size_t slabs = 0;
+    for (size_t i = 0; i < alloc->class_count; ++i)
+        slabs += alloc->classes[i].slabs;
+    return slabs * align_size(CUSTOM_LIST_SLAB_SIZE);
+}
+
+static bool intact(const Block& block) {
+    for (size_t i = 0; i < block.size; ++i)
+        if (block.ptr[i] != block.fill) return false;
+    return true;
+}
+
+static Block allocate(custom_list_allocator_t* alloc, std::mt19937& rng, size_t size, size_t alignment) {
+    Block block{nullptr, size, alignment, static_cast<uint8_t>(rng())};
+    block.ptr = static_cast<uint8_t*>(alignment ? custom_list_malloc_aligned(alloc, size, alignment)
+                                                : custom_list_malloc(alloc, size));
+    CHECK(block.ptr != nullptr);
+    CHECK(reinterpret_cast<uintptr_t>(block.ptr) % std::max(alignment, sizeof(void*)) == 0);
+    std::fill(block.ptr, block.ptr + size, block.fill);
+    return block;
+}
+
+// Takes block i out of live, checking it on the way.
+static Block take(std::vector<Block>& live, size_t i) {
+    const Block block = live[i];
+    CHECK(intact(block));
+    live[i] = live.back();
+    live.pop_back();
+    return block;
+}
+
+static void release(custom_list_allocator_t* alloc, const Block& block) {
+    if (block.alignment)
+        custom_list_free_aligned(alloc, block.ptr, block.size, block.alignment);
+    else
+        custom_list_free(alloc, block.ptr);
+}
+
+// Frees up to count plain blocks with custom_list_free_batch, or every block of the same size
+// and alignment as a random aligned one with custom_list_free_aligned_batch.
+static void release_batch(custom_list_allocator_t* alloc, std::mt19937& rng, std::vector<Block>& live) {
+    const Block& pick = live[rng() % live.size()];
+    const size_t size = pick.size;
+    const size_t alignment = pick.alignment;
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < live.size();) {
+        const bool goes = alignment ? live[i].alignment == alignment && live[i].size == size
+                                    : live[i].alignment == 0 && ptrs.size() < 16 && rng() % 2 == 0;
+        if (goes)
+            ptrs.push_back(take(live, i).ptr);
+        else
+            ++i;
+    }
+    if (rng() % 4 == 0) ptrs.push_back(nullptr);
+    if (alignment)
+        custom_list_free_aligned_batch(alloc, ptrs.data(), ptrs.size(), size, alignment);
+    else
+        custom_list_free_batch(alloc, ptrs.data(), ptrs.size());
+}
+
+static void random_ops(std::mt19937& rng, alloc_policy_t policy, size_t ops) {
+    static const size_t SIZES[] = {1, 8, 24, 40, 100, 256, 1000, 5000, 20000};
+    static const size_t ALIGNMENTS[] = {8, 16, 64, 256, 4096};
+
+    custom_list_heap_options_t options = custom_list_default_heap_options();
+    options.grow_size = 1024 * 1024;
+    custom_list_allocator_t* alloc = custom_list_alloc_create_ex(256 * 1024, policy, &options);
+    CHECK(alloc != nullptr);
+
+    std::vector<Block> live;
+    for (size_t op = 0; op < ops; ++op) {
+        const size_t kind = rng() % 8;
+        if (live.empty() || kind < 3) {
+            // Now and then a size of its own, so the size class policy runs out of classes.
+            const size_t size = (rng() % 16 == 0) ? 1 + rng() % 2000 : SIZES[rng() % 9];
+            live.push_back(allocate(alloc, rng, size, 0));
+        } else if (kind < 5) {
+            const size_t size = (rng() % 16 == 0) ? 1 + rng() % 2000 : SIZES[rng() % 9];
+            live.push_back(allocate(alloc, rng, size, ALIGNMENTS[rng() % 5]));
+        } else if (kind < 7) {
+            release(alloc, take(live, rng() % live.size()));
+        } else {
+            release_batch(alloc, rng, live);
+        }
+        CHECK(free_bytes(alloc) + alloc->used_size == alloc->total_size);
+    }
+
+    while (!live.empty())
+        release(alloc, take(live, live.size() - 1));
+    CHECK(free_bytes(alloc) + alloc->used_size == alloc->total_size);
+    CHECK(class_blocks_in_use(alloc) == 0);
+    CHECK(alloc->used_size == slab_bytes(alloc));
+    if (policy != ALLOC_POLICY_SIZE_CLASS) CHECK(alloc->class_count == 0 && alloc->used_size == 0);
+    custom_list_alloc_destroy(alloc);
+}
+
+// Once every class is taken, the next size is a list block, and freeing it gives back its bytes.
+static void classes_full() {
+    custom_list_allocator_t* alloc = custom_list_alloc_create(4 * 1024 * 1024, ALLOC_POLICY_SIZE_CLASS);
+    CHECK(alloc != nullptr);
+
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < CUSTOM_LIST_MAX_SIZE_CLASSES; ++i)
+        ptrs.push_back(custom_list_malloc(alloc, 16 * (i + 1)));
+    CHECK(alloc->class_count == CUSTOM_LIST_MAX_SIZE_CLASSES);
+    CHECK(class_blocks_in_use(alloc) == CUSTOM_LIST_MAX_SIZE_CLASSES);
+
+    const size_t used = alloc->used_size;
+    void* spilled = custom_list_malloc(alloc, 1000);
+    void* spilled_aligned = custom_list_malloc_aligned(alloc, 1000, 64);
+    CHECK(spilled != nullptr && spilled_aligned != nullptr);
+    CHECK(reinterpret_cast<uintptr_t>(spilled_aligned) % 64 == 0);
+    CHECK(alloc->used_size > used);
+    CHECK(class_blocks_in_use(alloc) == CUSTOM_LIST_MAX_SIZE_CLASSES);
+    custom_list_free(alloc, spilled);
+    custom_list_free_aligned(alloc, spilled_aligned, 1000, 64);
+    CHECK(alloc->used_size == used);
+
+    custom_list_free_batch(alloc, ptrs.data(), ptrs.size());
+    CHECK(class_blocks_in_use(alloc) == 0);
+    CHECK(alloc->used_size == slab_bytes(alloc));
+    CHECK(free_bytes(alloc) + alloc->used_size == alloc->total_size);
+    custom_list_alloc_destroy(alloc);
+}
+
+int main(int argc, char** argv) {
+    size_t ops = 20000;
+    if (argc > 1) ops = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    for (alloc_policy_t policy : {ALLOC_POLICY_FIRST_FIT, ALLOC_POLICY_BEST_FIT, ALLOC_POLICY_SIZE_CLASS})
+        random_ops(rng, policy, ops);
+    classes_full();
+    return 0;
+}
@@ -0,0 +1,185 @@
+/* Assertion test of custom_mt_allocator across threads.
+ *
+ * Threads (4 unless given as the first argument) allocate blocks of a few size classes, of a
+ * size without a class and aligned ones, then free half of their neighbour's, so plain blocks
+ * go back through the owner's remote lists and aligned ones into the freeing thread's cache.
+ * They allocate again and free those blocks themselves, then free the other half of their
+ * neighbour's just before all of them exit, with the remote lists still full. Each block
+ * carries a pattern of its own that is checked before it is freed, so a block handed out twice
+ * shows up. A second wave of threads does the same once the first has exited and must adopt its
+ * retired caches instead of making new ones. At the end the shared pool holds every class block
+ * exactly once and the heap holds nothing but slabs.
+ *
+ * g++ mt_allocator_test.cpp -o mt_allocator_test -std=c++17 -O2 -pthread
+ *
+ */
+
+#include "../example/custom_mt_allocator.hpp"
+#include "test_util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+constexpr size_t BLOCKS = 2000;
+
+struct Block {
+    uint8_t* ptr;
+    size_t size;
+    size_t alignment; // 0 for custom_mt_malloc
+    uint8_t fill;
+};
+
+// Lets the threads of a wave through once all of them have arrived.
+class Barrier {
+public:
+    explicit Barrier(size_t threads) : threads_(threads) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock_);
+        const size_t round = round_;
+        if (++waiting_ == threads_) {
+            waiting_ = 0;
+            round_++;
+            wake_.notify_all();
+        } else {
+            wake_.wait(guard, [&] { return round_ != round; });
+        }
+    }
+
+private:
+    std::mutex lock_;
+    std::condition_variable wake_;
+    size_t threads_;
+    size_t waiting_ = 0;
+    size_t round_ = 0;
+};
+
+// Block i of a thread: mostly plain class sizes, now and then one too big for a class or an
+// aligned one.
+static Block allocate(custom_mt_allocator_t* alloc, size_t t, size_t i) {
+    static const size_t SIZES[] = {8, 48, 200, 1000};
+    Block block{nullptr, SIZES[i % 4], 0, static_cast<uint8_t>(t * 31 + i)};
+    if (i % 16 == 4 || i % 16 == 9) block.size = CUSTOM_LIST_MAX_CLASS_BLOCK;
+    if (i % 8 == 2) block = Block{nullptr, 128, 64, block.fill};
+    if (i % 8 == 6) block = Block{nullptr, 512, 256, block.fill};
+
+    block.ptr = static_cast<uint8_t*>(block.alignment ? custom_mt_malloc_aligned(alloc, block.size, block.alignment)
+                                                      : custom_mt_malloc(alloc, block.size));
+    if (block.ptr) std::fill(block.ptr, block.ptr + block.size, block.fill);
+    return block;
+}
+
+static bool intact(const Block& block) {
+    if (!block.ptr) return false;
+    if (reinterpret_cast<uintptr_t>(block.ptr) % std::max(block.alignment, sizeof(void*)) != 0) return false;
+    for (size_t i = 0; i < block.size; ++i)
+        if (block.ptr[i] != block.fill) return false;
+    return true;
+}
+
+static void release(custom_mt_allocator_t* alloc, Block& block) {
+    if (block.alignment)
+        custom_mt_free_aligned(alloc, block.ptr, block.size, block.alignment);
+    else
+        custom_mt_free(alloc, block.ptr);
+    block.ptr = nullptr;
+}
+
+static void wave(custom_mt_allocator_t* alloc, size_t threads) {
+    std::vector<std::vector<Block>> blocks(threads);
+    Barrier barrier(threads);
+    std::atomic<bool> failed{false};
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<Block>& mine = blocks[t];
+            for (size_t i = 0; i < BLOCKS; ++i)
+                mine.push_back(allocate(alloc, t, i));
+            barrier.wait();
+
+            // The neighbour's even blocks; it is still running, so these are remote frees.
+            std::vector<Block>& theirs = blocks[(t + 1) % threads];
+            for (size_t i = 0; i < BLOCKS; i += 2) {
+                if (!intact(theirs[i])) failed.store(true);
+                release(alloc, theirs[i]);
+            }
+            barrier.wait();
+
+            // Enough new blocks to take back the remote lists, freed again by their owner.
+            for (size_t i = BLOCKS; i < BLOCKS + BLOCKS / 2; ++i)
+                mine.push_back(allocate(alloc, t, i));
+            for (size_t i = BLOCKS; i < mine.size(); ++i) {
+                if (!intact(mine[i])) failed.store(true);
+                release(alloc, mine[i]);
+            }
+            barrier.wait();
+
+            // The neighbour's odd blocks, which leaves its remote lists full when it exits.
+            for (size_t i = 1; i < BLOCKS; i += 2) {
+                if (!intact(theirs[i])) failed.store(true);
+                release(alloc, theirs[i]);
+            }
+            barrier.wait();
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    CHECK(!failed.load());
+}
+
+static size_t caches(const custom_mt_allocator_t* alloc) {
+    size_t count = 0;
+    for (const mt_cache_t* cache = alloc->caches; cache; cache = cache->next_cache) {
+        CHECK(cache->retired.load());
+        count++;
+    }
+    return count;
+}
+
+// With every thread gone, each class block is back in the shared pool, once.
+static void check_pool(const custom_mt_allocator_t* alloc) {
+    std::set<const mt_block_t*> seen;
+    size_t slabs = 0;
+    for (size_t c = 0; c < alloc->class_count.load(); ++c) {
+        const mt_class_t& size_class = alloc->classes[c];
+        size_t count = 0;
+        for (const mt_block_t* block = size_class.free_blocks; block; block = block->next) {
+            CHECK(seen.insert(block).second);
+            count++;
+        }
+        CHECK(count == size_class.free_count);
+        CHECK(count * size_class.block_size <= size_class.slabs * CUSTOM_LIST_SLAB_SIZE);
+        slabs += size_class.slabs;
+    }
+    CHECK(alloc->heap->used_size == slabs * align_size(CUSTOM_LIST_SLAB_SIZE + sizeof(size_t)));
+}
+
+int main(int argc, char** argv) {
+    size_t threads = 4;
+    if (argc > 1) threads = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    custom_mt_allocator_t* alloc = custom_mt_alloc_create(128 * 1024 * 1024);
+    CHECK(alloc != nullptr);
+
+    wave(alloc, threads);
+    CHECK(caches(alloc) == threads);
+    CHECK(alloc->refills.load() > 0 && alloc->flushes.load() > 0);
+    if (threads > 1) CHECK(alloc->remote_frees.load() > 0);
+    check_pool(alloc);
+
+    const size_t remote_frees = alloc->remote_frees.load();
+    wave(alloc, threads);
+    CHECK(caches(alloc) == threads);
+    if (threads > 1) CHECK(alloc->remote_frees.load() > remote_frees);
+    check_pool(alloc);
+
+    custom_mt_alloc_destroy(alloc);
+    return 0;
+}
@@ -0,0 +1,168 @@
+/* Differential test of WorkStealingPool and the parallel BTree operations.
+ *
+ * The pool must call every index of a run exactly once, also for runs started from inside a
+ * task and from several outside threads at once, and rethrow an exception a call throws only
+ * after all other calls are done, staying usable afterwards. parallel_build must give the same
+ * keys as bulk_load_unsorted for multi, unique and counted trees of any size and fill, and the
+ * trees it builds must keep matching a std::multiset through later inserts and erases.
+ * parallel_for_each must visit every key once and parallel_reduce fold them in key order. Pools
+ * of 1 to 4 threads unless the first argument says otherwise.
+ *
+ * g++ parallel_test.cpp -o parallel_test -std=c++17 -O2 -pthread
+ *
+ */
+
+#include "../btree.hpp"
+#include "test_util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using btree::WorkStealingPool;
+
+template <size_t ORDER, typename Duplicates>
+using Tree = btree::BTree<int, ORDER, std::allocator<int>, btree::default_search, btree::no_stats, Duplicates>;
+
+template <typename Duplicates>
+using Model = std::conditional_t<Duplicates::UNIQUE && !Duplicates::COUNTED, std::set<int>, std::multiset<int>>;
+
+// Each index of a run of count calls was seen exactly once.
+static bool once_each(const std::vector<std::atomic<int>>& seen) {
+    return std::all_of(seen.begin(), seen.end(), [](const std::atomic<int>& s) { return s.load() == 1; });
+}
+
+static void pool_runs(size_t threads) {
+    WorkStealingPool pool(threads);
+    CHECK(pool.size() == threads);
+    pool.run(0, [](size_t) { CHECK(false); });
+
+    for (size_t count : {1, 7, 1000}) {
+        std::vector<std::atomic<int>> seen(count);
+        pool.run(count, [&](size_t i) { seen[i].fetch_add(1); });
+        CHECK(once_each(seen));
+    }
+
+    // Runs started from inside tasks.
+    constexpr size_t OUTER = 16;
+    constexpr size_t INNER = 50;
+    std::vector<std::atomic<int>> pairs(OUTER * INNER);
+    pool.run(OUTER, [&](size_t i) { pool.run(INNER, [&](size_t j) { pairs[i * INNER + j].fetch_add(1); }); });
+    CHECK(once_each(pairs));
+
+    // The first exception comes back once every other call has run.
+    std::vector<std::atomic<int>> calls(200);
+    bool thrown = false;
+    try {
+        pool.run(calls.size(), [&](size_t i) {
+            calls[i].fetch_add(1);
+            if (i % 50 == 3) throw std::runtime_error("task");
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(once_each(calls));
+
+    // Runs from several threads outside the pool at the same time.
+    std::vector<std::atomic<int>> shared(4 * 500);
+    std::vector<std::thread> callers;
+    for (size_t c = 0; c < 4; ++c) {
+        callers.emplace_back([&, c] { pool.run(500, [&](size_t i) { shared[c * 500 + i].fetch_add(1); }); });
+    }
+    for (std::thread& caller : callers)
+        caller.join();
+    CHECK(once_each(shared));
+}
+
+// Collects the keys it is called with, for parallel_reduce.
+struct Collect {
+    std::vector<int> keys_;
+    void operator()(const int& key) { keys_.push_back(key); }
+};
+
+template <size_t ORDER, typename Duplicates>
+static void check_parallel_reads(const Tree<ORDER, Duplicates>& tree, const Model<Duplicates>& model,
+                                 WorkStealingPool& pool) {
+    const std::vector<int> expected(model.begin(), model.end());
+
+    std::mutex lock;
+    std::vector<int> visited;
+    tree.parallel_for_each(
+        [&](const int& key) {
+            std::lock_guard<std::mutex> guard(lock);
+            visited.push_back(key);
+        },
+        pool);
+    std::sort(visited.begin(), visited.end());
+    CHECK(visited == expected);
+
+    const Collect reduced = tree.parallel_reduce(
+        Collect(), [](Collect& total, Collect&& part) {
+            total.keys_.insert(total.keys_.end(), part.keys_.begin(), part.keys_.end());
+        },
+        pool);
+    CHECK(reduced.keys_ == expected);
+}
+
+template <size_t ORDER, typename Duplicates>
+static void builds(std::mt19937& rng, WorkStealingPool& pool) {
+    for (size_t n : {0, 1, 5, 100, 3000, 20000}) {
+        for (double fill : {1.0, 0.7, 0.5}) {
+            const int key_range = (rng() % 2) ? 64 : 1 << 20;
+            std::vector<int> keys(n);
+            for (int& key : keys)
+                key = static_cast<int>(rng() % key_range);
+
+            Tree<ORDER, Duplicates> tree;
+            Tree<ORDER, Duplicates> serial;
+            tree.insert(-1);  // replaced by the build
+            tree.parallel_build(keys.begin(), keys.end(), pool, fill);
+            serial.bulk_load_unsorted(keys.begin(), keys.end(), fill);
+            Model<Duplicates> model(keys.begin(), keys.end());
+            CHECK(traversed<int>(tree) == traversed<int>(serial));
+            CHECK(traversed<int>(tree) == std::vector<int>(model.begin(), model.end()));
+            check_parallel_reads(tree, model, pool);
+
+            // The built tree takes inserts and erases like any other.
+            for (size_t op = 0; op < 2000; ++op) {
+                const int k = static_cast<int>(rng() % key_range);
+                if (rng() % 2) {
+                    tree.insert(k);
+                    model.insert(k);
+                } else {
+                    const auto m = model.find(k);
+                    CHECK(tree.erase_one(k) == (m != model.end()));
+                    if (m != model.end()) model.erase(m);
+                }
+            }
+            CHECK(traversed<int>(tree) == std::vector<int>(model.begin(), model.end()));
+            check_parallel_reads(tree, model, pool);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t max_threads = 4;
+    if (argc > 1) max_threads = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    for (size_t threads = 1; threads <= max_threads; ++threads) {
+        pool_runs(threads);
+
+        WorkStealingPool pool(threads);
+        builds<2, btree::multi_keys>(rng, pool);
+        builds<16, btree::multi_keys>(rng, pool);
+        builds<3, btree::unique_keys>(rng, pool);
+        builds<3, btree::counted_keys<>>(rng, pool);
+    }
+    return 0;
+}
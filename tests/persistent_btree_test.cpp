@@ -0,0 +1,100 @@
+/* Differential test of PersistentBTree against std::multiset.
+ *
+ * Random inserts, erases and lookups run on a file-backed tree and on a std::multiset side by
+ * side, with small pages so the tree grows several levels and the file is remapped often. The
+ * tree is closed and reopened from its file every few thousand operations and must come back
+ * with the same keys. A file of another key size or page size, or of no tree at all, is refused.
+ *
+ * The file path is the first argument (/tmp/persistent_btree_test.db by default).
+ *
+ * g++ persistent_btree_test.cpp -o persistent_btree_test -std=c++17 -O2
+ *
+ */
+
+#include "../persistent_btree.hpp"
+#include "test_util.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using Tree = btree::PersistentBTree<uint64_t, 256>;
+using Model = std::multiset<uint64_t>;
+
+static void check_tree(const Tree& tree, const Model& model) {
+    CHECK(tree.empty() == model.empty());
+    CHECK(traversed<uint64_t>(tree) == std::vector<uint64_t>(model.begin(), model.end()));
+}
+
+template <typename Other>
+static bool refused(const std::string& path) {
+    try {
+        Other other(path);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    const std::string path = argc > 1 ? argv[1] : "/tmp/persistent_btree_test.db";
+    ::unlink(path.c_str());
+
+    std::mt19937_64 rng(42);
+    Model model;
+    auto tree = std::make_unique<Tree>(path);
+    check_tree(*tree, model);
+
+    for (size_t round = 0; round < 12; ++round) {
+        // Rounds alternate between growing the tree and shrinking it.
+        const uint64_t key_range = (round % 3 == 2) ? 64 : 4096;
+        const size_t erase_share = (round % 2) ? 3 : 1;
+        for (size_t op = 0; op < 4000; ++op) {
+            const uint64_t k = rng() % key_range;
+            const size_t kind = rng() % 6;
+            if (kind < erase_share) {
+                CHECK(tree->erase(k) == model.erase(k));
+            } else if (kind < 5) {
+                tree->insert(k);
+                model.insert(k);
+            } else {
+                CHECK(tree->contains(k) == (model.count(k) != 0));
+                CHECK(tree->count(k) == model.count(k));
+            }
+            if (op % 256 == 0) check_tree(*tree, model);
+        }
+        check_tree(*tree, model);
+
+        if (round % 4 == 3) tree->sync();
+        const size_t pages = tree->pages();
+        tree.reset();
+        tree = std::make_unique<Tree>(path);
+        CHECK(tree->pages() == pages);
+        check_tree(*tree, model);
+    }
+
+    // The same file read with another page size or key type, and a file that holds no tree.
+    tree.reset();
+    CHECK(refused<btree::PersistentBTree<uint64_t, 512>>(path));
+    CHECK(refused<btree::PersistentBTree<uint32_t, 256>>(path));
+    tree = std::make_unique<Tree>(path);
+    check_tree(*tree, model);
+    tree.reset();
+
+    const std::string junk = path + ".junk";
+    if (std::FILE* f = std::fopen(junk.c_str(), "wb")) {
+        const std::vector<unsigned char> bytes(4 * 256, 0x42);
+        CHECK(std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size());
+        std::fclose(f);
+    }
+    CHECK(refused<Tree>(junk));
+
+    ::unlink(junk.c_str());
+    ::unlink(path.c_str());
+    return 0;
+}
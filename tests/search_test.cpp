@@ -0,0 +1,117 @@
+/* Differential test of the intra-node search policies against std::lower_bound/upper_bound.
+ *
+ * linear_search, binary_search and simd_search answer lower_bound and upper_bound over random
+ * sorted arrays of int32_t, uint32_t, int64_t, uint64_t, float and double at every length from 0
+ * to 2 * ORDER - 1, i.e. every key count a node can hold. Keys are drawn from small ranges with
+ * the type's extremes mixed in, so arrays hold runs of duplicates, INT_MIN, UINT_MAX and
+ * infinities; probes are every key present, its neighbours, the extremes and random values.
+ *
+ * Which simd_search kernels run depends on the instruction set the test is compiled for; CMake
+ * builds it for the default target and, where this machine runs them, for SSE4.2 and AVX2.
+ *
+ * g++ search_test.cpp -o search_test -std=c++17 -O2 [-msse4.2 | -mavx2]
+ *
+ */
+
+#include "../btree_search.hpp"
+#include "test_util.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+constexpr size_t ORDER = 64;
+constexpr size_t MAX_KEYS = 2 * ORDER - 1;
+
+template <typename T>
+static std::vector<T> extremes() {
+    using limits = std::numeric_limits<T>;
+    std::vector<T> values{limits::lowest(), limits::max(), T(0), T(1)};
+    if constexpr (std::is_signed<T>::value) values.push_back(T(-1));
+    if constexpr (std::is_integral<T>::value) {
+        values.push_back(T(limits::lowest() + 1));
+        values.push_back(T(limits::max() - 1));
+        // Either side of the sign bit the unsigned kernels flip.
+        values.push_back(T(T(1) << (sizeof(T) * 8 - 2)));
+        values.push_back(T(limits::max() / 2));
+    } else {
+        values.push_back(-limits::infinity());
+        values.push_back(limits::infinity());
+        values.push_back(T(-0.0));
+        values.push_back(limits::min());
+    }
+    return values;
+}
+
+// Mostly values in a range about as wide as the array, so duplicates are common, with an
+// extreme now and then.
+template <typename T>
+static T random_key(std::mt19937_64& rng, size_t spread, const std::vector<T>& special) {
+    if (rng() % 8 == 0) return special[rng() % special.size()];
+    const auto v = static_cast<int64_t>(rng() % (spread + 1));
+    if constexpr (std::is_signed<T>::value) return T(v - static_cast<int64_t>(spread / 2));
+    return T(v);
+}
+
+template <typename Policy, typename T>
+static void check_policy(const T* keys, size_t n, const T& k) {
+    const size_t lower = static_cast<size_t>(std::lower_bound(keys, keys + n, k) - keys);
+    const size_t upper = static_cast<size_t>(std::upper_bound(keys, keys + n, k) - keys);
+    CHECK(Policy::lower_bound(keys, n, k, std::less<T>()) == lower);
+    CHECK(Policy::upper_bound(keys, n, k, std::less<T>()) == upper);
+    CHECK(Policy::lower_bound(keys, n, k, std::less<>()) == lower);
+    CHECK(Policy::upper_bound(keys, n, k, std::less<>()) == upper);
+}
+
+template <typename T>
+static void check_all(const T* keys, size_t n, const T& k) {
+    check_policy<btree::linear_search>(keys, n, k);
+    check_policy<btree::binary_search>(keys, n, k);
+    check_policy<btree::simd_search>(keys, n, k);
+}
+
+template <typename T>
+static void run(std::mt19937_64& rng) {
+    const std::vector<T> special = extremes<T>();
+    for (size_t n = 0; n <= MAX_KEYS; ++n) {
+        for (int round = 0; round < 20; ++round) {
+            const size_t spread = (round % 2) ? n : 4 * n + 8;
+            std::vector<T> keys(n);
+            for (T& key : keys)
+                key = random_key(rng, spread, special);
+            std::sort(keys.begin(), keys.end());
+
+            // The same keys one slot further on, so the vector loads start off their usual alignment.
+            std::vector<T> shifted(n + 1);
+            std::copy(keys.begin(), keys.end(), shifted.begin() + 1);
+
+            std::vector<T> probes(special);
+            for (const T& key : keys) {
+                probes.push_back(key);
+                if (key > std::numeric_limits<T>::lowest()) probes.push_back(T(key - 1));
+                if (key < std::numeric_limits<T>::max()) probes.push_back(T(key + 1));
+            }
+            for (int i = 0; i < 16; ++i)
+                probes.push_back(random_key(rng, spread, special));
+
+            for (const T& k : probes) {
+                check_all(keys.data(), n, k);
+                check_all(shifted.data() + 1, n, k);
+            }
+        }
+    }
+}
+
+int main() {
+    std::mt19937_64 rng(42);
+    run<int32_t>(rng);
+    run<uint32_t>(rng);
+    run<int64_t>(rng);
+    run<uint64_t>(rng);
+    run<float>(rng);
+    run<double>(rng);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/* Assertion test of BTree::stats() under collect_stats and no_stats.
+ *
+ * The same random inserts, erases and lookups run on a tree with collect_stats and on one with
+ * no_stats. Both must report the same shape: as many keys as the model, levels that add up to
+ * the node count, a fill histogram over every node and its average. collect_stats must count
+ * every insert and lookup, sample their latencies as often as it was told, see no merge before
+ * the first erase, and keep nodes equal to height plus splits minus merges, since each split
+ * adds a node and each merge, or the root it empties, takes one away. Lookups from several
+ * threads on a const tree are all counted. The optional argument is the number of random
+ * operations per tree (20000).
+ *
+ * g++ stats_test.cpp -o stats_test -std=c++17 -O2 -pthread
+ *
+ */
+
+#include "../btree.hpp"
+#include "test_util.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+template <size_t ORDER, typename Stats>
+using Tree = btree::BTree<int, ORDER, std::allocator<int>, btree::default_search, Stats>;
+using Model = std::multiset<int>;
+
+static bool has_field(const std::string& json, const char* name, uint64_t value) {
+    return json.find("\"" + std::string(name) + "\":" + std::to_string(value)) != std::string::npos;
+}
+
+template <size_t ORDER>
+static void check_shape(const btree::TreeStats& s, const Model& model) {
+    constexpr size_t MAX_KEYS = 2 * ORDER - 1;
+    CHECK(s.order_ == ORDER);
+    CHECK(s.keys_ == model.size());
+    CHECK(s.height_ == s.nodes_per_level_.size());
+    CHECK(std::accumulate(s.nodes_per_level_.begin(), s.nodes_per_level_.end(), size_t(0)) == s.nodes_);
+    if (s.height_ > 0) CHECK(s.nodes_per_level_[0] == 1);
+    for (size_t level = 1; level < s.height_; ++level)
+        CHECK(s.nodes_per_level_[level] > s.nodes_per_level_[level - 1]);
+    CHECK(std::accumulate(s.fill_, s.fill_ + btree::TreeStats::FILL_BUCKETS, size_t(0)) == s.nodes_);
+    CHECK(s.bytes_ >= s.nodes_ * btree::CACHE_LINE_SIZE);
+    if (s.nodes_ > 0)
+        CHECK(s.average_fill_ == static_cast<double>(s.keys_) / static_cast<double>(s.nodes_ * MAX_KEYS));
+
+    const std::string json = s.to_json();
+    CHECK(json.front() == '{' && json.back() == '}');
+    CHECK(has_field(json, "keys", s.keys_) && has_field(json, "nodes", s.nodes_));
+    CHECK(has_field(json, "height", s.height_));
+}
+
+template <size_t ORDER, size_t SAMPLE_EVERY>
+static void random_ops(std::mt19937& rng, size_t ops, int key_range) {
+    Tree<ORDER, btree::collect_stats<SAMPLE_EVERY>> tree;
+    Tree<ORDER, btree::no_stats> plain;
+    Model model;
+    uint64_t inserts = 0;
+    uint64_t searches = 0;
+    bool erased = false;
+
+    for (size_t op = 0; op < ops; ++op) {
+        const int k = static_cast<int>(rng() % key_range);
+        // Grows over the first half, then erases as often as it inserts.
+        const size_t kind = rng() % 4;
+        if (kind < 2 || (kind == 2 && op < ops / 2)) {
+            tree.insert(k);
+            plain.insert(k);
+            model.insert(k);
+            inserts++;
+        } else if (kind == 2) {
+            CHECK(tree.erase(k) == plain.erase(k));
+            model.erase(k);
+            erased = true;
+        } else {
+            CHECK(tree.contains(k) == (model.count(k) != 0));
+            CHECK((tree.find(k) == tree.end()) == (model.count(k) == 0));
+            searches += 2;
+        }
+
+        if (op % 256 == 0 || op + 1 == ops) {
+            const btree::TreeStats s = tree.stats();
+            const btree::TreeStats p = plain.stats();
+            check_shape<ORDER>(s, model);
+            check_shape<ORDER>(p, model);
+            CHECK(s.nodes_ == p.nodes_ && s.nodes_per_level_ == p.nodes_per_level_ && s.bytes_ == p.bytes_);
+
+            CHECK(s.counters_ && !p.counters_);
+            CHECK(p.splits_ == 0 && p.merges_ == 0 && p.searches_ == 0 && p.inserts_ == 0);
+            CHECK(s.inserts_ == inserts && s.searches_ == searches);
+            CHECK(s.insert_latency_.samples_ == inserts / SAMPLE_EVERY);
+            CHECK(s.search_latency_.samples_ == searches / SAMPLE_EVERY);
+            if (!erased) CHECK(s.merges_ == 0);
+            CHECK(s.nodes_ == s.height_ + s.splits_ - s.merges_);
+
+            const std::string json = s.to_json();
+            CHECK(has_field(json, "splits", s.splits_) && has_field(json, "merges", s.merges_));
+            CHECK(has_field(json, "inserts", inserts) && has_field(json, "searches", searches));
+            CHECK(p.to_json().find("\"counters\":false") != std::string::npos);
+        }
+    }
+    CHECK(tree.stats().merges_ > 0);
+
+    // Const lookups from several threads count every one.
+    const auto& shared = tree;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&shared, key_range] {
+            for (int k = 0; k < key_range; ++k)
+                (void) shared.contains(k);
+        });
+    }
+    for (std::thread& reader : readers)
+        reader.join();
+    CHECK(tree.stats().searches_ == searches + 4 * static_cast<uint64_t>(key_range));
+}
+
+static void latency_histogram() {
+    using btree::LatencyHistogram;
+    CHECK(LatencyHistogram::bucketOf(0) == 0 && LatencyHistogram::bucketOf(1) == 0);
+    CHECK(LatencyHistogram::bucketOf(2) == 1 && LatencyHistogram::bucketOf(3) == 1);
+    CHECK(LatencyHistogram::bucketOf(uint64_t(1) << 20) == 20);
+    CHECK(LatencyHistogram::bucketOf(UINT64_MAX) == LatencyHistogram::BUCKETS - 1);
+
+    LatencyHistogram h;
+    CHECK(h.quantile(0.5) == 0);
+    for (int i = 0; i < 99; ++i)
+        h.record(5);
+    h.record(1000);
+    CHECK(h.samples_ == 100);
+    CHECK(h.quantile(0.5) == 7 && h.quantile(0.99) == 7);
+    CHECK(h.quantile(1.0) == 1023);
+}
+
+int main(int argc, char** argv) {
+    size_t ops = 20000;
+    if (argc > 1) ops = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    latency_histogram();
+    for (int key_range : {64, 4096}) {
+        random_ops<2, 1>(rng, ops, key_range);
+        random_ops<3, 64>(rng, ops, key_range);
+        random_ops<16, 7>(rng, ops, key_range);
+    }
+    return 0;
+}
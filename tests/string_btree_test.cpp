@@ -0,0 +1,95 @@
+/* Differential test of StringBTree against std::set<std::string>.
+ *
+ * Random inserts, erases and lookups run on both side by side at two node sizes. Keys share
+ * long prefixes, as URLs and paths do, and range from empty to MAX_KEY_BYTES, so nodes split on
+ * bytes rather than counts and prefix compression is exercised. The optional argument is the
+ * number of random operations per tree (20000).
+ *
+ * g++ string_btree_test.cpp -o string_btree_test -std=c++17 -O2
+ *
+ */
+
+#include "../string_btree.hpp"
+#include "test_util.hpp"
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using Model = std::set<std::string>;
+
+template <typename Tree>
+static void check_tree(const Tree& tree, const Model& model) {
+    CHECK(tree.empty() == model.empty());
+    CHECK(tree.size() == model.size());
+    CHECK(same_keys(tree, model));
+    CHECK(traversed<std::string>(tree) == std::vector<std::string>(model.begin(), model.end()));
+}
+
+// One of a few shared prefixes, then a tail of random length over a small alphabet.
+static std::string random_key(std::mt19937& rng, size_t max_bytes) {
+    static const char* const PREFIXES[] = {"", "a", "https://example.com/", "https://example.com/static/img/",
+                                           "/usr/local/share/"};
+    std::string key = PREFIXES[rng() % 5];
+    const size_t tail = (rng() % 8 == 0) ? rng() % max_bytes : rng() % 12;
+    while (key.size() < max_bytes && key.size() < tail + 1)
+        key.push_back(static_cast<char>('a' + rng() % 4));
+    if (key.size() > max_bytes) key.resize(max_bytes);
+    return key;
+}
+
+template <size_t NODE_BYTES>
+static void random_ops(std::mt19937& rng, size_t ops) {
+    using Tree = btree::StringBTree<NODE_BYTES>;
+    Tree tree;
+    Model model;
+
+    for (size_t op = 0; op < ops; ++op) {
+        const std::string key = random_key(rng, Tree::MAX_KEY_BYTES);
+        switch (rng() % 5) {
+            case 0:
+            case 1:
+            case 2:
+                CHECK(tree.insert(key) == model.insert(key).second);
+                break;
+            case 3:
+                CHECK(tree.erase(key) == model.erase(key));
+                break;
+            case 4:
+                CHECK(tree.contains(key) == (model.count(key) != 0));
+                CHECK(tree.count(key) == model.count(key));
+                break;
+        }
+        if (op % 256 == 0) check_tree(tree, model);
+    }
+    check_tree(tree, model);
+
+    bool thrown = false;
+    try {
+        tree.insert(std::string(Tree::MAX_KEY_BYTES + 1, 'x'));
+    } catch (const std::length_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    // Erasing everything in order, then reusing the tree.
+    for (const std::string& key : Model(model))
+        CHECK(tree.erase(key) == model.erase(key));
+    check_tree(tree, model);
+    CHECK(tree.nodes() == 1);
+    CHECK(tree.insert(""));
+    tree.clear();
+    check_tree(tree, Model());
+}
+
+int main(int argc, char** argv) {
+    size_t ops = 20000;
+    if (argc > 1) ops = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+
+    std::mt19937 rng(42);
+    random_ops<512>(rng, ops);
+    random_ops<2048>(rng, ops);
+    return 0;
+}
@@ -0,0 +1,60 @@
+/* Helpers shared by the differential tests: every container is driven with the same random
+ * operations as its std:: counterpart and the two are compared as they go.
+ *
+ * CHECK stays on in release builds, unlike assert.
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <vector>
+
+#define CHECK(...)                                                                               \
+    do {                                                                                         \
+        if (!(__VA_ARGS__)) {                                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #__VA_ARGS__); \
+            std::exit(1);                                                                        \
+        }                                                                                        \
+    } while (0)
+
+// range holds the keys of expected, in the same order.
+template <typename Range, typename Expected>
+static bool same_keys(const Range& range, const Expected& expected) {
+    auto it = range.begin();
+    for (const auto& key : expected) {
+        if (it == range.end() || !(*it == key)) return false;
+        ++it;
+    }
+    return it == range.end();
+}
+
+// Same, walking both backwards from end(), for bidirectional iterators.
+template <typename Range, typename Expected>
+static bool same_keys_backwards(const Range& range, const Expected& expected) {
+    auto it = range.end();
+    for (auto rit = expected.rbegin(); rit != expected.rend(); ++rit) {
+        if (it == range.begin()) return false;
+        --it;
+        if (!(*it == *rit)) return false;
+    }
+    return it == range.begin();
+}
+
+// The keys traverse() passes, in order.
+template <typename T, typename Tree>
+static std::vector<T> traversed(Tree& tree) {
+    std::vector<T> keys;
+    auto collect = [&keys](const auto& key) { keys.push_back(T(key)); };
+    tree.traverse(collect);
+    return keys;
+}
+
+// Position of it in range, so iterators of the tree and of the std:: container can be compared.
+template <typename Range, typename Iterator>
+static size_t index_of(const Range& range, Iterator it) {
+    return static_cast<size_t>(std::distance(range.begin(), decltype(range.begin())(it)));
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "btree_node.hpp"
+
+namespace btree {
+
+using std::size_t;
+
+// Fixed set of threads for fork/join loops. Every worker owns a deque of tasks: it takes its
+// newest task from the back and, once that runs dry, steals the oldest one from the front of
+// another deque, so idle threads pick up whatever the busy ones have not started yet. The thread
+// calling run() works through tasks as well until its own loop is done, which also makes a run()
+// from inside a task safe.
+class WorkStealingPool {
+    struct Loop {
+        void (*invoke_)(void*, size_t);
+        void* body_;
+        std::atomic<size_t> remaining_;
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+    };
+
+    struct Task {
+        Loop* loop_;
+        size_t index_;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Queue {
+        std::mutex mutex_;
+        std::deque<Task> tasks_;
+    };
+
+    struct Local {
+        const WorkStealingPool* pool_;
+        size_t queue_;
+    };
+
+    // One queue per worker and a last one shared by the threads outside the pool.
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> queued_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+
+public:
+    // threads counts the calling thread, so threads - 1 workers are started. 0 means one per
+    // hardware thread.
+    explicit WorkStealingPool(size_t threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < threads; ++i)
+            queues_.push_back(std::make_unique<Queue>());
+        workers_.reserve(threads - 1);
+        try {
+            for (size_t i = 0; i + 1 < threads; ++i)
+                workers_.emplace_back([this, i] { work(i); });
+        } catch (...) {
+            shutdown();
+            throw;
+        }
+    }
+
+    ~WorkStealingPool() { shutdown(); }
+
+    WorkStealingPool(const WorkStealingPool& other) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool& other) = delete;
+
+    // Threads taking part in a run(), the caller included.
+    size_t size() const noexcept { return queues_.size(); }
+
+    // Calls body(i) for every i in [0, count) across the pool and returns once all calls are
+    // done. The first exception a call throws is rethrown here, after the others have finished.
+    template <typename F>
+    void run(size_t count, F&& body) {
+        if (count == 0) return;
+        using Body = std::remove_reference_t<F>;
+
+        Loop loop;
+        loop.invoke_ = [](void* b, size_t i) { (*static_cast<Body*>(b))(i); };
+        loop.body_ = const_cast<void*>(static_cast<const void*>(std::addressof(body)));
+        loop.remaining_.store(count, std::memory_order_relaxed);
+
+        const size_t home = homeQueue();
+        size_t pushed = 0;
+        try {
+            push(loop, count, home, pushed);
+        } catch (...) {
+            // Tasks already queued point at loop, which lives on this stack.
+            queued_.fetch_sub(count - pushed, std::memory_order_acq_rel);
+            loop.remaining_.fetch_sub(count - pushed, std::memory_order_acq_rel);
+            join(loop, home);
+            throw;
+        }
+        join(loop, home);
+        if (loop.error_) std::rethrow_exception(loop.error_);
+    }
+
+private:
+    static Local& local() noexcept {
+        static thread_local Local current{nullptr, 0};
+        return current;
+    }
+
+    size_t homeQueue() const noexcept {
+        const Local& current = local();
+        return current.pool_ == this ? current.queue_ : queues_.size() - 1;
+    }
+
+    // A worker keeps its own tasks, so they stay hot in its cache unless someone steals them.
+    // Anyone else deals them out round robin, which starts every worker right away.
+    void push(Loop& loop, size_t count, size_t home, size_t& pushed) {
+        queued_.fetch_add(count, std::memory_order_acq_rel);
+        const bool worker = home + 1 < queues_.size();
+        const size_t spread = worker ? 1 : queues_.size();
+        for (size_t q = 0; q < spread; ++q) {
+            Queue& queue = *queues_[worker ? home : q];
+            std::lock_guard<std::mutex> lock(queue.mutex_);
+            for (size_t i = q; i < count; i += spread) {
+                queue.tasks_.push_back(Task{&loop, i});
+                ++pushed;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        wake_.notify_all();
+    }
+
+    // Runs queued tasks, of any loop, until every task of loop has finished.
+    void join(Loop& loop, size_t home) {
+        while (loop.remaining_.load(std::memory_order_acquire) != 0) {
+            Task task;
+            if (take(home, task))
+                execute(task);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    bool take(size_t home, Task& task) {
+        {
+            Queue& own = *queues_[home];
+            std::lock_guard<std::mutex> lock(own.mutex_);
+            if (!own.tasks_.empty()) {
+                task = own.tasks_.back();
+                own.tasks_.pop_back();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues_.size(); ++k) {
+            Queue& victim = *queues_[(home + k) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex_);
+            if (!victim.tasks_.empty()) {
+                task = victim.tasks_.front();
+                victim.tasks_.pop_front();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_)
+            worker.join();
+    }
+
+    static void execute(const Task& task) {
+        Loop& loop = *task.loop_;
+        try {
+            loop.invoke_(loop.body_, task.index_);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(loop.error_mutex_);
+            if (!loop.error_) loop.error_ = std::current_exception();
+        }
+        // The caller may return as soon as this drops to zero, so loop is not touched afterwards.
+        loop.remaining_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void work(size_t self) {
+        local() = Local{this, self};
+        for (;;) {
+            Task task;
+            if (take(self, task)) {
+                execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] { return stop_ || queued_.load(std::memory_order_acquire) != 0; });
+            if (stop_ && queued_.load(std::memory_order_acquire) == 0) return;
+        }
+    }
+};
+
+}  // namespace btree